@@ -0,0 +1,90 @@
+#!/bin/sh
+# Builds the CPU-only executable for linux, which supports batch rendering (--batch) and distributed rendering (--worker, --coordinator)
+# The D3D12 renderer is replaced by renderer_headless.cpp, there is no window and no interactive mode
+set -e
+
+CONFIG=${1:-release}
+OUT_DIR="bin/linux/$CONFIG"
+
+if [ "$CONFIG" = "debug" ]; then
+	FLAGS="-O0 -g -D_DEBUG"
+else
+	FLAGS="-O2 -DNDEBUG"
+fi
+
+CXX=${CXX:-g++}
+CC=${CC:-gcc}
+# The third party headers are system includes, so that their warnings do not show up in every source that includes them
+INCLUDES="-I source -isystem extern -isystem extern/d3d12_agility/include"
+WARNINGS="-Wall -Wextra"
+
+SOURCES="
+	source/core/application.cpp
+	source/core/scene.cpp
+	source/core/allocators/linear_alloc.cpp
+	source/core/assets/asset_loader.cpp
+	source/core/assets/image_writer.cpp
+	source/core/camera/camera.cpp
+	source/core/camera/camera_controller.cpp
+	source/core/distributed/distributed.cpp
+	source/core/fileio/fileio.cpp
+	source/core/math/math.cpp
+	source/core/memory/memory_arena.cpp
+	source/core/string/string.cpp
+	source/platform/command_line.cpp
+	source/platform/linux/entrypoint.cpp
+	source/platform/linux/input.cpp
+	source/platform/linux/net_linux.cpp
+	source/platform/linux/platform.cpp
+	source/platform/linux/thread_linux.cpp
+	source/platform/linux/virtual_memory.cpp
+	source/renderer/renderer_headless.cpp
+	source/renderer/bvh/bvh_builder.cpp
+	source/renderer/bvh/tlas_builder.cpp
+	source/renderer/cpu/cpu_accelstruct.cpp
+	source/renderer/cpu/cpu_denoiser.cpp
+	source/renderer/cpu/cpu_path_guiding.cpp
+	source/renderer/cpu/cpu_pathtracer.cpp
+	source/renderer/cpu/cpu_render_pass.cpp
+	source/renderer/cpu/cpu_sampler.cpp
+	source/renderer/cpu/cpu_scan.cpp
+	source/renderer/cpu/cpu_texture.cpp
+	source/renderer/cpu/cpu_texture_cache.cpp
+	source/renderer/cpu/cpu_tile_scheduler.cpp
+	source/renderer/light/env_builder.cpp
+	source/renderer/light/light_builder.cpp
+"
+
+# GCC reports false positives for the bounds checked array lookups of imgui
+EXTERN_SOURCES="
+	extern/imgui/imgui.cpp
+	extern/imgui/imgui_draw.cpp
+	extern/imgui/imgui_tables.cpp
+	extern/imgui/imgui_widgets.cpp
+"
+
+mkdir -p "$OUT_DIR/obj"
+
+OBJECTS=""
+PIDS=""
+for SRC in $SOURCES $EXTERN_SOURCES; do
+	OBJ="$OUT_DIR/obj/$(echo "$SRC" | tr '/' '_').o"
+	SRC_WARNINGS="$WARNINGS"
+	case "$SRC" in extern/*) SRC_WARNINGS="$WARNINGS -Wno-array-bounds" ;; esac
+	$CXX -std=c++20 $FLAGS $SRC_WARNINGS $INCLUDES -c "$SRC" -o "$OBJ" &
+	PIDS="$PIDS $!"
+	OBJECTS="$OBJECTS $OBJ"
+done
+
+OBJ="$OUT_DIR/obj/extern_ufbx_ufbx.c.o"
+$CC $FLAGS $WARNINGS -c extern/ufbx/ufbx.c -o "$OBJ" &
+PIDS="$PIDS $!"
+OBJECTS="$OBJECTS $OBJ"
+
+# Every object is compiled in parallel, the build stops if any of them failed
+for PID in $PIDS; do
+	wait "$PID"
+done
+
+$CXX $OBJECTS -o "$OUT_DIR/WavefrontPathtracing" -lpthread -lm
+echo "Built $OUT_DIR/WavefrontPathtracing"
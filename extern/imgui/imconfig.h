@@ -13,7 +13,7 @@
 //-----------------------------------------------------------------------------
 
 #pragma once
-#include "Core/Assertion.h"
+#include "core/assertion.h"
 
 //---- Define assertion handler. Defaults to calling assert().
 // If your macro uses multiple statements, make sure is enclosed in a 'do { .. } while (0)' block so it can be used as a single statement.
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Starts a coordinator and a number of workers on this machine, to test distributed rendering without a second machine
+# Usage: ./run_distributed_local.sh <worker count> <output path> [arguments passed to every process, e.g. --scene, --width, --height, --spp, --job-spp]
+# Build with build_linux.sh first, the log of every process is written next to the output as <output>.coordinator.log and <output>.worker<i>.log
+set -e
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 <worker count> <output path> [render arguments]"
+	exit 1
+fi
+
+WORKER_COUNT=$1
+OUTPUT_PATH=$(realpath "$2")
+shift 2
+
+REPO_DIR=$(cd "$(dirname "$0")" && pwd)
+EXE=${EXE:-"$REPO_DIR/bin/linux/release/WavefrontPathtracing"}
+PORT=${PORT:-27015}
+
+cd "$REPO_DIR"
+"$EXE" --coordinator "$PORT" --workers "$WORKER_COUNT" --output "$OUTPUT_PATH" "$@" > "$OUTPUT_PATH.coordinator.log" 2>&1 &
+COORDINATOR_PID=$!
+
+# Give the coordinator some time to start listening before the workers try to connect
+sleep 1
+
+WORKER_PIDS=""
+i=0
+while [ $i -lt "$WORKER_COUNT" ]; do
+	"$EXE" --worker "127.0.0.1:$PORT" "$@" > "$OUTPUT_PATH.worker$i.log" 2>&1 &
+	WORKER_PIDS="$WORKER_PIDS $!"
+	i=$((i + 1))
+done
+
+RESULT=0
+wait "$COORDINATOR_PID" || RESULT=$?
+for PID in $WORKER_PIDS; do
+	wait "$PID" || true
+done
+
+if [ $RESULT -ne 0 ]; then
+	echo "Coordinator failed, see $OUTPUT_PATH.coordinator.log"
+	exit $RESULT
+fi
+
+echo "Wrote $OUTPUT_PATH"
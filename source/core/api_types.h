@@ -39,7 +39,12 @@ struct cond_var_t
 	void* ptr;
 };
 
-struct timer_t
+struct timer_ticks_t
 {
 	int64_t val;
 };
+
+struct socket_t
+{
+	uint64_t handle;
+};
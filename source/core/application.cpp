@@ -3,6 +3,8 @@
 #include "core/logger.h"
 #include "core/scene.h"
 #include "core/input.h"
+#include "core/assets/image_writer.h"
+#include "core/distributed/distributed.h"
 
 #include "platform/platform.h"
 #include "renderer/renderer.h"
@@ -21,6 +23,19 @@ namespace application
 		scene_t* active_scene;
 		double delta_time;
 		bool running = false;
+
+		bool batch;
+		char batch_output_path[COMMAND_LINE_MAX_PATH];
+		uint32_t batch_sample_count;
+		float batch_time_budget;
+
+		// The coordinator only merges the results of the workers, so it has no window, renderer, or scene
+		bool coordinator;
+		distributed::coordinator_params_t coordinator_params;
+		char coordinator_bind_address[COMMAND_LINE_MAX_PATH];
+		bool worker;
+		char worker_host[COMMAND_LINE_MAX_PATH];
+		uint16_t worker_port;
 	} static *inst;
 
 	static void handle_events()
@@ -74,13 +89,132 @@ namespace application
 		renderer::end_frame();
 	}
 
+	// Renders the scene without updating the camera or the UI until the sample count or time budget is reached, then writes the result to disk
+	static void run_batch()
+	{
+		LOG_INFO("Application", "Batch rendering %u samples to %s", inst->batch_sample_count, inst->batch_output_path);
+
+		timer_ticks_t time_begin = platform::get_ticks();
+		double elapsed_seconds = 0.0;
+		renderer::cpu_accumulation_t accumulation = {};
+
+		while (!s_should_close)
+		{
+			s_should_close = !platform::window_poll_events();
+
+			renderer::begin_frame();
+			scene::render(*inst->active_scene);
+			renderer::end_frame();
+
+			// The accumulation waits for the CPU pass that was just started, which keeps the batch from running ahead of the path tracer
+			accumulation = renderer::get_cpu_accumulation();
+			elapsed_seconds = platform::get_elapsed_seconds(time_begin, platform::get_ticks());
+
+			if (accumulation.sample_count >= inst->batch_sample_count ||
+				(inst->batch_time_budget > 0.0f && elapsed_seconds >= inst->batch_time_budget))
+				break;
+		}
+
+		double rays_per_second = elapsed_seconds > 0.0 ? (double)accumulation.ray_count / elapsed_seconds : 0.0;
+		LOG_INFO("Application", "Batch render finished: %u samples, %ux%u, %.3f s, %.2f Mrays/s",
+			accumulation.sample_count, accumulation.width, accumulation.height, elapsed_seconds, rays_per_second / 1000000.0);
+
+		ARENA_SCRATCH_SCOPE()
+		{
+			if (!image_writer::write_image(arena_scratch, inst->batch_output_path, accumulation.width, accumulation.height, accumulation.pixels))
+				LOG_ERR("Application", "Failed to write batch render output to %s", inst->batch_output_path);
+		}
+
+		s_should_close = true;
+	}
+
+	// Renders the jobs the coordinator hands out one by one until it has no jobs left, every job restarts the accumulation at the sample offset of the job
+	static void run_worker()
+	{
+		int32_t width = 0, height = 0;
+		platform::window_get_client_area(width, height);
+
+		distributed::worker_t worker = {};
+		if (!distributed::worker_connect(inst->worker_host, inst->worker_port, width, height, worker))
+		{
+			s_should_close = true;
+			return;
+		}
+
+		distributed::job_t job = {};
+		while (!s_should_close && distributed::worker_receive_job(worker, job))
+		{
+			LOG_INFO("Application", "Rendering job %u, samples %u to %u", job.job_idx, job.sample_offset, job.sample_offset + job.sample_count);
+
+			renderer::reset_cpu_accumulation(job.sample_offset);
+			renderer::cpu_accumulation_t accumulation = {};
+
+			while (!s_should_close)
+			{
+				s_should_close = !platform::window_poll_events();
+
+				renderer::begin_frame();
+				scene::render(*inst->active_scene);
+				renderer::end_frame();
+
+				accumulation = renderer::get_cpu_accumulation();
+				if (accumulation.sample_count >= job.sample_count)
+					break;
+			}
+
+			// A job that got interrupted is not sent back, the coordinator hands it to another worker once the connection closes
+			if (s_should_close || !distributed::worker_send_result(worker, job, accumulation.pixels, accumulation.pixel_variance))
+				break;
+		}
+
+		distributed::worker_disconnect(worker);
+		s_should_close = true;
+	}
+
+	static void run_coordinator()
+	{
+		distributed::run_coordinator(inst->arena, inst->coordinator_params);
+		s_should_close = true;
+	}
+
 	void init(memory_arena_t& arena, const command_line_args_t& cmd_args)
 	{
 		LOG_INFO("Application", "Init");
 
-		platform::window_create(cmd_args.window_width, cmd_args.window_height);
 		inst = ARENA_ALLOC_STRUCT_ZERO(arena, instance_t);
 		inst->arena = arena;
+		inst->arena.name = "Application";
+
+		if (cmd_args.coordinator)
+		{
+			inst->coordinator = true;
+			memcpy(inst->batch_output_path, cmd_args.batch_output_path, sizeof(inst->batch_output_path));
+			memcpy(inst->coordinator_bind_address, cmd_args.coordinator_bind_address, sizeof(inst->coordinator_bind_address));
+			inst->coordinator_params.bind_address = inst->coordinator_bind_address;
+			inst->coordinator_params.port = cmd_args.coordinator_port;
+			inst->coordinator_params.worker_count = cmd_args.coordinator_worker_count;
+			inst->coordinator_params.accept_timeout = cmd_args.coordinator_accept_timeout;
+			inst->coordinator_params.width = cmd_args.window_width;
+			inst->coordinator_params.height = cmd_args.window_height;
+			inst->coordinator_params.sample_count = cmd_args.batch_sample_count;
+			inst->coordinator_params.job_sample_count = cmd_args.coordinator_job_sample_count;
+			inst->coordinator_params.output_path = inst->batch_output_path;
+
+			inst->running = true;
+			return;
+		}
+
+		inst->worker = cmd_args.worker;
+		memcpy(inst->worker_host, cmd_args.worker_host, sizeof(inst->worker_host));
+		inst->worker_port = cmd_args.worker_port;
+
+		bool headless = cmd_args.batch || cmd_args.worker;
+		platform::window_create(cmd_args.window_width, cmd_args.window_height, !headless);
+
+		inst->batch = cmd_args.batch;
+		memcpy(inst->batch_output_path, cmd_args.batch_output_path, sizeof(inst->batch_output_path));
+		inst->batch_sample_count = MAX(cmd_args.batch_sample_count, 1u);
+		inst->batch_time_budget = cmd_args.batch_time_budget;
 
 		int32_t client_width = 0, client_height = 0;
 		platform::window_get_client_area(client_width, client_height);
@@ -92,10 +226,19 @@ namespace application
 		renderer_init.render_height = client_height;
 		renderer_init.backbuffer_count = 2u;
 		renderer_init.vsync = false;
+		renderer_init.batch = headless;
+		// Denoised results can not be merged by the coordinator, since the denoiser does not preserve the mean of the samples
+		renderer_init.denoise = cmd_args.batch_denoise && !cmd_args.worker;
 		renderer::init(renderer_init);
 
 		inst->active_scene = ARENA_ALLOC_STRUCT_ZERO(inst->arena, scene_t);
-		scene::create(*inst->active_scene);
+		inst->active_scene->arena.name = "Scene";
+		scene::create(*inst->active_scene, cmd_args.scene_path, cmd_args.hdr_env_path);
+
+		if (cmd_args.camera_override)
+		{
+			camera::create(inst->active_scene->camera, cmd_args.camera_pos, cmd_args.camera_target, cmd_args.camera_vfov_deg);
+		}
 
 		inst->running = true;
 	}
@@ -104,6 +247,12 @@ namespace application
 	{
 		LOG_INFO("Application", "Exit");
 
+		if (inst->coordinator)
+		{
+			ARENA_RELEASE(inst->arena);
+			return;
+		}
+
 		renderer::exit();
 		scene::destroy(*inst->active_scene);
 		inst->active_scene = nullptr;
@@ -113,8 +262,26 @@ namespace application
 
 	void run()
 	{
-		timer_t time_curr = platform::get_ticks();
-		timer_t time_prev = platform::get_ticks();
+		if (inst->coordinator)
+		{
+			run_coordinator();
+			return;
+		}
+
+		if (inst->worker)
+		{
+			run_worker();
+			return;
+		}
+
+		if (inst->batch)
+		{
+			run_batch();
+			return;
+		}
+
+		timer_ticks_t time_curr = platform::get_ticks();
+		timer_ticks_t time_prev = platform::get_ticks();
 
 		while (inst->running && !s_should_close)
 		{
@@ -3,10 +3,45 @@
 
 struct memory_arena_t;
 
+inline constexpr uint32_t COMMAND_LINE_MAX_PATH = 260;
+
 struct command_line_args_t
 {
 	int32_t window_width = 0;
 	int32_t window_height = 0;
+
+	// Optional, replace the scene and HDR environment selected at compile time
+	char scene_path[COMMAND_LINE_MAX_PATH] = {};
+	char hdr_env_path[COMMAND_LINE_MAX_PATH] = {};
+
+	// Batch mode renders the scene headless with the CPU path tracer until the sample count or the time budget is reached,
+	// then writes the result to the output path and closes the application
+	bool batch = false;
+	char batch_output_path[COMMAND_LINE_MAX_PATH] = {};
+	uint32_t batch_sample_count = 0;
+	// In seconds, zero means no time budget
+	float batch_time_budget = 0.0f;
+	bool batch_denoise = false;
+
+	// Distributed batch rendering, see core/distributed/distributed.h
+	// The coordinator does not open a window or render, it merges the results of the workers and writes them to the batch output path
+	bool coordinator = false;
+	uint16_t coordinator_port = 0;
+	// Numeric IPv4 address of the interface to listen on, empty listens on every interface
+	char coordinator_bind_address[COMMAND_LINE_MAX_PATH] = {};
+	uint32_t coordinator_worker_count = 0;
+	// In seconds, zero waits for every worker forever
+	float coordinator_accept_timeout = 0.0f;
+	uint32_t coordinator_job_sample_count = 0;
+	// Workers render in batch mode, the samples they render are picked by the coordinator
+	bool worker = false;
+	char worker_host[COMMAND_LINE_MAX_PATH] = {};
+	uint16_t worker_port = 0;
+
+	bool camera_override = false;
+	glm::vec3 camera_pos = glm::vec3(0.0f);
+	glm::vec3 camera_target = glm::vec3(0.0f);
+	float camera_vfov_deg = 0.0f;
 };
 
 namespace application
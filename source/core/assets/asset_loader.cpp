@@ -9,6 +9,7 @@
 
 #include "renderer/renderer.h"
 #include "renderer/shaders/shared.hlsl.h"
+#include "renderer/light/env_builder.h"
 
 namespace asset_loader
 {
@@ -63,7 +64,6 @@ namespace asset_loader
 			return TEXTURE_FILE_TYPE_UNKNOWN;
 		}
 
-		const char* extension = extension_delim + 1;
 		if (strcmp(extension_delim, ".png") == 0)
 		{
 			return TEXTURE_FILE_TYPE_PNG;
@@ -94,7 +94,7 @@ namespace asset_loader
 		bool loaded;
 	};
 
-	static texture_asset_t load_texture_png_jpg(memory_arena_t& arena, memory_arena_t& arena_scratch, const char* filepath, bool srgb)
+	static texture_asset_t load_texture_png_jpg(memory_arena_t& arena, [[maybe_unused]] memory_arena_t& arena_scratch, const char* filepath, bool srgb)
 	{
 		texture_asset_t ret = {};
 		ret.render_texture_handle.handle = INVALID_HANDLE;
@@ -135,7 +135,7 @@ namespace asset_loader
 		return ret;
 	}
 
-	static texture_asset_t load_texture_hdr(memory_arena_t& arena, memory_arena_t& arena_scratch, const char* filepath, bool srgb)
+	static texture_asset_t load_texture_hdr(memory_arena_t& arena, memory_arena_t& arena_scratch, const char* filepath, [[maybe_unused]] bool srgb)
 	{
 		texture_asset_t ret = {};
 		ret.render_texture_handle.handle = INVALID_HANDLE;
@@ -160,6 +160,21 @@ namespace asset_loader
 			LOG_ERR("Assets", "Failed to load image: %s", filepath);
 			return ret;
 		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Build the importance sampling distribution, HDR textures are used as equirectangular environment maps
+		env_distribution_t env_distribution = {};
+		{
+			env_builder_t::build_args_t env_build_args = {};
+			env_build_args.pixels = (const glm::vec4*)loaded_image.data_ptr;
+			env_build_args.width = loaded_image.width;
+			env_build_args.height = loaded_image.height;
+
+			env_builder_t env_builder = {};
+			env_builder.build(arena_scratch, env_build_args);
+			uint64_t env_distribution_byte_size = 0;
+			env_builder.extract(arena_scratch, env_distribution, env_distribution_byte_size);
+		}
 		
 		{
 			renderer::render_texture_params_t rtexture_params = {};
@@ -168,6 +183,7 @@ namespace asset_loader
 			rtexture_params.bits_per_pixel = loaded_image.bits_per_pixel;
 			rtexture_params.format = loaded_image.format;
 			rtexture_params.ptr_data = loaded_image.data_ptr;
+			rtexture_params.env_alias_table = env_distribution.entries;
 			rtexture_params.debug_name = ARENA_CHAR_TO_WIDE(arena, filepath);
 
 			ret.render_texture_handle = renderer::create_render_texture(rtexture_params);
@@ -295,7 +311,7 @@ namespace asset_loader
 		return *load_texture(arena, fbx_texture.filename.data, srgb);
 	}
 	
-	static glm::mat4 gltf_node_get_transform(const cgltf_node& node)
+	[[maybe_unused]] static glm::mat4 gltf_node_get_transform(const cgltf_node& node)
 	{
 		glm::mat4 transform = glm::identity<glm::mat4>();
 
@@ -351,7 +367,6 @@ namespace asset_loader
 			return SCENE_MESH_FILE_TYPE_UNKNOWN;
 		}
 
-		const char* extension = extension_delim + 1;
 		if (strcmp(extension_delim, ".gltf") == 0)
 		{
 			return SCENE_MESH_FILE_TYPE_GLTF;
@@ -524,6 +539,7 @@ namespace asset_loader
 						case cgltf_attribute_type_normal:	attr_indices[1] = attr_idx; break;
 						case cgltf_attribute_type_tangent:	attr_indices[2] = attr_idx; break;
 						case cgltf_attribute_type_texcoord: attr_indices[3] = attr_idx; break;
+						default: break;
 						}
 					}
 
@@ -562,7 +578,6 @@ namespace asset_loader
 		// -------------------------------------------------------------------------------------------------------------
 		// Parse nodes and node hierarchy
 		{
-			uint32_t root_node_count = 0;
 			uint32_t node_count = 0;
 
 			for (uint32_t node_idx = 0; node_idx < loaded_gltf->nodes_count; ++node_idx)
@@ -0,0 +1,354 @@
+#include "image_writer.h"
+#include "core/logger.h"
+#include "core/assertion.h"
+#include "core/fileio/fileio.h"
+#include "core/memory/memory_arena.h"
+
+#include <cctype>
+
+namespace image_writer
+{
+
+	// Sequential writer into a byte buffer that is large enough for the whole file
+	struct byte_writer_t
+	{
+		uint8_t* data;
+		uint64_t capacity;
+		uint64_t at;
+	};
+
+	static byte_writer_t make_byte_writer(memory_arena_t& arena, uint64_t capacity)
+	{
+		byte_writer_t writer = {};
+		writer.data = (uint8_t*)ARENA_ALLOC(arena, capacity, 16);
+		writer.capacity = capacity;
+
+		return writer;
+	}
+
+	static void write_bytes(byte_writer_t& writer, const void* bytes, uint64_t count)
+	{
+		ASSERT(writer.at + count <= writer.capacity);
+		memcpy(writer.data + writer.at, bytes, count);
+		writer.at += count;
+	}
+
+	static void write_u8(byte_writer_t& writer, uint8_t value)
+	{
+		write_bytes(writer, &value, 1);
+	}
+
+	static void write_u32_be(byte_writer_t& writer, uint32_t value)
+	{
+		uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+		write_bytes(writer, bytes, 4);
+	}
+
+	// OpenEXR is little endian, same as all platforms we run on
+	template<typename T>
+	static void write_le(byte_writer_t& writer, T value)
+	{
+		write_bytes(writer, &value, sizeof(T));
+	}
+
+	static void write_str(byte_writer_t& writer, const char* str, bool null_terminate)
+	{
+		write_bytes(writer, str, strlen(str) + (null_terminate ? 1 : 0));
+	}
+
+	static bool write_to_file(const char* filepath, const byte_writer_t& writer)
+	{
+		if (!fileio::write_file(filepath, writer.data, writer.at))
+		{
+			LOG_ERR("Image Writer", "Failed to write image: %s", filepath);
+			return false;
+		}
+
+		return true;
+	}
+
+	static uint32_t crc32(const uint8_t* data, uint64_t count, uint32_t crc = 0)
+	{
+		crc = ~crc;
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			crc ^= data[i];
+			for (uint32_t bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+			}
+		}
+
+		return ~crc;
+	}
+
+	static void write_png_chunk(byte_writer_t& writer, const char* type, const uint8_t* chunk_data, uint32_t chunk_size)
+	{
+		write_u32_be(writer, chunk_size);
+		uint64_t crc_begin = writer.at;
+		write_bytes(writer, type, 4);
+		write_bytes(writer, chunk_data, chunk_size);
+		write_u32_be(writer, crc32(writer.data + crc_begin, 4 + (uint64_t)chunk_size));
+	}
+
+	static float linear_to_srgb(float value)
+	{
+		value = glm::clamp(value, 0.0f, 1.0f);
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * glm::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	bool write_png(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels)
+	{
+		// Every row starts with its filter type, no filtering is done
+		uint64_t row_size = 1 + 3 * (uint64_t)width;
+		uint64_t raw_size = row_size * height;
+		uint8_t* raw = (uint8_t*)ARENA_ALLOC(arena, raw_size, 16);
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			uint8_t* row = raw + y * row_size;
+			row[0] = 0;
+
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				// Same tone mapping as the post-process
+				glm::vec3 color = glm::max(glm::vec3(pixels[y * width + x]), glm::vec3(0.0f));
+				color = color / (1.0f + color);
+
+				for (uint32_t c = 0; c < 3; ++c)
+				{
+					row[1 + x * 3 + c] = (uint8_t)(linear_to_srgb(color[c]) * 255.0f + 0.5f);
+				}
+			}
+		}
+
+		// Zlib stream made out of uncompressed deflate blocks, which keeps the writer small, the file size does not matter for our use cases
+		const uint32_t max_block_size = 65535;
+		uint64_t block_count = MAX((raw_size + max_block_size - 1) / max_block_size, 1ull);
+		uint64_t zlib_size = 2 + block_count * 5 + raw_size + 4;
+		byte_writer_t zlib = make_byte_writer(arena, zlib_size);
+
+		write_u8(zlib, 0x78);
+		write_u8(zlib, 0x01);
+
+		uint32_t adler_a = 1, adler_b = 0;
+		for (uint64_t offset = 0; offset < raw_size || offset == 0; offset += max_block_size)
+		{
+			uint16_t block_size = (uint16_t)MIN(raw_size - offset, (uint64_t)max_block_size);
+			bool last_block = offset + block_size >= raw_size;
+
+			write_u8(zlib, last_block ? 1 : 0);
+			write_le<uint16_t>(zlib, block_size);
+			write_le<uint16_t>(zlib, (uint16_t)~block_size);
+			write_bytes(zlib, raw + offset, block_size);
+
+			for (uint32_t i = 0; i < block_size; ++i)
+			{
+				adler_a = (adler_a + raw[offset + i]) % 65521;
+				adler_b = (adler_b + adler_a) % 65521;
+			}
+
+			if (last_block)
+				break;
+		}
+		write_u32_be(zlib, (adler_b << 16) | adler_a);
+
+		uint8_t header[13] = {};
+		header[0] = (uint8_t)(width >> 24); header[1] = (uint8_t)(width >> 16); header[2] = (uint8_t)(width >> 8); header[3] = (uint8_t)width;
+		header[4] = (uint8_t)(height >> 24); header[5] = (uint8_t)(height >> 16); header[6] = (uint8_t)(height >> 8); header[7] = (uint8_t)height;
+		// 8 bits per channel, RGB, deflate, adaptive filtering, no interlacing
+		header[8] = 8; header[9] = 2; header[10] = 0; header[11] = 0; header[12] = 0;
+
+		const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		byte_writer_t png = make_byte_writer(arena, sizeof(signature) + 3 * 12 + sizeof(header) + zlib.at);
+		write_bytes(png, signature, sizeof(signature));
+		write_png_chunk(png, "IHDR", header, sizeof(header));
+		write_png_chunk(png, "IDAT", zlib.data, (uint32_t)zlib.at);
+		write_png_chunk(png, "IEND", nullptr, 0);
+
+		return write_to_file(filepath, png);
+	}
+
+	bool write_hdr(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels)
+	{
+		char resolution[64];
+		snprintf(resolution, sizeof(resolution), "-Y %u +X %u\n", height, width);
+
+		// Worst case for the run length encoded scanlines is one count byte for every 128 literal bytes, plus the scanline header
+		uint64_t scanline_size = 4 + 4 * ((uint64_t)width + (width + 127) / 128);
+		byte_writer_t hdr = make_byte_writer(arena, 256 + (uint64_t)height * scanline_size);
+		write_str(hdr, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n", false);
+		write_str(hdr, resolution, false);
+
+		uint8_t* rgbe = (uint8_t*)ARENA_ALLOC(arena, 4 * (uint64_t)width, 16);
+		// Run length encoded scanlines only exist for these widths, everything else is written as flat RGBE pixels
+		bool rle = width >= 8 && width < 32768;
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				glm::vec3 color = glm::max(glm::vec3(pixels[y * width + x]), glm::vec3(0.0f));
+				float max_component = glm::max(color.r, glm::max(color.g, color.b));
+
+				uint8_t* texel = &rgbe[x * 4];
+				if (max_component < 1e-32f)
+				{
+					texel[0] = texel[1] = texel[2] = texel[3] = 0;
+				}
+				else
+				{
+					int32_t exponent;
+					float scale = frexpf(max_component, &exponent) * 256.0f / max_component;
+					texel[0] = (uint8_t)(color.r * scale);
+					texel[1] = (uint8_t)(color.g * scale);
+					texel[2] = (uint8_t)(color.b * scale);
+					texel[3] = (uint8_t)(exponent + 128);
+				}
+			}
+
+			if (!rle)
+			{
+				write_bytes(hdr, rgbe, 4 * (uint64_t)width);
+				continue;
+			}
+
+			// Every channel is written separately as literal runs, a flat scanline could accidentally start with the run length encoding marker
+			write_u8(hdr, 2);
+			write_u8(hdr, 2);
+			write_u8(hdr, (uint8_t)(width >> 8));
+			write_u8(hdr, (uint8_t)width);
+
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				for (uint32_t x = 0; x < width; x += 128)
+				{
+					uint32_t run = MIN(width - x, 128u);
+					write_u8(hdr, (uint8_t)run);
+
+					for (uint32_t i = 0; i < run; ++i)
+					{
+						write_u8(hdr, rgbe[(x + i) * 4 + c]);
+					}
+				}
+			}
+		}
+
+		return write_to_file(filepath, hdr);
+	}
+
+	static void write_exr_attribute_header(byte_writer_t& writer, const char* name, const char* type, uint32_t size)
+	{
+		write_str(writer, name, true);
+		write_str(writer, type, true);
+		write_le<uint32_t>(writer, size);
+	}
+
+	static void write_exr_box2i(byte_writer_t& writer, const char* name, uint32_t width, uint32_t height)
+	{
+		write_exr_attribute_header(writer, name, "box2i", 16);
+		write_le<int32_t>(writer, 0);
+		write_le<int32_t>(writer, 0);
+		write_le<int32_t>(writer, (int32_t)width - 1);
+		write_le<int32_t>(writer, (int32_t)height - 1);
+	}
+
+	bool write_exr(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels)
+	{
+		// Channels need to be sorted by name, every scanline stores all values of one channel before the next channel
+		const char* channel_names[3] = { "B", "G", "R" };
+		const uint32_t channel_indices[3] = { 2, 1, 0 };
+
+		uint32_t scanline_data_size = 3 * sizeof(float) * width;
+		uint64_t header_size = 512;
+		uint64_t offset_table_size = sizeof(uint64_t) * (uint64_t)height;
+		byte_writer_t exr = make_byte_writer(arena, header_size + offset_table_size + (uint64_t)height * (8 + scanline_data_size));
+
+		// Magic number and version 2, single part scanline image
+		write_le<uint32_t>(exr, 20000630);
+		write_le<uint32_t>(exr, 2);
+
+		// Every channel is a null terminated name, pixel type (2 = float), linear flag, three reserved bytes and the x and y sampling
+		write_exr_attribute_header(exr, "channels", "chlist", 3 * (2 + 16) + 1);
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			write_str(exr, channel_names[c], true);
+			write_le<int32_t>(exr, 2);
+			write_le<uint32_t>(exr, 0);
+			write_le<int32_t>(exr, 1);
+			write_le<int32_t>(exr, 1);
+		}
+		write_u8(exr, 0);
+
+		write_exr_attribute_header(exr, "compression", "compression", 1);
+		write_u8(exr, 0);
+		write_exr_box2i(exr, "dataWindow", width, height);
+		write_exr_box2i(exr, "displayWindow", width, height);
+		write_exr_attribute_header(exr, "lineOrder", "lineOrder", 1);
+		write_u8(exr, 0);
+		write_exr_attribute_header(exr, "pixelAspectRatio", "float", 4);
+		write_le<float>(exr, 1.0f);
+		write_exr_attribute_header(exr, "screenWindowCenter", "v2f", 8);
+		write_le<float>(exr, 0.0f);
+		write_le<float>(exr, 0.0f);
+		write_exr_attribute_header(exr, "screenWindowWidth", "float", 4);
+		write_le<float>(exr, 1.0f);
+		write_u8(exr, 0);
+
+		// Uncompressed files store one scanline per block, the offset table points to the start of every block
+		uint64_t first_block_offset = exr.at + offset_table_size;
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			write_le<uint64_t>(exr, first_block_offset + (uint64_t)y * (8 + scanline_data_size));
+		}
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			write_le<int32_t>(exr, (int32_t)y);
+			write_le<uint32_t>(exr, scanline_data_size);
+
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				for (uint32_t x = 0; x < width; ++x)
+				{
+					write_le<float>(exr, pixels[y * width + x][channel_indices[c]]);
+				}
+			}
+		}
+
+		return write_to_file(filepath, exr);
+	}
+
+	static bool has_extension(const char* filepath, const char* extension)
+	{
+		size_t path_length = strlen(filepath);
+		size_t extension_length = strlen(extension);
+
+		if (path_length < extension_length)
+			return false;
+
+		// Case-insensitive, _stricmp and strcasecmp are the same thing under a different name on windows and linux
+		const char* path_extension = filepath + path_length - extension_length;
+		for (size_t i = 0; i < extension_length; ++i)
+		{
+			if (tolower((unsigned char)path_extension[i]) != tolower((unsigned char)extension[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool write_image(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels)
+	{
+		if (has_extension(filepath, ".png"))
+			return write_png(arena, filepath, width, height, pixels);
+		if (has_extension(filepath, ".hdr"))
+			return write_hdr(arena, filepath, width, height, pixels);
+		if (has_extension(filepath, ".exr"))
+			return write_exr(arena, filepath, width, height, pixels);
+
+		LOG_ERR("Image Writer", "Unsupported image file extension: %s", filepath);
+		return false;
+	}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "core/common.h"
+
+struct memory_arena_t;
+
+namespace image_writer
+{
+
+	// All writers take linear HDR RGB pixels row by row starting at the top row, the alpha channel is ignored
+	// The encoded file is built in the arena before it gets written, so a scratch arena scope around the call is enough
+	// The PNG gets tone mapped and converted to sRGB the same way as the post-process does, the HDR and EXR keep the linear radiance as is
+	bool write_png(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels);
+	// Radiance RGBE
+	bool write_hdr(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels);
+	// Uncompressed scanline OpenEXR with 32-bit float channels
+	bool write_exr(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels);
+
+	// Picks the writer based on the file extension (.png, .hdr or .exr), returns false for unknown extensions
+	bool write_image(memory_arena_t& arena, const char* filepath, uint32_t width, uint32_t height, const glm::vec4* pixels);
+
+}
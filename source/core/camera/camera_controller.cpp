@@ -26,7 +26,7 @@ namespace camera_controller
 		{
 			// Mouse wheel to increase/decrease camera move speed
 			float scroll_y = input::get_mouse_scroll_rely();
-			controller.move_speed += 0.01f * scroll_y * std::max(std::sqrtf(controller.move_speed), 0.005f);
+			controller.move_speed += 0.01f * scroll_y * std::max(std::sqrt(controller.move_speed), 0.005f);
 			controller.move_speed = std::max(controller.move_speed, 0.0f);
 
 			// Rotation
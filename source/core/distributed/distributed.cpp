@@ -0,0 +1,574 @@
+#include "distributed.h"
+#include "core/net.h"
+#include "core/thread.h"
+#include "core/logger.h"
+#include "core/assets/image_writer.h"
+#include "core/memory/memory_arena.h"
+
+#include "platform/platform.h"
+
+namespace distributed
+{
+
+	// Every message starts with a header, followed by payload_size bytes of the payload of its type
+	// The coordinator and workers can run on different machines, so every field is serialized one by one in little-endian,
+	// the structs below are only the in-memory representation and their layout never goes over the wire
+	inline constexpr uint32_t MESSAGE_MAGIC = 0x44545057; // "WPTD"
+	// Needs to be bumped whenever the wire format of any message changes
+	inline constexpr uint32_t PROTOCOL_VERSION = 2;
+	inline constexpr uint32_t JOB_INVALID = 0xFFFFFFFF;
+	// Results are packed and sent in batches of this many pixels, so that the worker does not need a copy of the entire image
+	inline constexpr uint32_t RESULT_BATCH_PIXEL_COUNT = 4096;
+	// How long the coordinator waits for a connection at a time, before it checks the accept timeout and whether the connected workers finished every job
+	inline constexpr uint32_t ACCEPT_POLL_INTERVAL_MS = 100;
+
+	enum MESSAGE_TYPE : uint32_t
+	{
+		// Worker to coordinator and back, hello_payload_t, the coordinator answers with its own so that both sides can check the other
+		MESSAGE_TYPE_HELLO,
+		// Coordinator to worker, job_t
+		MESSAGE_TYPE_JOB,
+		// Worker to coordinator, job_t followed by the mean color and sample count of every pixel
+		MESSAGE_TYPE_RESULT,
+		// Coordinator to worker, no payload, there are no jobs left
+		MESSAGE_TYPE_DONE
+	};
+
+	struct message_header_t
+	{
+		uint32_t magic;
+		uint32_t type;
+		uint64_t payload_size;
+	};
+
+	struct hello_payload_t
+	{
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// Size of every message part on the wire
+	inline constexpr uint64_t HEADER_WIRE_SIZE = 16;
+	inline constexpr uint64_t HELLO_WIRE_SIZE = 12;
+	inline constexpr uint64_t JOB_WIRE_SIZE = 12;
+	// Mean color of the pixel in xyz and the number of samples it was averaged over in w, as four floats
+	inline constexpr uint64_t RESULT_PIXEL_WIRE_SIZE = 16;
+
+	static void write_u32(uint8_t*& ptr, uint32_t value)
+	{
+		for (uint32_t i = 0; i < 4; ++i)
+			*ptr++ = (uint8_t)(value >> (i * 8));
+	}
+
+	static void write_u64(uint8_t*& ptr, uint64_t value)
+	{
+		for (uint32_t i = 0; i < 8; ++i)
+			*ptr++ = (uint8_t)(value >> (i * 8));
+	}
+
+	// Floats are sent as their IEEE 754 bits, which every platform that runs the path tracer uses
+	static void write_f32(uint8_t*& ptr, float value)
+	{
+		uint32_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		write_u32(ptr, bits);
+	}
+
+	static uint32_t read_u32(const uint8_t*& ptr)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < 4; ++i)
+			value |= (uint32_t)(*ptr++) << (i * 8);
+
+		return value;
+	}
+
+	static uint64_t read_u64(const uint8_t*& ptr)
+	{
+		uint64_t value = 0;
+		for (uint32_t i = 0; i < 8; ++i)
+			value |= (uint64_t)(*ptr++) << (i * 8);
+
+		return value;
+	}
+
+	static float read_f32(const uint8_t*& ptr)
+	{
+		uint32_t bits = read_u32(ptr);
+		float value = 0.0f;
+		memcpy(&value, &bits, sizeof(value));
+
+		return value;
+	}
+
+	static void write_job(uint8_t*& ptr, const job_t& job)
+	{
+		write_u32(ptr, job.job_idx);
+		write_u32(ptr, job.sample_offset);
+		write_u32(ptr, job.sample_count);
+	}
+
+	static job_t read_job(const uint8_t*& ptr)
+	{
+		job_t job = {};
+		job.job_idx = read_u32(ptr);
+		job.sample_offset = read_u32(ptr);
+		job.sample_count = read_u32(ptr);
+
+		return job;
+	}
+
+	// The payload needs to be serialized already, extra_payload_size is added for payloads that the caller sends in parts after this
+	static bool send_message(socket_t& sock, MESSAGE_TYPE type, const uint8_t* payload, uint64_t payload_size, uint64_t extra_payload_size = 0)
+	{
+		uint8_t header[HEADER_WIRE_SIZE] = {};
+		uint8_t* header_ptr = header;
+		write_u32(header_ptr, MESSAGE_MAGIC);
+		write_u32(header_ptr, type);
+		write_u64(header_ptr, payload_size + extra_payload_size);
+
+		return net::send(sock, header, sizeof(header)) && (payload_size == 0 || net::send(sock, payload, payload_size));
+	}
+
+	static bool send_hello(socket_t& sock, uint32_t width, uint32_t height)
+	{
+		uint8_t payload[HELLO_WIRE_SIZE] = {};
+		uint8_t* payload_ptr = payload;
+		write_u32(payload_ptr, PROTOCOL_VERSION);
+		write_u32(payload_ptr, width);
+		write_u32(payload_ptr, height);
+
+		return send_message(sock, MESSAGE_TYPE_HELLO, payload, sizeof(payload));
+	}
+
+	// Only receives the header and checks it against the expected type, the payload is left for the caller to receive
+	static bool receive_header(socket_t& sock, MESSAGE_TYPE expected_type, uint64_t expected_payload_size, message_header_t& out_header)
+	{
+		uint8_t header[HEADER_WIRE_SIZE] = {};
+		if (!net::receive(sock, header, sizeof(header)))
+			return false;
+
+		const uint8_t* header_ptr = header;
+		out_header.magic = read_u32(header_ptr);
+		out_header.type = read_u32(header_ptr);
+		out_header.payload_size = read_u64(header_ptr);
+
+		if (out_header.magic != MESSAGE_MAGIC)
+		{
+			LOG_ERR("Distributed", "Received a message with an invalid magic number");
+			return false;
+		}
+
+		if (out_header.type != expected_type && out_header.type != MESSAGE_TYPE_DONE)
+		{
+			LOG_ERR("Distributed", "Received message type %u, expected %u", out_header.type, expected_type);
+			return false;
+		}
+
+		if (out_header.type == expected_type && out_header.payload_size != expected_payload_size)
+		{
+			LOG_ERR("Distributed", "Received a message of type %u with a payload of %llu bytes, expected %llu bytes",
+				out_header.type, out_header.payload_size, expected_payload_size);
+			return false;
+		}
+
+		return true;
+	}
+
+	// Receives the hello of the other side, a hello of a different protocol version is still received since the version is always its first field
+	static bool receive_hello(socket_t& sock, hello_payload_t& out_hello)
+	{
+		message_header_t header = {};
+		uint8_t payload[HELLO_WIRE_SIZE] = {};
+		if (!receive_header(sock, MESSAGE_TYPE_HELLO, sizeof(payload), header) || header.type != MESSAGE_TYPE_HELLO ||
+			!net::receive(sock, payload, sizeof(payload)))
+			return false;
+
+		const uint8_t* payload_ptr = payload;
+		out_hello.version = read_u32(payload_ptr);
+		out_hello.width = read_u32(payload_ptr);
+		out_hello.height = read_u32(payload_ptr);
+
+		return true;
+	}
+
+	struct coordinator_t
+	{
+		coordinator_params_t params;
+		uint32_t job_count;
+
+		// Protects everything below, the cond var wakes up connections that wait for a job to be handed back by a connection that failed
+		mutex_t mutex;
+		cond_var_t job_cond_var;
+		uint32_t next_job_idx;
+		uint32_t* requeued_jobs;
+		uint32_t requeued_job_count;
+		uint32_t jobs_in_flight;
+		uint32_t completed_job_count;
+		// Sum of the color of every pixel weighted by its sample count in xyz, and the total sample count in w
+		glm::vec4* weighted_sum;
+	};
+
+	static bool are_all_jobs_completed(coordinator_t& coordinator)
+	{
+		thread::mutex::lock(coordinator.mutex);
+		bool completed = coordinator.completed_job_count == coordinator.job_count;
+		thread::mutex::unlock(coordinator.mutex);
+
+		return completed;
+	}
+
+	// Every worker gets its own connection with its own thread, which only needs the lock to take jobs and merge results
+	struct connection_t
+	{
+		coordinator_t* coordinator;
+		uint32_t worker_idx;
+		socket_t sock;
+		thread_t thread;
+		// Serialized result pixels as they were received, they are only deserialized while they get merged
+		uint8_t* result_data;
+	};
+
+	static job_t get_job(const coordinator_t& coordinator, uint32_t job_idx)
+	{
+		job_t job = {};
+		job.job_idx = job_idx;
+		job.sample_offset = job_idx * coordinator.params.job_sample_count;
+		job.sample_count = MIN(coordinator.params.job_sample_count, coordinator.params.sample_count - job.sample_offset);
+
+		return job;
+	}
+
+	// Returns JOB_INVALID once every job is either completed or can no longer be completed, since there are no other jobs in flight that could still fail
+	static uint32_t acquire_job(coordinator_t& coordinator)
+	{
+		uint32_t job_idx = JOB_INVALID;
+		thread::mutex::lock(coordinator.mutex);
+
+		while (true)
+		{
+			if (coordinator.requeued_job_count > 0)
+			{
+				job_idx = coordinator.requeued_jobs[--coordinator.requeued_job_count];
+				break;
+			}
+			if (coordinator.next_job_idx < coordinator.job_count)
+			{
+				job_idx = coordinator.next_job_idx++;
+				break;
+			}
+			if (coordinator.jobs_in_flight == 0)
+				break;
+
+			thread::cond_var::sleep(coordinator.job_cond_var, coordinator.mutex);
+		}
+
+		if (job_idx != JOB_INVALID)
+			coordinator.jobs_in_flight++;
+
+		thread::mutex::unlock(coordinator.mutex);
+		return job_idx;
+	}
+
+	// Merges the result of a completed job, or hands the job back so that another worker can render it
+	static void release_job(coordinator_t& coordinator, uint32_t job_idx, const uint8_t* result_data)
+	{
+		uint32_t pixel_count = coordinator.params.width * coordinator.params.height;
+		thread::mutex::lock(coordinator.mutex);
+
+		if (result_data)
+		{
+			const uint8_t* result_ptr = result_data;
+			for (uint32_t i = 0; i < pixel_count; ++i)
+			{
+				glm::vec4 result = {};
+				result.x = read_f32(result_ptr);
+				result.y = read_f32(result_ptr);
+				result.z = read_f32(result_ptr);
+				result.w = read_f32(result_ptr);
+				coordinator.weighted_sum[i] += glm::vec4(glm::vec3(result) * result.w, result.w);
+			}
+
+			coordinator.completed_job_count++;
+			LOG_INFO("Distributed", "Completed job %u (%u/%u)", job_idx, coordinator.completed_job_count, coordinator.job_count);
+		}
+		else
+		{
+			coordinator.requeued_jobs[coordinator.requeued_job_count++] = job_idx;
+		}
+
+		coordinator.jobs_in_flight--;
+		thread::cond_var::wake_all(coordinator.job_cond_var, coordinator.mutex);
+		thread::mutex::unlock(coordinator.mutex);
+	}
+
+	static void connection_thread_proc(void* user_data)
+	{
+		connection_t* connection = (connection_t*)user_data;
+		coordinator_t& coordinator = *connection->coordinator;
+		uint32_t pixel_count = coordinator.params.width * coordinator.params.height;
+
+		hello_payload_t hello = {};
+		if (!receive_hello(connection->sock, hello))
+		{
+			LOG_ERR("Distributed", "Worker %u did not say hello", connection->worker_idx);
+			net::close(connection->sock);
+			return;
+		}
+
+		// The worker gets the hello of the coordinator either way, so that it can report why it was refused
+		bool hello_sent = send_hello(connection->sock, coordinator.params.width, coordinator.params.height);
+		if (hello.version != PROTOCOL_VERSION || hello.width != coordinator.params.width || hello.height != coordinator.params.height)
+		{
+			LOG_ERR("Distributed", "Worker %u uses protocol version %u at %ux%u, expected version %u at %ux%u", connection->worker_idx,
+				hello.version, hello.width, hello.height, PROTOCOL_VERSION, coordinator.params.width, coordinator.params.height);
+			send_message(connection->sock, MESSAGE_TYPE_DONE, nullptr, 0);
+			net::close(connection->sock);
+			return;
+		}
+
+		if (!hello_sent)
+		{
+			LOG_ERR("Distributed", "Failed to say hello to worker %u", connection->worker_idx);
+			net::close(connection->sock);
+			return;
+		}
+
+		message_header_t header = {};
+		uint64_t result_data_size = RESULT_PIXEL_WIRE_SIZE * pixel_count;
+
+		while (true)
+		{
+			uint32_t job_idx = acquire_job(coordinator);
+			if (job_idx == JOB_INVALID)
+			{
+				send_message(connection->sock, MESSAGE_TYPE_DONE, nullptr, 0);
+				break;
+			}
+
+			job_t job = get_job(coordinator, job_idx);
+			uint8_t job_data[JOB_WIRE_SIZE] = {};
+			uint8_t* job_ptr = job_data;
+			write_job(job_ptr, job);
+
+			uint8_t result_job_data[JOB_WIRE_SIZE] = {};
+			const uint8_t* result_job_ptr = result_job_data;
+			bool succeeded = send_message(connection->sock, MESSAGE_TYPE_JOB, job_data, sizeof(job_data)) &&
+				receive_header(connection->sock, MESSAGE_TYPE_RESULT, JOB_WIRE_SIZE + result_data_size, header) &&
+				header.type == MESSAGE_TYPE_RESULT &&
+				net::receive(connection->sock, result_job_data, sizeof(result_job_data)) &&
+				read_job(result_job_ptr).job_idx == job.job_idx &&
+				net::receive(connection->sock, connection->result_data, result_data_size);
+
+			if (!succeeded)
+			{
+				LOG_ERR("Distributed", "Lost worker %u while it was rendering job %u, handing the job to another worker", connection->worker_idx, job_idx);
+				release_job(coordinator, job_idx, nullptr);
+				break;
+			}
+
+			release_job(coordinator, job_idx, connection->result_data);
+		}
+
+		net::close(connection->sock);
+	}
+
+	bool run_coordinator(memory_arena_t& arena, const coordinator_params_t& params)
+	{
+		if (!net::init())
+			return false;
+
+		coordinator_t coordinator = {};
+		coordinator.params = params;
+		coordinator.params.worker_count = MAX(params.worker_count, 1u);
+		coordinator.params.sample_count = MAX(params.sample_count, 1u);
+		coordinator.params.job_sample_count = MAX(params.job_sample_count, 1u);
+		coordinator.job_count = (coordinator.params.sample_count + coordinator.params.job_sample_count - 1) / coordinator.params.job_sample_count;
+
+		uint32_t pixel_count = params.width * params.height;
+		coordinator.requeued_jobs = ARENA_ALLOC_ARRAY(arena, uint32_t, coordinator.job_count);
+		coordinator.weighted_sum = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+
+		socket_t listen_socket = {};
+		if (!net::listen(params.bind_address, params.port, listen_socket))
+		{
+			net::exit();
+			return false;
+		}
+
+		const char* listen_address = params.bind_address && params.bind_address[0] != '\0' ? params.bind_address : "every interface";
+		LOG_INFO("Distributed", "Coordinator rendering %u samples at %ux%u in %u jobs, waiting for %u workers on %s, port %u", coordinator.params.sample_count,
+			params.width, params.height, coordinator.job_count, coordinator.params.worker_count, listen_address, params.port);
+
+		// The result buffers are allocated here when a worker connects, since the arena can not be used from the connection threads
+		connection_t* connections = ARENA_ALLOC_ARRAY_ZERO(arena, connection_t, coordinator.params.worker_count);
+		uint32_t connection_count = 0;
+
+		// Workers that do not show up before the accept timeout are not waited on, the workers that did connect render every job between them
+		// Workers that connect late still pick up jobs, including the jobs of workers that were lost before that
+		timer_ticks_t accept_begin = platform::get_ticks();
+		while (connection_count < coordinator.params.worker_count)
+		{
+			if (are_all_jobs_completed(coordinator))
+				break;
+
+			double accept_elapsed = platform::get_elapsed_seconds(accept_begin, platform::get_ticks());
+			if (params.accept_timeout > 0.0f && accept_elapsed >= params.accept_timeout)
+			{
+				LOG_WARN("Distributed", "Only %u of %u workers connected within %.1f seconds, continuing with the workers that did connect",
+					connection_count, coordinator.params.worker_count, params.accept_timeout);
+				break;
+			}
+
+			if (!net::wait_for_connection(listen_socket, ACCEPT_POLL_INTERVAL_MS))
+				continue;
+
+			connection_t& connection = connections[connection_count];
+			connection.coordinator = &coordinator;
+			connection.worker_idx = connection_count;
+			connection.result_data = ARENA_ALLOC_ARRAY(arena, uint8_t, RESULT_PIXEL_WIRE_SIZE * pixel_count);
+
+			if (!net::accept(listen_socket, connection.sock))
+				break;
+
+			LOG_INFO("Distributed", "Worker %u connected", connection.worker_idx);
+			connection.thread = thread::create(connection_thread_proc, &connection);
+			connection_count++;
+		}
+
+		for (uint32_t i = 0; i < connection_count; ++i)
+		{
+			thread::join(connections[i].thread);
+		}
+
+		net::close(listen_socket);
+		net::exit();
+
+		if (connection_count == 0)
+		{
+			LOG_ERR("Distributed", "No workers connected, nothing was rendered");
+			return false;
+		}
+
+		// Every pixel is the average of all of its samples, no matter how many samples each of the workers rendered for it
+		for (uint32_t i = 0; i < pixel_count; ++i)
+		{
+			const glm::vec4& sum = coordinator.weighted_sum[i];
+			coordinator.weighted_sum[i] = sum.w > 0.0f ? glm::vec4(glm::vec3(sum) / sum.w, 1.0f) : glm::vec4(0.0f);
+		}
+
+		bool completed = coordinator.completed_job_count == coordinator.job_count;
+		if (!completed)
+		{
+			LOG_ERR("Distributed", "Only %u of %u jobs were completed, the output is missing samples", coordinator.completed_job_count, coordinator.job_count);
+		}
+
+		bool written = false;
+		ARENA_SCRATCH_SCOPE()
+		{
+			written = image_writer::write_image(arena_scratch, params.output_path, params.width, params.height, coordinator.weighted_sum);
+		}
+
+		if (!written)
+		{
+			LOG_ERR("Distributed", "Failed to write the merged image to %s", params.output_path);
+		}
+
+		return completed && written;
+	}
+
+	bool worker_connect(const char* host, uint16_t port, uint32_t width, uint32_t height, worker_t& out_worker)
+	{
+		if (!net::init())
+			return false;
+
+		out_worker = {};
+		out_worker.width = width;
+		out_worker.height = height;
+
+		if (!net::connect(host, port, out_worker.sock))
+		{
+			net::exit();
+			return false;
+		}
+
+		hello_payload_t coordinator_hello = {};
+		if (!send_hello(out_worker.sock, width, height) || !receive_hello(out_worker.sock, coordinator_hello))
+		{
+			LOG_ERR("Distributed", "Failed to exchange hellos with the coordinator at %s:%u", host, port);
+			worker_disconnect(out_worker);
+			return false;
+		}
+
+		if (coordinator_hello.version != PROTOCOL_VERSION || coordinator_hello.width != width || coordinator_hello.height != height)
+		{
+			LOG_ERR("Distributed", "Coordinator at %s:%u uses protocol version %u at %ux%u, this worker uses version %u at %ux%u", host, port,
+				coordinator_hello.version, coordinator_hello.width, coordinator_hello.height, PROTOCOL_VERSION, width, height);
+			worker_disconnect(out_worker);
+			return false;
+		}
+
+		LOG_INFO("Distributed", "Connected to the coordinator at %s:%u", host, port);
+		return true;
+	}
+
+	void worker_disconnect(worker_t& worker)
+	{
+		net::close(worker.sock);
+		net::exit();
+	}
+
+	bool worker_receive_job(worker_t& worker, job_t& out_job)
+	{
+		message_header_t header = {};
+		if (!receive_header(worker.sock, MESSAGE_TYPE_JOB, JOB_WIRE_SIZE, header))
+		{
+			LOG_ERR("Distributed", "Lost the connection to the coordinator");
+			return false;
+		}
+
+		if (header.type == MESSAGE_TYPE_DONE)
+			return false;
+
+		uint8_t job_data[JOB_WIRE_SIZE] = {};
+		if (!net::receive(worker.sock, job_data, sizeof(job_data)))
+			return false;
+
+		const uint8_t* job_ptr = job_data;
+		out_job = read_job(job_ptr);
+		return true;
+	}
+
+	bool worker_send_result(worker_t& worker, const job_t& job, const glm::vec4* pixels, const glm::vec4* pixel_variance)
+	{
+		uint32_t pixel_count = worker.width * worker.height;
+		uint8_t job_data[JOB_WIRE_SIZE] = {};
+		uint8_t* job_ptr = job_data;
+		write_job(job_ptr, job);
+
+		if (!send_message(worker.sock, MESSAGE_TYPE_RESULT, job_data, sizeof(job_data), RESULT_PIXEL_WIRE_SIZE * pixel_count))
+			return false;
+
+		uint8_t batch[RESULT_BATCH_PIXEL_COUNT * RESULT_PIXEL_WIRE_SIZE];
+		for (uint32_t batch_begin = 0; batch_begin < pixel_count; batch_begin += RESULT_BATCH_PIXEL_COUNT)
+		{
+			uint32_t batch_count = MIN(RESULT_BATCH_PIXEL_COUNT, pixel_count - batch_begin);
+			uint8_t* batch_ptr = batch;
+			for (uint32_t i = 0; i < batch_count; ++i)
+			{
+				uint32_t pixel_idx = batch_begin + i;
+				write_f32(batch_ptr, pixels[pixel_idx].x);
+				write_f32(batch_ptr, pixels[pixel_idx].y);
+				write_f32(batch_ptr, pixels[pixel_idx].z);
+				write_f32(batch_ptr, pixel_variance[pixel_idx].x);
+			}
+
+			if (!net::send(worker.sock, batch, RESULT_PIXEL_WIRE_SIZE * batch_count))
+				return false;
+		}
+
+		return true;
+	}
+
+}
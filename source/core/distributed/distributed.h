@@ -0,0 +1,58 @@
+#pragma once
+#include "core/common.h"
+#include "core/api_types.h"
+
+struct memory_arena_t;
+
+// Distributed batch rendering with a coordinator process and any number of worker processes that talk over TCP sockets
+// The coordinator splits the samples of the image into jobs, every job is a range of sample indices over the full image
+// Workers render one job at a time with the CPU path tracer and send back the mean color and sample count of every pixel,
+// the coordinator merges them weighted by their sample counts, so the result is the same as if one process had rendered every sample
+namespace distributed
+{
+
+	struct coordinator_params_t
+	{
+		// Numeric IPv4 address to listen on, null or empty listens on every interface so that workers on other machines can connect
+		const char* bind_address;
+		uint16_t port;
+		// The coordinator accepts up to this many workers, workers that connect early start rendering right away
+		uint32_t worker_count;
+		// In seconds, the coordinator stops accepting workers after this and continues with the workers that did connect, zero waits forever
+		float accept_timeout;
+		uint32_t width;
+		uint32_t height;
+		uint32_t sample_count;
+		// Samples per job, smaller jobs balance better between workers of different speeds but send more results
+		uint32_t job_sample_count;
+		const char* output_path;
+	};
+
+	// Hands out jobs until every sample is rendered, then writes the merged image to the output path
+	// Jobs of workers that disconnect are handed to the other workers, returns false if some samples could not be rendered at all,
+	// the image is still written with the samples that did get rendered, unless no worker connected before the accept timeout
+	bool run_coordinator(memory_arena_t& arena, const coordinator_params_t& params);
+
+	struct job_t
+	{
+		uint32_t job_idx;
+		uint32_t sample_offset;
+		uint32_t sample_count;
+	};
+
+	struct worker_t
+	{
+		socket_t sock;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// The width and height are sent to the coordinator, which refuses workers that do not render at its resolution
+	bool worker_connect(const char* host, uint16_t port, uint32_t width, uint32_t height, worker_t& out_worker);
+	void worker_disconnect(worker_t& worker);
+	// Blocks until the coordinator sends the next job, returns false once there are no jobs left or the connection was lost
+	bool worker_receive_job(worker_t& worker, job_t& out_job);
+	// Pixels hold the mean color and pixel variance holds the sample count of every pixel in x, both in the layout of renderer::cpu_accumulation_t
+	bool worker_send_result(worker_t& worker, const job_t& job, const glm::vec4* pixels, const glm::vec4* pixel_variance);
+
+}
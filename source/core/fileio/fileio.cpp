@@ -1,6 +1,15 @@
 #include "fileio.h"
 #include "core/memory/memory_arena.h"
 
+#include <cstdio>
+#ifdef _WIN32
+#include "platform/windows/windows_common.h"
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace fileio
 {
     
@@ -33,5 +42,144 @@ namespace fileio
 
         return ret;
     }
+
+    bool write_file(const char* filepath, const void* data, uint64_t size)
+    {
+        FILE* file = fopen(filepath, "wb");
+        if (!file)
+        {
+            return false;
+        }
+
+        size_t bytes_written = fwrite(data, 1, size, file);
+        fclose(file);
+
+        return bytes_written == size;
+    }
+
+    // The random access files use the native file handles instead of FILE, so that reads and writes at an offset are thread-safe
+    // The position of a FILE is shared by every thread that uses it, while the native reads and writes at an offset leave it alone
+#ifdef _WIN32
+    static bool create_file_native(const char* filepath, DWORD flags_and_attributes, file_t& out_file)
+    {
+        HANDLE handle = CreateFileA(filepath, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags_and_attributes, nullptr);
+        out_file.handle = (uint64_t)handle;
+        out_file.open = handle != INVALID_HANDLE_VALUE;
+        return out_file.open;
+    }
+
+    static OVERLAPPED get_overlapped(uint64_t offset)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        return overlapped;
+    }
+#endif
+
+    bool create_file(const char* filepath, file_t& out_file)
+    {
+#ifdef _WIN32
+        return create_file_native(filepath, FILE_ATTRIBUTE_NORMAL, out_file);
+#else
+        int fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        out_file.handle = (uint64_t)fd;
+        out_file.open = fd != -1;
+        return out_file.open;
+#endif
+    }
+
+    bool create_temp_file(const char* filepath_prefix, file_t& out_file, char* out_filepath, uint32_t out_filepath_size)
+    {
+#ifdef _WIN32
+        // The process id makes the name unique among the running processes, the file gets deleted once its handle is closed
+        snprintf(out_filepath, out_filepath_size, "%s.%d", filepath_prefix, _getpid());
+        return create_file_native(out_filepath, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, out_file);
+#else
+        // The file is unlinked right away, so that it is deleted once it is closed, even if the process does not exit cleanly
+        snprintf(out_filepath, out_filepath_size, "%s.XXXXXX", filepath_prefix);
+        int fd = mkstemp(out_filepath);
+        out_file.handle = (uint64_t)fd;
+        out_file.open = fd != -1;
+        if (out_file.open)
+        {
+            unlink(out_filepath);
+        }
+
+        return out_file.open;
+#endif
+    }
+
+    void close_file(file_t& file)
+    {
+        if (file.open)
+        {
+#ifdef _WIN32
+            CloseHandle((HANDLE)file.handle);
+#else
+            close((int)file.handle);
+#endif
+            file.open = false;
+        }
+    }
+
+    bool read_file_at(const file_t& file, uint64_t offset, void* dst, uint64_t size)
+    {
+        uint8_t* dst_bytes = (uint8_t*)dst;
+
+        // A single read might return fewer bytes than requested, or be limited to 32-bit sizes
+        while (size > 0)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped = get_overlapped(offset);
+            DWORD bytes_read = 0;
+            if (!ReadFile((HANDLE)file.handle, dst_bytes, (DWORD)MIN(size, (uint64_t)UINT32_MAX), &bytes_read, &overlapped) || bytes_read == 0)
+            {
+                return false;
+            }
+#else
+            ssize_t bytes_read = pread((int)file.handle, dst_bytes, size, (off_t)offset);
+            if (bytes_read <= 0)
+            {
+                return false;
+            }
+#endif
+
+            dst_bytes += bytes_read;
+            offset += bytes_read;
+            size -= bytes_read;
+        }
+
+        return true;
+    }
+
+    bool write_file_at(const file_t& file, uint64_t offset, const void* data, uint64_t size)
+    {
+        const uint8_t* data_bytes = (const uint8_t*)data;
+
+        while (size > 0)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped = get_overlapped(offset);
+            DWORD bytes_written = 0;
+            if (!WriteFile((HANDLE)file.handle, data_bytes, (DWORD)MIN(size, (uint64_t)UINT32_MAX), &bytes_written, &overlapped) || bytes_written == 0)
+            {
+                return false;
+            }
+#else
+            ssize_t bytes_written = pwrite((int)file.handle, data_bytes, size, (off_t)offset);
+            if (bytes_written <= 0)
+            {
+                return false;
+            }
+#endif
+
+            data_bytes += bytes_written;
+            offset += bytes_written;
+            size -= bytes_written;
+        }
+
+        return true;
+    }
     
 }
@@ -14,5 +14,25 @@ namespace fileio
     };
     
     read_file_result_t read_file(memory_arena_t& arena, const char* filepath);
+    // Creates the file or overwrites it if it already exists, returns false if the file could not be opened or not all bytes were written
+    bool write_file(const char* filepath, const void* data, uint64_t size);
+
+    // Random access to a file that stays open, for data that is streamed in and out instead of being loaded at once
+    struct file_t
+    {
+        // HANDLE on windows, file descriptor on linux
+        uint64_t handle;
+        bool open;
+    };
+
+    // Creates the file or overwrites it if it already exists, the file can be read from and written to
+    bool create_file(const char* filepath, file_t& out_file);
+    // Creates a file that no other process shares, named after the prefix with a unique suffix, and writes its name to out_filepath
+    // The file gets deleted once it is closed, it can be read from and written to
+    bool create_temp_file(const char* filepath_prefix, file_t& out_file, char* out_filepath, uint32_t out_filepath_size);
+    void close_file(file_t& file);
+    // Reads and writes at an offset do not move a shared file position, so multiple threads can read from and write to the same file at once
+    bool read_file_at(const file_t& file, uint64_t offset, void* dst, uint64_t size);
+    bool write_file_at(const file_t& file, uint64_t offset, const void* data, uint64_t size);
     
 }
@@ -16,13 +16,13 @@ namespace hash
 		return h ^= h >> 16;
 	}
 
-	static uint32_t djb2(const void* in)
+	inline uint32_t djb2(const void* in)
 	{
 		uint8_t* data = (uint8_t*)in;
 		uint32_t hash = 5381;
 		int c;
 
-		while (c = *data++)
+		while ((c = *data++))
 		{
 			hash = ((hash << 5) + hash) + c;
 		}
@@ -30,7 +30,7 @@ namespace hash
 		return hash;
 	}
 
-	static uint32_t murmur2_32(const void* in, uint32_t len, uint32_t seed)
+	inline uint32_t murmur2_32(const void* in, uint32_t len, uint32_t seed)
 	{
 		const uint32_t m = 0x5bd1e995;
 		const int r = 24;
@@ -68,7 +68,7 @@ namespace hash
 		return hash;
 	}
 
-	static uint32_t murmur3_32(const void* in, uint32_t len, uint32_t seed)
+	inline uint32_t murmur3_32(const void* in, uint32_t len, uint32_t seed)
 	{
 		const uint8_t* tail = (const uint8_t*)in + (len / 4) * 4;
 		uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
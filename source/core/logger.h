@@ -4,6 +4,7 @@
 #include "core/memory/memory_arena.h"
 
 #include <cstdarg>
+#include <cstdio>
 
 namespace logger
 {
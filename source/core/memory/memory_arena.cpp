@@ -2,10 +2,17 @@
 
 #include "core/memory/virtual_memory.h"
 #include "core/assertion.h"
+#include "core/logger.h"
+#include "core/thread.h"
+#include "core/hash.h"
+
+#include <cstdio>
+#include <cwchar>
 
 static constexpr uint64_t ARENA_RESERVE_CHUNK_SIZE = GB(4ull);
 static constexpr uint64_t ARENA_COMMIT_CHUNK_SIZE = KB(4ull);
-static constexpr uint64_t ARENA_DECOMMIT_KEEP_CHUNK_SIZE = KB(4ull);
+// Scratch scopes are opened and closed in loops all the time, so scratch arenas keep some memory committed between them
+static constexpr uint64_t ARENA_SCRATCH_DECOMMIT_THRESHOLD = MB(64ull);
 
 static bool arena_can_fit(memory_arena_t& arena, uint64_t size, uint64_t align)
 {
@@ -13,18 +20,89 @@ static bool arena_can_fit(memory_arena_t& arena, uint64_t size, uint64_t align)
 	return AlignedBytesLeft >= size;
 }
 
+#if ARENA_ENABLE_TRACKING
+// Open addressing hash table, so the size needs to be a power of two, call sites that do not fit anymore are not tracked
+static constexpr uint32_t ARENA_TRACKING_MAX_CALL_SITES = 4096;
+
+struct call_site_table_t
+{
+	// Scratch arenas are used from every thread, so the table is protected by a lock
+	mutex_t mutex;
+	memory_arena::call_site_stats_t call_sites[ARENA_TRACKING_MAX_CALL_SITES];
+	uint32_t call_site_count;
+} static s_call_site_table;
+
+static void track_call_site(const memory_arena_t& arena, const char* file, uint32_t line, uint64_t size)
+{
+	if (!file)
+		file = "unknown";
+
+	// The same file can have a different __FILE__ pointer in every translation unit that includes it, so the file name itself is hashed and compared
+	uint64_t arena_address = (uint64_t)&arena;
+	uint32_t hash = hash::fmix(hash::djb2(file) ^ line ^ hash::fmix((uint32_t)arena_address ^ (uint32_t)(arena_address >> 32)));
+
+	thread::mutex::lock(s_call_site_table.mutex);
+
+	for (uint32_t probe = 0; probe < ARENA_TRACKING_MAX_CALL_SITES; ++probe)
+	{
+		memory_arena::call_site_stats_t& call_site = s_call_site_table.call_sites[(hash + probe) & (ARENA_TRACKING_MAX_CALL_SITES - 1)];
+
+		if (!call_site.file)
+		{
+			// One slot always stays empty, so that lookups of call sites that are not in the table end
+			if (s_call_site_table.call_site_count + 1 >= ARENA_TRACKING_MAX_CALL_SITES)
+				break;
+
+			call_site.arena = &arena;
+			call_site.arena_name = arena.name;
+			call_site.file = file;
+			call_site.line = line;
+			s_call_site_table.call_site_count++;
+		}
+
+		if (call_site.arena == &arena && call_site.line == line && (call_site.file == file || strcmp(call_site.file, file) == 0))
+		{
+			call_site.alloc_count++;
+			call_site.total_bytes += size;
+			call_site.largest_bytes = MAX(call_site.largest_bytes, size);
+			break;
+		}
+	}
+
+	thread::mutex::unlock(s_call_site_table.mutex);
+}
+#endif
+
+// Only gives back the memory past the decommit threshold, so that allocations which come and go do not commit and decommit the same memory over and over
+static void decommit_unused(memory_arena_t& arena)
+{
+	uint64_t unused_bytes = arena.ptr_committed - arena.ptr_at;
+	if (unused_bytes > arena.decommit_threshold)
+	{
+		memory_arena::decommit(arena, arena.ptr_at + arena.decommit_threshold);
+	}
+}
+
 void memory_arena::init(memory_arena_t& arena)
 {
 	if (!arena.ptr_base)
 	{
+		// The commit granularity is resolved once, so that commits and decommits always line up with the pages of the arena
+		uint64_t commit_granularity = arena.commit_granularity ? arena.commit_granularity : ARENA_COMMIT_CHUNK_SIZE;
+		if (arena.huge_pages)
+			commit_granularity = MAX(commit_granularity, virtual_memory::get_huge_page_size());
+		arena.commit_granularity = MAX(commit_granularity, virtual_memory::get_page_size());
+		ASSERT_MSG(IS_POW2(arena.commit_granularity), "Arena commit granularity needs to be a power of two");
+
 		arena.ptr_base = (uint8_t*)virtual_memory::reserve(ARENA_RESERVE_CHUNK_SIZE);
 		arena.ptr_at = arena.ptr_base;
 		arena.ptr_end = arena.ptr_base + ARENA_RESERVE_CHUNK_SIZE;
 		arena.ptr_committed = arena.ptr_base;
+		arena.ptr_high_water = arena.ptr_base;
 	}
 }
 
-void* memory_arena::alloc(memory_arena_t& arena, uint64_t size, uint64_t align)
+void* memory_arena::alloc(memory_arena_t& arena, uint64_t size, uint64_t align, [[maybe_unused]] const char* file, [[maybe_unused]] uint32_t line)
 {
 	// The arena holds no memory yet, so we need to reserve some
 	init(arena);
@@ -37,15 +115,24 @@ void* memory_arena::alloc(memory_arena_t& arena, uint64_t size, uint64_t align)
 		// align the allocation pointer to the alignment required
 		result = (uint8_t*)ALIGN_UP_POW2(arena.ptr_at, align);
 
-		// If the arena does not have enough memory committed, make it commit memory that makes the allocation fit, aligned up to the default commit chunk size
-		if (arena.ptr_at + size > arena.ptr_committed)
+		// If the arena does not have enough memory committed, make it commit memory that makes the allocation fit, aligned up to the commit granularity of the arena
+		if (result + size > arena.ptr_committed)
 		{
-			uint64_t commit_chunk_size = ALIGN_UP_POW2(arena.ptr_at + size - arena.ptr_committed, ARENA_COMMIT_CHUNK_SIZE);
-			virtual_memory::commit(arena.ptr_committed, commit_chunk_size);
+			uint64_t commit_chunk_size = ALIGN_UP_POW2(result + size - arena.ptr_committed, arena.commit_granularity);
+			virtual_memory::commit(arena.ptr_committed, commit_chunk_size, arena.huge_pages);
 			arena.ptr_committed += commit_chunk_size;
+			arena.commit_count++;
 		}
 
 		arena.ptr_at = result + size;
+		arena.ptr_high_water = MAX(arena.ptr_high_water, arena.ptr_at);
+
+#if ARENA_ENABLE_TRACKING
+		arena.alloc_count++;
+		arena.peak_allocated = MAX(arena.peak_allocated, total_allocated(arena));
+		arena.peak_committed = MAX(arena.peak_committed, total_committed(arena));
+		track_call_site(arena, file, line, size);
+#endif
 		ASSERT(arena.ptr_at >= arena.ptr_base);
 		ASSERT(arena.ptr_at < arena.ptr_end);
 	}
@@ -53,9 +140,9 @@ void* memory_arena::alloc(memory_arena_t& arena, uint64_t size, uint64_t align)
 	return result;
 }
 
-void* memory_arena::alloc_zero(memory_arena_t& arena, uint64_t size, uint64_t align)
+void* memory_arena::alloc_zero(memory_arena_t& arena, uint64_t size, uint64_t align, const char* file, uint32_t line)
 {
-	void* result = alloc(arena, size, align);
+	void* result = alloc(arena, size, align, file, line);
 	memset(result, 0, size);
 	return result;
 }
@@ -64,15 +151,36 @@ void memory_arena::decommit(memory_arena_t& arena, uint8_t* ptr)
 {
 	ASSERT(ptr);
 
-	// Decommit memory until ptr, aligned to ARENA_DECOMMIT_KEEP_CHUNK_SIZE
-	uint8_t* ptr_decommit = (uint8_t*)ALIGN_UP_POW2(ptr, ARENA_DECOMMIT_KEEP_CHUNK_SIZE);
+	// Decommit memory until ptr, aligned to the commit granularity so that huge pages are never split up
+	uint8_t* ptr_decommit = arena.ptr_base + ALIGN_UP_POW2(ptr - arena.ptr_base, arena.commit_granularity);
 	uint64_t decommit_bytes = MAX(0, arena.ptr_committed - ptr_decommit);
 
 	if (decommit_bytes > 0)
 	{
 		virtual_memory::decommit(ptr_decommit, decommit_bytes);
 		arena.ptr_committed = ptr_decommit;
+		arena.decommit_count++;
+	}
+}
+
+void memory_arena::decay(memory_arena_t& arena, float fraction)
+{
+	if (!arena.ptr_base)
+		return;
+
+	// Everything up to the high-water mark was in use since the last decay, so it is likely to be used again
+	// The part of the slack that is kept is rounded down to the commit granularity, otherwise decommit rounds it back up and slack
+	// smaller than the granularity divided by the fraction would never shrink, with huge pages that is tens of megabytes
+	uint8_t* ptr_keep = MAX(arena.ptr_at, arena.ptr_high_water);
+	uint8_t* ptr_keep_aligned = arena.ptr_base + ALIGN_UP_POW2(ptr_keep - arena.ptr_base, arena.commit_granularity);
+	if (arena.ptr_committed > ptr_keep_aligned)
+	{
+		uint64_t slack_bytes = arena.ptr_committed - ptr_keep_aligned;
+		uint64_t keep_bytes = (uint64_t)(slack_bytes * (1.0 - glm::clamp(fraction, 0.0f, 1.0f)));
+		memory_arena::decommit(arena, ptr_keep_aligned + ALIGN_DOWN_POW2(keep_bytes, arena.commit_granularity));
 	}
+
+	arena.ptr_high_water = arena.ptr_at;
 }
 
 void memory_arena::free(memory_arena_t& arena, uint8_t* ptr)
@@ -88,7 +196,7 @@ void memory_arena::free(memory_arena_t& arena, uint8_t* ptr)
 	{
 		// Move the current pointer back to free size memory
 		arena.ptr_at -= bytes_to_free;
-		memory_arena::decommit(arena, arena.ptr_at);
+		decommit_unused(arena);
 	}
 }
 
@@ -99,18 +207,19 @@ void memory_arena::clear(memory_arena_t& arena)
 	
 	if (arena.ptr_base)
 	{
-		memory_arena::decommit(arena, arena.ptr_base);
+		decommit_unused(arena);
 	}
 }
 
 void memory_arena::release(memory_arena_t& arena)
 {
 	void* ptr_arena_base = arena.ptr_base;
-	arena.ptr_base = arena.ptr_at = arena.ptr_end = arena.ptr_committed = nullptr;
+	uint64_t reserved_bytes = total_reserved(arena);
+	arena.ptr_base = arena.ptr_at = arena.ptr_end = arena.ptr_committed = arena.ptr_high_water = nullptr;
 	
 	if (ptr_arena_base)
 	{
-		virtual_memory::release(ptr_arena_base);
+		virtual_memory::release(ptr_arena_base, reserved_bytes);
 	}
 }
 
@@ -134,6 +243,91 @@ uint64_t memory_arena::total_committed(memory_arena_t& arena)
 	return arena.ptr_committed - arena.ptr_base;
 }
 
+memory_arena::stats_t memory_arena::get_stats(memory_arena_t& arena)
+{
+	stats_t stats = {};
+	stats.reserved = total_reserved(arena);
+	stats.committed = total_committed(arena);
+	stats.allocated = total_allocated(arena);
+	stats.commit_count = arena.commit_count;
+	stats.decommit_count = arena.decommit_count;
+
+#if ARENA_ENABLE_TRACKING
+	stats.peak_committed = arena.peak_committed;
+	stats.peak_allocated = arena.peak_allocated;
+	stats.alloc_count = arena.alloc_count;
+#endif
+
+	return stats;
+}
+
+uint32_t memory_arena::get_call_site_stats([[maybe_unused]] call_site_stats_t* out_call_sites, [[maybe_unused]] uint32_t max_count)
+{
+	uint32_t count = 0;
+
+#if ARENA_ENABLE_TRACKING
+	thread::mutex::lock(s_call_site_table.mutex);
+
+	// Insertion sort into the output, which only ever holds the call sites with the most bytes so far
+	for (uint32_t i = 0; i < ARENA_TRACKING_MAX_CALL_SITES; ++i)
+	{
+		const call_site_stats_t& call_site = s_call_site_table.call_sites[i];
+		if (!call_site.file)
+			continue;
+
+		uint32_t insert_idx = count;
+		while (insert_idx > 0 && out_call_sites[insert_idx - 1].total_bytes < call_site.total_bytes)
+			insert_idx--;
+
+		if (insert_idx >= max_count)
+			continue;
+
+		uint32_t move_count = MIN(count, max_count - 1) - insert_idx;
+		memmove(&out_call_sites[insert_idx + 1], &out_call_sites[insert_idx], move_count * sizeof(call_site_stats_t));
+		out_call_sites[insert_idx] = call_site;
+		count = MIN(count + 1, max_count);
+	}
+
+	thread::mutex::unlock(s_call_site_table.mutex);
+#endif
+
+	return count;
+}
+
+void memory_arena::reset_call_site_stats()
+{
+#if ARENA_ENABLE_TRACKING
+	thread::mutex::lock(s_call_site_table.mutex);
+
+	memset(s_call_site_table.call_sites, 0, sizeof(s_call_site_table.call_sites));
+	s_call_site_table.call_site_count = 0;
+
+	thread::mutex::unlock(s_call_site_table.mutex);
+#endif
+}
+
+void memory_arena::log_call_site_stats([[maybe_unused]] uint32_t max_count)
+{
+#if ARENA_ENABLE_TRACKING
+	ARENA_SCRATCH_SCOPE()
+	{
+		// The call sites are copied first, since logging allocates from the scratch arena which would take the call site lock again
+		call_site_stats_t* call_sites = ARENA_ALLOC_ARRAY(arena_scratch, call_site_stats_t, max_count);
+		uint32_t count = get_call_site_stats(call_sites, max_count);
+
+		LOG_INFO("Memory Arena", "Top %u allocation call sites by bytes:", count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			LOG_INFO("Memory Arena", "%10llu KB %8llu allocs %10llu KB largest  %-16s %p  %s(%u)", TO_KB(call_sites[i].total_bytes), call_sites[i].alloc_count,
+				TO_KB(call_sites[i].largest_bytes), call_sites[i].arena_name ? call_sites[i].arena_name : "unnamed", (const void*)call_sites[i].arena,
+				call_sites[i].file, call_sites[i].line);
+		}
+	}
+#else
+	LOG_INFO("Memory Arena", "Allocation tracking is disabled, enable ARENA_ENABLE_TRACKING in memory_arena.h");
+#endif
+}
+
 void* memory_arena::bootstrap_arena(uint64_t size, uint64_t align, uint64_t arena_offset)
 {
 	memory_arena_t arena = {};
@@ -148,6 +342,11 @@ memory_arena_t& memory_arena::get_scratch()
 	thread_local memory_arena_t g_arena_thread;
 
 	// Per thread scratch arena, only used with memory scopes to always automatically reset them
+	if (!g_arena_thread.ptr_base)
+	{
+		g_arena_thread.name = "Scratch";
+		g_arena_thread.decommit_threshold = ARENA_SCRATCH_DECOMMIT_THRESHOLD;
+	}
 	init(g_arena_thread);
 	return g_arena_thread;
 }
@@ -192,18 +391,30 @@ wstring_t memory_arena::wprintf(memory_arena_t& arena, const wchar_t* fmt, ...)
 
 wstring_t memory_arena::wprintf_args(memory_arena_t& arena, const wchar_t* fmt, va_list args)
 {
-	va_list args2;
-	va_copy(args2, args);
+	// Unlike vsnprintf, vswprintf can not count the characters without a buffer that fits them, and _vscwprintf only exists on MSVC
+	// So the string is formatted into a buffer that doubles in size until it fits, and the part of the buffer that is not needed is freed again
+	uint32_t capacity = 256;
+	while (true)
+	{
+		va_list args2;
+		va_copy(args2, args);
 
-	int32_t count = _vscwprintf(fmt, args2);
-	ASSERT(count != -1);
-	
-	va_end(args2);
+		wstring_t result = wstring::make(arena, capacity);
+		int32_t count = vswprintf(result.buf, capacity, fmt, args2);
 
-	wstring_t result = wstring::make(arena, count + 1);
-	_vsnwprintf(result.buf, count + 1, fmt, args);
+		va_end(args2);
 
-	return result;
+		if (count >= 0)
+		{
+			result.count = count + 1;
+			memory_arena::free(arena, (uint8_t*)(result.buf + result.count));
+			return result;
+		}
+
+		memory_arena::free(arena, (uint8_t*)result.buf);
+		ASSERT_MSG(capacity < UINT32_MAX / 2, "Failed to format a wide string");
+		capacity *= 2;
+	}
 }
 
 string_t memory_arena::wide_to_char(memory_arena_t& arena, const wchar_t* wide)
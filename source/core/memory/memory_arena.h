@@ -2,12 +2,47 @@
 #include "core/common.h"
 #include "core/string/string.h"
 
+#include <cstdarg>
+
+// Records the peak usage and allocation count of every arena, and the allocations of every arena and call site of the ARENA_ALLOC macros
+// Every allocation takes a global lock for the call site table, so this is only on by default in debug builds
+#ifdef _DEBUG
+#define ARENA_ENABLE_TRACKING 1
+#else
+#define ARENA_ENABLE_TRACKING 0
+#endif
+
 struct memory_arena_t
 {
 	uint8_t* ptr_base;
 	uint8_t* ptr_end;
 	uint8_t* ptr_at;
 	uint8_t* ptr_committed;
+	// Furthest the allocation pointer got since the last decay
+	uint8_t* ptr_high_water;
+
+	// Optional, the call site stats show this name for the allocations of the arena, arenas without a name show up by address
+	const char* name;
+
+	// Optional, both need to be set before the first allocation
+	// Memory is committed and decommitted in multiples of the commit granularity, zero picks the default of 4 KB
+	uint64_t commit_granularity;
+	// Backs the arena with huge pages where the platform supports it, which raises the commit granularity to the huge page size
+	// Large arrays that are read all over, like BVH nodes and triangles, need far fewer TLB entries that way
+	bool huge_pages;
+	// Optional, free and clear only decommit the committed memory that is more than this many bytes past the allocation pointer
+	// Zero decommits everything that is not allocated anymore right away, UINT64_MAX keeps everything committed up to the high-water mark until it decays
+	uint64_t decommit_threshold;
+
+	// Number of calls to commit and decommit virtual memory since the first allocation
+	uint64_t commit_count;
+	uint64_t decommit_count;
+
+#if ARENA_ENABLE_TRACKING
+	uint64_t peak_allocated;
+	uint64_t peak_committed;
+	uint64_t alloc_count;
+#endif
 };
 
 namespace memory_arena
@@ -15,10 +50,15 @@ namespace memory_arena
 
 	void init(memory_arena_t& arena);
 
-	void* alloc(memory_arena_t& arena, uint64_t size, uint64_t align);
-	void* alloc_zero(memory_arena_t& arena, uint64_t size, uint64_t align);
+	// The file and line are the call site the allocation gets attributed to when tracking is enabled
+	void* alloc(memory_arena_t& arena, uint64_t size, uint64_t align, const char* file = nullptr, uint32_t line = 0);
+	void* alloc_zero(memory_arena_t& arena, uint64_t size, uint64_t align, const char* file = nullptr, uint32_t line = 0);
 
+	// Decommits everything past ptr, no matter the decommit threshold
 	void decommit(memory_arena_t& arena, uint8_t* ptr);
+	// Decommits a fraction of the committed memory past the high-water mark since the last decay, and resets the high-water mark
+	// Called once per frame on arenas that keep memory committed, so that the memory of a one-off spike does not stay committed forever
+	void decay(memory_arena_t& arena, float fraction);
 	void free(memory_arena_t& arena, uint8_t* ptr);
 	void clear(memory_arena_t& arena);
 	void release(memory_arena_t& arena);
@@ -28,6 +68,39 @@ namespace memory_arena
 	uint64_t total_free(memory_arena_t& arena);
 	uint64_t total_committed(memory_arena_t& arena);
 
+	// The peaks and allocation count are zero when tracking is disabled
+	struct stats_t
+	{
+		uint64_t reserved;
+		uint64_t committed;
+		uint64_t allocated;
+		uint64_t peak_committed;
+		uint64_t peak_allocated;
+		uint64_t alloc_count;
+		uint64_t commit_count;
+		uint64_t decommit_count;
+	};
+	stats_t get_stats(memory_arena_t& arena);
+
+	// Allocations per arena and call site, since the start of the application or the last reset
+	// The same call site gets one entry for every arena it allocates from, like the scratch arenas of the worker threads
+	struct call_site_stats_t
+	{
+		const memory_arena_t* arena;
+		const char* arena_name;
+		const char* file;
+		uint32_t line;
+		uint64_t alloc_count;
+		uint64_t total_bytes;
+		uint64_t largest_bytes;
+	};
+	// Copies the call sites with the most allocated bytes to out_call_sites, sorted from most to least bytes, returns the number of call sites copied
+	// Always returns zero when tracking is disabled
+	uint32_t get_call_site_stats(call_site_stats_t* out_call_sites, uint32_t max_count);
+	void reset_call_site_stats();
+	// Logs the call sites with the most allocated bytes as a table
+	void log_call_site_stats(uint32_t max_count);
+
 	void* bootstrap_arena(uint64_t size, uint64_t align, uint64_t arena_offset);
 	memory_arena_t& get_scratch();
 
@@ -43,10 +116,10 @@ namespace memory_arena
 	void wstring_copy(memory_arena_t& arena, const wstring_t& src, wstring_t& dst);
 	void wstring_copy_sub(memory_arena_t& arena, const wstring_t& src, uint32_t offset, uint32_t count, wstring_t& dst);
 
-#define ARENA_ALLOC(arena, size, align) memory_arena::alloc(arena, size, align)
-#define ARENA_ALLOC_ZERO(arena, size, align) memory_arena::alloc_zero(arena, size, align)
-#define ARENA_ALLOC_ARRAY(arena, type, count) (type *)memory_arena::alloc((arena), sizeof(type) * (count), alignof(type))
-#define ARENA_ALLOC_ARRAY_ZERO(arena, type, count) (type *)memory_arena::alloc_zero((arena), sizeof(type) * (count), alignof(type))
+#define ARENA_ALLOC(arena, size, align) memory_arena::alloc(arena, size, align, __FILE__, __LINE__)
+#define ARENA_ALLOC_ZERO(arena, size, align) memory_arena::alloc_zero(arena, size, align, __FILE__, __LINE__)
+#define ARENA_ALLOC_ARRAY(arena, type, count) (type *)memory_arena::alloc((arena), sizeof(type) * (count), alignof(type), __FILE__, __LINE__)
+#define ARENA_ALLOC_ARRAY_ZERO(arena, type, count) (type *)memory_arena::alloc_zero((arena), sizeof(type) * (count), alignof(type), __FILE__, __LINE__)
 #define ARENA_ALLOC_STRUCT(arena, type) ARENA_ALLOC_ARRAY(arena, type, 1)
 #define ARENA_ALLOC_STRUCT_ZERO(arena, type) ARENA_ALLOC_ARRAY_ZERO(arena, type, 1)
 
@@ -5,9 +5,15 @@
 namespace virtual_memory
 {
 
+	uint64_t get_page_size();
+	// Zero if the platform can not back committed memory with huge pages
+	uint64_t get_huge_page_size();
+
+	// Reservations of at least the huge page size start at an address aligned to the huge page size
 	void* reserve(uint64_t Size);
-	bool commit(void* Address, uint64_t Size);
+	// Huge pages are a hint, the parts of the range that cover entire huge pages get backed by them if the platform supports it
+	bool commit(void* Address, uint64_t Size, bool huge_pages = false);
 	void decommit(void* Address, uint64_t Size);
-	void release(void* Address);
+	void release(void* Address, uint64_t Size);
 
 }
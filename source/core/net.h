@@ -0,0 +1,28 @@
+#pragma once
+#include "core/common.h"
+#include "core/api_types.h"
+
+// Blocking TCP sockets, implementation is platform-specific
+namespace net
+{
+
+	// Needs to be called once before any of the other functions are used
+	bool init();
+	void exit();
+
+	// Listens on every interface if the bind address is null or empty, otherwise only on the given numeric IPv4 address
+	// The other side of a connection is not authenticated, so this should only be reachable from a trusted network
+	bool listen(const char* bind_address, uint16_t port, socket_t& out_socket);
+	// Waits at most timeout_ms for a connection that can be accepted without blocking, returns false on a timeout or an error
+	bool wait_for_connection(socket_t& listen_socket, uint32_t timeout_ms);
+	// Blocks until a new connection comes in
+	bool accept(socket_t& listen_socket, socket_t& out_socket);
+	// The host can be a name or a numeric IPv4 address
+	bool connect(const char* host, uint16_t port, socket_t& out_socket);
+	void close(socket_t& sock);
+
+	// Both block until all bytes are sent or received, and return false if the connection was closed or failed before that
+	bool send(socket_t& sock, const void* data, uint64_t size);
+	bool receive(socket_t& sock, void* dst, uint64_t size);
+
+}
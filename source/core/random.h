@@ -1,10 +1,12 @@
 #pragma once
 #include "core/common.h"
 
-namespace random
+namespace rng
 {
 
-	inline uint32_t s_seed = 0xC977E154;
+	// State of the xor-shift generator below, every thread has its own so that it can be used from the job system threads as well
+	// Anything that needs to be reproducible regardless of which thread draws the numbers should use the counter-based generator instead
+	inline thread_local uint32_t s_seed = 0xC977E154;
 
 	inline uint32_t wanghash(uint32_t Seed)
 	{
@@ -44,9 +46,49 @@ namespace random
 		return rand_uint32() * 2.3283064365387e-10f;
 	}
 
+	// Range 0..1
+	inline float rand_float(uint32_t& custom_seed)
+	{
+		return rand_uint32(custom_seed) * 2.3283064365387e-10f;
+	}
+
 	inline float rand_float_range(float min = 0.0f, float max = 1.0f)
 	{
 		return min + (float() * (max - min));
 	}
 
+	// Stateless counter-based generator, pcg4d from "Hash Functions for GPU Rendering" (Jarzynski and Olano 2020)
+	// The output only depends on the input counter, so any thread can draw any number without shared state, matches pcg4d in common.hlsl
+	inline glm::uvec4 pcg4d(glm::uvec4 v)
+	{
+		v = v * 1664525u + 1013904223u;
+
+		v.x += v.y * v.w;
+		v.y += v.z * v.x;
+		v.z += v.x * v.y;
+		v.w += v.y * v.z;
+
+		v = v ^ (v >> 16u);
+
+		v.x += v.y * v.w;
+		v.y += v.z * v.x;
+		v.z += v.x * v.y;
+		v.w += v.y * v.z;
+
+		return v;
+	}
+
+	// Four random numbers for one dimension of one sample of a pixel, every combination of pixel, sample and dimension gets its own uncorrelated stream
+	inline glm::uvec4 rand_counter_uint4(const glm::uvec2& pixel_pos, uint32_t sample_idx, uint32_t dimension)
+	{
+		return pcg4d(glm::uvec4(pixel_pos.x, pixel_pos.y, sample_idx, dimension));
+	}
+
+	// Range 0..1, only the upper 24 bits are used so that the result can never round up to one
+	inline glm::vec2 rand_counter_float2(const glm::uvec2& pixel_pos, uint32_t sample_idx, uint32_t dimension)
+	{
+		glm::uvec4 r = rand_counter_uint4(pixel_pos, sample_idx, dimension);
+		return glm::vec2(r.x >> 8u, r.y >> 8u) * 5.96046448e-8f;
+	}
+
 }
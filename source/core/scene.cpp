@@ -40,7 +40,7 @@ namespace scene
 		}
 	}
 
-	void create(scene_t& scene)
+	void create(scene_t& scene, const char* scene_path, const char* hdr_env_path)
 	{
 		// Scene objects
 		scene.scene_object_count = 16384;
@@ -51,10 +51,26 @@ namespace scene
 		camera::create(scene.camera, glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 10.0f, 1.0f), 60.0f);
 		camera_controller::create(scene.camera_controller, &scene.camera);
 
+		if (hdr_env_path && hdr_env_path[0] != '\0')
+		{
+			scene.hdr_env = asset_loader::load_texture(scene.arena, hdr_env_path);
+		}
+
+		if (scene_path && scene_path[0] != '\0')
+		{
+			if (!scene.hdr_env)
+				scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Country_Club.hdr");
+
+			scene.custom_scene_asset = asset_loader::load_scene(scene.arena, scene_path);
+			create_scene_objects_from_scene_asset(scene, *scene.custom_scene_asset, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+			return;
+		}
+
 #if SCENE_SPONZA
 		//scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Victorian_Hall.hdr");
 		//scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_St_Peters_Square_Night.hdr");
-		scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Country_Club.hdr");
+		if (!scene.hdr_env)
+			scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Country_Club.hdr");
 		scene.sponza_scene_asset = asset_loader::load_scene(scene.arena, "assets/scenes/sponza/Sponza.gltf");
 		create_scene_objects_from_scene_asset(scene, *scene.sponza_scene_asset, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
 #endif
@@ -62,13 +78,15 @@ namespace scene
 #if SCENE_SUN_TEMPLE
 		//scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Victorian_Hall.hdr");
 		//scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_St_Peters_Square_Night.hdr");
-		scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Country_Club.hdr");
+		if (!scene.hdr_env)
+			scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/textures/HDR_Env_Country_Club.hdr");
 		scene.sun_temple_scene_asset = asset_loader::load_scene(scene.arena, "assets/scenes/sun_temple/SunTemple.fbx");
 		create_scene_objects_from_scene_asset(scene, *scene.sun_temple_scene_asset, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
 #endif
 
 #if SCENE_BISTRO
-		scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/scenes/bistro/san_giuseppe_bridge_4k.hdr");
+		if (!scene.hdr_env)
+			scene.hdr_env = asset_loader::load_texture(scene.arena, "assets/scenes/bistro/san_giuseppe_bridge_4k.hdr");
 		
 		scene.bistro_exterior_scene_asset = asset_loader::load_scene(scene.arena, "assets/scenes/bistro/BistroExterior.fbx");
 		create_scene_objects_from_scene_asset(scene, *scene.bistro_exterior_scene_asset, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
@@ -104,7 +122,7 @@ namespace scene
 		renderer::end_scene();
 	}
 
-	void render_ui(scene_t& scene)
+	void render_ui([[maybe_unused]] scene_t& scene)
 	{
 	}
 
@@ -29,6 +29,7 @@ struct scene_t
 	scene_asset_t* bistro_interior_scene_asset;
 	scene_asset_t* bistro_wine_scene_asset;
 	scene_asset_t* sun_temple_scene_asset;
+	scene_asset_t* custom_scene_asset;
 
 	camera_t camera;
 
@@ -41,7 +42,8 @@ struct scene_t
 namespace scene
 {
 
-	void create(scene_t& scene);
+	// The scene and HDR environment paths are optional, and replace the scene and environment that are selected at compile time
+	void create(scene_t& scene, const char* scene_path = nullptr, const char* hdr_env_path = nullptr);
 	void destroy(scene_t& scene);
 
 	void update(scene_t& scene, float dt);
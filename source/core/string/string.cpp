@@ -2,6 +2,8 @@
 #include "core/memory/memory_arena.h"
 #include "core/assertion.h"
 
+#include <cwchar>
+
 namespace string
 {
 
@@ -6,7 +6,7 @@
 #define STRING_EXPAND(str) (int32_t)(str).count, (str).buf
 
 #define STRING_LITERAL(str) string_t{ .buf = (char*)str, .count = sizeof(str) - 1 }
-#define WSTRING_LITERAL(wstr) wstring_t{ .buf = (wchar_t*)wstr, .count = (sizeof(wstr) / 2) - 1 }
+#define WSTRING_LITERAL(wstr) wstring_t{ .buf = (wchar_t*)wstr, .count = (sizeof(wstr) / sizeof(wchar_t)) - 1 }
 
 struct memory_arena_t;
 
@@ -5,7 +5,12 @@
 namespace thread
 {
 
-	//thread_t create();
+	using thread_proc_t = void(*)(void* user_data);
+
+	// Starts a new thread that runs proc(user_data), the thread needs to be joined before user_data goes out of scope
+	thread_t create(thread_proc_t proc, void* user_data);
+	void join(thread_t& thread);
+	uint32_t get_hardware_thread_count();
 
 	bool wait_on_address(volatile void* address, void* compare_address, size_t address_size);
 	void wake_on_address(void* address);
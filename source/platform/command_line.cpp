@@ -0,0 +1,212 @@
+#include "platform/platform.h"
+
+#include "core/logger.h"
+#include "core/assertion.h"
+#include "core/string/string.h"
+#include "core/memory/memory_arena.h"
+
+#include <cstdlib>
+#include <cwchar>
+
+// The command line is parsed the same way on every platform, only the entrypoint that passes it in is platform-specific
+namespace platform
+{
+
+	static void parse_next_command_arg(string_t& cmd_line_cur, string_t& arg_str, string_t& param_str)
+	{
+		uint32_t arg_begin = string::find_char(cmd_line_cur, '-');
+		uint32_t arg_end = string::find_char(cmd_line_cur, ' ');
+		if (arg_end == STRING_NPOS || arg_begin >= arg_end)
+			FATAL_ERROR("CommandLine", "Malformed command line arguments found: %s", cmd_line_cur);
+
+		arg_str = string::make_view(cmd_line_cur, arg_begin, arg_end - arg_begin);
+		cmd_line_cur = string::make_view(cmd_line_cur, arg_end + 1, cmd_line_cur.count - arg_end - 1);
+
+		uint32_t param_begin = 0;
+		uint32_t param_end = string::find_char(cmd_line_cur, ' ');
+		if (param_end == STRING_NPOS)
+			param_end = cmd_line_cur.count;
+
+		if (param_begin >= param_end)
+			FATAL_ERROR("CommandLine", "Malformed command line arguments found: %s", cmd_line_cur);
+
+		param_str = string::make_view(cmd_line_cur, param_begin, param_end - param_begin);
+		cmd_line_cur = string::make_view(cmd_line_cur, param_end + 1, cmd_line_cur.count - param_end - 1);
+	}
+
+	// The parameter views point into the command line, which only lives for as long as the arguments are being parsed
+	static void copy_cmd_line_param(const string_t& param_str, char* dst, uint32_t dst_size)
+	{
+		if (param_str.count >= dst_size)
+			FATAL_ERROR("CommandLine", "Command line parameter is too long: %.*s", (int32_t)param_str.count, param_str.buf);
+
+		memcpy(dst, param_str.buf, param_str.count);
+		dst[param_str.count] = '\0';
+	}
+
+	// Parses a vector in the form of x,y,z
+	static glm::vec3 parse_cmd_line_vec3(const string_t& param_str)
+	{
+		glm::vec3 result = glm::vec3(0.0f);
+		char* param_ptr = param_str.buf;
+		char* param_end_ptr = param_str.buf + param_str.count;
+
+		for (uint32_t i = 0; i < 3 && param_ptr < param_end_ptr; ++i)
+		{
+			result[i] = strtof(param_ptr, &param_ptr);
+			if (param_ptr < param_end_ptr && *param_ptr == ',')
+				++param_ptr;
+		}
+
+		return result;
+	}
+
+	// Parses an address in the form of host:port
+	static void parse_cmd_line_address(const string_t& param_str, char* dst_host, uint32_t dst_host_size, uint16_t& out_port)
+	{
+		uint32_t colon_idx = string::find_char(param_str, ':');
+		if (colon_idx == STRING_NPOS)
+			FATAL_ERROR("CommandLine", "Expected an address in the form of host:port: %.*s", STRING_EXPAND(param_str));
+
+		copy_cmd_line_param(string::make_view(param_str, 0, colon_idx), dst_host, dst_host_size);
+		char* port_end_ptr = param_str.buf + param_str.count;
+		out_port = (uint16_t)strtoul(param_str.buf + colon_idx + 1, &port_end_ptr, 10);
+	}
+
+	static void parse_cmd_line_args(const string_t& cmd_line, command_line_args_t& parsed_args)
+	{
+		if (cmd_line.count == 0)
+			return;
+
+		string_t cmd_line_cur = cmd_line;
+		while (cmd_line_cur.count > 0)
+		{
+			string_t arg_str, param_str;
+			parse_next_command_arg(cmd_line_cur, arg_str, param_str);
+			char* param_end_ptr = param_str.buf + param_str.count;
+
+			if (string::compare(arg_str, STRING_LITERAL("--width")))
+			{
+				parsed_args.window_width = strtol(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--height")))
+			{
+				parsed_args.window_height = strtol(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--scene")))
+			{
+				copy_cmd_line_param(param_str, parsed_args.scene_path, ARRAY_SIZE(parsed_args.scene_path));
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--env")))
+			{
+				copy_cmd_line_param(param_str, parsed_args.hdr_env_path, ARRAY_SIZE(parsed_args.hdr_env_path));
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--batch")))
+			{
+				parsed_args.batch = true;
+				copy_cmd_line_param(param_str, parsed_args.batch_output_path, ARRAY_SIZE(parsed_args.batch_output_path));
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--spp")))
+			{
+				parsed_args.batch_sample_count = strtoul(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--time")))
+			{
+				parsed_args.batch_time_budget = strtof(param_str.buf, &param_end_ptr);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--denoise")))
+			{
+				parsed_args.batch_denoise = strtol(param_str.buf, &param_end_ptr, 10) != 0;
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--output")))
+			{
+				copy_cmd_line_param(param_str, parsed_args.batch_output_path, ARRAY_SIZE(parsed_args.batch_output_path));
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--coordinator")))
+			{
+				parsed_args.coordinator = true;
+				parsed_args.coordinator_port = (uint16_t)strtoul(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--bind")))
+			{
+				copy_cmd_line_param(param_str, parsed_args.coordinator_bind_address, ARRAY_SIZE(parsed_args.coordinator_bind_address));
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--workers")))
+			{
+				parsed_args.coordinator_worker_count = strtoul(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--accept-timeout")))
+			{
+				parsed_args.coordinator_accept_timeout = strtof(param_str.buf, &param_end_ptr);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--job-spp")))
+			{
+				parsed_args.coordinator_job_sample_count = strtoul(param_str.buf, &param_end_ptr, 10);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--worker")))
+			{
+				parsed_args.worker = true;
+				parse_cmd_line_address(param_str, parsed_args.worker_host, ARRAY_SIZE(parsed_args.worker_host), parsed_args.worker_port);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--camera-pos")))
+			{
+				parsed_args.camera_override = true;
+				parsed_args.camera_pos = parse_cmd_line_vec3(param_str);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--camera-target")))
+			{
+				parsed_args.camera_override = true;
+				parsed_args.camera_target = parse_cmd_line_vec3(param_str);
+			}
+			else if (string::compare(arg_str, STRING_LITERAL("--fov")))
+			{
+				parsed_args.camera_override = true;
+				parsed_args.camera_vfov_deg = strtof(param_str.buf, &param_end_ptr);
+			}
+			else
+			{
+				LOG_WARN("Command Line", "Unknown command line argument: %.*s", (int32_t)arg_str.count, arg_str.buf);
+			}
+		}
+	}
+
+	static command_line_args_t get_default_cmd_line_args()
+	{
+		command_line_args_t default_args = {};
+		default_args.window_width = 1920;
+		default_args.window_height = 1080;
+		default_args.batch_sample_count = 64;
+		default_args.coordinator_worker_count = 1;
+		default_args.coordinator_accept_timeout = 60.0f;
+		default_args.coordinator_job_sample_count = 8;
+		// Same as the default scene camera
+		default_args.camera_pos = glm::vec3(0.0f, 10.0f, 0.0f);
+		default_args.camera_target = glm::vec3(0.0f, 10.0f, 1.0f);
+		default_args.camera_vfov_deg = 60.0f;
+
+		return default_args;
+	}
+
+	command_line_args_t parse_command_line_args(memory_arena_t& arena, const wchar_t* cmd_line_ptr)
+	{
+		// Parse command line arguments
+		command_line_args_t parsed_args = platform::get_default_cmd_line_args();
+
+		ARENA_MEMORY_SCOPE(arena)
+		{
+			if (wcslen(cmd_line_ptr))
+			{
+				string_t cmd_line = ARENA_WIDE_TO_CHAR(arena, cmd_line_ptr);
+				LOG_INFO("Command Line", "Passed arguments: %s", cmd_line.buf);
+				platform::parse_cmd_line_args(cmd_line, parsed_args);
+			}
+			else
+			{
+				LOG_INFO("Command Line", "No command line arguments passed");
+			}
+		}
+
+		return parsed_args;
+	}
+
+}
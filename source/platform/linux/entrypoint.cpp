@@ -0,0 +1,44 @@
+#include "core/memory/memory_arena.h"
+#include "platform/platform.h"
+#include "core/application.h"
+
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	memory_arena_t arena = {};
+
+	// The command line parser takes the arguments as a single string like wWinMain receives them, so the arguments get joined back together
+	// Arguments that contain spaces would be split up again, which the parser does not support on windows either
+	uint64_t cmd_line_length = 0;
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		cmd_line_length += strlen(argv[i]) + 1;
+	}
+
+	char* cmd_line = ARENA_ALLOC_ARRAY_ZERO(arena, char, cmd_line_length + 1);
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		if (i > 1)
+			strcat(cmd_line, " ");
+		strcat(cmd_line, argv[i]);
+	}
+
+	// Allocated with room for the null terminator, which char_to_wide leaves out
+	wchar_t* cmd_line_wide = ARENA_ALLOC_ARRAY_ZERO(arena, wchar_t, cmd_line_length + 1);
+	mbstowcs(cmd_line_wide, cmd_line, cmd_line_length);
+	command_line_args_t parsed_args = platform::parse_command_line_args(arena, cmd_line_wide);
+	platform::init();
+
+	while (!application::should_close())
+	{
+		application::init(arena, parsed_args);
+		application::run();
+		application::exit();
+	}
+
+	platform::exit();
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "core/input.h"
+
+namespace input
+{
+
+	// There is no window to receive input from on linux, only batch rendering and distributed rendering are supported
+	// Everything reports as released and unmoved, so the camera controller never moves the camera
+	static bool s_capturing_mouse = false;
+	static bool s_window_focused = false;
+
+	void on_platform_key_button_state_changed([[maybe_unused]] uint64_t platformcode, [[maybe_unused]] bool pressed)
+	{
+	}
+
+	void on_mousewheel_scrolled([[maybe_unused]] float wheel_delta)
+	{
+	}
+
+	void update_mouse_pos()
+	{
+	}
+
+	bool is_key_pressed([[maybe_unused]] KEYCODE keycode)
+	{
+		return false;
+	}
+
+	float get_axis_1d([[maybe_unused]] KEYCODE axis_pos, [[maybe_unused]] KEYCODE axis_neg)
+	{
+		return 0.0f;
+	}
+
+	float get_mouse_relx()
+	{
+		return 0.0f;
+	}
+
+	float get_mouse_rely()
+	{
+		return 0.0f;
+	}
+
+	float get_mouse_scroll_rely()
+	{
+		return 0.0f;
+	}
+
+	void set_mouse_capture(bool capture)
+	{
+		s_capturing_mouse = capture;
+	}
+
+	bool is_mouse_captured()
+	{
+		return s_capturing_mouse;
+	}
+
+	void set_window_focus(bool focus)
+	{
+		s_window_focused = focus;
+	}
+
+	bool is_window_focused()
+	{
+		return s_window_focused;
+	}
+
+	void reset()
+	{
+	}
+
+}
@@ -0,0 +1,193 @@
+#include "core/net.h"
+#include "core/logger.h"
+
+#include <cstdio>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace net
+{
+
+	static int32_t to_posix_socket(const socket_t& sock)
+	{
+		return (int32_t)sock.handle;
+	}
+
+	static void set_no_delay(int32_t fd)
+	{
+		// The messages are written with a header and a payload in separate sends, which should not wait on each other
+		int32_t no_delay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	}
+
+	bool init()
+	{
+		return true;
+	}
+
+	void exit()
+	{
+	}
+
+	bool listen(const char* bind_address, uint16_t port, socket_t& out_socket)
+	{
+		int32_t listen_fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_fd < 0)
+		{
+			LOG_ERR("Net", "Failed to create listen socket, error %d", errno);
+			return false;
+		}
+
+		// Allows the coordinator to be restarted right away on the same port
+		int32_t reuse_addr = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr));
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (bind_address && bind_address[0] != '\0' && inet_pton(AF_INET, bind_address, &addr.sin_addr) != 1)
+		{
+			LOG_ERR("Net", "Invalid bind address %s, expected a numeric IPv4 address", bind_address);
+			::close(listen_fd);
+			return false;
+		}
+
+		if (::bind(listen_fd, (const sockaddr*)&addr, sizeof(addr)) < 0 ||
+			::listen(listen_fd, SOMAXCONN) < 0)
+		{
+			LOG_ERR("Net", "Failed to listen on port %u, error %d", port, errno);
+			::close(listen_fd);
+			return false;
+		}
+
+		out_socket.handle = (uint64_t)listen_fd;
+		return true;
+	}
+
+	bool wait_for_connection(socket_t& listen_socket, uint32_t timeout_ms)
+	{
+		pollfd poll_fd = {};
+		poll_fd.fd = to_posix_socket(listen_socket);
+		poll_fd.events = POLLIN;
+
+		int32_t result = ::poll(&poll_fd, 1, (int32_t)timeout_ms);
+		if (result < 0 && errno != EINTR)
+		{
+			LOG_ERR("Net", "Failed to wait for a connection, error %d", errno);
+		}
+
+		return result > 0 && (poll_fd.revents & POLLIN);
+	}
+
+	bool accept(socket_t& listen_socket, socket_t& out_socket)
+	{
+		int32_t accepted = -1;
+		do
+		{
+			accepted = ::accept(to_posix_socket(listen_socket), nullptr, nullptr);
+		} while (accepted < 0 && errno == EINTR);
+
+		if (accepted < 0)
+		{
+			LOG_ERR("Net", "Failed to accept connection, error %d", errno);
+			return false;
+		}
+
+		set_no_delay(accepted);
+		out_socket.handle = (uint64_t)accepted;
+		return true;
+	}
+
+	bool connect(const char* host, uint16_t port, socket_t& out_socket)
+	{
+		addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		char port_str[8] = {};
+		snprintf(port_str, sizeof(port_str), "%u", port);
+
+		addrinfo* addr_list = nullptr;
+		int32_t result = getaddrinfo(host, port_str, &hints, &addr_list);
+		if (result != 0)
+		{
+			LOG_ERR("Net", "Failed to resolve %s:%u, %s", host, port, gai_strerror(result));
+			return false;
+		}
+
+		int32_t connected = -1;
+		for (addrinfo* addr = addr_list; addr && connected < 0; addr = addr->ai_next)
+		{
+			connected = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+			if (connected >= 0 && ::connect(connected, addr->ai_addr, addr->ai_addrlen) < 0)
+			{
+				::close(connected);
+				connected = -1;
+			}
+		}
+		freeaddrinfo(addr_list);
+
+		if (connected < 0)
+		{
+			LOG_ERR("Net", "Failed to connect to %s:%u, error %d", host, port, errno);
+			return false;
+		}
+
+		set_no_delay(connected);
+		out_socket.handle = (uint64_t)connected;
+		return true;
+	}
+
+	void close(socket_t& sock)
+	{
+		::close(to_posix_socket(sock));
+		sock.handle = UINT64_MAX;
+	}
+
+	bool send(socket_t& sock, const void* data, uint64_t size)
+	{
+		const uint8_t* ptr = (const uint8_t*)data;
+		while (size > 0)
+		{
+			// A worker that went away should fail the send instead of raising SIGPIPE
+			ssize_t sent = ::send(to_posix_socket(sock), ptr, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				return false;
+
+			ptr += sent;
+			size -= sent;
+		}
+
+		return true;
+	}
+
+	bool receive(socket_t& sock, void* dst, uint64_t size)
+	{
+		uint8_t* ptr = (uint8_t*)dst;
+		while (size > 0)
+		{
+			ssize_t received = ::recv(to_posix_socket(sock), ptr, size, 0);
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received <= 0)
+				return false;
+
+			ptr += received;
+			size -= received;
+		}
+
+		return true;
+	}
+
+}
@@ -0,0 +1,99 @@
+#include "platform/platform.h"
+
+#include "core/logger.h"
+#include "core/assertion.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace platform
+{
+
+	// There is no window system on linux, the window only keeps track of the render size for batch and distributed rendering
+	static int32_t s_window_width = 0;
+	static int32_t s_window_height = 0;
+
+	void init()
+	{
+	}
+
+	void exit()
+	{
+	}
+
+	timer_ticks_t get_ticks()
+	{
+		// CLOCK_MONOTONIC ticks are reported in nanoseconds, so there is no frequency to query like QueryPerformanceFrequency on windows
+		timespec time = {};
+		if (clock_gettime(CLOCK_MONOTONIC, &time) != 0)
+		{
+			FATAL_ERROR("Platform", "Failed call to clock_gettime");
+		}
+
+		return timer_ticks_t{ (int64_t)time.tv_sec * 1000000000ll + (int64_t)time.tv_nsec };
+	}
+
+	double get_elapsed_seconds(timer_ticks_t begin, timer_ticks_t end)
+	{
+		ASSERT(begin.val <= end.val);
+		return (double)(end.val - begin.val) / 1000000000.0;
+	}
+
+	void fatal_error([[maybe_unused]] int32_t line, const char* error_msg)
+	{
+		fprintf(stderr, "Fatal Error: %s\n", error_msg);
+		fflush(stderr);
+		abort();
+	}
+
+	bool show_message_box(const char* title, const char* message)
+	{
+		// There is no message box without a window system, and nobody to press retry either
+		fprintf(stderr, "%s: %s\n", title, message);
+		return false;
+	}
+
+	void debug_break()
+	{
+		raise(SIGTRAP);
+	}
+
+	void window_create(int32_t desired_width, int32_t desired_height, bool visible)
+	{
+		if (visible)
+		{
+			FATAL_ERROR("Platform", "Interactive mode is not supported on linux, use --batch, --worker or --coordinator");
+		}
+
+		s_window_width = desired_width;
+		s_window_height = desired_height;
+	}
+
+	void window_get_client_area(int32_t& out_window_width, int32_t& out_window_height)
+	{
+		out_window_width = s_window_width;
+		out_window_height = s_window_height;
+	}
+
+	void window_set_capture_mouse([[maybe_unused]] bool capture)
+	{
+	}
+
+	bool window_poll_events()
+	{
+		return true;
+	}
+
+	void window_reset_mouse_to_center()
+	{
+	}
+
+	void window_get_center(int32_t& out_centerX, int32_t& out_centerY)
+	{
+		out_centerX = s_window_width / 2;
+		out_centerY = s_window_height / 2;
+	}
+
+}
@@ -0,0 +1,168 @@
+#include "core/thread.h"
+#include "core/assertion.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+namespace thread
+{
+
+	// Mutexes and condition variables are zero initialized like SRWLOCK and CONDITION_VARIABLE on windows,
+	// so they are implemented directly on a futex word that lives inside of the pointer sized handle
+	static_assert(sizeof(uint32_t) <= sizeof(mutex_t) && sizeof(uint32_t) <= sizeof(cond_var_t));
+
+	static long futex_wait(volatile uint32_t* address, uint32_t expected)
+	{
+		return syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+	}
+
+	static long futex_wake(volatile uint32_t* address, int32_t count)
+	{
+		return syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+	}
+
+	struct thread_start_params_t
+	{
+		thread_proc_t proc;
+		void* user_data;
+	};
+
+	static void* thread_proc_linux(void* params)
+	{
+		// The start parameters are owned by the new thread, since the creating thread might return before this thread starts running
+		thread_start_params_t start_params = *(thread_start_params_t*)params;
+		::free(params);
+
+		start_params.proc(start_params.user_data);
+		return nullptr;
+	}
+
+	thread_t create(thread_proc_t proc, void* user_data)
+	{
+		thread_start_params_t* start_params = (thread_start_params_t*)malloc(sizeof(thread_start_params_t));
+		start_params->proc = proc;
+		start_params->user_data = user_data;
+
+		static_assert(sizeof(pthread_t) <= sizeof(thread_t));
+		pthread_t thread_linux = {};
+		int32_t result = pthread_create(&thread_linux, nullptr, thread_proc_linux, start_params);
+		ASSERT_MSG(result == 0, "Failed to create thread");
+
+		thread_t thread = {};
+		thread.ptr = (void*)thread_linux;
+
+		return thread;
+	}
+
+	void join(thread_t& thread)
+	{
+		pthread_join((pthread_t)thread.ptr, nullptr);
+		thread.ptr = nullptr;
+	}
+
+	uint32_t get_hardware_thread_count()
+	{
+		return (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	bool wait_on_address(volatile void* address, void* compare_address, size_t address_size)
+	{
+		// Futexes only operate on 32-bit words, unlike WaitOnAddress which also takes 8, 16 and 64-bit values
+		ASSERT_MSG(address_size == sizeof(uint32_t), "Waiting on an address is only supported for 32-bit values on linux");
+
+		long result = futex_wait((volatile uint32_t*)address, *(uint32_t*)compare_address);
+		return result == 0 || errno == EAGAIN;
+	}
+
+	void wake_on_address(void* address)
+	{
+		futex_wake((volatile uint32_t*)address, 1);
+	}
+
+	void wake_on_address_all(void* address)
+	{
+		futex_wake((volatile uint32_t*)address, INT32_MAX);
+	}
+
+	namespace mutex
+	{
+
+		// The futex word is 0 when unlocked, 1 when locked, and 2 when locked while other threads might be waiting
+		enum mutex_state : uint32_t
+		{
+			MUTEX_STATE_UNLOCKED,
+			MUTEX_STATE_LOCKED,
+			MUTEX_STATE_CONTENDED
+		};
+
+		void lock(mutex_t& mutex)
+		{
+			uint32_t* mutex_linux = (uint32_t*)&mutex;
+
+			uint32_t state = MUTEX_STATE_UNLOCKED;
+			if (__atomic_compare_exchange_n(mutex_linux, &state, MUTEX_STATE_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return;
+
+			if (state != MUTEX_STATE_CONTENDED)
+				state = __atomic_exchange_n(mutex_linux, MUTEX_STATE_CONTENDED, __ATOMIC_ACQUIRE);
+
+			while (state != MUTEX_STATE_UNLOCKED)
+			{
+				futex_wait(mutex_linux, MUTEX_STATE_CONTENDED);
+				state = __atomic_exchange_n(mutex_linux, MUTEX_STATE_CONTENDED, __ATOMIC_ACQUIRE);
+			}
+		}
+
+		bool try_lock(mutex_t& mutex)
+		{
+			uint32_t* mutex_linux = (uint32_t*)&mutex;
+
+			uint32_t state = MUTEX_STATE_UNLOCKED;
+			return __atomic_compare_exchange_n(mutex_linux, &state, MUTEX_STATE_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+		}
+
+		void unlock(mutex_t& mutex)
+		{
+			uint32_t* mutex_linux = (uint32_t*)&mutex;
+
+			if (__atomic_exchange_n(mutex_linux, MUTEX_STATE_UNLOCKED, __ATOMIC_RELEASE) == MUTEX_STATE_CONTENDED)
+				futex_wake(mutex_linux, 1);
+		}
+
+	}
+
+	namespace cond_var
+	{
+
+		// The futex word is a sequence number that changes on every wake, so a wake that happens between unlocking the mutex and going to sleep is not lost
+		void sleep(cond_var_t& cond_var, mutex_t& mutex)
+		{
+			uint32_t* cond_var_linux = (uint32_t*)&cond_var;
+			uint32_t sequence = __atomic_load_n(cond_var_linux, __ATOMIC_RELAXED);
+
+			mutex::unlock(mutex);
+			futex_wait(cond_var_linux, sequence);
+			mutex::lock(mutex);
+		}
+
+		void wake_one(cond_var_t& cond_var, [[maybe_unused]] mutex_t& mutex)
+		{
+			uint32_t* cond_var_linux = (uint32_t*)&cond_var;
+			__atomic_fetch_add(cond_var_linux, 1, __ATOMIC_RELEASE);
+			futex_wake(cond_var_linux, 1);
+		}
+
+		void wake_all(cond_var_t& cond_var, [[maybe_unused]] mutex_t& mutex)
+		{
+			uint32_t* cond_var_linux = (uint32_t*)&cond_var;
+			__atomic_fetch_add(cond_var_linux, 1, __ATOMIC_RELEASE);
+			futex_wake(cond_var_linux, INT32_MAX);
+		}
+
+	}
+
+}
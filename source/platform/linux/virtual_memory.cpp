@@ -0,0 +1,105 @@
+#include "core/memory/virtual_memory.h"
+#include "core/assertion.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace virtual_memory
+{
+
+	static uint64_t query_huge_page_size()
+	{
+		// Transparent huge pages can be turned off entirely, in which case madvise does nothing
+		FILE* enabled_file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+		if (!enabled_file)
+			return 0;
+
+		char enabled[64] = {};
+		bool thp_enabled = fgets(enabled, sizeof(enabled), enabled_file) && !strstr(enabled, "[never]");
+		fclose(enabled_file);
+
+		if (!thp_enabled)
+			return 0;
+
+		uint64_t huge_page_size = MB(2ull);
+		FILE* size_file = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+		if (size_file)
+		{
+			unsigned long long pmd_size = 0;
+			if (fscanf(size_file, "%llu", &pmd_size) == 1 && IS_POW2(pmd_size))
+				huge_page_size = pmd_size;
+			fclose(size_file);
+		}
+
+		return huge_page_size;
+	}
+
+	uint64_t get_page_size()
+	{
+		static const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+		return page_size;
+	}
+
+	uint64_t get_huge_page_size()
+	{
+		static const uint64_t huge_page_size = query_huge_page_size();
+		return huge_page_size;
+	}
+
+	void* reserve(uint64_t size)
+	{
+		// The kernel only uses huge pages for ranges that are aligned to the huge page size, so the reservation is padded and the excess is unmapped again
+		uint64_t alignment = get_huge_page_size();
+		if (alignment == 0 || size < alignment)
+			alignment = get_page_size();
+
+		// NORESERVE keeps reservations that are much larger than the available memory from counting against the overcommit limit
+		uint64_t padded_size = size + alignment - get_page_size();
+		void* mapped = mmap(nullptr, padded_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		ASSERT(mapped != MAP_FAILED);
+
+		uint8_t* mapped_begin = (uint8_t*)mapped;
+		uint8_t* reserved = (uint8_t*)ALIGN_UP_POW2(mapped_begin, alignment);
+		uint8_t* mapped_end = mapped_begin + padded_size;
+
+		if (reserved > mapped_begin)
+			munmap(mapped_begin, reserved - mapped_begin);
+		if (mapped_end > reserved + size)
+			munmap(reserved + size, mapped_end - (reserved + size));
+
+		return reserved;
+	}
+
+	bool commit(void* address, uint64_t size, bool huge_pages)
+	{
+		int32_t status = mprotect(address, size, PROT_READ | PROT_WRITE);
+		ASSERT(status == 0);
+
+		if (status == 0 && huge_pages && get_huge_page_size() > 0)
+		{
+			// Only a hint, the kernel might still back the range with regular pages if it is low on contiguous memory
+			madvise(address, size, MADV_HUGEPAGE);
+		}
+
+		return status == 0;
+	}
+
+	void decommit(void* address, uint64_t size)
+	{
+		// Gives the physical pages back right away, and makes the range inaccessible again like a decommit on Windows
+		int32_t status = madvise(address, size, MADV_DONTNEED);
+		ASSERT(status == 0);
+
+		status = mprotect(address, size, PROT_NONE);
+		ASSERT(status == 0);
+	}
+
+	void release(void* address, uint64_t size)
+	{
+		int32_t status = munmap(address, size);
+		ASSERT(status == 0);
+	}
+
+}
@@ -12,15 +12,16 @@ namespace platform
     void init();
     void exit();
     
-    void window_create(int32_t desired_width, int32_t desired_height);
+    // Hidden windows are used for batch rendering, and are created at exactly the desired size
+    void window_create(int32_t desired_width, int32_t desired_height, bool visible = true);
     void window_get_client_area(int32_t& out_window_width, int32_t& out_window_height);
     void window_set_capture_mouse(bool capture);
     bool window_poll_events();
     void window_reset_mouse_to_center();
     void window_get_center(int32_t& out_centerX, int32_t& out_centerY);
 
-    timer_t get_ticks();
-    double get_elapsed_seconds(timer_t begin, timer_t end);
+    timer_ticks_t get_ticks();
+    double get_elapsed_seconds(timer_ticks_t begin, timer_ticks_t end);
 
     void fatal_error(int32_t line, const char* error_msg);
     bool show_message_box(const char* title, const char* message);
@@ -0,0 +1,181 @@
+#include "core/net.h"
+#include "core/logger.h"
+
+// Winsock needs to be included before Windows.h, otherwise Windows.h pulls in the old Winsock headers
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+namespace net
+{
+
+	static SOCKET to_win32_socket(const socket_t& sock)
+	{
+		return (SOCKET)sock.handle;
+	}
+
+	bool init()
+	{
+		WSADATA wsa_data = {};
+		int32_t result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+		if (result != 0)
+		{
+			LOG_ERR("Net", "WSAStartup failed with error %d", result);
+			return false;
+		}
+
+		return true;
+	}
+
+	void exit()
+	{
+		WSACleanup();
+	}
+
+	bool listen(const char* bind_address, uint16_t port, socket_t& out_socket)
+	{
+		SOCKET listen_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket == INVALID_SOCKET)
+		{
+			LOG_ERR("Net", "Failed to create listen socket, error %d", WSAGetLastError());
+			return false;
+		}
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (bind_address && bind_address[0] != '\0' && inet_pton(AF_INET, bind_address, &addr.sin_addr) != 1)
+		{
+			LOG_ERR("Net", "Invalid bind address %s, expected a numeric IPv4 address", bind_address);
+			closesocket(listen_socket);
+			return false;
+		}
+
+		if (::bind(listen_socket, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+			::listen(listen_socket, SOMAXCONN) == SOCKET_ERROR)
+		{
+			LOG_ERR("Net", "Failed to listen on port %u, error %d", port, WSAGetLastError());
+			closesocket(listen_socket);
+			return false;
+		}
+
+		out_socket.handle = (uint64_t)listen_socket;
+		return true;
+	}
+
+	bool wait_for_connection(socket_t& listen_socket, uint32_t timeout_ms)
+	{
+		// Incoming connections on a listen socket are reported as normal data
+		WSAPOLLFD poll_fd = {};
+		poll_fd.fd = to_win32_socket(listen_socket);
+		poll_fd.events = POLLRDNORM;
+
+		int32_t result = WSAPoll(&poll_fd, 1, (INT)timeout_ms);
+		if (result == SOCKET_ERROR)
+		{
+			LOG_ERR("Net", "Failed to wait for a connection, error %d", WSAGetLastError());
+		}
+
+		return result > 0 && (poll_fd.revents & POLLRDNORM);
+	}
+
+	bool accept(socket_t& listen_socket, socket_t& out_socket)
+	{
+		SOCKET accepted = ::accept(to_win32_socket(listen_socket), nullptr, nullptr);
+		if (accepted == INVALID_SOCKET)
+		{
+			LOG_ERR("Net", "Failed to accept connection, error %d", WSAGetLastError());
+			return false;
+		}
+
+		// The messages are written with a header and a payload in separate sends, which should not wait on each other
+		BOOL no_delay = TRUE;
+		setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+		out_socket.handle = (uint64_t)accepted;
+		return true;
+	}
+
+	bool connect(const char* host, uint16_t port, socket_t& out_socket)
+	{
+		addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		char port_str[8] = {};
+		snprintf(port_str, sizeof(port_str), "%u", port);
+
+		addrinfo* addr_list = nullptr;
+		if (getaddrinfo(host, port_str, &hints, &addr_list) != 0)
+		{
+			LOG_ERR("Net", "Failed to resolve %s:%u, error %d", host, port, WSAGetLastError());
+			return false;
+		}
+
+		SOCKET connected = INVALID_SOCKET;
+		for (addrinfo* addr = addr_list; addr && connected == INVALID_SOCKET; addr = addr->ai_next)
+		{
+			connected = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+			if (connected != INVALID_SOCKET && ::connect(connected, addr->ai_addr, (int32_t)addr->ai_addrlen) == SOCKET_ERROR)
+			{
+				closesocket(connected);
+				connected = INVALID_SOCKET;
+			}
+		}
+		freeaddrinfo(addr_list);
+
+		if (connected == INVALID_SOCKET)
+		{
+			LOG_ERR("Net", "Failed to connect to %s:%u, error %d", host, port, WSAGetLastError());
+			return false;
+		}
+
+		BOOL no_delay = TRUE;
+		setsockopt(connected, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+		out_socket.handle = (uint64_t)connected;
+		return true;
+	}
+
+	void close(socket_t& sock)
+	{
+		closesocket(to_win32_socket(sock));
+		sock.handle = (uint64_t)INVALID_SOCKET;
+	}
+
+	bool send(socket_t& sock, const void* data, uint64_t size)
+	{
+		const char* ptr = (const char*)data;
+		while (size > 0)
+		{
+			int32_t sent = ::send(to_win32_socket(sock), ptr, (int32_t)MIN(size, (uint64_t)INT32_MAX), 0);
+			if (sent <= 0)
+				return false;
+
+			ptr += sent;
+			size -= sent;
+		}
+
+		return true;
+	}
+
+	bool receive(socket_t& sock, void* dst, uint64_t size)
+	{
+		char* ptr = (char*)dst;
+		while (size > 0)
+		{
+			int32_t received = ::recv(to_win32_socket(sock), ptr, (int32_t)MIN(size, (uint64_t)INT32_MAX), 0);
+			if (received <= 0)
+				return false;
+
+			ptr += received;
+			size -= received;
+		}
+
+		return true;
+	}
+
+}
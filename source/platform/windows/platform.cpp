@@ -209,7 +209,7 @@ namespace platform
 		return true;
 	}
 
-	timer_t get_ticks()
+	timer_ticks_t get_ticks()
 	{
 		LARGE_INTEGER counter = {};
 		if (!QueryPerformanceCounter(&counter))
@@ -217,22 +217,23 @@ namespace platform
 			FATAL_ERROR("Platform", "Failed call to QueryPerformanceCounter");
 		}
 
-		return timer_t{ counter.QuadPart };
+		return timer_ticks_t{ counter.QuadPart };
 	}
 
-	double get_elapsed_seconds(timer_t begin, timer_t end)
+	double get_elapsed_seconds(timer_ticks_t begin, timer_ticks_t end)
 	{
 		ASSERT(begin.val <= end.val);
 		return (double)(end.val - begin.val) / (double)internal.perf_freq;
 	}
 
-	void window_create(int32_t desired_width, int32_t desired_height)
+	void window_create(int32_t desired_width, int32_t desired_height, bool visible)
 	{
 		int32_t screen_width = GetSystemMetrics(SM_CXFULLSCREEN);
 		int32_t screen_height = GetSystemMetrics(SM_CYFULLSCREEN);
 
-		if (desired_width <= 0 || desired_width > screen_width ||
-			desired_height <= 0 || desired_height > screen_height)
+		// A hidden window is never shown, so it does not need to fit on the screen
+		bool fits_screen = !visible || (desired_width <= screen_width && desired_height <= screen_height);
+		if (desired_width <= 0 || desired_height <= 0 || !fits_screen)
 		{
 			desired_width = 4 * screen_width / 5;
 			desired_height = 4 * screen_height / 5;
@@ -275,7 +276,7 @@ namespace platform
 		if (!internal.window.hwnd)
 			FATAL_ERROR("Window", "Failed to create window");
 
-		ShowWindow(internal.window.hwnd, TRUE);
+		ShowWindow(internal.window.hwnd, visible ? SW_SHOW : SW_HIDE);
 	}
 
 	void fatal_error(int32_t line, const char* error_msg)
@@ -312,82 +313,6 @@ namespace platform
 		DebugBreak();
 	}
 
-	static void parse_next_command_arg(string_t& cmd_line_cur, string_t& arg_str, string_t& param_str)
-	{
-		uint32_t arg_begin = string::find_char(cmd_line_cur, '-');
-		uint32_t arg_end = string::find_char(cmd_line_cur, ' ');
-		if (arg_end == STRING_NPOS || arg_begin >= arg_end)
-			FATAL_ERROR("CommandLine", "Malformed command line arguments found: %s", cmd_line_cur);
-
-		arg_str = string::make_view(cmd_line_cur, arg_begin, arg_end - arg_begin);
-		cmd_line_cur = string::make_view(cmd_line_cur, arg_end + 1, cmd_line_cur.count - arg_end - 1);
-
-		uint32_t param_begin = 0;
-		uint32_t param_end = string::find_char(cmd_line_cur, ' ');
-		if (param_end == STRING_NPOS)
-			param_end = cmd_line_cur.count;
-
-		if (param_begin >= param_end)
-			FATAL_ERROR("CommandLine", "Malformed command line arguments found: %s", cmd_line_cur);
-
-		param_str = string::make_view(cmd_line_cur, param_begin, param_end - param_begin);
-		cmd_line_cur = string::make_view(cmd_line_cur, param_end + 1, cmd_line_cur.count - param_end - 1);
-	}
-
-	static void parse_cmd_line_args(const string_t& cmd_line, command_line_args_t& parsed_args)
-	{
-		if (cmd_line.count == 0)
-			return;
-
-		string_t cmd_line_cur = cmd_line;
-		while (cmd_line_cur.count > 0)
-		{
-			string_t arg_str, param_str;
-			parse_next_command_arg(cmd_line_cur, arg_str, param_str);
-			char* param_end_ptr = param_str.buf + param_str.count;
-
-			if (string::compare(arg_str, STRING_LITERAL("--width")))
-			{
-				parsed_args.window_width = strtol(param_str.buf, &param_end_ptr, 10);
-			}
-			else if (string::compare(arg_str, STRING_LITERAL("--height")))
-			{
-				parsed_args.window_height = strtol(param_str.buf, &param_end_ptr, 10);
-			}
-		}
-	}
-
-	static command_line_args_t get_default_cmd_line_args()
-	{
-		command_line_args_t default_args = {};
-		default_args.window_width = 1920;
-		default_args.window_height = 1080;
-
-		return default_args;
-	}
-
-	command_line_args_t parse_command_line_args(memory_arena_t& arena, const wchar_t* cmd_line_ptr)
-	{
-		// Parse command line arguments
-		command_line_args_t parsed_args = platform::get_default_cmd_line_args();
-
-		ARENA_MEMORY_SCOPE(arena)
-		{
-			if (wcslen(cmd_line_ptr))
-			{
-				string_t cmd_line = ARENA_WIDE_TO_CHAR(arena, cmd_line_ptr);
-				LOG_INFO("Command Line", "Passed arguments: %s", cmd_line.buf);
-				platform::parse_cmd_line_args(cmd_line, parsed_args);
-			}
-			else
-			{
-				LOG_INFO("Command Line", "No command line arguments passed");
-			}
-		}
-
-		return parsed_args;
-	}
-
 	void init()
 	{
 		SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
@@ -1,21 +1,50 @@
 #include "core/thread.h"
+#include "core/assertion.h"
 #include "windows_common.h"
 
 namespace thread
 {
 
-	//static DWORD WINAPI thread_proc_win32(void* params)
-	//{
-	//	return 0;
-	//}
+	struct thread_start_params_t
+	{
+		thread_proc_t proc;
+		void* user_data;
+	};
+
+	static DWORD WINAPI thread_proc_win32(void* params)
+	{
+		// The start parameters are owned by the new thread, since the creating thread might return before this thread starts running
+		thread_start_params_t start_params = *(thread_start_params_t*)params;
+		HeapFree(GetProcessHeap(), 0, params);
+
+		start_params.proc(start_params.user_data);
+		return 0;
+	}
+
+	thread_t create(thread_proc_t proc, void* user_data)
+	{
+		thread_start_params_t* start_params = (thread_start_params_t*)HeapAlloc(GetProcessHeap(), 0, sizeof(thread_start_params_t));
+		start_params->proc = proc;
+		start_params->user_data = user_data;
 
-	//thread_t create()
-	//{
-	//	thread_t thread = {};
-	//	thread.ptr = CreateThread(NULL, 0, thread_proc_win32, nullptr, 0, nullptr);
+		thread_t thread = {};
+		thread.ptr = CreateThread(NULL, 0, thread_proc_win32, start_params, 0, nullptr);
+		ASSERT_MSG(thread.ptr, "Failed to create thread");
 
-	//	return thread;
-	//}
+		return thread;
+	}
+
+	void join(thread_t& thread)
+	{
+		WaitForSingleObject((HANDLE)thread.ptr, INFINITE);
+		CloseHandle((HANDLE)thread.ptr);
+		thread.ptr = nullptr;
+	}
+
+	uint32_t get_hardware_thread_count()
+	{
+		return GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	}
 
 	bool wait_on_address(volatile void* address, void* compare_address, size_t address_size)
 	{
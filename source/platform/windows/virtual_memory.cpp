@@ -6,6 +6,21 @@
 namespace virtual_memory
 {
 
+	uint64_t get_page_size()
+	{
+		SYSTEM_INFO system_info = {};
+		GetSystemInfo(&system_info);
+
+		return system_info.dwPageSize;
+	}
+
+	uint64_t get_huge_page_size()
+	{
+		// Large pages on Windows need the lock pages in memory privilege, and can only be committed together with the reservation
+		// That does not work with arenas that commit their reservation bit by bit, so they only get the larger commit granularity
+		return 0;
+	}
+
 	void* reserve(uint64_t size)
 	{
 		void* reserved = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
@@ -14,7 +29,7 @@ namespace virtual_memory
 		return reserved;
 	}
 
-	bool commit(void* address, uint64_t size)
+	bool commit(void* address, uint64_t size, bool huge_pages)
 	{
 		void* committed = VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE);
 		ASSERT(committed);
@@ -28,7 +43,7 @@ namespace virtual_memory
 		ASSERT(status > 0);
 	}
 
-	void release(void* address)
+	void release(void* address, uint64_t size)
 	{
 		int32_t status = VirtualFree(address, 0, MEM_RELEASE);
 		ASSERT(status > 0);
@@ -55,17 +55,65 @@ void bvh_builder_t::extract(memory_arena_t& arena, bvh_t& out_bvh, uint64_t& out
 	uint32_t nodes_byte_size = sizeof(bvh_node_t) * m_node_at;
 	uint32_t triangles_byte_size = sizeof(bvh_triangle_t) * m_triangle_count;
 	uint32_t triangle_indices_byte_size = sizeof(uint32_t) * m_triangle_count;
+	uint32_t parents_byte_size = sizeof(uint32_t) * m_node_at;
 
-	out_bvh_byte_size = /*header_size + */nodes_byte_size + triangles_byte_size + triangle_indices_byte_size;
+	out_bvh_byte_size = /*header_size + */nodes_byte_size + triangles_byte_size + triangle_indices_byte_size + parents_byte_size;
 	out_bvh.data = ARENA_ALLOC(arena, out_bvh_byte_size, alignof(bvh_t));
 
 	out_bvh.header.nodes_offset = header_size;
 	out_bvh.header.triangles_offset = header_size + nodes_byte_size;
 	out_bvh.header.indices_offset = header_size + nodes_byte_size + triangles_byte_size;
+	out_bvh.header.parents_offset = header_size + nodes_byte_size + triangles_byte_size + triangle_indices_byte_size;
 
 	memcpy(PTR_OFFSET(out_bvh.data, 0), m_nodes, nodes_byte_size);
 	memcpy(PTR_OFFSET(out_bvh.data, nodes_byte_size), m_triangles, triangles_byte_size);
 	memcpy(PTR_OFFSET(out_bvh.data, nodes_byte_size + triangles_byte_size), m_triangle_indices, triangle_indices_byte_size);
+
+	// Child nodes are always allocated in pairs, so every interior node is the parent of left_first and left_first + 1
+	// The root and the unused node at index 1 do not have a parent, they point to the root instead
+	uint32_t* parents = (uint32_t*)PTR_OFFSET(out_bvh.data, nodes_byte_size + triangles_byte_size + triangle_indices_byte_size);
+	memset(parents, 0, parents_byte_size);
+
+	for (uint32_t node_idx = 0; node_idx < m_node_at; ++node_idx)
+	{
+		const bvh_node_t& node = m_nodes[node_idx];
+		if (node_idx == 1 || node.prim_count > 0)
+			continue;
+
+		parents[node.left_first] = node_idx;
+		parents[node.left_first + 1] = node_idx;
+	}
+
+	out_bvh.triangle_soa = {};
+	if (m_build_opts.emit_triangle_soa)
+	{
+		// Leaves can start at any triangle, so pad by a full SIMD width minus one to be able to always load BVH_TRIANGLE_SOA_WIDTH triangles
+		uint32_t padded_count = (uint32_t)ALIGN_UP_POW2(m_triangle_count + BVH_TRIANGLE_SOA_WIDTH - 1, BVH_TRIANGLE_SOA_WIDTH);
+		bvh_triangle_soa_t& soa = out_bvh.triangle_soa;
+		soa.count = m_triangle_count;
+		soa.primitive_indices = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, padded_count);
+
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			soa.p0[axis] = (float*)ARENA_ALLOC_ZERO(arena, sizeof(float) * padded_count, 16);
+			soa.p1[axis] = (float*)ARENA_ALLOC_ZERO(arena, sizeof(float) * padded_count, 16);
+			soa.p2[axis] = (float*)ARENA_ALLOC_ZERO(arena, sizeof(float) * padded_count, 16);
+		}
+
+		for (uint32_t i = 0; i < m_triangle_count; ++i)
+		{
+			uint32_t tri_idx = m_triangle_indices[i];
+			const bvh_triangle_t& triangle = m_triangles[tri_idx];
+			soa.primitive_indices[i] = tri_idx;
+
+			for (uint32_t axis = 0; axis < 3; ++axis)
+			{
+				soa.p0[axis][i] = triangle.p0[axis];
+				soa.p1[axis][i] = triangle.p1[axis];
+				soa.p2[axis][i] = triangle.p2[axis];
+			}
+		}
+	}
 }
 
 void bvh_builder_t::calc_node_min_max(bvh_node_t& node, glm::vec3& out_centroid_min, glm::vec3& out_centroid_max)
@@ -130,7 +178,7 @@ void bvh_builder_t::subdivide_node(memory_arena_t& arena, bvh_node_t& node, glm:
 		int32_t bin_idx = glm::min((int32_t)m_build_opts.interval_count - 1,
 			(int32_t)((tri_centroid[split_axis] - out_centroid_min[split_axis]) * bin_scale));
 
-		if (bin_idx < split_pos)
+		if (bin_idx < (int32_t)split_pos)
 			i++;
 		else
 			std::swap(m_triangle_indices[i], m_triangle_indices[j--]);
@@ -5,10 +5,28 @@
 struct memory_arena_t;
 struct triangle_t;
 
+// Number of triangles the CPU path tracer intersects at once from the structure of arrays triangle layout
+inline constexpr uint32_t BVH_TRIANGLE_SOA_WIDTH = 4;
+
+// Leaf ordered triangle vertices in a structure of arrays layout, so that the triangles of a leaf can be loaded and intersected BVH_TRIANGLE_SOA_WIDTH at a time
+// The vertices are stored as-is instead of as precomputed edges, since the watertight intersection relies on neighbouring triangles sharing the exact same vertex positions
+struct bvh_triangle_soa_t
+{
+	uint32_t count;
+	// x, y and z components per vertex, padded with degenerate triangles so that loads starting at any leaf triangle stay in bounds
+	float* p0[3];
+	float* p1[3];
+	float* p2[3];
+	// Maps the leaf ordered triangles back to their primitive index
+	uint32_t* primitive_indices;
+};
+
 struct bvh_t
 {
 	bvh_header_t header;
 	void* data;
+	// Only emitted if requested in the build options, the GPU only uses the data above
+	bvh_triangle_soa_t triangle_soa;
 };
 
 class bvh_builder_t
@@ -18,6 +36,8 @@ public:
 	{
 		uint32_t interval_count;
 		bool subdivide_single_prim;
+		// Additionally extract the triangles in the structure of arrays layout for the CPU path tracer
+		bool emit_triangle_soa;
 	};
 
 	struct build_args_t
@@ -11,7 +11,7 @@ void tlas_builder_t::build(memory_arena_t& arena, bvh_instance_t* bvh_instances,
 	m_node_count = m_instance_count * 2;
 	m_nodes = ARENA_ALLOC_ARRAY_ZERO(arena, tlas_node_t, m_node_count);
 
-	uint32_t node_idx[256] = {};
+	uint32_t* node_idx = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, m_instance_count);
 	uint32_t node_indices = m_instance_count;
 	m_node_at = 1;
 
@@ -93,9 +93,8 @@ uint32_t tlas_builder_t::find_best_match(uint32_t A, const uint32_t* indices, ui
 	{
 		if (B != A)
 		{
-			glm::vec3 bmax = glm::max(m_nodes[indices[A]].aabb_min, m_nodes[indices[B]].aabb_min);
-			glm::vec3 bmin = glm::max(m_nodes[indices[A]].aabb_max, m_nodes[indices[B]].aabb_max);
-			glm::vec3 extent = bmax - bmin;
+			glm::vec3 bmin = glm::min(m_nodes[indices[A]].aabb_min, m_nodes[indices[B]].aabb_min);
+			glm::vec3 bmax = glm::max(m_nodes[indices[A]].aabb_max, m_nodes[indices[B]].aabb_max);
 
 			float area = as_util::get_aabb_volume(bmin, bmax);
 			if (area < smallest_area)
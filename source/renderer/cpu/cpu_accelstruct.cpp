@@ -0,0 +1,814 @@
+#include "cpu_accelstruct.h"
+#include "renderer/bvh/bvh_builder.h"
+#include "renderer/bvh/tlas_builder.h"
+
+#include "core/assertion.h"
+
+#include <immintrin.h>
+
+namespace cpu
+{
+
+	// Result of intersecting BVH_TRIANGLE_SOA_WIDTH triangles at once, the bits in mask are set for every lane that was hit within the ray extent
+	struct triangle_soa_hit_t
+	{
+		int32_t mask;
+		alignas(16) float t[BVH_TRIANGLE_SOA_WIDTH];
+		alignas(16) float v[BVH_TRIANGLE_SOA_WIDTH];
+		alignas(16) float w[BVH_TRIANGLE_SOA_WIDTH];
+	};
+
+	// The header offsets include the size of the header, since the GPU buffers have the header in front of the data
+	// The CPU-side data pointer does not contain the header, so we need to subtract it again
+	static const bvh_node_t* bvh_get_nodes(const bvh_t& bvh)
+	{
+		return (const bvh_node_t*)PTR_OFFSET(bvh.data, bvh.header.nodes_offset - sizeof(bvh_header_t));
+	}
+
+	static const bvh_triangle_t* bvh_get_triangles(const bvh_t& bvh)
+	{
+		return (const bvh_triangle_t*)PTR_OFFSET(bvh.data, bvh.header.triangles_offset - sizeof(bvh_header_t));
+	}
+
+	static const uint32_t* bvh_get_triangle_indices(const bvh_t& bvh)
+	{
+		return (const uint32_t*)PTR_OFFSET(bvh.data, bvh.header.indices_offset - sizeof(bvh_header_t));
+	}
+
+	static const uint32_t* bvh_get_parents(const bvh_t& bvh)
+	{
+		return (const uint32_t*)PTR_OFFSET(bvh.data, bvh.header.parents_offset - sizeof(bvh_header_t));
+	}
+
+	static const tlas_node_t* tlas_get_nodes(const tlas_t& tlas)
+	{
+		return (const tlas_node_t*)PTR_OFFSET(tlas.data, tlas.header.nodes_offset - sizeof(tlas_header_t));
+	}
+
+	static const bvh_instance_t* tlas_get_instances(const tlas_t& tlas)
+	{
+		return (const bvh_instance_t*)PTR_OFFSET(tlas.data, tlas.header.instances_offset - sizeof(tlas_header_t));
+	}
+
+	static bool tlas_node_is_leaf(const tlas_node_t& node)
+	{
+		return node.left_right == 0;
+	}
+
+	// Create a new ray that will be in local/object space of the bvh we want to intersect
+	// The direction is not normalized after the transform, so ray.t stays valid in local space
+	// Instances with an identity transform get the world space ray as it is, including its inverse direction
+	static ray_t make_ray_local(const bvh_instance_t& instance, const ray_t& ray)
+	{
+		ray_t ray_local = ray;
+		if (instance.identity_transform)
+			return ray_local;
+
+		ray_local.origin = transform_point(instance.world_to_local, ray.origin);
+		ray_local.direction = transform_vector(instance.world_to_local, ray.direction);
+		ray_local.inv_dir = 1.0f / ray_local.direction;
+
+		return ray_local;
+	}
+
+	// Traversal functions always count into a stats struct, this one absorbs the counts when the caller is not interested in them
+	static traversal_stats_t& get_traversal_stats(traversal_stats_t* stats, traversal_stats_t& stats_unused)
+	{
+		return stats ? *stats : stats_unused;
+	}
+
+	void add_traversal_stats(traversal_stats_t& stats, const traversal_stats_t& other)
+	{
+		stats.rays += other.rays;
+		stats.tlas_leaves += other.tlas_leaves;
+		stats.inner_nodes += other.inner_nodes;
+		stats.aabb_tests += other.aabb_tests;
+		stats.triangle_tests += other.triangle_tests;
+	}
+
+	void add_traversal_stats(traversal_totals_t& totals, const traversal_stats_t& stats)
+	{
+		totals.rays += stats.rays;
+		totals.tlas_leaves += stats.tlas_leaves;
+		totals.inner_nodes += stats.inner_nodes;
+		totals.aabb_tests += stats.aabb_tests;
+		totals.triangle_tests += stats.triangle_tests;
+	}
+
+	void add_traversal_stats(traversal_totals_t& totals, const traversal_totals_t& other)
+	{
+		totals.rays += other.rays;
+		totals.tlas_leaves += other.tlas_leaves;
+		totals.inner_nodes += other.inner_nodes;
+		totals.aabb_tests += other.aabb_tests;
+		totals.triangle_tests += other.triangle_tests;
+	}
+
+	uint32_t get_traversal_cost(const traversal_stats_t& stats)
+	{
+		return stats.aabb_tests + stats.triangle_tests;
+	}
+
+	ray_t make_ray(const glm::vec3& origin, const glm::vec3& dir, float t_max)
+	{
+		ray_t ray = {};
+		ray.origin = origin + dir * RAY_MIN_T;
+		ray.direction = dir;
+		ray.inv_dir = 1.0f / dir;
+		ray.t = t_max;
+
+		return ray;
+	}
+
+	hit_result_t make_hit_result()
+	{
+		hit_result_t hit = {};
+		hit.instance_idx = INSTANCE_IDX_INVALID;
+		hit.primitive_idx = PRIMITIVE_IDX_INVALID;
+		hit.t = RAY_MAX_T;
+		hit.bary = glm::vec2(0.0f);
+
+		return hit;
+	}
+
+	bool has_hit_geometry(const hit_result_t& hit)
+	{
+		return hit.instance_idx != INSTANCE_IDX_INVALID &&
+			hit.primitive_idx != PRIMITIVE_IDX_INVALID;
+	}
+
+	// Moeller-Trumbore ray-triangle intersection
+	// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection.html
+	bool intersect_ray_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, ray_t& ray, glm::vec2& out_bary)
+	{
+		glm::vec3 v0v1 = v1 - v0;
+		glm::vec3 v0v2 = v2 - v0;
+
+		glm::vec3 pvec = glm::cross(ray.direction, v0v2);
+		float det = glm::dot(v0v1, pvec);
+
+		if (TRIANGLE_BACKFACE_CULLING ? det < INTERSECT_EPSILON : glm::abs(det) < INTERSECT_EPSILON)
+			return false;
+
+		float inv_det = 1.0f / det;
+		glm::vec3 tvec = ray.origin - v0;
+		float v = glm::dot(tvec, pvec) * inv_det;
+
+		if (v < 0.0f || v > 1.0f)
+			return false;
+
+		glm::vec3 qvec = glm::cross(tvec, v0v1);
+		float w = glm::dot(ray.direction, qvec) * inv_det;
+
+		if (w < 0.0f || v + w > 1.0f)
+			return false;
+
+		float t = glm::dot(v0v2, qvec) * inv_det;
+
+		if (t < 0.0f || t >= ray.t)
+			return false;
+
+		ray.t = t;
+		out_bary = glm::vec2(v, w);
+		return true;
+	}
+
+	bool intersect_ray_triangle_any(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const ray_t& ray)
+	{
+		glm::vec3 v0v1 = v1 - v0;
+		glm::vec3 v0v2 = v2 - v0;
+
+		glm::vec3 pvec = glm::cross(ray.direction, v0v2);
+		float det = glm::dot(v0v1, pvec);
+
+		if (TRIANGLE_BACKFACE_CULLING ? det < INTERSECT_EPSILON : glm::abs(det) < INTERSECT_EPSILON)
+			return false;
+
+		float inv_det = 1.0f / det;
+		glm::vec3 tvec = ray.origin - v0;
+		float v = glm::dot(tvec, pvec) * inv_det;
+
+		if (v < 0.0f || v > 1.0f)
+			return false;
+
+		glm::vec3 qvec = glm::cross(tvec, v0v1);
+		float w = glm::dot(ray.direction, qvec) * inv_det;
+
+		if (w < 0.0f || v + w > 1.0f)
+			return false;
+
+		float t = glm::dot(v0v2, qvec) * inv_det;
+		return t >= 0.0f && t < ray.t;
+	}
+
+	// Watertight ray-triangle intersection, see: https://jcgt.org/published/0002/01/05/
+	// The dominant axis of the ray direction becomes the z axis, and the other two axes are sheared so that the ray points along +z
+	watertight_ray_t make_watertight_ray(const ray_t& ray)
+	{
+		watertight_ray_t ray_wt = {};
+
+		glm::vec3 abs_dir = glm::abs(ray.direction);
+		ray_wt.kz = abs_dir.x > abs_dir.y ? (abs_dir.x > abs_dir.z ? 0 : 2) : (abs_dir.y > abs_dir.z ? 1 : 2);
+		ray_wt.kx = (ray_wt.kz + 1) % 3;
+		ray_wt.ky = (ray_wt.kx + 1) % 3;
+
+		// Swap the x and y axes to preserve the winding of the triangles when the ray points along the negative dominant axis
+		if (ray.direction[ray_wt.kz] < 0.0f)
+			std::swap(ray_wt.kx, ray_wt.ky);
+
+		ray_wt.sx = ray.direction[ray_wt.kx] / ray.direction[ray_wt.kz];
+		ray_wt.sy = ray.direction[ray_wt.ky] / ray.direction[ray_wt.kz];
+		ray_wt.sz = 1.0f / ray.direction[ray_wt.kz];
+
+		return ray_wt;
+	}
+
+	static bool intersect_ray_triangle_watertight_internal(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+		const watertight_ray_t& ray_wt, const ray_t& ray, float& out_t, glm::vec2& out_bary)
+	{
+		glm::vec3 a = v0 - ray.origin;
+		glm::vec3 b = v1 - ray.origin;
+		glm::vec3 c = v2 - ray.origin;
+
+		float ax = a[ray_wt.kx] - ray_wt.sx * a[ray_wt.kz];
+		float ay = a[ray_wt.ky] - ray_wt.sy * a[ray_wt.kz];
+		float bx = b[ray_wt.kx] - ray_wt.sx * b[ray_wt.kz];
+		float by = b[ray_wt.ky] - ray_wt.sy * b[ray_wt.kz];
+		float cx = c[ray_wt.kx] - ray_wt.sx * c[ray_wt.kz];
+		float cy = c[ray_wt.ky] - ray_wt.sy * c[ray_wt.kz];
+
+		// Scaled barycentrics, an edge shared by two triangles gives the exact same result for both, so rays can not slip through in between them
+		float u = cx * by - cy * bx;
+		float v = ax * cy - ay * cx;
+		float w = bx * ay - by * ax;
+
+		bool any_negative = u < 0.0f || v < 0.0f || w < 0.0f;
+		bool any_positive = u > 0.0f || v > 0.0f || w > 0.0f;
+
+		if (TRIANGLE_BACKFACE_CULLING ? any_negative : (any_negative && any_positive))
+			return false;
+
+		float det = u + v + w;
+		if (det == 0.0f)
+			return false;
+
+		// Compare the scaled hit distance against the ray extent before dividing, with the sign of the determinant folded into both sides
+		float t_scaled = u * (ray_wt.sz * a[ray_wt.kz]) + v * (ray_wt.sz * b[ray_wt.kz]) + w * (ray_wt.sz * c[ray_wt.kz]);
+		float det_sign = det < 0.0f ? -1.0f : 1.0f;
+
+		if (t_scaled * det_sign < 0.0f || t_scaled * det_sign >= ray.t * det * det_sign)
+			return false;
+
+		float inv_det = 1.0f / det;
+		out_t = t_scaled * inv_det;
+		out_bary = glm::vec2(v, w) * inv_det;
+		return true;
+	}
+
+	bool intersect_ray_triangle_watertight(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const watertight_ray_t& ray_wt, ray_t& ray, glm::vec2& out_bary)
+	{
+		float t = 0.0f;
+		if (!intersect_ray_triangle_watertight_internal(v0, v1, v2, ray_wt, ray, t, out_bary))
+			return false;
+
+		ray.t = t;
+		return true;
+	}
+
+	bool intersect_ray_triangle_watertight_any(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const watertight_ray_t& ray_wt, const ray_t& ray)
+	{
+		float t = 0.0f;
+		glm::vec2 bary;
+		return intersect_ray_triangle_watertight_internal(v0, v1, v2, ray_wt, ray, t, bary);
+	}
+
+	// Same as intersect_ray_triangle_watertight_internal, for BVH_TRIANGLE_SOA_WIDTH consecutive leaf ordered triangles at once
+	// Lanes at or beyond count are masked out, the padding at the end of the arrays keeps the loads in bounds
+	static void intersect_ray_triangle_soa_watertight(const bvh_triangle_soa_t& soa, uint32_t first, uint32_t count,
+		const watertight_ray_t& ray_wt, const ray_t& ray, triangle_soa_hit_t& out_hit)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+		__m128 org_x = _mm_set1_ps(ray.origin[ray_wt.kx]);
+		__m128 org_y = _mm_set1_ps(ray.origin[ray_wt.ky]);
+		__m128 org_z = _mm_set1_ps(ray.origin[ray_wt.kz]);
+		__m128 sx = _mm_set1_ps(ray_wt.sx);
+		__m128 sy = _mm_set1_ps(ray_wt.sy);
+		__m128 sz = _mm_set1_ps(ray_wt.sz);
+
+		__m128 az = _mm_sub_ps(_mm_loadu_ps(soa.p0[ray_wt.kz] + first), org_z);
+		__m128 bz = _mm_sub_ps(_mm_loadu_ps(soa.p1[ray_wt.kz] + first), org_z);
+		__m128 cz = _mm_sub_ps(_mm_loadu_ps(soa.p2[ray_wt.kz] + first), org_z);
+
+		__m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p0[ray_wt.kx] + first), org_x), _mm_mul_ps(sx, az));
+		__m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p0[ray_wt.ky] + first), org_y), _mm_mul_ps(sy, az));
+		__m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p1[ray_wt.kx] + first), org_x), _mm_mul_ps(sx, bz));
+		__m128 by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p1[ray_wt.ky] + first), org_y), _mm_mul_ps(sy, bz));
+		__m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p2[ray_wt.kx] + first), org_x), _mm_mul_ps(sx, cz));
+		__m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(soa.p2[ray_wt.ky] + first), org_y), _mm_mul_ps(sy, cz));
+
+		__m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		__m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+		__m128 any_negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+		__m128 any_positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+		__m128 rejected = TRIANGLE_BACKFACE_CULLING ? any_negative : _mm_and_ps(any_negative, any_positive);
+
+		__m128 lane_idx = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		__m128 valid = _mm_andnot_ps(rejected, _mm_cmplt_ps(lane_idx, _mm_set1_ps((float)count)));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+		valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+
+		__m128 t_scaled = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_mul_ps(sz, az)), _mm_mul_ps(v, _mm_mul_ps(sz, bz))), _mm_mul_ps(w, _mm_mul_ps(sz, cz)));
+		__m128 det_sign = _mm_and_ps(det, sign_mask);
+		__m128 t_signed = _mm_xor_ps(t_scaled, det_sign);
+		__m128 det_abs = _mm_xor_ps(det, det_sign);
+
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(t_signed, zero));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(t_signed, _mm_mul_ps(_mm_set1_ps(ray.t), det_abs)));
+
+		out_hit.mask = _mm_movemask_ps(valid);
+		if (out_hit.mask == 0)
+			return;
+
+		__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+		_mm_store_ps(out_hit.t, _mm_mul_ps(t_scaled, inv_det));
+		_mm_store_ps(out_hit.v, _mm_mul_ps(v, inv_det));
+		_mm_store_ps(out_hit.w, _mm_mul_ps(w, inv_det));
+	}
+
+	float intersect_ray_aabb(const glm::vec3& aabb_min, const glm::vec3& aabb_max, const ray_t& ray)
+	{
+		float tx1 = (aabb_min.x - ray.origin.x) * ray.inv_dir.x;
+		float tx2 = (aabb_max.x - ray.origin.x) * ray.inv_dir.x;
+		float tmin = glm::min(tx1, tx2);
+		float tmax = glm::max(tx1, tx2);
+
+		float ty1 = (aabb_min.y - ray.origin.y) * ray.inv_dir.y;
+		float ty2 = (aabb_max.y - ray.origin.y) * ray.inv_dir.y;
+		tmin = glm::max(tmin, glm::min(ty1, ty2));
+		tmax = glm::min(tmax, glm::max(ty1, ty2));
+
+		float tz1 = (aabb_min.z - ray.origin.z) * ray.inv_dir.z;
+		float tz2 = (aabb_max.z - ray.origin.z) * ray.inv_dir.z;
+		tmin = glm::max(tmin, glm::min(tz1, tz2));
+		tmax = glm::min(tmax, glm::max(tz1, tz2));
+
+		if (tmax >= tmin && tmin < ray.t && tmax > 0.0f)
+			return tmin;
+
+		return RAY_MAX_T;
+	}
+
+	// Closest-hit intersection of all triangles in a leaf node, shortens the ray extent for every hit
+	static bool intersect_bvh_leaf(const bvh_t& bvh, const bvh_node_t& node, const watertight_ray_t& ray_wt, ray_t& ray, hit_result_t& hit, traversal_stats_t& stats)
+	{
+		bool has_hit = false;
+		stats.triangle_tests += node.prim_count;
+
+		const bvh_triangle_soa_t& triangle_soa = bvh.triangle_soa;
+		uint32_t leaf_end = node.left_first + node.prim_count;
+
+		if (triangle_soa.primitive_indices)
+		{
+			for (uint32_t i = node.left_first; i < leaf_end; i += BVH_TRIANGLE_SOA_WIDTH)
+			{
+				triangle_soa_hit_t soa_hit;
+				intersect_ray_triangle_soa_watertight(triangle_soa, i, MIN(BVH_TRIANGLE_SOA_WIDTH, leaf_end - i), ray_wt, ray, soa_hit);
+
+				// All lanes were tested against the same ray extent, so we still need to find the closest one
+				for (uint32_t lane = 0; lane < BVH_TRIANGLE_SOA_WIDTH; ++lane)
+				{
+					if ((soa_hit.mask & (1 << lane)) && soa_hit.t[lane] < ray.t)
+					{
+						ray.t = soa_hit.t[lane];
+						hit.bary = glm::vec2(soa_hit.v[lane], soa_hit.w[lane]);
+						hit.primitive_idx = triangle_soa.primitive_indices[i + lane];
+						has_hit = true;
+					}
+				}
+			}
+		}
+		else
+		{
+			const bvh_triangle_t* triangles = bvh_get_triangles(bvh);
+			const uint32_t* triangle_indices = bvh_get_triangle_indices(bvh);
+
+			for (uint32_t i = node.left_first; i < leaf_end; ++i)
+			{
+				uint32_t tri_idx = triangle_indices[i];
+				const bvh_triangle_t& tri = triangles[tri_idx];
+
+				if (intersect_ray_triangle_watertight(tri.p0, tri.p1, tri.p2, ray_wt, ray, hit.bary))
+				{
+					hit.primitive_idx = tri_idx;
+					has_hit = true;
+				}
+			}
+		}
+
+		return has_hit;
+	}
+
+	// Orders the children of an interior node by their entry distance, left first on a tie
+	// The ray extent only ever gets shorter during a traversal, so a child that is visited first stays first whenever the order is computed again
+	static void get_ordered_children(const bvh_node_t* nodes, const bvh_node_t& node, const ray_t& ray,
+		uint32_t& out_near_idx, uint32_t& out_far_idx, float& out_dist_near, float& out_dist_far, traversal_stats_t& stats)
+	{
+		stats.inner_nodes++;
+		stats.aabb_tests += 2;
+
+		const bvh_node_t& node_left = nodes[node.left_first];
+		const bvh_node_t& node_right = nodes[node.left_first + 1];
+
+		out_near_idx = node.left_first;
+		out_far_idx = node.left_first + 1;
+		out_dist_near = intersect_ray_aabb(node_left.aabb_min, node_left.aabb_max, ray);
+		out_dist_far = intersect_ray_aabb(node_right.aabb_min, node_right.aabb_max, ray);
+
+		if (out_dist_near > out_dist_far)
+		{
+			std::swap(out_near_idx, out_far_idx);
+			std::swap(out_dist_near, out_dist_far);
+		}
+	}
+
+	bool trace_ray_bvh_local(const bvh_t& bvh, ray_t& ray, hit_result_t& hit, traversal_stats_t* stats)
+	{
+		bool has_hit = false;
+		traversal_stats_t stats_unused = {};
+		traversal_stats_t& ray_stats = get_traversal_stats(stats, stats_unused);
+
+		const bvh_node_t* nodes = bvh_get_nodes(bvh);
+		watertight_ray_t ray_wt = make_watertight_ray(ray);
+
+		const bvh_node_t* node = &nodes[0];
+		const bvh_node_t* stack[TRAVERSAL_STACK_SIZE];
+		uint32_t stack_at = 0;
+
+		while (true)
+		{
+			// Node is a leaf node, check for triangle intersections
+			if (node->prim_count > 0)
+			{
+				if (intersect_bvh_leaf(bvh, *node, ray_wt, ray, hit, ray_stats))
+					has_hit = true;
+
+				if (stack_at == 0)
+					break;
+
+				node = stack[--stack_at];
+				continue;
+			}
+
+			// Current node is not a leaf node, keep traversing the BVH
+			uint32_t near_idx, far_idx;
+			float dist_left, dist_right;
+			get_ordered_children(nodes, *node, ray, near_idx, far_idx, dist_left, dist_right, ray_stats);
+
+			const bvh_node_t* node_left = &nodes[near_idx];
+			const bvh_node_t* node_right = &nodes[far_idx];
+
+			// If we have not intersected with the child nodes, we keep traversing the node stack
+			if (dist_left == RAY_MAX_T)
+			{
+				if (stack_at == 0)
+					break;
+
+				node = stack[--stack_at];
+			}
+			// We have intersected with at least one of the child nodes, check the closest one first
+			// and push the other one onto the stack
+			else
+			{
+				node = node_left;
+				if (dist_right != RAY_MAX_T)
+				{
+					DEBUG_ASSERT_MSG(stack_at < TRAVERSAL_STACK_SIZE, "BVH traversal stack overflow");
+					stack[stack_at++] = node_right;
+				}
+			}
+		}
+
+		return has_hit;
+	}
+
+	// Walks up from the last visited node until it finds a parent whose far child was not visited yet and is still within the ray extent
+	// The far child of a parent is pending exactly when we are coming up from its near child, since the far child is visited after the near child
+	static bool find_next_far_child(const bvh_node_t* nodes, const uint32_t* parents, const ray_t& ray, uint32_t& node_idx, traversal_stats_t& stats)
+	{
+		while (node_idx != 0)
+		{
+			uint32_t parent_idx = parents[node_idx];
+
+			uint32_t near_idx, far_idx;
+			float dist_near, dist_far;
+			get_ordered_children(nodes, nodes[parent_idx], ray, near_idx, far_idx, dist_near, dist_far, stats);
+
+			if (node_idx == near_idx && dist_far != RAY_MAX_T)
+			{
+				node_idx = far_idx;
+				return true;
+			}
+
+			node_idx = parent_idx;
+		}
+
+		return false;
+	}
+
+	bool trace_ray_bvh_local_short_stack(const bvh_t& bvh, ray_t& ray, hit_result_t& hit, traversal_stats_t* stats)
+	{
+		bool has_hit = false;
+		traversal_stats_t stats_unused = {};
+		traversal_stats_t& ray_stats = get_traversal_stats(stats, stats_unused);
+
+		const bvh_node_t* nodes = bvh_get_nodes(bvh);
+		const uint32_t* parents = bvh_get_parents(bvh);
+		watertight_ray_t ray_wt = make_watertight_ray(ray);
+
+		// Ring buffer of node indices, a push onto a full stack overwrites the oldest entry
+		uint32_t node_idx = 0;
+		uint32_t stack[TRAVERSAL_SHORT_STACK_SIZE];
+		uint32_t stack_top = 0;
+		uint32_t stack_count = 0;
+		bool stack_overflowed = false;
+
+		while (true)
+		{
+			const bvh_node_t& node = nodes[node_idx];
+
+			if (node.prim_count > 0)
+			{
+				if (intersect_bvh_leaf(bvh, node, ray_wt, ray, hit, ray_stats))
+					has_hit = true;
+			}
+			else
+			{
+				uint32_t near_idx, far_idx;
+				float dist_near, dist_far;
+				get_ordered_children(nodes, node, ray, near_idx, far_idx, dist_near, dist_far, ray_stats);
+
+				// We have intersected with at least one of the child nodes, check the closest one first
+				// and push the other one onto the stack
+				if (dist_near != RAY_MAX_T)
+				{
+					if (dist_far != RAY_MAX_T)
+					{
+						stack_overflowed |= stack_count == TRAVERSAL_SHORT_STACK_SIZE;
+						stack[stack_top] = far_idx;
+						stack_top = (stack_top + 1) % TRAVERSAL_SHORT_STACK_SIZE;
+						stack_count = MIN(stack_count + 1, TRAVERSAL_SHORT_STACK_SIZE);
+					}
+
+					node_idx = near_idx;
+					continue;
+				}
+			}
+
+			if (stack_count > 0)
+			{
+				stack_top = (stack_top + TRAVERSAL_SHORT_STACK_SIZE - 1) % TRAVERSAL_SHORT_STACK_SIZE;
+				stack_count--;
+				node_idx = stack[stack_top];
+				continue;
+			}
+
+			// The stack is empty, if it never overflowed there is nothing left to visit
+			// Otherwise the dropped entries are all far children of ancestors of the current node, so the parent links lead us back to them
+			if (!stack_overflowed || !find_next_far_child(nodes, parents, ray, node_idx, ray_stats))
+				break;
+		}
+
+		return has_hit;
+	}
+
+	void trace_ray_tlas(const tlas_t& tlas, const bvh_t* const* instance_bvhs, ray_t& ray, hit_result_t& hit, bool bvh_short_stack, traversal_stats_t* stats)
+	{
+		traversal_stats_t stats_unused = {};
+		traversal_stats_t& ray_stats = get_traversal_stats(stats, stats_unused);
+		ray_stats.rays++;
+		ray_stats.aabb_tests++;
+
+		const tlas_node_t* nodes = tlas_get_nodes(tlas);
+		const bvh_instance_t* instances = tlas_get_instances(tlas);
+
+		const tlas_node_t* node = &nodes[0];
+
+		// Check if we miss the entire TLAS
+		if (intersect_ray_aabb(node->aabb_min, node->aabb_max, ray) == RAY_MAX_T)
+			return;
+
+		const tlas_node_t* stack[TRAVERSAL_STACK_SIZE];
+		uint32_t stack_at = 0;
+
+		while (true)
+		{
+			if (tlas_node_is_leaf(*node))
+			{
+				ray_t ray_local = make_ray_local(instances[node->instance_idx], ray);
+				ray_stats.tlas_leaves++;
+
+				const bvh_t& bvh = *instance_bvhs[node->instance_idx];
+				bool bvh_hit = bvh_short_stack ?
+					trace_ray_bvh_local_short_stack(bvh, ray_local, hit, &ray_stats) : trace_ray_bvh_local(bvh, ray_local, hit, &ray_stats);
+
+				if (bvh_hit)
+				{
+					ray.t = ray_local.t;
+					hit.instance_idx = node->instance_idx;
+					hit.t = ray.t;
+				}
+
+				if (stack_at == 0)
+					break;
+
+				node = stack[--stack_at];
+				continue;
+			}
+
+			// Node is not a leaf node, keep traversing
+			ray_stats.inner_nodes++;
+			ray_stats.aabb_tests += 2;
+
+			const tlas_node_t* node_left = &nodes[node->left_right >> 16];
+			const tlas_node_t* node_right = &nodes[node->left_right & 0x0000FFFF];
+
+			float dist_left = intersect_ray_aabb(node_left->aabb_min, node_left->aabb_max, ray);
+			float dist_right = intersect_ray_aabb(node_right->aabb_min, node_right->aabb_max, ray);
+
+			// Swap the left and right nodes so we always have the closest one first
+			if (dist_left > dist_right)
+			{
+				std::swap(dist_left, dist_right);
+				std::swap(node_left, node_right);
+			}
+
+			if (dist_left == RAY_MAX_T)
+			{
+				if (stack_at == 0)
+					break;
+
+				node = stack[--stack_at];
+			}
+			else
+			{
+				node = node_left;
+				if (dist_right != RAY_MAX_T)
+				{
+					DEBUG_ASSERT_MSG(stack_at < TRAVERSAL_STACK_SIZE, "TLAS traversal stack overflow");
+					stack[stack_at++] = node_right;
+				}
+			}
+		}
+	}
+
+	bool trace_ray_bvh_local_occluded(const bvh_t& bvh, const ray_t& ray, traversal_stats_t* stats)
+	{
+		traversal_stats_t stats_unused = {};
+		traversal_stats_t& ray_stats = get_traversal_stats(stats, stats_unused);
+
+		const bvh_node_t* nodes = bvh_get_nodes(bvh);
+		const bvh_triangle_t* triangles = bvh_get_triangles(bvh);
+		const uint32_t* triangle_indices = bvh_get_triangle_indices(bvh);
+
+		const bvh_triangle_soa_t& triangle_soa = bvh.triangle_soa;
+		watertight_ray_t ray_wt = make_watertight_ray(ray);
+
+		const bvh_node_t* node = &nodes[0];
+		const bvh_node_t* stack[TRAVERSAL_STACK_SIZE];
+		uint32_t stack_at = 0;
+
+		while (true)
+		{
+			if (node->prim_count > 0)
+			{
+				uint32_t leaf_end = node->left_first + node->prim_count;
+				ray_stats.triangle_tests += node->prim_count;
+
+				if (triangle_soa.primitive_indices)
+				{
+					for (uint32_t i = node->left_first; i < leaf_end; i += BVH_TRIANGLE_SOA_WIDTH)
+					{
+						triangle_soa_hit_t soa_hit;
+						intersect_ray_triangle_soa_watertight(triangle_soa, i, MIN(BVH_TRIANGLE_SOA_WIDTH, leaf_end - i), ray_wt, ray, soa_hit);
+
+						if (soa_hit.mask != 0)
+							return true;
+					}
+				}
+				else
+				{
+					for (uint32_t i = node->left_first; i < leaf_end; ++i)
+					{
+						const bvh_triangle_t& tri = triangles[triangle_indices[i]];
+
+						if (intersect_ray_triangle_watertight_any(tri.p0, tri.p1, tri.p2, ray_wt, ray))
+							return true;
+					}
+				}
+			}
+			else
+			{
+				// The traversal order does not matter for occlusion, so we skip sorting the child nodes by distance
+				ray_stats.inner_nodes++;
+				ray_stats.aabb_tests += 2;
+
+				const bvh_node_t* node_left = &nodes[node->left_first];
+				const bvh_node_t* node_right = &nodes[node->left_first + 1];
+
+				bool hit_left = intersect_ray_aabb(node_left->aabb_min, node_left->aabb_max, ray) != RAY_MAX_T;
+				bool hit_right = intersect_ray_aabb(node_right->aabb_min, node_right->aabb_max, ray) != RAY_MAX_T;
+
+				if (hit_left || hit_right)
+				{
+					node = hit_left ? node_left : node_right;
+					if (hit_left && hit_right)
+					{
+						DEBUG_ASSERT_MSG(stack_at < TRAVERSAL_STACK_SIZE, "BVH traversal stack overflow");
+						stack[stack_at++] = node_right;
+					}
+					continue;
+				}
+			}
+
+			if (stack_at == 0)
+				break;
+
+			node = stack[--stack_at];
+		}
+
+		return false;
+	}
+
+	bool trace_ray_tlas_occluded(const tlas_t& tlas, const bvh_t* const* instance_bvhs, const ray_t& ray, traversal_stats_t* stats)
+	{
+		traversal_stats_t stats_unused = {};
+		traversal_stats_t& ray_stats = get_traversal_stats(stats, stats_unused);
+		ray_stats.rays++;
+		ray_stats.aabb_tests++;
+
+		const tlas_node_t* nodes = tlas_get_nodes(tlas);
+		const bvh_instance_t* instances = tlas_get_instances(tlas);
+
+		const tlas_node_t* node = &nodes[0];
+
+		if (intersect_ray_aabb(node->aabb_min, node->aabb_max, ray) == RAY_MAX_T)
+			return false;
+
+		const tlas_node_t* stack[TRAVERSAL_STACK_SIZE];
+		uint32_t stack_at = 0;
+
+		while (true)
+		{
+			if (tlas_node_is_leaf(*node))
+			{
+				ray_t ray_local = make_ray_local(instances[node->instance_idx], ray);
+				ray_stats.tlas_leaves++;
+
+				if (trace_ray_bvh_local_occluded(*instance_bvhs[node->instance_idx], ray_local, &ray_stats))
+					return true;
+			}
+			else
+			{
+				ray_stats.inner_nodes++;
+				ray_stats.aabb_tests += 2;
+
+				const tlas_node_t* node_left = &nodes[node->left_right >> 16];
+				const tlas_node_t* node_right = &nodes[node->left_right & 0x0000FFFF];
+
+				bool hit_left = intersect_ray_aabb(node_left->aabb_min, node_left->aabb_max, ray) != RAY_MAX_T;
+				bool hit_right = intersect_ray_aabb(node_right->aabb_min, node_right->aabb_max, ray) != RAY_MAX_T;
+
+				if (hit_left || hit_right)
+				{
+					node = hit_left ? node_left : node_right;
+					if (hit_left && hit_right)
+					{
+						DEBUG_ASSERT_MSG(stack_at < TRAVERSAL_STACK_SIZE, "TLAS traversal stack overflow");
+						stack[stack_at++] = node_right;
+					}
+					continue;
+				}
+			}
+
+			if (stack_at == 0)
+				break;
+
+			node = stack[--stack_at];
+		}
+
+		return false;
+	}
+
+	void get_tlas_bounds(const tlas_t& tlas, glm::vec3& out_aabb_min, glm::vec3& out_aabb_max)
+	{
+		const tlas_node_t& root = tlas_get_nodes(tlas)[0];
+		out_aabb_min = root.aabb_min;
+		out_aabb_max = root.aabb_max;
+	}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+struct bvh_t;
+struct tlas_t;
+
+namespace cpu
+{
+
+	// Mirrors the global defines in common.hlsl
+	inline constexpr float INTERSECT_EPSILON = 1e-8f;
+	inline constexpr float RAY_MIN_T = 1e-8f;
+	inline constexpr float RAY_MAX_T = FLT_MAX;
+	inline constexpr bool TRIANGLE_BACKFACE_CULLING = true;
+
+	inline constexpr uint32_t INSTANCE_IDX_INVALID = UINT32_MAX;
+	inline constexpr uint32_t PRIMITIVE_IDX_INVALID = UINT32_MAX;
+
+	inline constexpr uint32_t TRAVERSAL_STACK_SIZE = 64;
+	// Mirrors BVH_SHORT_STACK_SIZE in accelstruct.hlsl
+	inline constexpr uint32_t TRAVERSAL_SHORT_STACK_SIZE = 8;
+
+	struct ray_t
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 inv_dir;
+		float t;
+	};
+
+	// Per-ray constants for the watertight ray-triangle intersection, the ray is sheared so that it points along +z from the origin
+	struct watertight_ray_t
+	{
+		uint32_t kx;
+		uint32_t ky;
+		uint32_t kz;
+		float sx;
+		float sy;
+		float sz;
+	};
+
+	// 64-bit sums of traversal_stats_t, for the counters of an entire frame
+	struct traversal_totals_t
+	{
+		uint64_t rays;
+		uint64_t tlas_leaves;
+		uint64_t inner_nodes;
+		uint64_t aabb_tests;
+		uint64_t triangle_tests;
+	};
+
+	void add_traversal_stats(traversal_stats_t& stats, const traversal_stats_t& other);
+	void add_traversal_stats(traversal_totals_t& totals, const traversal_stats_t& stats);
+	void add_traversal_stats(traversal_totals_t& totals, const traversal_totals_t& other);
+	// Number of AABB and triangle tests, which is what the traversal cost view mode visualizes
+	uint32_t get_traversal_cost(const traversal_stats_t& stats);
+
+	ray_t make_ray(const glm::vec3& origin, const glm::vec3& dir, float t_max = RAY_MAX_T);
+	hit_result_t make_hit_result();
+	bool has_hit_geometry(const hit_result_t& hit);
+
+	bool intersect_ray_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, ray_t& ray, glm::vec2& out_bary);
+	bool intersect_ray_triangle_any(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const ray_t& ray);
+	watertight_ray_t make_watertight_ray(const ray_t& ray);
+	bool intersect_ray_triangle_watertight(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const watertight_ray_t& ray_wt, ray_t& ray, glm::vec2& out_bary);
+	bool intersect_ray_triangle_watertight_any(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const watertight_ray_t& ray_wt, const ray_t& ray);
+	float intersect_ray_aabb(const glm::vec3& aabb_min, const glm::vec3& aabb_max, const ray_t& ray);
+
+	// Closest-hit traversal, same as the software raytracing path in accelstruct.hlsl
+	// The TLAS leaf nodes refer to instances by index, instance_bvhs contains the BLAS for every instance in that same order
+	// All traversal functions add the work they did to stats if it is not null
+	bool trace_ray_bvh_local(const bvh_t& bvh, ray_t& ray, hit_result_t& hit, traversal_stats_t* stats = nullptr);
+	// Same result as trace_ray_bvh_local, but only keeps the last TRAVERSAL_SHORT_STACK_SIZE node indices on the stack
+	// Entries that fall off the bottom of the stack are found again by walking up the parent links once the stack runs empty
+	bool trace_ray_bvh_local_short_stack(const bvh_t& bvh, ray_t& ray, hit_result_t& hit, traversal_stats_t* stats = nullptr);
+	void trace_ray_tlas(const tlas_t& tlas, const bvh_t* const* instance_bvhs, ray_t& ray, hit_result_t& hit, bool bvh_short_stack = false, traversal_stats_t* stats = nullptr);
+
+	// Occlusion-only traversal for shadow rays, returns as soon as any intersection within the ray extent is found
+	bool trace_ray_bvh_local_occluded(const bvh_t& bvh, const ray_t& ray, traversal_stats_t* stats = nullptr);
+	bool trace_ray_tlas_occluded(const tlas_t& tlas, const bvh_t* const* instance_bvhs, const ray_t& ray, traversal_stats_t* stats = nullptr);
+
+	// World space bounds of all instances, which is the bounding box of the TLAS root node
+	void get_tlas_bounds(const tlas_t& tlas, glm::vec3& out_aabb_min, glm::vec3& out_aabb_max);
+
+}
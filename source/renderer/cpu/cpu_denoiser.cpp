@@ -0,0 +1,149 @@
+#include "cpu_denoiser.h"
+#include "cpu_pathtracer.h"
+
+namespace cpu
+{
+
+	namespace denoiser
+	{
+
+		// Lower bound for the albedo when dividing it out of the color, so that black surfaces do not blow up the illumination
+		inline constexpr float DENOISE_MIN_ALBEDO = 1e-3f;
+		// Lower bound for the depth of a pixel when computing the relative depth difference to a filter tap
+		inline constexpr float DENOISE_MIN_DEPTH = 1e-4f;
+		// Separable B3 spline kernel from the paper, the 5x5 kernel is the outer product with itself
+		inline constexpr float DENOISE_KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+		static glm::vec3 get_demodulation_albedo(const glm::vec4& albedo)
+		{
+			return glm::max(glm::vec3(albedo), glm::vec3(DENOISE_MIN_ALBEDO));
+		}
+
+		static float get_edge_weight(float distance_sq, float sigma)
+		{
+			return glm::exp(-distance_sq / glm::max(sigma * sigma, 1e-8f));
+		}
+
+		static float get_edge_weight(const glm::vec3& a, const glm::vec3& b, float sigma)
+		{
+			return get_edge_weight(glm::dot(a - b, a - b), sigma);
+		}
+
+		void accumulate_tile(const render_settings_t& settings, uint32_t render_width, const glm::uvec2& tile_min, const glm::uvec2& tile_max,
+			const glm::vec4* energy, const path_features_t* features, const glm::vec4* pixel_variance, const denoise_buffers_t& buffers)
+		{
+			// The pixel variance sample count is only kept up to date while accumulating, every other frame replaces the accumulated values
+			bool accumulate = settings.accumulate && settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+
+			for (uint32_t y = tile_min.y; y < tile_max.y; ++y)
+			{
+				for (uint32_t x = tile_min.x; x < tile_max.x; ++x)
+				{
+					uint32_t pixel_idx = y * render_width + x;
+
+					if (energy[pixel_idx].w > 0.0f)
+					{
+						glm::vec3 color = glm::vec3(energy[pixel_idx]);
+
+						// Badness detector for NaN/INF in the energy, same as the post-process
+						if (glm::any(glm::isnan(color)) || glm::any(glm::isinf(color)))
+						{
+							color = glm::vec3(1.0f, 0.0f, 1.0f);
+						}
+
+						// The pixel variance sample count already includes this frame's sample, and is one for the first sample after an accumulator reset
+						float sample_weight = accumulate ? 1.0f / glm::max(pixel_variance[pixel_idx].x, 1.0f) : 1.0f;
+						buffers.color_accum[pixel_idx] = glm::mix(buffers.color_accum[pixel_idx], glm::vec4(color, 1.0f), sample_weight);
+
+						if (features)
+						{
+							const path_features_t& pixel_features = features[pixel_idx];
+							buffers.albedo_accum[pixel_idx] = glm::mix(buffers.albedo_accum[pixel_idx], glm::vec4(pixel_features.albedo, 1.0f), sample_weight);
+							buffers.normal_depth_accum[pixel_idx] = glm::mix(buffers.normal_depth_accum[pixel_idx],
+								glm::vec4(pixel_features.normal, pixel_features.depth), sample_weight);
+						}
+					}
+
+					if (!features)
+						continue;
+
+					glm::vec3 illumination = glm::vec3(buffers.color_accum[pixel_idx]) / get_demodulation_albedo(buffers.albedo_accum[pixel_idx]);
+					buffers.filter[0][pixel_idx] = glm::vec4(illumination, 1.0f);
+				}
+			}
+		}
+
+		void filter_tile(const render_settings_t& settings, const glm::uvec2& render_dim, uint32_t iteration, const glm::uvec2& tile_min, const glm::uvec2& tile_max,
+			const denoise_buffers_t& buffers, glm::vec4* out_color)
+		{
+			const glm::vec4* src = buffers.filter[iteration % 2];
+			bool last_iteration = iteration + 1 >= settings.denoise_iterations;
+			glm::vec4* dst = last_iteration ? out_color : buffers.filter[(iteration + 1) % 2];
+
+			int32_t step_width = 1 << iteration;
+			// The color variance is halved with every iteration, since the illumination gets smoother with every iteration as well
+			float sigma_color = settings.denoise_sigma_color / glm::sqrt((float)step_width);
+
+			for (uint32_t y = tile_min.y; y < tile_max.y; ++y)
+			{
+				for (uint32_t x = tile_min.x; x < tile_max.x; ++x)
+				{
+					uint32_t pixel_idx = y * render_dim.x + x;
+
+					glm::vec3 center_color = glm::vec3(src[pixel_idx]);
+					glm::vec3 center_albedo = glm::vec3(buffers.albedo_accum[pixel_idx]);
+					glm::vec4 center_normal_depth = buffers.normal_depth_accum[pixel_idx];
+					glm::vec3 filtered = center_color;
+
+					// Pixels that missed the scene show the environment, which is not noisy and would only lose detail by filtering it
+					if (center_normal_depth.w > 0.0f)
+					{
+						glm::vec3 color_sum = glm::vec3(0.0f);
+						float weight_sum = 0.0f;
+
+						for (int32_t ky = -2; ky <= 2; ++ky)
+						{
+							int32_t tap_y = (int32_t)y + ky * step_width;
+							if (tap_y < 0 || tap_y >= (int32_t)render_dim.y)
+								continue;
+
+							for (int32_t kx = -2; kx <= 2; ++kx)
+							{
+								int32_t tap_x = (int32_t)x + kx * step_width;
+								if (tap_x < 0 || tap_x >= (int32_t)render_dim.x)
+									continue;
+
+								uint32_t tap_idx = tap_y * render_dim.x + tap_x;
+								glm::vec3 tap_color = glm::vec3(src[tap_idx]);
+								glm::vec4 tap_normal_depth = buffers.normal_depth_accum[tap_idx];
+
+								float depth_delta = (center_normal_depth.w - tap_normal_depth.w) / glm::max(center_normal_depth.w, DENOISE_MIN_DEPTH);
+
+								float weight = DENOISE_KERNEL[kx + 2] * DENOISE_KERNEL[ky + 2];
+								weight *= get_edge_weight(center_color, tap_color, sigma_color);
+								weight *= get_edge_weight(center_albedo, glm::vec3(buffers.albedo_accum[tap_idx]), settings.denoise_sigma_albedo);
+								weight *= get_edge_weight(glm::vec3(center_normal_depth), glm::vec3(tap_normal_depth), settings.denoise_sigma_normal);
+								weight *= get_edge_weight(depth_delta * depth_delta, settings.denoise_sigma_depth);
+
+								color_sum += tap_color * weight;
+								weight_sum += weight;
+							}
+						}
+
+						// The center tap always has a weight of one for all edge-stopping functions, so the weight sum is never zero
+						filtered = color_sum / weight_sum;
+					}
+
+					if (last_iteration)
+					{
+						filtered *= get_demodulation_albedo(buffers.albedo_accum[pixel_idx]);
+					}
+
+					dst[pixel_idx] = glm::vec4(filtered, 1.0f);
+				}
+			}
+		}
+
+	}
+
+}
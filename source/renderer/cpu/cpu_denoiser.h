@@ -0,0 +1,39 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+namespace cpu
+{
+
+	struct path_features_t;
+
+	// Accumulated color and first hit features of every pixel, plus two intermediate buffers that the filter iterations ping-pong between
+	// All buffers are indexed by pixel and need to be at least render_width * render_height in size
+	struct denoise_buffers_t
+	{
+		glm::vec4* color_accum;
+		glm::vec4* albedo_accum;
+		// xyz: normal, w: depth
+		glm::vec4* normal_depth_accum;
+		glm::vec4* filter[2];
+	};
+
+	// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010), which filters the accumulated color with the albedo, normal and depth as edge-stopping functions
+	// Every iteration reads the pixels of the previous one, so all tiles of an iteration need to be done before the next iteration starts
+	namespace denoiser
+	{
+
+		// Adds the energy and features of the pixels traced this frame to the accumulators, the same way the post-process accumulates for the GPU path tracers
+		// Pixels with an energy alpha of zero were not traced and keep their accumulated values, pixel_variance holds the per-pixel sample count
+		// Only the color is accumulated if features is null, otherwise the accumulated color also gets divided by the albedo and written to filter[0],
+		// so that the filter does not blur the texture detail
+		void accumulate_tile(const render_settings_t& settings, uint32_t render_width, const glm::uvec2& tile_min, const glm::uvec2& tile_max,
+			const glm::vec4* energy, const path_features_t* features, const glm::vec4* pixel_variance, const denoise_buffers_t& buffers);
+		// Runs one filter iteration over filter[iteration % 2], every iteration doubles the distance between the filter taps
+		// The last iteration multiplies the albedo back in and writes the result to out_color with an alpha of one, the others write to filter[(iteration + 1) % 2]
+		void filter_tile(const render_settings_t& settings, const glm::uvec2& render_dim, uint32_t iteration, const glm::uvec2& tile_min, const glm::uvec2& tile_max,
+			const denoise_buffers_t& buffers, glm::vec4* out_color);
+
+	}
+
+}
@@ -0,0 +1,418 @@
+#include "cpu_path_guiding.h"
+#include "core/thread.h"
+#include "core/logger.h"
+#include "core/assertion.h"
+#include "core/memory/memory_arena.h"
+
+namespace cpu
+{
+
+	namespace path_guiding
+	{
+
+		inline constexpr float FOUR_PI = 12.5663706f;
+		inline constexpr float TWO_PI = 6.28318530f;
+
+		inline constexpr uint32_t SPATIAL_LEAF_MAX_COUNT = 2048;
+		inline constexpr uint32_t DIRECTIONAL_NODE_MAX_COUNT = 128;
+		inline constexpr uint32_t DIRECTIONAL_MAX_DEPTH = 20;
+		// A quadrant that received more than this fraction of the radiance of its quadtree gets subdivided for the next iteration
+		inline constexpr float DIRECTIONAL_SUBDIVISION_THRESHOLD = 0.01f;
+		// A spatial leaf splits once it received more than this many records times the square root of the passes in the iteration
+		inline constexpr uint32_t SPATIAL_SUBDIVISION_THRESHOLD = 12000;
+		// Iteration k takes 2^k passes, training stops after the last iteration and the guide stays the same until the next reset
+		inline constexpr uint32_t TRAINING_ITERATION_COUNT = 10;
+		// One-sample MIS between the guide and the BSDF, half of the directions come from either one
+		inline constexpr float GUIDE_PROBABILITY = 0.5f;
+
+		// Quadtree node over the square of cylindrical coordinates, quadrant index is x + 2 * y, a child index of zero means the quadrant is a leaf
+		// The root is always node zero, so it can never be a child
+		struct directional_node_t
+		{
+			float sums[4];
+			uint32_t children[4];
+		};
+
+		struct directional_tree_t
+		{
+			uint32_t node_count;
+			directional_node_t nodes[DIRECTIONAL_NODE_MAX_COUNT];
+		};
+
+		// The sampling tree is only read from during a pass, the training tree gets the records of the pass and replaces the sampling tree at the end of the iteration
+		struct spatial_leaf_t
+		{
+			directional_tree_t sampling;
+			directional_tree_t training;
+
+			mutex_t mutex;
+			uint32_t record_count;
+		};
+
+		// Binary tree over the cube around the scene, the split axis alternates between x, y and z with every level
+		struct spatial_node_t
+		{
+			uint32_t axis;
+			// Zero for leaves
+			uint32_t children[2];
+			uint32_t leaf_idx;
+		};
+
+		struct path_guiding_inst_t
+		{
+			glm::vec3 cube_min;
+			float cube_size;
+
+			uint32_t spatial_node_count;
+			spatial_node_t* spatial_nodes;
+			uint32_t spatial_leaf_count;
+			spatial_leaf_t* spatial_leaves;
+
+			uint32_t iteration;
+			uint32_t iteration_pass_count;
+		};
+		static path_guiding_inst_t* g_path_guiding = nullptr;
+
+		// Cylindrical mapping of the sphere onto the unit square, it preserves area so the pdf on the sphere is the pdf on the square divided by 4 pi
+		static glm::vec2 direction_to_square(const glm::vec3& direction)
+		{
+			float cos_theta = glm::clamp(direction.z, -1.0f, 1.0f);
+			float phi = glm::atan(direction.y, direction.x);
+			if (phi < 0.0f)
+				phi += TWO_PI;
+
+			return glm::clamp(glm::vec2((cos_theta + 1.0f) * 0.5f, phi / TWO_PI), 0.0f, 1.0f);
+		}
+
+		static glm::vec3 square_to_direction(const glm::vec2& p)
+		{
+			float cos_theta = 2.0f * p.x - 1.0f;
+			float sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - cos_theta * cos_theta));
+			float phi = TWO_PI * p.y;
+
+			return glm::vec3(sin_theta * glm::cos(phi), sin_theta * glm::sin(phi), cos_theta);
+		}
+
+		static uint32_t get_quadrant(glm::vec2& p)
+		{
+			uint32_t x = p.x >= 0.5f ? 1 : 0;
+			uint32_t y = p.y >= 0.5f ? 1 : 0;
+			p = p * 2.0f - glm::vec2(x, y);
+
+			return x + 2 * y;
+		}
+
+		static float get_total(const directional_node_t& node)
+		{
+			return node.sums[0] + node.sums[1] + node.sums[2] + node.sums[3];
+		}
+
+		static void clear_tree(directional_tree_t& tree)
+		{
+			tree.node_count = 1;
+			tree.nodes[0] = {};
+		}
+
+		static void copy_tree(directional_tree_t& dst, const directional_tree_t& src)
+		{
+			dst.node_count = src.node_count;
+			memcpy(dst.nodes, src.nodes, sizeof(directional_node_t) * src.node_count);
+		}
+
+		// Builds the structure of dst from the radiance in src with all sums at zero, quadrants that hold a large enough fraction of the radiance get subdivided,
+		// and the ones that do not get collapsed, src might be coarser than the new structure, its leaf quadrants then spread their radiance evenly over the new children
+		static void refine_tree(directional_tree_t& dst, const directional_tree_t& src)
+		{
+			struct refine_entry_t
+			{
+				uint32_t dst_node_idx;
+				// UINT32_MAX once the new structure goes deeper than src
+				uint32_t src_node_idx;
+				float src_sums[4];
+				uint32_t depth;
+			};
+
+			clear_tree(dst);
+
+			float total = get_total(src.nodes[0]);
+			if (total <= 0.0f)
+				return;
+
+			refine_entry_t stack[DIRECTIONAL_NODE_MAX_COUNT];
+			uint32_t stack_at = 0;
+			stack[stack_at++] = { 0, 0, { src.nodes[0].sums[0], src.nodes[0].sums[1], src.nodes[0].sums[2], src.nodes[0].sums[3] }, 1 };
+
+			while (stack_at > 0)
+			{
+				refine_entry_t entry = stack[--stack_at];
+
+				for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+				{
+					if (entry.src_sums[quadrant] / total <= DIRECTIONAL_SUBDIVISION_THRESHOLD || entry.depth >= DIRECTIONAL_MAX_DEPTH ||
+						dst.node_count >= DIRECTIONAL_NODE_MAX_COUNT || stack_at >= DIRECTIONAL_NODE_MAX_COUNT)
+						continue;
+
+					uint32_t child_idx = dst.node_count++;
+					dst.nodes[child_idx] = {};
+					dst.nodes[entry.dst_node_idx].children[quadrant] = child_idx;
+
+					refine_entry_t child = { child_idx, UINT32_MAX, {}, entry.depth + 1 };
+					uint32_t src_child_idx = entry.src_node_idx != UINT32_MAX ? src.nodes[entry.src_node_idx].children[quadrant] : 0;
+					if (src_child_idx != 0)
+					{
+						child.src_node_idx = src_child_idx;
+						memcpy(child.src_sums, src.nodes[src_child_idx].sums, sizeof(child.src_sums));
+					}
+					else
+					{
+						for (uint32_t i = 0; i < 4; ++i)
+							child.src_sums[i] = entry.src_sums[quadrant] * 0.25f;
+					}
+
+					stack[stack_at++] = child;
+				}
+			}
+		}
+
+		static spatial_leaf_t& get_leaf(uint32_t leaf_idx)
+		{
+			ASSERT(leaf_idx < g_path_guiding->spatial_leaf_count);
+			return g_path_guiding->spatial_leaves[leaf_idx];
+		}
+
+		static uint32_t get_spatial_subdivision_threshold()
+		{
+			return (uint32_t)(SPATIAL_SUBDIVISION_THRESHOLD * glm::sqrt((float)(1u << g_path_guiding->iteration)));
+		}
+
+		// Splits every spatial leaf that received too many records in two, the children start out with a copy of the trees of the parent and half of its records
+		static void subdivide_spatial_tree()
+		{
+			uint32_t threshold = get_spatial_subdivision_threshold();
+
+			// New nodes get appended, so they are visited as well and keep splitting until they are below the threshold
+			for (uint32_t node_idx = 0; node_idx < g_path_guiding->spatial_node_count; ++node_idx)
+			{
+				spatial_node_t& node = g_path_guiding->spatial_nodes[node_idx];
+				if (node.children[0] != 0)
+					continue;
+
+				spatial_leaf_t& leaf = get_leaf(node.leaf_idx);
+				if (leaf.record_count <= threshold || g_path_guiding->spatial_leaf_count >= SPATIAL_LEAF_MAX_COUNT)
+					continue;
+
+				leaf.record_count /= 2;
+
+				uint32_t child_leaf_idx = g_path_guiding->spatial_leaf_count++;
+				spatial_leaf_t& child_leaf = g_path_guiding->spatial_leaves[child_leaf_idx];
+				copy_tree(child_leaf.sampling, leaf.sampling);
+				copy_tree(child_leaf.training, leaf.training);
+				child_leaf.record_count = leaf.record_count;
+
+				// The first child keeps the leaf of the parent, the second one gets the copy
+				for (uint32_t i = 0; i < 2; ++i)
+				{
+					uint32_t child_node_idx = g_path_guiding->spatial_node_count++;
+					spatial_node_t& child = g_path_guiding->spatial_nodes[child_node_idx];
+					child = {};
+					child.axis = (node.axis + 1) % 3;
+					child.leaf_idx = i == 0 ? node.leaf_idx : child_leaf_idx;
+					node.children[i] = child_node_idx;
+				}
+			}
+		}
+
+		void init(memory_arena_t& arena)
+		{
+			g_path_guiding = ARENA_ALLOC_STRUCT_ZERO(arena, path_guiding_inst_t);
+			// Every split turns one leaf into two nodes
+			g_path_guiding->spatial_nodes = ARENA_ALLOC_ARRAY_ZERO(arena, spatial_node_t, 2 * SPATIAL_LEAF_MAX_COUNT);
+			g_path_guiding->spatial_leaves = ARENA_ALLOC_ARRAY_ZERO(arena, spatial_leaf_t, SPATIAL_LEAF_MAX_COUNT);
+
+			reset(glm::vec3(-1.0f), glm::vec3(1.0f));
+
+			LOG_INFO("CPU", "Path guiding: %u spatial leaves with %u directional nodes (%llu MB)", SPATIAL_LEAF_MAX_COUNT, DIRECTIONAL_NODE_MAX_COUNT,
+				(sizeof(spatial_leaf_t) * SPATIAL_LEAF_MAX_COUNT) >> 20);
+		}
+
+		void exit()
+		{
+			g_path_guiding = nullptr;
+		}
+
+		void reset(const glm::vec3& scene_aabb_min, const glm::vec3& scene_aabb_max)
+		{
+			// A cube keeps the spatial leaves roughly cube shaped as well, since every axis gets split equally often
+			glm::vec3 extent = scene_aabb_max - scene_aabb_min;
+			g_path_guiding->cube_size = glm::max(glm::max(extent.x, glm::max(extent.y, extent.z)), 1e-4f);
+			g_path_guiding->cube_min = (scene_aabb_min + scene_aabb_max) * 0.5f - 0.5f * g_path_guiding->cube_size;
+
+			g_path_guiding->spatial_node_count = 1;
+			g_path_guiding->spatial_nodes[0] = {};
+			g_path_guiding->spatial_leaf_count = 1;
+
+			spatial_leaf_t& root_leaf = g_path_guiding->spatial_leaves[0];
+			clear_tree(root_leaf.sampling);
+			clear_tree(root_leaf.training);
+			root_leaf.record_count = 0;
+
+			g_path_guiding->iteration = 0;
+			g_path_guiding->iteration_pass_count = 0;
+		}
+
+		void end_pass()
+		{
+			if (!is_training())
+				return;
+
+			g_path_guiding->iteration_pass_count++;
+			if (g_path_guiding->iteration_pass_count < (1u << g_path_guiding->iteration))
+				return;
+
+			// The spatial tree is split first, so that the children of a split leaf still refine their directional trees from the records of the parent
+			subdivide_spatial_tree();
+
+			for (uint32_t leaf_idx = 0; leaf_idx < g_path_guiding->spatial_leaf_count; ++leaf_idx)
+			{
+				spatial_leaf_t& leaf = g_path_guiding->spatial_leaves[leaf_idx];
+				copy_tree(leaf.sampling, leaf.training);
+				refine_tree(leaf.training, leaf.sampling);
+				leaf.record_count = 0;
+			}
+
+			g_path_guiding->iteration++;
+			g_path_guiding->iteration_pass_count = 0;
+		}
+
+		bool is_training()
+		{
+			return g_path_guiding->iteration < TRAINING_ITERATION_COUNT;
+		}
+
+		uint32_t find_leaf(const glm::vec3& position)
+		{
+			glm::vec3 p = glm::clamp((position - g_path_guiding->cube_min) / g_path_guiding->cube_size, 0.0f, 1.0f);
+			const spatial_node_t* node = &g_path_guiding->spatial_nodes[0];
+
+			while (node->children[0] != 0)
+			{
+				uint32_t child = p[node->axis] >= 0.5f ? 1 : 0;
+				p[node->axis] = p[node->axis] * 2.0f - (float)child;
+				node = &g_path_guiding->spatial_nodes[node->children[child]];
+			}
+
+			return node->leaf_idx;
+		}
+
+		float get_guide_probability(uint32_t leaf_idx)
+		{
+			return get_total(get_leaf(leaf_idx).sampling.nodes[0]) > 0.0f ? GUIDE_PROBABILITY : 0.0f;
+		}
+
+		// Walks down the quadtree and picks every quadrant proportional to its radiance, first the column and then the row within that column,
+		// the random numbers get rescaled after every decision so they can be reused for the next level and for the position within the leaf quadrant
+		glm::vec3 sample(uint32_t leaf_idx, const glm::vec2& r)
+		{
+			const directional_tree_t& tree = get_leaf(leaf_idx).sampling;
+			const directional_node_t* node = &tree.nodes[0];
+			glm::vec2 u = r;
+			glm::vec2 origin = glm::vec2(0.0f);
+			float size = 1.0f;
+
+			while (true)
+			{
+				float total = get_total(*node);
+				float column_sums[2] = { node->sums[0] + node->sums[2], node->sums[1] + node->sums[3] };
+				float p_left = total > 0.0f ? column_sums[0] / total : 0.5f;
+
+				uint32_t x = u.x < p_left ? 0 : 1;
+				u.x = x == 0 ? u.x / p_left : (u.x - p_left) / (1.0f - p_left);
+
+				float p_top = column_sums[x] > 0.0f ? node->sums[x] / column_sums[x] : 0.5f;
+				uint32_t y = u.y < p_top ? 0 : 1;
+				u.y = y == 0 ? u.y / p_top : (u.y - p_top) / (1.0f - p_top);
+
+				size *= 0.5f;
+				origin += glm::vec2(x, y) * size;
+
+				uint32_t child_idx = node->children[x + 2 * y];
+				if (child_idx == 0)
+					break;
+
+				node = &tree.nodes[child_idx];
+			}
+
+			return square_to_direction(origin + glm::clamp(u, 0.0f, 1.0f) * size);
+		}
+
+		float get_pdf(uint32_t leaf_idx, const glm::vec3& direction)
+		{
+			const directional_tree_t& tree = get_leaf(leaf_idx).sampling;
+			const directional_node_t* node = &tree.nodes[0];
+			glm::vec2 p = direction_to_square(direction);
+			float pdf = 1.0f;
+
+			while (true)
+			{
+				uint32_t quadrant = get_quadrant(p);
+				float total = get_total(*node);
+				if (total <= 0.0f)
+					break;
+
+				pdf *= 4.0f * node->sums[quadrant] / total;
+
+				uint32_t child_idx = node->children[quadrant];
+				if (child_idx == 0)
+					break;
+
+				node = &tree.nodes[child_idx];
+			}
+
+			return pdf / FOUR_PI;
+		}
+
+		void record(uint32_t leaf_idx, const glm::vec3& direction, float radiance_over_pdf)
+		{
+			if (glm::isnan(radiance_over_pdf) || glm::isinf(radiance_over_pdf) || radiance_over_pdf < 0.0f)
+				return;
+
+			spatial_leaf_t& leaf = get_leaf(leaf_idx);
+			glm::vec2 p = direction_to_square(direction);
+
+			thread::mutex::lock(leaf.mutex);
+
+			leaf.record_count++;
+			directional_node_t* node = &leaf.training.nodes[0];
+			while (true)
+			{
+				uint32_t quadrant = get_quadrant(p);
+				node->sums[quadrant] += radiance_over_pdf;
+
+				uint32_t child_idx = node->children[quadrant];
+				if (child_idx == 0)
+					break;
+
+				node = &leaf.training.nodes[child_idx];
+			}
+
+			thread::mutex::unlock(leaf.mutex);
+		}
+
+		stats_t get_stats()
+		{
+			stats_t stats = {};
+			stats.iteration = g_path_guiding->iteration;
+			stats.training = is_training();
+			stats.spatial_leaf_count = g_path_guiding->spatial_leaf_count;
+
+			for (uint32_t leaf_idx = 0; leaf_idx < g_path_guiding->spatial_leaf_count; ++leaf_idx)
+			{
+				stats.directional_node_count += g_path_guiding->spatial_leaves[leaf_idx].sampling.node_count;
+			}
+
+			return stats;
+		}
+
+	}
+
+}
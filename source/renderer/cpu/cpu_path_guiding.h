@@ -0,0 +1,52 @@
+#pragma once
+#include "core/common.h"
+
+struct memory_arena_t;
+
+namespace cpu
+{
+
+	// Online path guiding for the CPU path tracer, from "Practical Path Guiding for Efficient Light-Transport Simulation" (Muller et al. 2017)
+	// The scene is split by a binary tree over space, every spatial leaf keeps a quadtree over the sphere of directions with the incident radiance learned from earlier paths
+	// Training runs in iterations that each take twice as many passes as the previous one, at the end of an iteration the learned quadtrees get used for sampling
+	// and the tree structure is refined, so that the next iteration learns at a higher resolution wherever the radiance is concentrated
+	namespace path_guiding
+	{
+
+		struct stats_t
+		{
+			uint32_t iteration;
+			bool training;
+			uint32_t spatial_leaf_count;
+			// Summed over the sampling quadtrees of all spatial leaves
+			uint32_t directional_node_count;
+		};
+
+		void init(memory_arena_t& arena);
+		void exit();
+
+		// Throws away everything that was learned and starts training again within the given bounds, there can be no CPU pass in flight
+		void reset(const glm::vec3& scene_aabb_min, const glm::vec3& scene_aabb_max);
+		// Called after every completed CPU pass, refines the trees once the current training iteration has seen all of its passes
+		// Needs to be called in between passes, since the trees that the next pass samples from get replaced
+		void end_pass();
+		bool is_training();
+
+		// Index of the spatial leaf that contains the position
+		uint32_t find_leaf(const glm::vec3& position);
+		// Probability of sampling the guide instead of the BSDF at the position, zero until the leaf has learned anything
+		float get_guide_probability(uint32_t leaf_idx);
+		// Samples a direction proportional to the radiance the leaf learned in the previous iteration
+		glm::vec3 sample(uint32_t leaf_idx, const glm::vec2& r);
+		// Solid angle pdf of sample returning the direction
+		float get_pdf(uint32_t leaf_idx, const glm::vec3& direction);
+
+		// Adds radiance that arrived at a position in the leaf from the direction, divided by the pdf of the direction, to the quadtree that is being trained
+		// Safe to call from multiple threads
+		void record(uint32_t leaf_idx, const glm::vec3& direction, float radiance_over_pdf);
+
+		stats_t get_stats();
+
+	}
+
+}
@@ -0,0 +1,783 @@
+#include "cpu_pathtracer.h"
+#include "cpu_accelstruct.h"
+#include "cpu_sampler.h"
+#include "cpu_texture.h"
+#include "cpu_scan.h"
+#include "cpu_path_guiding.h"
+#include "renderer/bvh/bvh_builder.h"
+#include "renderer/bvh/tlas_builder.h"
+#include "renderer/light/light_builder.h"
+
+
+namespace cpu
+{
+
+	inline constexpr float PI = 3.14159265f;
+	inline constexpr float TWO_PI = 6.28318530f;
+	inline constexpr float INV_PI = 0.31830988f;
+	inline constexpr float INV_TWO_PI = 0.15915494f;
+	inline constexpr glm::vec2 INV_ATAN = glm::vec2(0.1591f, 0.3183f);
+	// Shadow rays towards a light are shortened slightly so that they do not hit the light itself
+	inline constexpr float SHADOW_RAY_T_MAX_MULTIPLIER = 1.0f - 1e-4f;
+	// Lower bound for the russian roulette survival probability, so that surviving paths do not get boosted by too much
+	inline constexpr float RUSSIAN_ROULETTE_MIN_SURVIVAL_PROBABILITY = 0.05f;
+	// Lower bound for the pixel luminance mean when computing the relative error, so that black pixels can still converge
+	inline constexpr float ADAPTIVE_SAMPLING_MIN_LUMINANCE = 1e-3f;
+	// Widening of the ray cone spread angle at every diffuse bounce, a diffuse lobe is much wider than a pixel so the secondary hits sample blurrier mips
+	inline constexpr float RAY_CONE_DIFFUSE_SPREAD_ANGLE = 0.1f;
+	// Pixels along a row are tested for convergence this many at a time, and only the active ones get compacted into the list that is traced
+	inline constexpr uint32_t RENDER_TILE_SPAN_SIZE = 64;
+	// Paths with more bounces than this are not recorded for path guiding, the bounce count slider stays well below it
+	inline constexpr uint32_t PATH_GUIDING_MAX_VERTEX_COUNT = 16;
+
+	struct hit_surface_t
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 tex_coord;
+
+		const instance_data_t* instance;
+		const triangle_t* tri;
+		const material_textures_t* textures;
+	};
+
+	// Everything needed to select the mip of a texture on the hit surface, see get_texture_lod
+	struct texture_footprint_t
+	{
+		bool use_ray_cones;
+		float triangle_lod;
+		float cone_width;
+		float cos_theta;
+	};
+
+	struct light_sample_t
+	{
+		glm::vec3 direction;
+		float distance;
+		glm::vec3 emission;
+		// Solid angle pdf of the sample, including the probability of picking the light
+		float pdf;
+	};
+
+	struct sampled_material_t
+	{
+		glm::vec3 base_color;
+		float metallic;
+		float roughness;
+		glm::vec3 emissive_color;
+	};
+
+	// Bounce of a path while path guiding is training, the radiance that arrives along the sampled direction gets added up until the path ends
+	struct guide_vertex_t
+	{
+		uint32_t leaf_idx;
+		glm::vec3 direction;
+		// Path throughput after the bounce, including the russian roulette of the bounce
+		glm::vec3 throughput;
+		float pdf;
+		glm::vec3 radiance;
+	};
+
+	struct guide_path_t
+	{
+		uint32_t vertex_count;
+		guide_vertex_t vertices[PATH_GUIDING_MAX_VERTEX_COUNT];
+	};
+
+	template<typename T>
+	static T interpolate(const T& v0, const T& v1, const T& v2, const glm::vec2& bary)
+	{
+		return v0 + bary.x * (v1 - v0) + bary.y * (v2 - v0);
+	}
+
+	static float get_luminance(const glm::vec3& color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	// Paths that carry little energy are more likely to get terminated, the caller divides the throughput by this probability if the path survives
+	static float get_russian_roulette_survival_probability(const glm::vec3& throughput)
+	{
+		return glm::clamp(get_luminance(throughput), RUSSIAN_ROULETTE_MIN_SURVIVAL_PROBABILITY, 1.0f);
+	}
+
+	// A pixel has converged once the relative standard error of its luminance mean drops below the adaptive sampling threshold
+	static bool is_pixel_converged(const render_settings_t& settings, const glm::vec4& pixel_variance)
+	{
+		if (!settings.adaptive_sampling || !settings.accumulate || settings.render_view_mode != RENDER_VIEW_MODE_NONE)
+			return false;
+
+		float sample_count = pixel_variance.x;
+		if (sample_count < (float)glm::max(settings.adaptive_sampling_min_samples, 2u))
+			return false;
+
+		float variance_of_mean = pixel_variance.z / ((sample_count - 1.0f) * sample_count);
+		float relative_error = glm::sqrt(variance_of_mean) / glm::max(pixel_variance.y, ADAPTIVE_SAMPLING_MIN_LUMINANCE);
+
+		return relative_error < settings.adaptive_sampling_threshold;
+	}
+
+	static uint32_t murmur_mix(uint32_t hash)
+	{
+		hash ^= hash >> 16;
+		hash *= 0x85ebca6b;
+		hash ^= hash >> 13;
+		hash *= 0xc2b2ae35;
+		hash ^= hash >> 16;
+		return hash;
+	}
+
+	static glm::vec3 int_to_color(uint32_t value)
+	{
+		uint32_t hash = murmur_mix(value);
+		glm::vec3 color = glm::vec3(
+			(hash >> 0) & 255,
+			(hash >> 8) & 255,
+			(hash >> 16) & 255
+		);
+		return color * (1.0f / 255.0f);
+	}
+
+	// Maps the traversal cost to a blue-green-red color ramp, same as cost_to_heatmap in common.hlsl
+	static glm::vec3 cost_to_heatmap(float cost, float max_cost)
+	{
+		float x = glm::clamp(cost / glm::max(max_cost, 1.0f), 0.0f, 1.0f);
+		return glm::clamp(glm::vec3(
+			1.5f - glm::abs(4.0f * x - 3.0f),
+			1.5f - glm::abs(4.0f * x - 2.0f),
+			1.5f - glm::abs(4.0f * x - 1.0f)
+		), 0.0f, 1.0f);
+	}
+
+	static glm::vec2 direction_to_equirect_uv(const glm::vec3& dir)
+	{
+		glm::vec2 uv = glm::vec2(glm::atan(dir.z, dir.x), glm::asin(-dir.y));
+		uv *= INV_ATAN;
+		uv += 0.5f;
+
+		return uv;
+	}
+
+	// Inverse of direction_to_equirect_uv
+	static glm::vec3 equirect_uv_to_direction(const glm::vec2& uv)
+	{
+		float phi = (uv.x - 0.5f) * TWO_PI;
+		float latitude = (uv.y - 0.5f) * PI;
+		float cos_latitude = glm::cos(latitude);
+
+		return glm::vec3(cos_latitude * glm::cos(phi), -glm::sin(latitude), cos_latitude * glm::sin(phi));
+	}
+
+	// Returns the tangent to world transform, x = tangent, y = normal, z = bitangent
+	static glm::mat3 create_orthonormal_basis(const glm::vec3& normal)
+	{
+		glm::vec3 tangent;
+		if (glm::abs(normal.x) > glm::abs(normal.z))
+		{
+			tangent = glm::normalize(glm::vec3(-normal.y, normal.x, 0.0f));
+		}
+		else
+		{
+			tangent = glm::normalize(glm::vec3(0.0f, -normal.z, normal.y));
+		}
+
+		glm::vec3 bitangent = glm::cross(normal, tangent);
+		return glm::mat3(tangent, normal, bitangent);
+	}
+
+	static glm::vec3 uniform_hemisphere_sample(const glm::vec3& normal, const glm::vec2& r)
+	{
+		float sin_theta = glm::sqrt(1.0f - r.x * r.x);
+		float phi = TWO_PI * r.y;
+
+		float x = sin_theta * glm::cos(phi);
+		float z = sin_theta * glm::sin(phi);
+
+		return create_orthonormal_basis(normal) * glm::normalize(glm::vec3(x, r.x, z));
+	}
+
+	static glm::vec3 cosine_weighted_hemisphere_sample(const glm::vec3& normal, const glm::vec2& r)
+	{
+		float sin_theta = glm::sqrt(r.x);
+		float phi = TWO_PI * r.y;
+
+		float x = sin_theta * glm::cos(phi);
+		float z = sin_theta * glm::sin(phi);
+
+		return create_orthonormal_basis(normal) * glm::normalize(glm::vec3(x, glm::sqrt(1.0f - r.x), z));
+	}
+
+	static float uniform_hemisphere_pdf()
+	{
+		return INV_TWO_PI;
+	}
+
+	static float cosine_weighted_hemisphere_pdf(float NoL)
+	{
+		return NoL * INV_PI;
+	}
+
+	// Pdf of the mixture between the guide and the diffuse BSDF sampling, only the guide can pick directions below the surface
+	static float get_bounce_pdf(const render_settings_t& settings, uint32_t guide_leaf_idx, float guide_probability, float NoL, const glm::vec3& L)
+	{
+		float bsdf_pdf = 0.0f;
+		if (NoL > 0.0f)
+			bsdf_pdf = settings.cosine_weighted_diffuse ? cosine_weighted_hemisphere_pdf(NoL) : uniform_hemisphere_pdf();
+
+		if (guide_probability <= 0.0f)
+			return bsdf_pdf;
+
+		return guide_probability * path_guiding::get_pdf(guide_leaf_idx, L) + (1.0f - guide_probability) * bsdf_pdf;
+	}
+
+	// Energy that gets added to the path further along also arrived at every earlier bounce along its sampled direction, divided by the throughput in between
+	static void add_guide_radiance(guide_path_t& guide_path, uint32_t vertex_count, const glm::vec3& contribution)
+	{
+		for (uint32_t i = 0; i < vertex_count; ++i)
+		{
+			guide_vertex_t& vertex = guide_path.vertices[i];
+			vertex.radiance += glm::vec3(
+				vertex.throughput.x > 0.0f ? contribution.x / vertex.throughput.x : 0.0f,
+				vertex.throughput.y > 0.0f ? contribution.y / vertex.throughput.y : 0.0f,
+				vertex.throughput.z > 0.0f ? contribution.z / vertex.throughput.z : 0.0f
+			);
+		}
+	}
+
+	// The bounce that found a light gets the emitted radiance without the MIS weight, otherwise the guide would barely learn about lights that next event estimation covers
+	static void add_guide_emission(guide_path_t& guide_path, const glm::vec3& contribution, const glm::vec3& emission)
+	{
+		if (guide_path.vertex_count == 0)
+			return;
+
+		add_guide_radiance(guide_path, guide_path.vertex_count - 1, contribution);
+		guide_path.vertices[guide_path.vertex_count - 1].radiance += emission;
+	}
+
+	static void record_guide_path(const guide_path_t& guide_path)
+	{
+		for (uint32_t i = 0; i < guide_path.vertex_count; ++i)
+		{
+			const guide_vertex_t& vertex = guide_path.vertices[i];
+			if (vertex.pdf > 0.0f)
+			{
+				path_guiding::record(vertex.leaf_idx, vertex.direction, get_luminance(vertex.radiance) / vertex.pdf);
+			}
+		}
+	}
+
+	static ray_t make_primary_ray(const view_t& view, const glm::uvec2& pixel_pos)
+	{
+		glm::vec2 uv = (glm::vec2(pixel_pos) + 0.5f) / view.render_dim;
+		uv.y = 1.0f - uv.y;
+
+		glm::vec2 pixel_pos_clip = 2.0f * uv - 1.0f;
+
+		glm::vec3 camera_to_pixel_view = glm::normalize(glm::vec3(view.clip_to_view * glm::vec4(pixel_pos_clip, 1.0f, 1.0f)));
+		glm::vec3 camera_to_pixel_world = view.view_to_world * glm::vec4(camera_to_pixel_view, 0.0f);
+		glm::vec3 camera_origin_world = view.view_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		return make_ray(camera_origin_world, camera_to_pixel_world);
+	}
+
+	static uint32_t get_hdr_env_texel_idx(const scene_t& scene, const glm::vec3& dir)
+	{
+		glm::vec2 uv = direction_to_equirect_uv(dir);
+		uint32_t x = MIN((uint32_t)(uv.x * scene.hdr_env_width), scene.hdr_env_width - 1);
+		uint32_t y = MIN((uint32_t)(uv.y * scene.hdr_env_height), scene.hdr_env_height - 1);
+
+		return y * scene.hdr_env_width + x;
+	}
+
+	static glm::vec3 sample_hdr_env(const scene_t& scene, const glm::vec3& dir)
+	{
+		if (!scene.hdr_env_pixels)
+			return glm::vec3(1.0f);
+
+		return scene.hdr_env_pixels[get_hdr_env_texel_idx(scene, dir)];
+	}
+
+	static hit_surface_t get_hit_surface(const scene_t& scene, const hit_result_t& hit)
+	{
+		hit_surface_t hit_surface = {};
+
+		hit_surface.instance = &scene.instances[hit.instance_idx];
+		hit_surface.tri = &scene.instance_triangles[hit.instance_idx][hit.primitive_idx];
+		hit_surface.textures = &scene.instance_textures[hit.instance_idx];
+
+		const triangle_t& tri = *hit_surface.tri;
+		hit_surface.position = interpolate(tri.v0.position, tri.v1.position, tri.v2.position, hit.bary);
+		hit_surface.position = transform_point(hit_surface.instance->local_to_world, hit_surface.position);
+		// TODO: Calculate bitangent, do normal mapping
+		hit_surface.normal = interpolate(tri.v0.normal, tri.v1.normal, tri.v2.normal, hit.bary);
+		hit_surface.normal = glm::normalize(transform_vector(hit_surface.instance->local_to_world, hit_surface.normal));
+		hit_surface.tex_coord = interpolate(tri.v0.uv, tri.v1.uv, tri.v2.uv, hit.bary);
+
+		return hit_surface;
+	}
+
+	static glm::vec4 sample_material_texture(const texture_t* texture, const glm::vec2& tex_coord, const texture_footprint_t& footprint)
+	{
+		if (!texture)
+			return glm::vec4(1.0f);
+
+		float lod = footprint.use_ray_cones ? get_texture_lod(*texture, footprint.triangle_lod, footprint.cone_width, footprint.cos_theta) : 0.0f;
+		return sample_texture(*texture, tex_coord, lod);
+	}
+
+	// Same as sample_material in material.hlsl, except that the mip is selected by the ray cone footprint instead of always sampling mip 0
+	static sampled_material_t sample_material(const hit_surface_t& hit_surface, const texture_footprint_t& footprint)
+	{
+		const material_t& material = hit_surface.instance->material;
+		const material_textures_t& textures = *hit_surface.textures;
+
+		sampled_material_t sampled_material = {};
+		sampled_material.base_color = material.base_color_factor * glm::vec3(sample_material_texture(textures.base_color, hit_surface.tex_coord, footprint));
+
+		glm::vec4 metallic_roughness = sample_material_texture(textures.metallic_roughness, hit_surface.tex_coord, footprint);
+		sampled_material.metallic = material.metallic_factor * metallic_roughness.b;
+		sampled_material.roughness = material.roughness_factor * metallic_roughness.g;
+
+		glm::vec3 emissive = sample_material_texture(textures.emissive, hit_surface.tex_coord, footprint);
+		sampled_material.emissive_color = material.emissive_strength * material.emissive_factor * emissive;
+
+		return sampled_material;
+	}
+
+	static glm::vec3 get_emissive_triangle_normal(const emissive_triangle_t& light)
+	{
+		return glm::normalize(glm::cross(light.p1 - light.p0, light.p2 - light.p0));
+	}
+
+	// Converts the area pdf of a point on a light to a solid angle pdf, as seen from the shading point
+	static float light_pdf_to_solid_angle(float pdf_area, float distance, float cos_light)
+	{
+		return cos_light > 0.0f ? pdf_area * (distance * distance) / cos_light : 0.0f;
+	}
+
+	static float mis_power_heuristic(float pdf_a, float pdf_b)
+	{
+		float pdf_a_sq = pdf_a * pdf_a;
+		return pdf_a_sq / (pdf_a_sq + pdf_b * pdf_b);
+	}
+
+	// Probability of sampling the HDR environment instead of the emissive triangles, both are picked equally often if both are present
+	static float get_env_selection_probability(const scene_t& scene)
+	{
+		if (!scene.hdr_env_alias_table)
+			return 0.0f;
+
+		return scene.light_count > 0 ? 0.5f : 1.0f;
+	}
+
+	// Converts the probability of picking an environment texel to a solid angle pdf, texels near the poles cover a smaller solid angle
+	static float env_pdf_to_solid_angle(const scene_t& scene, float pdf_texel, const glm::vec3& direction)
+	{
+		float sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - direction.y * direction.y));
+		return sin_theta > 0.0f ? pdf_texel * (scene.hdr_env_width * scene.hdr_env_height) / (2.0f * PI * PI * sin_theta) : 0.0f;
+	}
+
+	// Same as sample_env in light.hlsl
+	static light_sample_t sample_env(const scene_t& scene, const render_settings_t& settings, const glm::vec4& r)
+	{
+		light_sample_t light_sample = {};
+
+		uint32_t texel_count = scene.hdr_env_width * scene.hdr_env_height;
+		uint32_t texel_idx = MIN((uint32_t)(r.x * texel_count), texel_count - 1);
+		if (r.y >= scene.hdr_env_alias_table[texel_idx].alias_probability)
+		{
+			texel_idx = scene.hdr_env_alias_table[texel_idx].alias_idx;
+		}
+
+		glm::uvec2 texel_pos = glm::uvec2(texel_idx % scene.hdr_env_width, texel_idx / scene.hdr_env_width);
+		glm::vec2 uv = (glm::vec2(texel_pos) + glm::vec2(r.z, r.w)) / glm::vec2(scene.hdr_env_width, scene.hdr_env_height);
+
+		light_sample.direction = equirect_uv_to_direction(uv);
+		light_sample.distance = RAY_MAX_T;
+		light_sample.emission = glm::vec3(scene.hdr_env_pixels[texel_idx]) * settings.hdr_env_strength;
+		light_sample.pdf = env_pdf_to_solid_angle(scene, scene.hdr_env_alias_table[texel_idx].pdf, light_sample.direction);
+
+		return light_sample;
+	}
+
+	// Same as sample_light in light.hlsl
+	static light_sample_t sample_light(const scene_t& scene, const glm::vec3& position, const glm::vec4& r)
+	{
+		light_sample_t light_sample = {};
+
+		uint32_t light_idx = MIN((uint32_t)(r.x * scene.light_count), scene.light_count - 1);
+		if (r.y >= scene.lights[light_idx].alias_probability)
+		{
+			light_idx = scene.lights[light_idx].alias_idx;
+		}
+		const emissive_triangle_t& light = scene.lights[light_idx];
+
+		float r_sqrt = glm::sqrt(r.z);
+		glm::vec2 bary = glm::vec2(r_sqrt * (1.0f - r.w), r_sqrt * r.w);
+		glm::vec3 light_position = interpolate(light.p0, light.p1, light.p2, bary);
+
+		glm::vec3 to_light = light_position - position;
+		light_sample.distance = glm::length(to_light);
+		light_sample.direction = to_light / light_sample.distance;
+
+		float cos_light = glm::dot(get_emissive_triangle_normal(light), -light_sample.direction);
+		light_sample.pdf = light.area > 0.0f ? light_pdf_to_solid_angle(light.pdf / light.area, light_sample.distance, cos_light) : 0.0f;
+
+		// Evaluate the emissive material at the sampled point, since the emissive color might come from a texture, the light has no footprint so mip 0 is sampled
+		const material_t& material = scene.instances[light.instance_idx].material;
+		const triangle_t& tri = scene.instance_triangles[light.instance_idx][light.primitive_idx];
+		glm::vec2 tex_coord = interpolate(tri.v0.uv, tri.v1.uv, tri.v2.uv, bary);
+		glm::vec3 emissive = sample_material_texture(scene.instance_textures[light.instance_idx].emissive, tex_coord, {});
+		light_sample.emission = material.emissive_strength * material.emissive_factor * emissive;
+
+		return light_sample;
+	}
+
+	// Picks either the HDR environment or one of the emissive triangles, the returned pdf includes the probability of picking either one
+	static light_sample_t sample_direct_light(const scene_t& scene, const render_settings_t& settings, float env_selection_probability,
+		const glm::vec3& position, float r_select, const glm::vec4& r)
+	{
+		light_sample_t light_sample = {};
+
+		if (r_select < env_selection_probability)
+		{
+			light_sample = sample_env(scene, settings, r);
+			light_sample.pdf *= env_selection_probability;
+		}
+		else
+		{
+			light_sample = sample_light(scene, position, r);
+			light_sample.pdf *= 1.0f - env_selection_probability;
+		}
+
+		return light_sample;
+	}
+
+	static float get_env_hit_mis_weight(const scene_t& scene, const glm::vec3& ray_direction, float bsdf_pdf, float env_selection_probability)
+	{
+		// A BSDF pdf of zero means that the previous vertex did not do next event estimation (e.g. camera rays)
+		if (bsdf_pdf <= 0.0f || env_selection_probability <= 0.0f)
+			return 1.0f;
+
+		const env_alias_entry_t& entry = scene.hdr_env_alias_table[get_hdr_env_texel_idx(scene, ray_direction)];
+		float env_pdf = env_selection_probability * env_pdf_to_solid_angle(scene, entry.pdf, ray_direction);
+
+		return mis_power_heuristic(bsdf_pdf, env_pdf);
+	}
+
+	static float get_emissive_hit_mis_weight(const scene_t& scene, const instance_data_t& instance, const hit_result_t& hit, const glm::vec3& ray_direction, float bsdf_pdf, float light_selection_probability)
+	{
+		// A BSDF pdf of zero means that the previous vertex did not do next event estimation (e.g. camera rays)
+		if (bsdf_pdf <= 0.0f || instance.light_offset == LIGHT_IDX_INVALID)
+			return 1.0f;
+
+		const emissive_triangle_t& light = scene.lights[instance.light_offset + hit.primitive_idx];
+		if (light.area <= 0.0f)
+			return 1.0f;
+
+		float cos_light = glm::dot(get_emissive_triangle_normal(light), -ray_direction);
+		float light_pdf = light_selection_probability * light_pdf_to_solid_angle(light.pdf / light.area, hit.t, cos_light);
+
+		return mis_power_heuristic(bsdf_pdf, light_pdf);
+	}
+
+	glm::vec3 trace_path(const scene_t& scene, const render_settings_t& settings, const view_t& view, const glm::uvec2& pixel_pos,
+		uint32_t sample_idx, path_features_t* out_features, traversal_stats_t* stats)
+	{
+		ray_t ray = make_primary_ray(view, pixel_pos);
+		ray_cone_t ray_cone = make_primary_ray_cone(view);
+		traversal_stats_t path_stats = {};
+		path_features_t features = { glm::vec3(1.0f), glm::vec3(0.0f), 0.0f };
+
+		glm::vec3 throughput = glm::vec3(1.0f);
+		glm::vec3 energy = glm::vec3(0.0f);
+		uint32_t ray_depth = 0;
+		// Pdf of the BSDF sample that generated the current ray, zero for camera rays
+		float bsdf_pdf = 0.0f;
+		float env_selection_probability = get_env_selection_probability(scene);
+
+		// Path guiding only learns from and guides the regular render, the view modes stop at the first hit anyway
+		bool guiding = settings.path_guiding && settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+		bool guide_training = guiding && path_guiding::is_training();
+		guide_path_t guide_path;
+		guide_path.vertex_count = 0;
+
+		while (ray_depth <= settings.max_bounces)
+		{
+			// Prepare hit result and trace TLAS
+			hit_result_t hit = make_hit_result();
+			if (scene.instance_count > 0)
+			{
+				trace_ray_tlas(*scene.tlas, scene.instance_bvhs, ray, hit, settings.bvh_short_stack, &path_stats);
+			}
+
+			// The traversal cost view mode only looks at the camera rays, and also needs to show the ones that miss the scene
+			if (settings.render_view_mode == RENDER_VIEW_MODE_TRAVERSAL_COST)
+			{
+				energy = cost_to_heatmap((float)get_traversal_cost(path_stats), (float)settings.traversal_cost_heatmap_max);
+				break;
+			}
+
+			// We have missed the scene entirely, so we treat the HDR environment texture as a light source and stop tracing
+			if (!has_hit_geometry(hit))
+			{
+				float mis_weight = settings.next_event_estimation ?
+					get_env_hit_mis_weight(scene, ray.direction, bsdf_pdf, env_selection_probability) : 1.0f;
+				glm::vec3 env_emission = settings.hdr_env_strength * sample_hdr_env(scene, ray.direction);
+				glm::vec3 contribution = throughput * env_emission * mis_weight;
+				energy += contribution;
+
+				if (guide_training)
+				{
+					add_guide_emission(guide_path, contribution, env_emission);
+				}
+				break;
+			}
+
+			hit_surface_t hit_surface = get_hit_surface(scene, hit);
+
+			// The cone grows over the distance travelled, and its width at the hit decides which mip gets sampled
+			ray_cone.width += ray_cone.spread_angle * hit.t;
+
+			texture_footprint_t footprint = {};
+			footprint.use_ray_cones = settings.texture_lod_ray_cones;
+			if (footprint.use_ray_cones)
+			{
+				footprint.triangle_lod = get_triangle_lod(*hit_surface.tri, hit_surface.instance->local_to_world);
+				footprint.cone_width = ray_cone.width;
+				footprint.cos_theta = glm::dot(hit_surface.normal, ray.direction);
+			}
+
+			sampled_material_t sampled_material = sample_material(hit_surface, footprint);
+			bool emissive = glm::any(glm::greaterThan(sampled_material.emissive_color, glm::vec3(0.0f)));
+
+			if (ray_depth == 0)
+			{
+				features.albedo = emissive ? glm::vec3(1.0f) : sampled_material.base_color;
+				features.normal = hit_surface.normal;
+				features.depth = hit.t;
+			}
+
+			if (emissive)
+			{
+				float mis_weight = settings.next_event_estimation ?
+					get_emissive_hit_mis_weight(scene, *hit_surface.instance, hit, ray.direction, bsdf_pdf, 1.0f - env_selection_probability) : 1.0f;
+				glm::vec3 contribution = throughput * sampled_material.emissive_color * mis_weight;
+				energy += contribution;
+
+				if (guide_training)
+				{
+					add_guide_emission(guide_path, contribution, sampled_material.emissive_color);
+				}
+				break;
+			}
+
+			path_sampler_t path_sampler = make_path_sampler(settings.sampler_type, pixel_pos, sample_idx, ray_depth);
+
+			// Diffuse bounce, the specular bounce is disabled in the GPU path tracers as well, so the lobe select dimension is not drawn
+			glm::vec2 r_diffuse = path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_BSDF);
+
+			glm::vec3 N = hit_surface.normal;
+
+			// One-sample MIS between the guide and the BSDF, the first random number picks one of them and is then rescaled so that both get a stratified sample
+			uint32_t guide_leaf_idx = 0;
+			float guide_probability = 0.0f;
+			if (guiding)
+			{
+				guide_leaf_idx = path_guiding::find_leaf(hit_surface.position);
+				guide_probability = path_guiding::get_guide_probability(guide_leaf_idx);
+			}
+
+			glm::vec3 L;
+			if (r_diffuse.x < guide_probability)
+			{
+				r_diffuse.x /= guide_probability;
+				L = path_guiding::sample(guide_leaf_idx, r_diffuse);
+			}
+			else
+			{
+				r_diffuse.x = (r_diffuse.x - guide_probability) / (1.0f - guide_probability);
+				if (settings.cosine_weighted_diffuse)
+				{
+					L = cosine_weighted_hemisphere_sample(N, r_diffuse);
+				}
+				else
+				{
+					L = uniform_hemisphere_sample(N, r_diffuse);
+				}
+			}
+
+			float NoL = glm::max(0.0f, glm::dot(N, L));
+			float pdf = get_bounce_pdf(settings, guide_leaf_idx, guide_probability, NoL, L);
+
+			glm::vec3 diffuse_brdf = sampled_material.base_color * INV_PI;
+
+			// Next event estimation, only done when the BSDF sampled ray will be traced as well, otherwise the MIS weights do not add up to one
+			if (settings.next_event_estimation && (scene.light_count > 0 || scene.hdr_env_alias_table) &&
+				ray_depth < settings.max_bounces && settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+			{
+				float r_light_select = path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_LIGHT_SELECT);
+				glm::vec4 r_light = glm::vec4(path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_XY), path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_ZW));
+				light_sample_t light_sample = sample_direct_light(scene, settings, env_selection_probability, hit_surface.position, r_light_select, r_light);
+				float NoL_light = glm::dot(N, light_sample.direction);
+
+				if (NoL_light > 0.0f && light_sample.pdf > 0.0f)
+				{
+					float light_bsdf_pdf = get_bounce_pdf(settings, guide_leaf_idx, guide_probability, NoL_light, light_sample.direction);
+					float mis_weight = mis_power_heuristic(light_sample.pdf, light_bsdf_pdf);
+					glm::vec3 contribution = throughput * diffuse_brdf * NoL_light * light_sample.emission * (mis_weight / light_sample.pdf);
+
+					ray_t shadow_ray = make_ray(hit_surface.position, light_sample.direction, light_sample.distance * SHADOW_RAY_T_MAX_MULTIPLIER);
+					if (!trace_ray_tlas_occluded(*scene.tlas, scene.instance_bvhs, shadow_ray, &path_stats))
+					{
+						energy += contribution;
+
+						if (guide_training)
+						{
+							add_guide_radiance(guide_path, guide_path.vertex_count, contribution);
+						}
+					}
+				}
+			}
+
+			throughput *= pdf > 0.0f ? (NoL * diffuse_brdf) * (1.0f / pdf) : glm::vec3(0.0f);
+			bsdf_pdf = pdf;
+			ray = make_ray(hit_surface.position, L);
+			ray_cone.spread_angle += RAY_CONE_DIFFUSE_SPREAD_ANGLE;
+
+			switch (settings.render_view_mode)
+			{
+			case RENDER_VIEW_MODE_GEOMETRY_INSTANCE:            energy = int_to_color(hit.instance_idx); break;
+			case RENDER_VIEW_MODE_GEOMETRY_PRIMITIVE:           energy = int_to_color(hit.primitive_idx); break;
+			case RENDER_VIEW_MODE_GEOMETRY_BARYCENTRICS:        energy = glm::vec3(hit.bary, 0.0f); break;
+			case RENDER_VIEW_MODE_GEOMETRY_NORMAL:              energy = glm::abs(interpolate(hit_surface.tri->v0.normal, hit_surface.tri->v1.normal, hit_surface.tri->v2.normal, hit.bary)); break;
+			case RENDER_VIEW_MODE_GEOMETRY_UV:                  energy = glm::vec3(hit_surface.tex_coord, 0.0f); break;
+			case RENDER_VIEW_MODE_MATERIAL_BASE_COLOR:          energy = sampled_material.base_color; break;
+			case RENDER_VIEW_MODE_MATERIAL_NORMAL:              energy = glm::abs(hit_surface.normal); break;
+			case RENDER_VIEW_MODE_MATERIAL_METALLIC_ROUGHNESS:  energy = glm::vec3(0.0f, sampled_material.roughness, sampled_material.metallic); break;
+			case RENDER_VIEW_MODE_MATERIAL_EMISSIVE:            energy = sampled_material.emissive_color; break;
+			case RENDER_VIEW_MODE_WORLD_NORMAL:                 energy = glm::abs(hit_surface.normal); break;
+			case RENDER_VIEW_MODE_RENDER_TARGET_DEPTH:          energy = glm::vec3(hit.t) / view.far_plane; break;
+			}
+
+			if (settings.render_view_mode != RENDER_VIEW_MODE_NONE)
+			{
+				break;
+			}
+
+			// Guided directions can point below the surface, the path does not carry any energy from there on
+			if (NoL <= 0.0f)
+			{
+				break;
+			}
+
+			// Russian roulette, stochastically terminate paths with a low throughput and compensate the ones that survive
+			if (settings.russian_roulette && ray_depth >= settings.russian_roulette_min_depth)
+			{
+				float survival_probability = get_russian_roulette_survival_probability(throughput);
+				if (path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_RUSSIAN_ROULETTE) >= survival_probability)
+				{
+					break;
+				}
+
+				throughput /= survival_probability;
+			}
+
+			// Paths with more bounces than the guide path can hold are not recorded at all, since their later radiance would be missing from the recorded bounces
+			if (guide_training && guide_path.vertex_count == PATH_GUIDING_MAX_VERTEX_COUNT)
+			{
+				guide_training = false;
+			}
+
+			if (guide_training)
+			{
+				guide_vertex_t& vertex = guide_path.vertices[guide_path.vertex_count++];
+				vertex.leaf_idx = guide_leaf_idx;
+				vertex.direction = L;
+				vertex.throughput = throughput;
+				vertex.pdf = pdf;
+				vertex.radiance = glm::vec3(0.0f);
+			}
+
+			ray_depth++;
+		}
+
+		if (guide_training)
+		{
+			record_guide_path(guide_path);
+		}
+
+		if (out_features)
+		{
+			*out_features = features;
+		}
+
+		if (stats)
+		{
+			add_traversal_stats(*stats, path_stats);
+		}
+
+		return energy;
+	}
+
+	void render_tile(const scene_t& scene, const render_settings_t& settings, const view_t& view, uint32_t frame_seed, uint32_t sample_count,
+		const glm::uvec2& tile_min, const glm::uvec2& tile_max, glm::vec4* pixel_variance, glm::vec4* out_energy,
+		path_features_t* out_features, traversal_stats_t* out_stats)
+	{
+		uint32_t render_width = (uint32_t)view.render_dim.x;
+		bool track_variance = settings.accumulate && settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+		uint32_t pass_sample_idx = get_sample_index(settings, sample_count, frame_seed);
+
+		for (uint32_t y = tile_min.y; y < tile_max.y; ++y)
+		{
+			for (uint32_t span_x = tile_min.x; span_x < tile_max.x; span_x += RENDER_TILE_SPAN_SIZE)
+			{
+				uint32_t span_size = MIN(RENDER_TILE_SPAN_SIZE, tile_max.x - span_x);
+				uint32_t active_pixels[RENDER_TILE_SPAN_SIZE];
+
+				for (uint32_t i = 0; i < span_size; ++i)
+				{
+					uint32_t pixel_idx = y * render_width + span_x + i;
+					active_pixels[i] = !is_pixel_converged(settings, pixel_variance[pixel_idx]);
+
+					// Converged pixels keep an alpha of zero, so the post-process leaves their accumulated color untouched
+					if (!active_pixels[i])
+						out_energy[pixel_idx] = glm::vec4(0.0f);
+				}
+
+				// The compaction keeps the pixels in order, so they are traced in the same order as before they were compacted
+				uint32_t active_count = scan::compact_indices(active_pixels, active_pixels, span_size);
+
+				for (uint32_t i = 0; i < active_count; ++i)
+				{
+					uint32_t x = span_x + active_pixels[i];
+					uint32_t pixel_idx = y * render_width + x;
+
+					// Partial passes trace some pixels more often than others, so every pixel continues from its own sample count while accumulating
+					uint32_t sample_idx = track_variance ? settings.sample_offset + (uint32_t)pixel_variance[pixel_idx].x : pass_sample_idx;
+					glm::vec3 energy = trace_path(scene, settings, view, glm::uvec2(x, y), sample_idx,
+						out_features ? &out_features[pixel_idx] : nullptr, out_stats);
+					out_energy[pixel_idx] = glm::vec4(energy, 1.0f);
+
+					// Welford's online variance of the pixel luminance, same as the post-process does for the GPU path tracers
+					if (track_variance)
+					{
+						glm::vec4& variance = pixel_variance[pixel_idx];
+						float luminance = get_luminance(energy);
+						variance.x += 1.0f;
+						float delta = luminance - variance.y;
+						variance.y += delta / variance.x;
+						variance.z += delta * (luminance - variance.y);
+					}
+				}
+			}
+		}
+	}
+
+	void render(const scene_t& scene, const render_settings_t& settings, const view_t& view, uint32_t frame_seed, uint32_t sample_count,
+		glm::vec4* pixel_variance, glm::vec4* out_energy, path_features_t* out_features, traversal_stats_t* out_stats)
+	{
+		render_tile(scene, settings, view, frame_seed, sample_count, glm::uvec2(0), glm::uvec2(view.render_dim), pixel_variance, out_energy, out_features, out_stats);
+	}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+struct bvh_t;
+struct tlas_t;
+
+namespace cpu
+{
+
+	struct texture_t;
+
+	// Material textures of an instance, a null texture samples as white so that only the material factor remains
+	struct material_textures_t
+	{
+		const texture_t* base_color;
+		const texture_t* metallic_roughness;
+		const texture_t* emissive;
+	};
+
+	// Everything the CPU path tracer needs to know about the scene, all arrays are indexed by instance index
+	// The CPU path tracer only reads from the scene, so the data can be shared with the GPU uploads of the same frame
+	struct scene_t
+	{
+		const tlas_t* tlas;
+
+		uint32_t instance_count;
+		const instance_data_t* instances;
+		const bvh_t* const* instance_bvhs;
+		const triangle_t* const* instance_triangles;
+		const material_textures_t* instance_textures;
+
+		// Emissive triangles with their alias table, see light_builder_t
+		uint32_t light_count;
+		const emissive_triangle_t* lights;
+
+		// RGBA32 float equirectangular environment map, can be null
+		const glm::vec4* hdr_env_pixels;
+		uint32_t hdr_env_width;
+		uint32_t hdr_env_height;
+		// One entry per texel for importance sampling the environment, null if the environment is not importance sampled
+		const env_alias_entry_t* hdr_env_alias_table;
+	};
+
+	// Features of the first surface a path hits, the denoiser uses them to find the edges in the image
+	// Paths that miss the scene have a zero normal and depth, and paths that hit a light or miss the scene have a white albedo
+	struct path_features_t
+	{
+		glm::vec3 albedo;
+		glm::vec3 normal;
+		// Distance along the camera ray
+		float depth;
+	};
+
+	// Same path tracing algorithm as the megakernel in pathtracer.hlsl, to be able to compare the results against the GPU path tracers
+	// sample_idx selects the sample of the pixel in the sampler sequence, the random sampler uses it together with the pixel position as its counter
+	// The first hit features are written to out_features and the traversal work of all rays in the path is added to stats, if they are not null
+	glm::vec3 trace_path(const scene_t& scene, const render_settings_t& settings, const view_t& view, const glm::uvec2& pixel_pos,
+		uint32_t sample_idx, path_features_t* out_features = nullptr, traversal_stats_t* stats = nullptr);
+
+	// Path traces every pixel within [tile_min, tile_max) that has not converged yet once and writes the energy to out_energy, the alpha channel is zero for skipped pixels
+	// pixel_variance holds the per-pixel sample count, luminance mean and luminance M2, and is updated for every traced pixel when accumulating
+	// Both arrays are indexed by pixel and need to be at least render_dim.x * render_dim.y in size, tiles do not overlap so they can be rendered in parallel
+	// sample_count is the accumulated sample count including this one, same as the sample count the GPU path tracers get
+	// While accumulating, every pixel takes the sample index after the samples in its pixel variance instead, which is the same for pixels traced by every pass
+	// The first hit features of every traced pixel are written to out_features and the traversal work of all paths in the tile is added to out_stats, if they are not null
+	void render_tile(const scene_t& scene, const render_settings_t& settings, const view_t& view, uint32_t frame_seed, uint32_t sample_count,
+		const glm::uvec2& tile_min, const glm::uvec2& tile_max, glm::vec4* pixel_variance, glm::vec4* out_energy,
+		path_features_t* out_features = nullptr, traversal_stats_t* out_stats = nullptr);
+	// Same as render_tile, for the entire render target on the calling thread
+	void render(const scene_t& scene, const render_settings_t& settings, const view_t& view, uint32_t frame_seed, uint32_t sample_count,
+		glm::vec4* pixel_variance, glm::vec4* out_energy, path_features_t* out_features = nullptr, traversal_stats_t* out_stats = nullptr);
+
+}
@@ -0,0 +1,227 @@
+#include "cpu_render_pass.h"
+#include "cpu_tile_scheduler.h"
+#include "cpu_denoiser.h"
+#include "cpu_texture_cache.h"
+#include "cpu_path_guiding.h"
+#include "core/thread.h"
+#include "core/assertion.h"
+#include "core/memory/memory_arena.h"
+
+namespace cpu
+{
+
+	namespace render_pass
+	{
+
+		struct render_pass_inst_t
+		{
+			uint32_t render_width;
+			uint32_t render_height;
+
+			// The scene of the pass points to the TLAS of the pass, which is why the pass parameters are stored here instead of being passed to the tiles
+			pass_params_t pass;
+
+			// Traversal counters of the pass in flight, every tile adds its counters once it is done
+			mutex_t pass_traversal_stats_mutex;
+			traversal_totals_t pass_traversal_stats;
+			// Traversal counters of the last completed pass
+			traversal_totals_t traversal_stats;
+
+			glm::vec4* energy;
+			// Per-pixel sample count, luminance mean and luminance M2 for adaptive sampling, same layout as the pixel variance render target
+			glm::vec4* pixel_variance;
+			// First hit features of the pixels traced by the last pass, only written when denoising
+			path_features_t* features;
+
+			// Every tile accumulates its energy right after it was traced, so that the result can be read back without going through the GPU
+			// The denoiser runs on the worker threads in between two path tracing passes, one tile pass per filter iteration
+			struct denoise_pass_t
+			{
+				render_settings_t settings;
+				uint32_t iteration;
+			} denoise_pass;
+			denoise_buffers_t denoise_buffers;
+			// True if the energy of the last completed pass got replaced by the denoised accumulated color
+			bool energy_denoised;
+
+			// Samples and traversal counters of all completed passes since the last accumulator reset
+			// Partial passes only add a sample once the tiles they traced add up to the whole render target
+			uint32_t accumulated_sample_count;
+			uint64_t accumulated_tile_count;
+			traversal_totals_t accumulated_traversal_stats;
+		};
+		static render_pass_inst_t* g_render_pass = nullptr;
+
+		static void render_tile_proc(const glm::uvec2& tile_min, const glm::uvec2& tile_max, void* user_data)
+		{
+			const pass_params_t* pass = (const pass_params_t*)user_data;
+			traversal_stats_t tile_traversal_stats = {};
+			path_features_t* features = pass->settings.denoise ? g_render_pass->features : nullptr;
+			render_tile(pass->scene, pass->settings, pass->view, pass->frame_seed, pass->sample_count, tile_min, tile_max,
+				g_render_pass->pixel_variance, g_render_pass->energy, features, &tile_traversal_stats);
+			denoiser::accumulate_tile(pass->settings, g_render_pass->render_width, tile_min, tile_max,
+				g_render_pass->energy, features, g_render_pass->pixel_variance, g_render_pass->denoise_buffers);
+
+			thread::mutex::lock(g_render_pass->pass_traversal_stats_mutex);
+			add_traversal_stats(g_render_pass->pass_traversal_stats, tile_traversal_stats);
+			thread::mutex::unlock(g_render_pass->pass_traversal_stats_mutex);
+		}
+
+		static void denoise_filter_tile_proc(const glm::uvec2& tile_min, const glm::uvec2& tile_max, void* user_data)
+		{
+			const render_pass_inst_t::denoise_pass_t* pass = (const render_pass_inst_t::denoise_pass_t*)user_data;
+			denoiser::filter_tile(pass->settings, glm::uvec2(g_render_pass->render_width, g_render_pass->render_height), pass->iteration,
+				tile_min, tile_max, g_render_pass->denoise_buffers, g_render_pass->energy);
+		}
+
+		void init(memory_arena_t& arena, uint32_t render_width, uint32_t render_height)
+		{
+			g_render_pass = ARENA_ALLOC_STRUCT_ZERO(arena, render_pass_inst_t);
+			g_render_pass->render_width = render_width;
+			g_render_pass->render_height = render_height;
+
+			uint32_t pixel_count = render_width * render_height;
+			g_render_pass->energy = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->pixel_variance = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->features = ARENA_ALLOC_ARRAY_ZERO(arena, path_features_t, pixel_count);
+			g_render_pass->denoise_buffers.color_accum = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->denoise_buffers.albedo_accum = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->denoise_buffers.normal_depth_accum = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->denoise_buffers.filter[0] = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+			g_render_pass->denoise_buffers.filter[1] = ARENA_ALLOC_ARRAY_ZERO(arena, glm::vec4, pixel_count);
+
+			texture_cache::init(arena, TEXTURE_CACHE_MEMORY_BUDGET, TEXTURE_CACHE_BACKING_FILEPATH_PREFIX);
+			tile_scheduler::init(arena, render_width, render_height);
+			path_guiding::init(arena);
+		}
+
+		void exit()
+		{
+			// Stop the worker threads before anything they read from gets released
+			tile_scheduler::exit();
+			path_guiding::exit();
+			texture_cache::exit();
+
+			g_render_pass = nullptr;
+		}
+
+		void begin(const pass_params_t& params)
+		{
+			pass_params_t& pass = g_render_pass->pass;
+			pass = params;
+			pass.scene.tlas = &pass.tlas;
+
+			uint32_t pixel_count = g_render_pass->render_width * g_render_pass->render_height;
+
+			// The first sample after an accumulator reset discards the per-pixel statistics, same as the post-process does for the GPU path tracers
+			if (pass.sample_count <= 1)
+			{
+				memset(g_render_pass->pixel_variance, 0, sizeof(glm::vec4) * pixel_count);
+			}
+
+			// Pixels outside of a partial pass need an alpha of zero, so that they keep their accumulated color
+			if (pass.tile_count < tile_scheduler::get_tile_count())
+			{
+				memset(g_render_pass->energy, 0, sizeof(glm::vec4) * pixel_count);
+			}
+
+			// Every restart of the accumulation starts learning from scratch, since the camera, scene, or settings that the guide learned from might have changed
+			if (pass.settings.path_guiding && pass.sample_count <= 1 && pass.scene.instance_count > 0)
+			{
+				glm::vec3 scene_aabb_min, scene_aabb_max;
+				get_tlas_bounds(pass.tlas, scene_aabb_min, scene_aabb_max);
+				path_guiding::reset(scene_aabb_min, scene_aabb_max);
+			}
+
+			g_render_pass->pass_traversal_stats = {};
+			tile_scheduler::begin_pass(render_tile_proc, &pass, pass.first_tile, pass.tile_count);
+		}
+
+		bool wait()
+		{
+			if (!tile_scheduler::wait_pass())
+				return false;
+
+			g_render_pass->traversal_stats = g_render_pass->pass_traversal_stats;
+			add_traversal_stats(g_render_pass->accumulated_traversal_stats, g_render_pass->pass_traversal_stats);
+
+			const pass_params_t& pass = g_render_pass->pass;
+			bool accumulated = pass.settings.accumulate && pass.settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+			uint32_t tile_count = tile_scheduler::get_tile_count();
+			g_render_pass->accumulated_tile_count = accumulated ? g_render_pass->accumulated_tile_count + pass.tile_count : tile_count;
+			g_render_pass->accumulated_sample_count = (uint32_t)(g_render_pass->accumulated_tile_count / tile_count);
+
+			// The guiding trees can only be refined in between passes, since the workers sample from them
+			// Partial passes only count once they reach the end of the render target, so that every training pass covers the whole image
+			if (pass.settings.path_guiding && pass.first_tile + pass.tile_count == tile_count)
+				path_guiding::end_pass();
+
+			// Denoise the accumulated result before the next pass starts, the last filter iteration overwrites the energy
+			// A cancelled pass does not get denoised, its energy is empty and the post-process keeps the previously accumulated color
+			g_render_pass->energy_denoised = false;
+			if (pass.settings.denoise && pass.settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+			{
+				render_pass_inst_t::denoise_pass_t& denoise_pass = g_render_pass->denoise_pass;
+				denoise_pass.settings = pass.settings;
+
+				for (uint32_t i = 0; i < pass.settings.denoise_iterations; ++i)
+				{
+					denoise_pass.iteration = i;
+					tile_scheduler::begin_pass(denoise_filter_tile_proc, &denoise_pass);
+					tile_scheduler::wait_pass();
+				}
+
+				g_render_pass->energy_denoised = true;
+			}
+
+			return true;
+		}
+
+		void reset_accumulation()
+		{
+			tile_scheduler::cancel_pass();
+
+			g_render_pass->accumulated_sample_count = 0;
+			g_render_pass->accumulated_tile_count = 0;
+			g_render_pass->accumulated_traversal_stats = {};
+		}
+
+		glm::vec4* get_energy()
+		{
+			return g_render_pass->energy;
+		}
+
+		bool is_energy_denoised()
+		{
+			return g_render_pass->energy_denoised;
+		}
+
+		void clear_energy()
+		{
+			memset(g_render_pass->energy, 0, sizeof(glm::vec4) * g_render_pass->render_width * g_render_pass->render_height);
+			g_render_pass->energy_denoised = false;
+		}
+
+		const traversal_totals_t& get_traversal_stats()
+		{
+			return g_render_pass->traversal_stats;
+		}
+
+		renderer::cpu_accumulation_t get_accumulation()
+		{
+			wait();
+
+			renderer::cpu_accumulation_t result = {};
+			result.width = g_render_pass->render_width;
+			result.height = g_render_pass->render_height;
+			result.sample_count = g_render_pass->accumulated_sample_count;
+			result.ray_count = g_render_pass->accumulated_traversal_stats.rays;
+			result.pixels = g_render_pass->energy_denoised ? g_render_pass->energy : g_render_pass->denoise_buffers.color_accum;
+			result.pixel_variance = g_render_pass->pixel_variance;
+
+			return result;
+		}
+
+	}
+
+}
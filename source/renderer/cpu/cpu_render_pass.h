@@ -0,0 +1,64 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+#include "renderer/renderer.h"
+#include "renderer/bvh/tlas_builder.h"
+#include "renderer/cpu/cpu_pathtracer.h"
+#include "renderer/cpu/cpu_accelstruct.h"
+
+struct memory_arena_t;
+
+namespace cpu
+{
+
+	// Memory for the texture tiles the CPU path tracer keeps resident, the rest of the tiles wait in the backing file until they get sampled
+	inline constexpr uint64_t TEXTURE_CACHE_MEMORY_BUDGET = MB(256);
+	// Every process appends a unique suffix, so that processes which share a working directory do not share the file
+	inline constexpr const char* TEXTURE_CACHE_BACKING_FILEPATH_PREFIX = "texture_cache.tmp";
+
+	// Runs one tile pass of the CPU path tracer per frame on the worker threads, and accumulates and denoises the results of the completed passes
+	// Shared by the D3D12 renderer and the headless renderer, so that both render and accumulate exactly the same way
+	namespace render_pass
+	{
+
+		// Everything a pass reads from, the pass runs on the worker threads until it is waited on in the next frame
+		// Arrays of the scene that get rewritten every frame need to be copied by the caller into memory that outlives the pass, the TLAS header is copied by begin
+		struct pass_params_t
+		{
+			scene_t scene;
+			tlas_t tlas;
+			render_settings_t settings;
+			view_t view;
+			uint32_t frame_seed;
+			uint32_t sample_count;
+			// Range along the Morton curve of tiles, a pass only covers part of the render target when the frame time budget limits its tiles
+			uint32_t first_tile;
+			uint32_t tile_count;
+		};
+
+		// Creates the texture cache as well, which needs to exist before any texture is created for the CPU path tracer
+		void init(memory_arena_t& arena, uint32_t render_width, uint32_t render_height);
+		void exit();
+
+		// Starts the pass on the worker threads and returns immediately, the pass starts over the per-pixel statistics if its sample count is one
+		void begin(const pass_params_t& params);
+		// Waits for the pass in flight and adds its results to the accumulated results, returns false if there was no pass in flight or if it was cancelled
+		// The accumulated color gets denoised on the worker threads before this returns, if the pass was started with the denoiser enabled
+		bool wait();
+		// Cancels the pass in flight, since it was started with the previous camera or settings, and starts the accumulation over
+		void reset_accumulation();
+
+		// Energy of the last completed pass, the denoised accumulated color if is_energy_denoised returns true
+		glm::vec4* get_energy();
+		bool is_energy_denoised();
+		// Clears the energy of the last pass, so that the pixels do not add anything when the energy is accumulated with an alpha of zero
+		void clear_energy();
+		// Traversal counters of the last completed pass
+		const traversal_totals_t& get_traversal_stats();
+
+		// Waits for the pass in flight and returns everything that was accumulated since the last reset
+		renderer::cpu_accumulation_t get_accumulation();
+
+	}
+
+}
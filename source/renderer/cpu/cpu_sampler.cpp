@@ -0,0 +1,143 @@
+#include "cpu_sampler.h"
+#include "core/random.h"
+
+namespace cpu
+{
+
+	static uint32_t murmur_mix(uint32_t hash)
+	{
+		hash ^= hash >> 16;
+		hash *= 0x85ebca6b;
+		hash ^= hash >> 13;
+		hash *= 0xc2b2ae35;
+		hash ^= hash >> 16;
+		return hash;
+	}
+
+	static uint32_t hash_combine(uint32_t seed, uint32_t value)
+	{
+		return seed ^ (murmur_mix(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+	}
+
+	static uint32_t reverse_bits(uint32_t x)
+	{
+		x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+		x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+		x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+		x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	// Owen scrambling from "Practical Hash-based Owen Scrambling" (Burley 2020), same as common.hlsl
+	static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+	{
+		x += seed;
+		x ^= x * 0x6c50b47c;
+		x ^= x * 0xb82f1e52;
+		x ^= x * 0xc7afe638;
+		x ^= x * 0x8d22f6e6;
+		return x;
+	}
+
+	static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+	{
+		x = reverse_bits(x);
+		x = laine_karras_permutation(x, seed);
+		x = reverse_bits(x);
+		return x;
+	}
+
+	static glm::uvec2 sobol_2d(uint32_t index)
+	{
+		glm::uvec2 p = glm::uvec2(reverse_bits(index), 0);
+
+		uint32_t direction = 1u << 31;
+		for (; index != 0; index >>= 1, direction ^= direction >> 1)
+		{
+			if (index & 1)
+				p.y ^= direction;
+		}
+
+		return p;
+	}
+
+	static glm::vec2 shuffled_scrambled_sobol_2d(uint32_t index, uint32_t seed)
+	{
+		index = nested_uniform_scramble(index, seed);
+		glm::uvec2 p = sobol_2d(index);
+		p.x = nested_uniform_scramble(p.x, hash_combine(seed, 0));
+		p.y = nested_uniform_scramble(p.y, hash_combine(seed, 1));
+
+		// Only keep 24 bits so that the result can never round up to one
+		return glm::vec2(p >> 8u) * 5.96046448e-8f;
+	}
+
+	uint32_t get_sample_index(const render_settings_t& settings, uint32_t sample_count, uint32_t random_seed)
+	{
+		return settings.accumulate ? sample_count - 1 : random_seed;
+	}
+
+	static_assert(SAMPLER_DIMENSION_COUNT <= SAMPLER_DIMENSIONS_PER_BOUNCE);
+
+	path_sampler_t make_path_sampler(uint32_t type, const glm::uvec2& pixel_pos, uint32_t sample_idx, uint32_t bounce)
+	{
+		path_sampler_t path_sampler = {};
+		path_sampler.type = type;
+		path_sampler.pixel_pos = pixel_pos;
+		path_sampler.sample_idx = sample_idx;
+		path_sampler.bounce_dimension = bounce * SAMPLER_DIMENSIONS_PER_BOUNCE;
+
+		switch (type)
+		{
+		case SAMPLER_TYPE_SOBOL:
+		{
+			path_sampler.seed = hash_combine(hash_combine(0, pixel_pos.x), pixel_pos.y);
+		} break;
+		case SAMPLER_TYPE_SOBOL_BLUE_NOISE:
+		{
+			// R2 sequence over the pixel coordinates, neighbouring pixels get offsets that are far apart
+			glm::vec2 pixel = glm::vec2(pixel_pos);
+			path_sampler.seed = 0;
+			path_sampler.pixel_offset = glm::fract(glm::vec2(
+				glm::dot(pixel, glm::vec2(0.7548776662f, 0.5698402910f)),
+				glm::dot(pixel, glm::vec2(0.5698402910f, 0.7548776662f))
+			));
+		} break;
+		}
+
+		return path_sampler;
+	}
+
+	glm::vec2 path_sampler_get_2d(const path_sampler_t& path_sampler, uint32_t sampler_dimension)
+	{
+		glm::vec2 r = glm::vec2(0.0f);
+		uint32_t dimension = path_sampler.bounce_dimension + sampler_dimension;
+		uint32_t dimension_seed = hash_combine(path_sampler.seed, dimension);
+
+		switch (path_sampler.type)
+		{
+		case SAMPLER_TYPE_RANDOM:
+		{
+			r = rng::rand_counter_float2(path_sampler.pixel_pos, path_sampler.sample_idx, dimension);
+		} break;
+		case SAMPLER_TYPE_SOBOL:
+		{
+			r = shuffled_scrambled_sobol_2d(path_sampler.sample_idx, dimension_seed);
+		} break;
+		case SAMPLER_TYPE_SOBOL_BLUE_NOISE:
+		{
+			// Every dimension also gets its own random rotation, otherwise all dimensions would see the same screen space offsets
+			glm::vec2 dimension_offset = glm::vec2(murmur_mix(dimension_seed) >> 8, murmur_mix(dimension_seed + 1) >> 8) * 5.96046448e-8f;
+			r = glm::fract(shuffled_scrambled_sobol_2d(path_sampler.sample_idx, dimension_seed) + path_sampler.pixel_offset + dimension_offset);
+		} break;
+		}
+
+		return r;
+	}
+
+	float path_sampler_get_1d(const path_sampler_t& path_sampler, uint32_t sampler_dimension)
+	{
+		return path_sampler_get_2d(path_sampler, sampler_dimension).x;
+	}
+
+}
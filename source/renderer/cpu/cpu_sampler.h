@@ -0,0 +1,32 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+namespace cpu
+{
+
+	// Mirrors path_sampler_t in common.hlsl
+	struct path_sampler_t
+	{
+		uint32_t type;
+		// Key of the counter-based generator for random sampling
+		glm::uvec2 pixel_pos;
+		// Per-pixel seed for the Sobol sampler
+		uint32_t seed;
+		uint32_t sample_idx;
+		// First dimension of the bounce, every sample of the bounce uses its own dimension from SAMPLER_DIMENSION on top of it
+		uint32_t bounce_dimension;
+		// Screen space offset of the blue noise sampler, all pixels share the same Sobol sequence and are offset by a low-discrepancy pattern in screen space
+		glm::vec2 pixel_offset;
+	};
+
+	// Sample index of the current frame, the Sobol sequence is walked in order while accumulating, and randomized otherwise
+	uint32_t get_sample_index(const render_settings_t& settings, uint32_t sample_count, uint32_t random_seed);
+	// Every bounce starts at its own fixed dimension, see SAMPLER_DIMENSIONS_PER_BOUNCE
+	path_sampler_t make_path_sampler(uint32_t type, const glm::uvec2& pixel_pos, uint32_t sample_idx, uint32_t bounce);
+
+	// The sampler dimension is one of SAMPLER_DIMENSION, the same layout the GPU path tracers use
+	glm::vec2 path_sampler_get_2d(const path_sampler_t& path_sampler, uint32_t sampler_dimension);
+	float path_sampler_get_1d(const path_sampler_t& path_sampler, uint32_t sampler_dimension);
+
+}
@@ -0,0 +1,453 @@
+#include "cpu_scan.h"
+#include "core/thread.h"
+#include "core/logger.h"
+#include "core/random.h"
+#include "core/assertion.h"
+#include "core/memory/memory_arena.h"
+#include "platform/platform.h"
+
+#include <atomic>
+#include <immintrin.h>
+
+namespace cpu
+{
+
+	namespace scan
+	{
+
+		// Below this many elements the cost of waking up the workers is larger than the work itself
+		inline constexpr uint32_t PARALLEL_MIN_ELEMENT_COUNT = 1 << 16;
+
+		using block_proc_t = void(*)(uint32_t block_idx, void* user_data);
+
+		struct scan_inst_t
+		{
+			uint32_t worker_count;
+			thread_t* worker_threads;
+			// One block per worker and one for the calling thread
+			uint32_t block_count;
+			uint32_t* block_sums;
+
+			// Protects the job state below, the workers take blocks with the atomic until all blocks are taken
+			mutex_t mutex;
+			cond_var_t cond_var_job_begin;
+			cond_var_t cond_var_job_end;
+			uint32_t job_index;
+			uint32_t workers_busy;
+			bool job_in_flight;
+			bool should_exit;
+			block_proc_t block_proc;
+			void* user_data;
+
+			std::atomic<uint32_t> next_block;
+		};
+		static scan_inst_t* g_scan = nullptr;
+
+		// Offsets of the set lanes of every 4-bit mask, packed to the front, so that compacting four flags is one add and one store
+		struct compact_lut_t
+		{
+			alignas(16) uint32_t lane_offsets[16][4];
+			uint32_t lane_counts[16];
+
+			compact_lut_t()
+			{
+				for (uint32_t mask = 0; mask < 16; ++mask)
+				{
+					lane_counts[mask] = 0;
+					for (uint32_t lane = 0; lane < 4; ++lane)
+					{
+						lane_offsets[mask][lane] = 0;
+						if (mask & (1 << lane))
+							lane_offsets[mask][lane_counts[mask]++] = lane;
+					}
+				}
+			}
+		} static const s_compact_lut;
+
+		static void get_block_range(uint32_t block_idx, uint32_t block_count, uint32_t count, uint32_t& out_first, uint32_t& out_count)
+		{
+			out_first = (uint32_t)(((uint64_t)count * block_idx) / block_count);
+			out_count = (uint32_t)(((uint64_t)count * (block_idx + 1)) / block_count) - out_first;
+		}
+
+		// Inclusive prefix sum of the four lanes
+		static __m128i scan_lanes(__m128i x)
+		{
+			x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+			x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+			return x;
+		}
+
+		static uint32_t sum_lanes(__m128i x)
+		{
+			x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+			x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+			return (uint32_t)_mm_cvtsi128_si32(x);
+		}
+
+		static uint32_t sum_block(const uint32_t* values, uint32_t count)
+		{
+			__m128i sum = _mm_setzero_si128();
+			uint32_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)&values[i]));
+			}
+
+			uint32_t result = sum_lanes(sum);
+			for (; i < count; ++i)
+			{
+				result += values[i];
+			}
+
+			return result;
+		}
+
+		static uint32_t count_active_block(const uint32_t* flags, uint32_t count)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i one = _mm_set1_epi32(1);
+			__m128i active = _mm_setzero_si128();
+			uint32_t i = 0;
+
+			// Lanes that compare equal to zero are all ones, adding one to that gives zero for inactive lanes and one for active lanes
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i is_zero = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&flags[i]), zero);
+				active = _mm_add_epi32(active, _mm_add_epi32(is_zero, one));
+			}
+
+			uint32_t result = sum_lanes(active);
+			for (; i < count; ++i)
+			{
+				result += flags[i] != 0;
+			}
+
+			return result;
+		}
+
+		// Returns carry plus the sum of all values
+		static uint32_t exclusive_scan_block(const uint32_t* values, uint32_t* out, uint32_t count, uint32_t carry)
+		{
+			__m128i carry_lanes = _mm_set1_epi32((int32_t)carry);
+			uint32_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i inclusive = scan_lanes(_mm_loadu_si128((const __m128i*)&values[i]));
+				_mm_storeu_si128((__m128i*)&out[i], _mm_add_epi32(carry_lanes, _mm_slli_si128(inclusive, 4)));
+				carry_lanes = _mm_add_epi32(carry_lanes, _mm_shuffle_epi32(inclusive, _MM_SHUFFLE(3, 3, 3, 3)));
+			}
+
+			uint32_t sum = (uint32_t)_mm_cvtsi128_si32(carry_lanes);
+			for (; i < count; ++i)
+			{
+				uint32_t value = values[i];
+				out[i] = sum;
+				sum += value;
+			}
+
+			return sum;
+		}
+
+		// Every group of four flags is stored as four indices, of which only the active ones are counted, so the next group overwrites the rest
+		// The vector loop stops while there is still room for a full store, so that it never writes past out_capacity into the indices of another block
+		static uint32_t compact_block(const uint32_t* flags, uint32_t first_idx, uint32_t count, uint32_t* out_indices, uint32_t out_capacity)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			uint32_t out_count = 0;
+			uint32_t i = 0;
+
+			for (; i + 4 <= count && out_count + 4 <= out_capacity; i += 4)
+			{
+				__m128i is_zero = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&flags[i]), zero);
+				uint32_t active_mask = ~_mm_movemask_ps(_mm_castsi128_ps(is_zero)) & 0xF;
+
+				__m128i indices = _mm_add_epi32(_mm_set1_epi32((int32_t)(first_idx + i)), _mm_load_si128((const __m128i*)s_compact_lut.lane_offsets[active_mask]));
+				_mm_storeu_si128((__m128i*)&out_indices[out_count], indices);
+				out_count += s_compact_lut.lane_counts[active_mask];
+			}
+
+			for (; i < count; ++i)
+			{
+				if (flags[i])
+					out_indices[out_count++] = first_idx + i;
+			}
+
+			return out_count;
+		}
+
+		static void process_blocks()
+		{
+			uint32_t block_idx = 0;
+			while ((block_idx = g_scan->next_block.fetch_add(1, std::memory_order_relaxed)) < g_scan->block_count)
+			{
+				g_scan->block_proc(block_idx, g_scan->user_data);
+			}
+		}
+
+		static void worker_thread_proc(void* user_data)
+		{
+			(void)user_data;
+			uint32_t job_index = 0;
+
+			while (true)
+			{
+				thread::mutex::lock(g_scan->mutex);
+				while (g_scan->job_index == job_index && !g_scan->should_exit)
+				{
+					thread::cond_var::sleep(g_scan->cond_var_job_begin, g_scan->mutex);
+				}
+
+				if (g_scan->should_exit)
+				{
+					thread::mutex::unlock(g_scan->mutex);
+					return;
+				}
+
+				job_index = g_scan->job_index;
+				thread::mutex::unlock(g_scan->mutex);
+
+				process_blocks();
+
+				thread::mutex::lock(g_scan->mutex);
+				if (--g_scan->workers_busy == 0)
+				{
+					thread::cond_var::wake_all(g_scan->cond_var_job_end, g_scan->mutex);
+				}
+				thread::mutex::unlock(g_scan->mutex);
+			}
+		}
+
+		// Runs block_proc once for every block on the workers and the calling thread, and returns once all blocks are done
+		static void run_blocks(block_proc_t block_proc, void* user_data)
+		{
+			thread::mutex::lock(g_scan->mutex);
+			ASSERT_MSG(!g_scan->job_in_flight, "Tried to run a parallel scan while another one was still in flight");
+			g_scan->job_in_flight = true;
+			g_scan->block_proc = block_proc;
+			g_scan->user_data = user_data;
+			g_scan->next_block.store(0);
+			g_scan->workers_busy = g_scan->worker_count;
+			g_scan->job_index++;
+			thread::cond_var::wake_all(g_scan->cond_var_job_begin, g_scan->mutex);
+			thread::mutex::unlock(g_scan->mutex);
+
+			process_blocks();
+
+			thread::mutex::lock(g_scan->mutex);
+			while (g_scan->workers_busy > 0)
+			{
+				thread::cond_var::sleep(g_scan->cond_var_job_end, g_scan->mutex);
+			}
+			g_scan->job_in_flight = false;
+			thread::mutex::unlock(g_scan->mutex);
+		}
+
+		struct scan_job_t
+		{
+			const uint32_t* values;
+			uint32_t* out;
+			uint32_t count;
+			// Sum of all block sums, only known once the block sums are scanned
+			uint32_t total;
+		};
+
+		static void scan_job_sum_block(uint32_t block_idx, void* user_data)
+		{
+			const scan_job_t* job = (const scan_job_t*)user_data;
+			uint32_t first = 0, count = 0;
+			get_block_range(block_idx, g_scan->block_count, job->count, first, count);
+
+			g_scan->block_sums[block_idx] = sum_block(&job->values[first], count);
+		}
+
+		static void scan_job_scan_block(uint32_t block_idx, void* user_data)
+		{
+			const scan_job_t* job = (const scan_job_t*)user_data;
+			uint32_t first = 0, count = 0;
+			get_block_range(block_idx, g_scan->block_count, job->count, first, count);
+
+			exclusive_scan_block(&job->values[first], &job->out[first], count, g_scan->block_sums[block_idx]);
+		}
+
+		static void compact_job_count_block(uint32_t block_idx, void* user_data)
+		{
+			const scan_job_t* job = (const scan_job_t*)user_data;
+			uint32_t first = 0, count = 0;
+			get_block_range(block_idx, g_scan->block_count, job->count, first, count);
+
+			g_scan->block_sums[block_idx] = count_active_block(&job->values[first], count);
+		}
+
+		static void compact_job_compact_block(uint32_t block_idx, void* user_data)
+		{
+			const scan_job_t* job = (const scan_job_t*)user_data;
+			uint32_t first = 0, count = 0;
+			get_block_range(block_idx, g_scan->block_count, job->count, first, count);
+
+			// The block sums hold the exclusive prefix sum of the active counts by now, so the capacity is the distance to the next block
+			uint32_t out_first = g_scan->block_sums[block_idx];
+			uint32_t out_end = block_idx + 1 < g_scan->block_count ? g_scan->block_sums[block_idx + 1] : job->total;
+			compact_block(&job->values[first], first, count, &job->out[out_first], out_end - out_first);
+		}
+
+		void init(memory_arena_t& arena)
+		{
+			g_scan = ARENA_ALLOC_STRUCT_ZERO(arena, scan_inst_t);
+
+			// The tile scheduler workers are usually idle while the scans run, so this uses all hardware threads as well
+			g_scan->worker_count = MAX(thread::get_hardware_thread_count(), 2) - 1;
+			g_scan->worker_threads = ARENA_ALLOC_ARRAY_ZERO(arena, thread_t, g_scan->worker_count);
+			g_scan->block_count = g_scan->worker_count + 1;
+			g_scan->block_sums = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, g_scan->block_count);
+
+			for (uint32_t i = 0; i < g_scan->worker_count; ++i)
+			{
+				g_scan->worker_threads[i] = thread::create(worker_thread_proc, nullptr);
+			}
+
+			LOG_INFO("CPU", "Scan: %u worker threads", g_scan->worker_count);
+		}
+
+		void exit()
+		{
+			thread::mutex::lock(g_scan->mutex);
+			g_scan->should_exit = true;
+			thread::cond_var::wake_all(g_scan->cond_var_job_begin, g_scan->mutex);
+			thread::mutex::unlock(g_scan->mutex);
+
+			for (uint32_t i = 0; i < g_scan->worker_count; ++i)
+			{
+				thread::join(g_scan->worker_threads[i]);
+			}
+
+			g_scan = nullptr;
+		}
+
+		uint32_t exclusive_scan(const uint32_t* values, uint32_t* out, uint32_t count)
+		{
+			return exclusive_scan_block(values, out, count, 0);
+		}
+
+		uint32_t compact_indices(const uint32_t* flags, uint32_t* out_indices, uint32_t count)
+		{
+			return compact_block(flags, 0, count, out_indices, count);
+		}
+
+		uint32_t parallel_exclusive_scan(const uint32_t* values, uint32_t* out, uint32_t count)
+		{
+			if (count < PARALLEL_MIN_ELEMENT_COUNT || g_scan->worker_count == 0)
+				return exclusive_scan(values, out, count);
+
+			// Reduce then scan, the block sums are scanned on the calling thread in between, so each block knows the sum of all blocks before it
+			scan_job_t job = { values, out, count, 0 };
+			run_blocks(scan_job_sum_block, &job);
+			job.total = exclusive_scan_block(g_scan->block_sums, g_scan->block_sums, g_scan->block_count, 0);
+			run_blocks(scan_job_scan_block, &job);
+
+			return job.total;
+		}
+
+		uint32_t parallel_compact_indices(const uint32_t* flags, uint32_t* out_indices, uint32_t count)
+		{
+			if (count < PARALLEL_MIN_ELEMENT_COUNT || g_scan->worker_count == 0)
+				return compact_indices(flags, out_indices, count);
+
+			ASSERT_MSG(flags != out_indices, "The parallel compaction cannot work in place");
+
+			scan_job_t job = { flags, out_indices, count, 0 };
+			run_blocks(compact_job_count_block, &job);
+			job.total = exclusive_scan_block(g_scan->block_sums, g_scan->block_sums, g_scan->block_count, 0);
+			run_blocks(compact_job_compact_block, &job);
+
+			return job.total;
+		}
+
+		struct atomic_append_job_t
+		{
+			const uint32_t* flags;
+			uint32_t* out_indices;
+			uint32_t count;
+			std::atomic<uint32_t> out_count;
+		};
+
+		// Same as the wavefront shaders do on the GPU, one atomic increment per active element
+		static void atomic_append_job_block(uint32_t block_idx, void* user_data)
+		{
+			atomic_append_job_t* job = (atomic_append_job_t*)user_data;
+			uint32_t first = 0, count = 0;
+			get_block_range(block_idx, g_scan->block_count, job->count, first, count);
+
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				if (job->flags[i])
+					job->out_indices[job->out_count.fetch_add(1, std::memory_order_relaxed)] = i;
+			}
+		}
+
+		benchmark_result_t run_benchmark(uint32_t element_count, float active_fraction, uint32_t iteration_count)
+		{
+			benchmark_result_t result = {};
+			result.element_count = element_count;
+			result.thread_count = g_scan->block_count;
+			result.scan_ms = result.parallel_scan_ms = result.compact_ms = result.parallel_compact_ms = result.atomic_append_ms = DBL_MAX;
+			result.atomic_append_ordered = true;
+
+			ARENA_SCRATCH_SCOPE()
+			{
+				uint32_t* flags = ARENA_ALLOC_ARRAY(arena_scratch, uint32_t, element_count);
+				uint32_t* out_indices = ARENA_ALLOC_ARRAY(arena_scratch, uint32_t, element_count);
+				uint32_t* out_atomic = ARENA_ALLOC_ARRAY(arena_scratch, uint32_t, element_count);
+
+				// Fixed seed, so that every run compacts the same flags
+				uint32_t seed = 0x9E3779B9;
+				uint32_t active_threshold = (uint32_t)(glm::clamp(active_fraction, 0.0f, 1.0f) * 4294967295.0);
+				for (uint32_t i = 0; i < element_count; ++i)
+				{
+					flags[i] = rng::rand_uint32(seed) <= active_threshold ? 1 : 0;
+				}
+
+				for (uint32_t iteration = 0; iteration < iteration_count; ++iteration)
+				{
+					timer_ticks_t time_begin = platform::get_ticks();
+					exclusive_scan(flags, out_indices, element_count);
+					result.scan_ms = MIN(result.scan_ms, platform::get_elapsed_seconds(time_begin, platform::get_ticks()) * 1000.0);
+
+					time_begin = platform::get_ticks();
+					parallel_exclusive_scan(flags, out_indices, element_count);
+					result.parallel_scan_ms = MIN(result.parallel_scan_ms, platform::get_elapsed_seconds(time_begin, platform::get_ticks()) * 1000.0);
+
+					time_begin = platform::get_ticks();
+					compact_indices(flags, out_indices, element_count);
+					result.compact_ms = MIN(result.compact_ms, platform::get_elapsed_seconds(time_begin, platform::get_ticks()) * 1000.0);
+
+					time_begin = platform::get_ticks();
+					result.active_count = parallel_compact_indices(flags, out_indices, element_count);
+					result.parallel_compact_ms = MIN(result.parallel_compact_ms, platform::get_elapsed_seconds(time_begin, platform::get_ticks()) * 1000.0);
+
+					atomic_append_job_t atomic_job = {};
+					atomic_job.flags = flags;
+					atomic_job.out_indices = out_atomic;
+					atomic_job.count = element_count;
+
+					time_begin = platform::get_ticks();
+					run_blocks(atomic_append_job_block, &atomic_job);
+					result.atomic_append_ms = MIN(result.atomic_append_ms, platform::get_elapsed_seconds(time_begin, platform::get_ticks()) * 1000.0);
+
+					ASSERT(atomic_job.out_count.load() == result.active_count);
+					result.atomic_append_ordered &= memcmp(out_atomic, out_indices, result.active_count * sizeof(uint32_t)) == 0;
+				}
+			}
+
+			LOG_INFO("CPU", "Scan benchmark: %u elements, %u active, scan %.3f/%.3f ms, compact %.3f/%.3f ms, atomic append %.3f ms (%s)",
+				result.element_count, result.active_count, result.scan_ms, result.parallel_scan_ms, result.compact_ms, result.parallel_compact_ms,
+				result.atomic_append_ms, result.atomic_append_ordered ? "ordered" : "unordered");
+
+			return result;
+		}
+
+	}
+
+}
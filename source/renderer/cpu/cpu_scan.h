@@ -0,0 +1,52 @@
+#pragma once
+#include "core/common.h"
+
+struct memory_arena_t;
+
+namespace cpu
+{
+
+	// Exclusive prefix sums and stream compaction over uint32 arrays, the building blocks for compacting active rays in between path tracing stages
+	// The parallel variants split the array into one contiguous block per thread and always produce the exact same output as the single threaded variants,
+	// so the order of the compacted elements never depends on thread timing like it does with atomic appends
+	namespace scan
+	{
+
+		struct benchmark_result_t
+		{
+			uint32_t element_count;
+			uint32_t active_count;
+			uint32_t thread_count;
+			// Best time out of all benchmark iterations, in milliseconds
+			double scan_ms;
+			double parallel_scan_ms;
+			double compact_ms;
+			double parallel_compact_ms;
+			double atomic_append_ms;
+			// True if the atomic appends happened to produce the same order as the compaction in every iteration
+			bool atomic_append_ordered;
+		};
+
+		// Starts the worker threads for the parallel variants, the calling thread also works on its own block
+		void init(memory_arena_t& arena);
+		void exit();
+
+		// Writes the sum of all values before each element to out and returns the sum of all values, out may be the same array as values
+		uint32_t exclusive_scan(const uint32_t* values, uint32_t* out, uint32_t count);
+		// Writes the indices of all non-zero flags to out_indices in ascending order and returns how many were written
+		// out_indices needs to be count elements in size, and may be the same array as flags
+		uint32_t compact_indices(const uint32_t* flags, uint32_t* out_indices, uint32_t count);
+
+		// Same as above, spread over the worker threads, small arrays are processed on the calling thread only
+		// The parallel compaction cannot work in place, since a block writes its indices over the flags of the blocks before it
+		// Only one parallel operation can run at a time, and these should not be called from the worker threads themselves
+		uint32_t parallel_exclusive_scan(const uint32_t* values, uint32_t* out, uint32_t count);
+		uint32_t parallel_compact_indices(const uint32_t* flags, uint32_t* out_indices, uint32_t count);
+
+		// Compacts element_count random flags of which roughly active_fraction are set, both with the functions above and with one atomic increment per active element
+		// Blocks the calling thread until all iterations are done
+		benchmark_result_t run_benchmark(uint32_t element_count, float active_fraction, uint32_t iteration_count);
+
+	}
+
+}
@@ -0,0 +1,241 @@
+#include "cpu_texture.h"
+#include "cpu_texture_cache.h"
+#include "core/memory/memory_arena.h"
+
+namespace cpu
+{
+
+	static float srgb_to_linear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : glm::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	static float linear_to_srgb(float c)
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * glm::pow(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Every 8-bit sRGB value decoded to linear once, so that sampling does not need to do any pow
+	struct srgb_lut_t
+	{
+		float to_linear[256];
+
+		srgb_lut_t()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				to_linear[i] = srgb_to_linear((float)i / 255.0f);
+			}
+		}
+	} static const s_srgb_lut;
+
+	static uint8_t float_to_unorm8(float value)
+	{
+		return (uint8_t)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	static uint32_t get_bytes_per_texel(TEXTURE_FORMAT format)
+	{
+		switch (format)
+		{
+		case TEXTURE_FORMAT_RG8:			return 2;
+		case TEXTURE_FORMAT_RGBA8:
+		case TEXTURE_FORMAT_RGBA8_SRGB:		return 4;
+		default:							return 0;
+		}
+	}
+
+	// Returns the texel in linear space, two channel textures return zero for blue and one for alpha, same as the GPU
+	static glm::vec4 load_texel(TEXTURE_FORMAT format, const uint8_t* texel)
+	{
+		switch (format)
+		{
+		case TEXTURE_FORMAT_RG8:
+			return glm::vec4(texel[0] / 255.0f, texel[1] / 255.0f, 0.0f, 1.0f);
+		case TEXTURE_FORMAT_RGBA8:
+			return glm::vec4(texel[0], texel[1], texel[2], texel[3]) * (1.0f / 255.0f);
+		case TEXTURE_FORMAT_RGBA8_SRGB:
+			return glm::vec4(s_srgb_lut.to_linear[texel[0]], s_srgb_lut.to_linear[texel[1]], s_srgb_lut.to_linear[texel[2]], texel[3] / 255.0f);
+		default:
+			return glm::vec4(1.0f);
+		}
+	}
+
+	static void store_texel(TEXTURE_FORMAT format, uint8_t* texel, const glm::vec4& value)
+	{
+		switch (format)
+		{
+		case TEXTURE_FORMAT_RG8:
+		{
+			texel[0] = float_to_unorm8(value.x);
+			texel[1] = float_to_unorm8(value.y);
+		} break;
+		case TEXTURE_FORMAT_RGBA8:
+		{
+			for (uint32_t i = 0; i < 4; ++i)
+				texel[i] = float_to_unorm8(value[i]);
+		} break;
+		case TEXTURE_FORMAT_RGBA8_SRGB:
+		{
+			for (uint32_t i = 0; i < 3; ++i)
+				texel[i] = float_to_unorm8(linear_to_srgb(value[i]));
+			texel[3] = float_to_unorm8(value.w);
+		} break;
+		default:
+			break;
+		}
+	}
+
+	static tile_texel_t get_tile_texel(const texture_t& texture, uint32_t mip, uint32_t x, uint32_t y)
+	{
+		tile_texel_t result = {};
+		result.tile_idx = texture.mip_first_tile[mip] + (y / TEXTURE_TILE_SIZE) * texture.mip_tiles_x[mip] + x / TEXTURE_TILE_SIZE;
+		result.byte_offset = ((y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE + x % TEXTURE_TILE_SIZE) * texture.bytes_per_texel;
+
+		return result;
+	}
+
+	bool is_texture_format_supported(TEXTURE_FORMAT format)
+	{
+		return get_bytes_per_texel(format) > 0;
+	}
+
+	void create_texture(texture_t& texture, TEXTURE_FORMAT format, uint32_t width, uint32_t height, const uint8_t* texels)
+	{
+		texture = {};
+		texture.format = format;
+		texture.bytes_per_texel = get_bytes_per_texel(format);
+
+		if (!is_texture_format_supported(format) || width == 0 || height == 0)
+			return;
+
+		// Every mip halves the dimensions, rounded down, until both dimensions are one texel
+		uint64_t total_bytes = 0;
+		uint32_t mip_width = width;
+		uint32_t mip_height = height;
+
+		while (texture.mip_count < TEXTURE_MAX_MIP_COUNT)
+		{
+			texture.mip_widths[texture.mip_count] = mip_width;
+			texture.mip_heights[texture.mip_count] = mip_height;
+			total_bytes += (uint64_t)mip_width * mip_height * texture.bytes_per_texel;
+			texture.mip_count++;
+
+			if (mip_width == 1 && mip_height == 1)
+				break;
+
+			mip_width = MAX(mip_width / 2, 1u);
+			mip_height = MAX(mip_height / 2, 1u);
+		}
+
+		// Mip zero gets its tiles straight from the source texels, the other mips only need to stay in memory until their tiles are written to the texture cache
+		texture.mip_tiles_x[0] = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+		texture.mip_first_tile[0] = texture_cache::add_tiles(texels, width, height, texture.bytes_per_texel);
+
+		ARENA_SCRATCH_SCOPE()
+		{
+			const uint8_t* src = texels;
+			uint8_t* mip_texels = ARENA_ALLOC_ARRAY(arena_scratch, uint8_t, total_bytes);
+
+			for (uint32_t mip = 1; mip < texture.mip_count; ++mip)
+			{
+				uint32_t src_width = texture.mip_widths[mip - 1];
+				uint32_t src_height = texture.mip_heights[mip - 1];
+
+				for (uint32_t y = 0; y < texture.mip_heights[mip]; ++y)
+				{
+					for (uint32_t x = 0; x < texture.mip_widths[mip]; ++x)
+					{
+						// 2x2 box filter, odd source dimensions drop their last row or column
+						uint32_t src_x0 = MIN(x * 2, src_width - 1);
+						uint32_t src_x1 = MIN(x * 2 + 1, src_width - 1);
+						uint32_t src_y0 = MIN(y * 2, src_height - 1);
+						uint32_t src_y1 = MIN(y * 2 + 1, src_height - 1);
+
+						glm::vec4 sum = load_texel(format, &src[(src_y0 * src_width + src_x0) * texture.bytes_per_texel]);
+						sum += load_texel(format, &src[(src_y0 * src_width + src_x1) * texture.bytes_per_texel]);
+						sum += load_texel(format, &src[(src_y1 * src_width + src_x0) * texture.bytes_per_texel]);
+						sum += load_texel(format, &src[(src_y1 * src_width + src_x1) * texture.bytes_per_texel]);
+
+						store_texel(format, &mip_texels[(y * texture.mip_widths[mip] + x) * texture.bytes_per_texel], sum * 0.25f);
+					}
+				}
+
+				texture.mip_tiles_x[mip] = (texture.mip_widths[mip] + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+				texture.mip_first_tile[mip] = texture_cache::add_tiles(mip_texels, texture.mip_widths[mip], texture.mip_heights[mip], texture.bytes_per_texel);
+
+				src = mip_texels;
+				mip_texels += (uint64_t)texture.mip_widths[mip] * texture.mip_heights[mip] * texture.bytes_per_texel;
+			}
+		}
+	}
+
+	ray_cone_t make_primary_ray_cone(const view_t& view)
+	{
+		// The projection scales y by 1 / tan(vfov / 2), so this is the angle covered by a single pixel
+		ray_cone_t cone = {};
+		cone.width = 0.0f;
+		cone.spread_angle = glm::atan(2.0f / (view.view_to_clip[1][1] * view.render_dim.y));
+
+		return cone;
+	}
+
+	float get_triangle_lod(const triangle_t& tri, const affine_transform_t& local_to_world)
+	{
+		glm::vec3 p0 = transform_point(local_to_world, tri.v0.position);
+		glm::vec3 p1 = transform_point(local_to_world, tri.v1.position);
+		glm::vec3 p2 = transform_point(local_to_world, tri.v2.position);
+		float world_area = glm::length(glm::cross(p1 - p0, p2 - p0));
+
+		glm::vec2 uv_edge0 = tri.v1.uv - tri.v0.uv;
+		glm::vec2 uv_edge1 = tri.v2.uv - tri.v0.uv;
+		float uv_area = glm::abs(uv_edge0.x * uv_edge1.y - uv_edge0.y * uv_edge1.x);
+
+		// Both areas are doubled, which cancels out
+		return 0.5f * glm::log2(uv_area / world_area);
+	}
+
+	float get_texture_lod(const texture_t& texture, float triangle_lod, float cone_width, float cos_theta)
+	{
+		float texel_area = (float)texture.mip_widths[0] * (float)texture.mip_heights[0];
+		return triangle_lod + 0.5f * glm::log2(texel_area) + glm::log2(glm::abs(cone_width)) - glm::log2(glm::abs(cos_theta));
+	}
+
+	glm::vec4 sample_texture(const texture_t& texture, const glm::vec2& uv, float lod)
+	{
+		if (texture.mip_count == 0)
+			return glm::vec4(1.0f);
+
+		// Also catches a NaN level of detail from degenerate triangles
+		uint32_t mip = lod > 0.0f ? (uint32_t)glm::min(lod + 0.5f, (float)(texture.mip_count - 1)) : 0;
+
+		int32_t width = (int32_t)texture.mip_widths[mip];
+		int32_t height = (int32_t)texture.mip_heights[mip];
+
+		// Texel centers are at half texel offsets, wrap the UV first so that large texture coordinates keep their precision
+		glm::vec2 texel_pos = (uv - glm::floor(uv)) * glm::vec2(width, height) - 0.5f;
+		glm::vec2 texel_floor = glm::floor(texel_pos);
+		glm::vec2 frac = texel_pos - texel_floor;
+
+		int32_t x0 = (((int32_t)texel_floor.x % width) + width) % width;
+		int32_t y0 = (((int32_t)texel_floor.y % height) + height) % height;
+		int32_t x1 = (x0 + 1) % width;
+		int32_t y1 = (y0 + 1) % height;
+
+		// All four texels are read from the texture cache at once, so that it only needs to take its lock once per sample
+		tile_texel_t tile_texels[4] = {
+			get_tile_texel(texture, mip, x0, y0), get_tile_texel(texture, mip, x1, y0),
+			get_tile_texel(texture, mip, x0, y1), get_tile_texel(texture, mip, x1, y1)
+		};
+		uint8_t texels[4 * TEXTURE_TILE_MAX_BYTES_PER_TEXEL];
+		texture_cache::read_texels(4, tile_texels, texture.bytes_per_texel, texels);
+
+		glm::vec4 t00 = load_texel(texture.format, &texels[0 * texture.bytes_per_texel]);
+		glm::vec4 t10 = load_texel(texture.format, &texels[1 * texture.bytes_per_texel]);
+		glm::vec4 t01 = load_texel(texture.format, &texels[2 * texture.bytes_per_texel]);
+		glm::vec4 t11 = load_texel(texture.format, &texels[3 * texture.bytes_per_texel]);
+
+		return glm::mix(glm::mix(t00, t10, frac.x), glm::mix(t01, t11, frac.x), frac.y);
+	}
+
+}
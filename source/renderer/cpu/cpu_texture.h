@@ -0,0 +1,49 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/renderer_fwd.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+namespace cpu
+{
+
+	inline constexpr uint32_t TEXTURE_MAX_MIP_COUNT = 16;
+
+	// Mipmapped copy of a render texture for the CPU path tracer, every mip is stored in the format of the source texture
+	// The texels live in tiles in the texture cache, the texture only knows the index of the top left tile of every mip
+	// Block compressed and float formats are not supported, those textures have a mip count of zero and always sample as white
+	struct texture_t
+	{
+		TEXTURE_FORMAT format;
+		uint32_t bytes_per_texel;
+		uint32_t mip_count;
+		uint32_t mip_widths[TEXTURE_MAX_MIP_COUNT];
+		uint32_t mip_heights[TEXTURE_MAX_MIP_COUNT];
+		uint32_t mip_tiles_x[TEXTURE_MAX_MIP_COUNT];
+		uint32_t mip_first_tile[TEXTURE_MAX_MIP_COUNT];
+	};
+
+	// Footprint of a ray as a cone, from "Texture Level of Detail Strategies for Real-Time Ray Tracing" (Akenine-Moller et al. 2019)
+	// The width is the cone diameter at the ray origin, and grows by the spread angle per unit of distance travelled
+	struct ray_cone_t
+	{
+		float width;
+		float spread_angle;
+	};
+
+	// Builds the full mip chain with a box filter, sRGB textures are filtered in linear space, and adds all mips to the texture cache
+	void create_texture(texture_t& texture, TEXTURE_FORMAT format, uint32_t width, uint32_t height, const uint8_t* texels);
+	bool is_texture_format_supported(TEXTURE_FORMAT format);
+
+	// Camera rays start out with a width of zero, and spread by the angle of a single pixel
+	ray_cone_t make_primary_ray_cone(const view_t& view);
+	// Base level of detail of a triangle, half the log2 of the ratio between its texture space area and world space area
+	// The texture space area is measured in UV units, the resolution of the texture is added when sampling
+	float get_triangle_lod(const triangle_t& tri, const affine_transform_t& local_to_world);
+	// Mip level for a ray cone with the given width when it hits a surface at an angle, cos_theta is the cosine between the ray and the surface normal
+	float get_texture_lod(const texture_t& texture, float triangle_lod, float cone_width, float cos_theta);
+
+	// Bilinear filtered sample with wrap addressing from the mip closest to lod, sRGB textures are returned in linear space
+	// Tiles that are not resident in the texture cache are loaded on first access
+	glm::vec4 sample_texture(const texture_t& texture, const glm::vec2& uv, float lod);
+
+}
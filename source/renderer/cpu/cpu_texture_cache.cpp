@@ -0,0 +1,291 @@
+#include "cpu_texture_cache.h"
+#include "core/thread.h"
+#include "core/logger.h"
+#include "core/assertion.h"
+#include "core/fileio/fileio.h"
+#include "core/memory/memory_arena.h"
+
+namespace cpu
+{
+
+	namespace texture_cache
+	{
+
+		inline constexpr uint32_t TILE_SLOT_INVALID = 0xFFFFFFFF;
+		// Every shard has its own lock and LRU list, so that threads sampling tiles of different shards never wait on each other
+		inline constexpr uint32_t TEXTURE_CACHE_SHARD_COUNT_LOG2 = 4;
+		inline constexpr uint32_t TEXTURE_CACHE_SHARD_COUNT = 1 << TEXTURE_CACHE_SHARD_COUNT_LOG2;
+
+		// Memory for one resident tile, the slots that are not loading form a doubly linked list ordered from most to least recently used
+		struct tile_slot_t
+		{
+			uint32_t tile_idx;
+			uint32_t prev;
+			uint32_t next;
+			// The tile is being read from the backing file outside of the lock, the slot is not part of the LRU list until it is done
+			bool loading;
+		};
+
+		struct texture_cache_shard_t
+		{
+			// Protects everything in the shard, and the slot index of the tiles that belong to the shard
+			mutex_t mutex;
+			// Woken up whenever a tile of the shard is done loading
+			cond_var_t tile_loaded;
+
+			uint32_t slot_count;
+			uint32_t slots_used;
+			tile_slot_t* slots;
+			uint8_t* slot_texels;
+			uint32_t lru_head;
+			uint32_t lru_tail;
+
+			stats_t stats;
+		};
+
+		struct texture_cache_inst_t
+		{
+			// Only used for the tile table, so that it stays contiguous while it grows
+			memory_arena_t tile_arena;
+			// Slot index of every tile within its shard, or TILE_SLOT_INVALID if the tile is not resident
+			uint32_t* tile_slots;
+			uint32_t tile_count;
+			// Protects the tile count and the growth of the tile table, only taken when tiles are added
+			mutex_t add_mutex;
+
+			fileio::file_t backing_file;
+			char backing_filepath[260];
+
+			texture_cache_shard_t shards[TEXTURE_CACHE_SHARD_COUNT];
+		};
+		static texture_cache_inst_t* g_texture_cache = nullptr;
+
+		// Neighbouring tiles are sampled together by the bilinear filter, the multiplicative hash spreads them over different shards
+		static texture_cache_shard_t& get_shard(uint32_t tile_idx)
+		{
+			return g_texture_cache->shards[(tile_idx * 2654435761u) >> (32 - TEXTURE_CACHE_SHARD_COUNT_LOG2)];
+		}
+
+		static void lru_unlink(texture_cache_shard_t& shard, uint32_t slot_idx)
+		{
+			tile_slot_t& slot = shard.slots[slot_idx];
+
+			if (slot.prev != TILE_SLOT_INVALID)
+				shard.slots[slot.prev].next = slot.next;
+			else
+				shard.lru_head = slot.next;
+
+			if (slot.next != TILE_SLOT_INVALID)
+				shard.slots[slot.next].prev = slot.prev;
+			else
+				shard.lru_tail = slot.prev;
+		}
+
+		static void lru_push_front(texture_cache_shard_t& shard, uint32_t slot_idx)
+		{
+			tile_slot_t& slot = shard.slots[slot_idx];
+			slot.prev = TILE_SLOT_INVALID;
+			slot.next = shard.lru_head;
+
+			if (shard.lru_head != TILE_SLOT_INVALID)
+				shard.slots[shard.lru_head].prev = slot_idx;
+			else
+				shard.lru_tail = slot_idx;
+
+			shard.lru_head = slot_idx;
+		}
+
+		static uint8_t* get_slot_texels(texture_cache_shard_t& shard, uint32_t slot_idx)
+		{
+			return shard.slot_texels + (uint64_t)slot_idx * TEXTURE_TILE_BYTE_SIZE;
+		}
+
+		// Copies a single texel, the tile gets loaded into a free or the least recently used slot of its shard if it is not resident
+		// The backing file is read without holding the lock of the shard, other threads that need the same tile wait until it is loaded
+		static void read_texel(const tile_texel_t& texel, uint32_t bytes_per_texel, uint8_t* dst)
+		{
+			texture_cache_shard_t& shard = get_shard(texel.tile_idx);
+			thread::mutex::lock(shard.mutex);
+
+			uint32_t slot_idx = TILE_SLOT_INVALID;
+			while (slot_idx == TILE_SLOT_INVALID)
+			{
+				uint32_t resident_slot_idx = g_texture_cache->tile_slots[texel.tile_idx];
+				if (resident_slot_idx != TILE_SLOT_INVALID)
+				{
+					if (shard.slots[resident_slot_idx].loading)
+					{
+						thread::cond_var::sleep(shard.tile_loaded, shard.mutex);
+						continue;
+					}
+
+					shard.stats.hits++;
+					lru_unlink(shard, resident_slot_idx);
+					lru_push_front(shard, resident_slot_idx);
+					memcpy(dst, get_slot_texels(shard, resident_slot_idx) + texel.byte_offset, bytes_per_texel);
+
+					thread::mutex::unlock(shard.mutex);
+					return;
+				}
+
+				if (shard.slots_used < shard.slot_count)
+				{
+					slot_idx = shard.slots_used++;
+				}
+				else if (shard.lru_tail != TILE_SLOT_INVALID)
+				{
+					slot_idx = shard.lru_tail;
+					lru_unlink(shard, slot_idx);
+					g_texture_cache->tile_slots[shard.slots[slot_idx].tile_idx] = TILE_SLOT_INVALID;
+					shard.stats.evictions++;
+				}
+				else
+				{
+					// Every slot of the shard is being loaded by other threads, none of them can be evicted until they are done
+					thread::cond_var::sleep(shard.tile_loaded, shard.mutex);
+				}
+			}
+
+			shard.stats.misses++;
+			tile_slot_t& slot = shard.slots[slot_idx];
+			slot.tile_idx = texel.tile_idx;
+			slot.loading = true;
+			g_texture_cache->tile_slots[texel.tile_idx] = slot_idx;
+
+			thread::mutex::unlock(shard.mutex);
+
+			// Nothing else touches a loading slot, so its texels can be written without the lock
+			uint8_t* slot_texels = get_slot_texels(shard, slot_idx);
+			if (!fileio::read_file_at(g_texture_cache->backing_file, (uint64_t)texel.tile_idx * TEXTURE_TILE_BYTE_SIZE, slot_texels, TEXTURE_TILE_BYTE_SIZE))
+			{
+				LOG_ERR("Texture Cache", "Failed to read tile %u from %s", texel.tile_idx, g_texture_cache->backing_filepath);
+				memset(slot_texels, 0xFF, TEXTURE_TILE_BYTE_SIZE);
+			}
+
+			thread::mutex::lock(shard.mutex);
+
+			slot.loading = false;
+			lru_push_front(shard, slot_idx);
+			memcpy(dst, slot_texels + texel.byte_offset, bytes_per_texel);
+			thread::cond_var::wake_all(shard.tile_loaded, shard.mutex);
+
+			thread::mutex::unlock(shard.mutex);
+		}
+
+		void init(memory_arena_t& arena, uint64_t memory_budget, const char* backing_filepath_prefix)
+		{
+			g_texture_cache = ARENA_ALLOC_STRUCT_ZERO(arena, texture_cache_inst_t);
+			g_texture_cache->tile_arena.name = "Texture Cache Tiles";
+
+			// Every process gets its own backing file, so that multiple workers on the same machine can share a working directory
+			if (!fileio::create_temp_file(backing_filepath_prefix, g_texture_cache->backing_file,
+				g_texture_cache->backing_filepath, ARRAY_SIZE(g_texture_cache->backing_filepath)))
+				FATAL_ERROR("Texture Cache", "Failed to create texture cache backing file %s", g_texture_cache->backing_filepath);
+
+			// The budget is split evenly over the shards, every shard needs at least one slot
+			uint32_t shard_slot_count = MAX((uint32_t)(memory_budget / TEXTURE_TILE_BYTE_SIZE / TEXTURE_CACHE_SHARD_COUNT), 1u);
+			for (uint32_t shard_idx = 0; shard_idx < TEXTURE_CACHE_SHARD_COUNT; ++shard_idx)
+			{
+				texture_cache_shard_t& shard = g_texture_cache->shards[shard_idx];
+				shard.slot_count = shard_slot_count;
+				shard.slots = ARENA_ALLOC_ARRAY_ZERO(arena, tile_slot_t, shard_slot_count);
+				shard.slot_texels = (uint8_t*)ARENA_ALLOC(arena, (uint64_t)shard_slot_count * TEXTURE_TILE_BYTE_SIZE, 64);
+				shard.lru_head = TILE_SLOT_INVALID;
+				shard.lru_tail = TILE_SLOT_INVALID;
+			}
+
+			uint32_t slot_count = shard_slot_count * TEXTURE_CACHE_SHARD_COUNT;
+			LOG_INFO("Texture Cache", "Init with %u tile slots in %u shards (%llu MB)", slot_count, TEXTURE_CACHE_SHARD_COUNT,
+				((uint64_t)slot_count * TEXTURE_TILE_BYTE_SIZE) >> 20);
+		}
+
+		void exit()
+		{
+			fileio::close_file(g_texture_cache->backing_file);
+
+			ARENA_RELEASE(g_texture_cache->tile_arena);
+			g_texture_cache = nullptr;
+		}
+
+		uint32_t add_tiles(const uint8_t* texels, uint32_t width, uint32_t height, uint32_t bytes_per_texel)
+		{
+			ASSERT(bytes_per_texel <= TEXTURE_TILE_MAX_BYTES_PER_TEXEL);
+
+			uint32_t tiles_x = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+			uint32_t tiles_y = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+			uint32_t first_tile_idx = 0;
+			uint8_t tile_texels[TEXTURE_TILE_BYTE_SIZE];
+
+			thread::mutex::lock(g_texture_cache->add_mutex);
+
+			first_tile_idx = g_texture_cache->tile_count;
+			uint32_t* tile_slots = ARENA_ALLOC_ARRAY(g_texture_cache->tile_arena, uint32_t, tiles_x * tiles_y);
+			if (!g_texture_cache->tile_slots)
+				g_texture_cache->tile_slots = tile_slots;
+			ASSERT(tile_slots == g_texture_cache->tile_slots + first_tile_idx);
+
+			for (uint32_t tile_y = 0; tile_y < tiles_y; ++tile_y)
+			{
+				for (uint32_t tile_x = 0; tile_x < tiles_x; ++tile_x)
+				{
+					// Copy the rows of the tile, the padding of edge tiles stays zero
+					uint32_t texel_x = tile_x * TEXTURE_TILE_SIZE;
+					uint32_t texel_y = tile_y * TEXTURE_TILE_SIZE;
+					uint32_t row_texel_count = MIN(TEXTURE_TILE_SIZE, width - texel_x);
+					uint32_t row_count = MIN(TEXTURE_TILE_SIZE, height - texel_y);
+
+					memset(tile_texels, 0, sizeof(tile_texels));
+					for (uint32_t row = 0; row < row_count; ++row)
+					{
+						memcpy(&tile_texels[row * TEXTURE_TILE_SIZE * bytes_per_texel],
+							&texels[((uint64_t)(texel_y + row) * width + texel_x) * bytes_per_texel], row_texel_count * bytes_per_texel);
+					}
+
+					uint32_t tile_idx = g_texture_cache->tile_count++;
+					g_texture_cache->tile_slots[tile_idx] = TILE_SLOT_INVALID;
+
+					if (!fileio::write_file_at(g_texture_cache->backing_file, (uint64_t)tile_idx * TEXTURE_TILE_BYTE_SIZE, tile_texels, TEXTURE_TILE_BYTE_SIZE))
+						FATAL_ERROR("Texture Cache", "Failed to write tile %u to %s", tile_idx, g_texture_cache->backing_filepath);
+				}
+			}
+
+			thread::mutex::unlock(g_texture_cache->add_mutex);
+
+			return first_tile_idx;
+		}
+
+		void read_texels(uint32_t texel_count, const tile_texel_t* texels, uint32_t bytes_per_texel, uint8_t* dst)
+		{
+			// Every texel is copied as soon as its tile is resident, so a tile that gets evicted by a later texel of the same read is never read from
+			for (uint32_t i = 0; i < texel_count; ++i)
+				read_texel(texels[i], bytes_per_texel, &dst[i * bytes_per_texel]);
+		}
+
+		stats_t get_stats()
+		{
+			stats_t stats = {};
+
+			for (uint32_t shard_idx = 0; shard_idx < TEXTURE_CACHE_SHARD_COUNT; ++shard_idx)
+			{
+				texture_cache_shard_t& shard = g_texture_cache->shards[shard_idx];
+				thread::mutex::lock(shard.mutex);
+
+				stats.hits += shard.stats.hits;
+				stats.misses += shard.stats.misses;
+				stats.evictions += shard.stats.evictions;
+				stats.resident_tile_count += shard.slots_used;
+				stats.slot_count += shard.slot_count;
+
+				thread::mutex::unlock(shard.mutex);
+			}
+
+			thread::mutex::lock(g_texture_cache->add_mutex);
+			stats.tile_count = g_texture_cache->tile_count;
+			thread::mutex::unlock(g_texture_cache->add_mutex);
+
+			return stats;
+		}
+
+	}
+
+}
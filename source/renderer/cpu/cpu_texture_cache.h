@@ -0,0 +1,51 @@
+#pragma once
+#include "core/common.h"
+
+struct memory_arena_t;
+
+namespace cpu
+{
+
+	// Width and height of a texture tile in texels, tiles on the right and bottom edge of a mip are padded to the full size
+	inline constexpr uint32_t TEXTURE_TILE_SIZE = 64;
+	inline constexpr uint32_t TEXTURE_TILE_MAX_BYTES_PER_TEXEL = 4;
+	inline constexpr uint32_t TEXTURE_TILE_BYTE_SIZE = TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * TEXTURE_TILE_MAX_BYTES_PER_TEXEL;
+
+	// A texel within a tile, the byte offset is relative to the start of the tile
+	struct tile_texel_t
+	{
+		uint32_t tile_idx;
+		uint32_t byte_offset;
+	};
+
+	// Keeps the texture tiles for the CPU path tracer in a backing file on disk, and only the most recently used tiles in memory
+	// The memory use is fixed by the budget that is passed to init, no matter how large the textures of the scene are
+	namespace texture_cache
+	{
+
+		struct stats_t
+		{
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t evictions;
+			uint32_t tile_count;
+			uint32_t resident_tile_count;
+			uint32_t slot_count;
+		};
+
+		// The backing file gets created on init and deleted on exit, its name is the prefix followed by a suffix that is unique to the process
+		void init(memory_arena_t& arena, uint64_t memory_budget, const char* backing_filepath_prefix);
+		void exit();
+
+		// Splits a mip into tiles and writes them to the backing file, none of the tiles are resident until they are read from
+		// The tiles are stored row by row, the returned index is the index of the top left tile
+		uint32_t add_tiles(const uint8_t* texels, uint32_t width, uint32_t height, uint32_t bytes_per_texel);
+		// Copies the texels to dst one after the other, tiles that are not resident get loaded from the backing file and replace the least recently used tiles
+		// Safe to call from multiple threads, the tiles are spread over shards that each have their own lock and least recently used list
+		void read_texels(uint32_t texel_count, const tile_texel_t* texels, uint32_t bytes_per_texel, uint8_t* dst);
+
+		stats_t get_stats();
+
+	}
+
+}
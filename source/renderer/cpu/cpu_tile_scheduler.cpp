@@ -0,0 +1,266 @@
+#include "cpu_tile_scheduler.h"
+#include "core/thread.h"
+#include "core/logger.h"
+#include "core/assertion.h"
+#include "core/memory/memory_arena.h"
+
+#include <atomic>
+
+namespace cpu
+{
+
+	namespace tile_scheduler
+	{
+
+		// Range into the Morton ordered tile list, the owning worker takes tiles from the front and thieves take tiles from the back,
+		// so that both sides keep working on spatially coherent tiles for as long as possible
+		struct tile_deque_t
+		{
+			mutex_t mutex;
+			uint32_t begin;
+			uint32_t end;
+		};
+
+		struct tile_scheduler_inst_t
+		{
+			uint32_t render_width;
+			uint32_t render_height;
+			uint32_t tiles_x;
+			uint32_t tiles_y;
+			uint32_t tile_count;
+			// Tile indices sorted by the Morton code of their tile coordinates
+			uint32_t* morton_tiles;
+
+			uint32_t worker_count;
+			thread_t* worker_threads;
+			tile_deque_t* worker_deques;
+
+			// Protects the pass state below, the atomics are polled by the workers in between tiles
+			mutex_t mutex;
+			cond_var_t cond_var_pass_begin;
+			cond_var_t cond_var_pass_end;
+			uint32_t pass_index;
+			uint32_t workers_busy;
+			bool pass_in_flight;
+			bool should_exit;
+			tile_proc_t tile_proc;
+			void* user_data;
+
+			std::atomic<bool> pass_cancelled;
+			std::atomic<uint32_t> tiles_remaining;
+		};
+		static tile_scheduler_inst_t* g_tile_scheduler = nullptr;
+
+		static uint32_t morton_compact_bits(uint32_t x)
+		{
+			x &= 0x55555555;
+			x = (x ^ (x >> 1)) & 0x33333333;
+			x = (x ^ (x >> 2)) & 0x0f0f0f0f;
+			x = (x ^ (x >> 4)) & 0x00ff00ff;
+			x = (x ^ (x >> 8)) & 0x0000ffff;
+			return x;
+		}
+
+		static bool pop_tile(tile_deque_t& deque, uint32_t& out_tile_idx)
+		{
+			thread::mutex::lock(deque.mutex);
+			bool has_tile = deque.begin < deque.end;
+			if (has_tile)
+			{
+				out_tile_idx = g_tile_scheduler->morton_tiles[deque.begin++];
+			}
+			thread::mutex::unlock(deque.mutex);
+
+			return has_tile;
+		}
+
+		static bool steal_tile(uint32_t thief_idx, uint32_t& out_tile_idx)
+		{
+			for (uint32_t i = 1; i < g_tile_scheduler->worker_count; ++i)
+			{
+				tile_deque_t& victim = g_tile_scheduler->worker_deques[(thief_idx + i) % g_tile_scheduler->worker_count];
+
+				thread::mutex::lock(victim.mutex);
+				bool has_tile = victim.begin < victim.end;
+				if (has_tile)
+				{
+					out_tile_idx = g_tile_scheduler->morton_tiles[--victim.end];
+				}
+				thread::mutex::unlock(victim.mutex);
+
+				if (has_tile)
+					return true;
+			}
+
+			return false;
+		}
+
+		static void process_tiles(uint32_t worker_idx)
+		{
+			tile_deque_t& deque = g_tile_scheduler->worker_deques[worker_idx];
+			uint32_t tile_idx = 0;
+
+			while (!g_tile_scheduler->pass_cancelled.load(std::memory_order_relaxed) &&
+				(pop_tile(deque, tile_idx) || steal_tile(worker_idx, tile_idx)))
+			{
+				glm::uvec2 tile_pos = glm::uvec2(tile_idx % g_tile_scheduler->tiles_x, tile_idx / g_tile_scheduler->tiles_x);
+				glm::uvec2 tile_min = tile_pos * TILE_SIZE;
+				glm::uvec2 tile_max = glm::min(tile_min + TILE_SIZE, glm::uvec2(g_tile_scheduler->render_width, g_tile_scheduler->render_height));
+
+				g_tile_scheduler->tile_proc(tile_min, tile_max, g_tile_scheduler->user_data);
+				g_tile_scheduler->tiles_remaining.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		static void worker_thread_proc(void* user_data)
+		{
+			uint32_t worker_idx = (uint32_t)(uintptr_t)user_data;
+			uint32_t pass_index = 0;
+
+			while (true)
+			{
+				thread::mutex::lock(g_tile_scheduler->mutex);
+				while (g_tile_scheduler->pass_index == pass_index && !g_tile_scheduler->should_exit)
+				{
+					thread::cond_var::sleep(g_tile_scheduler->cond_var_pass_begin, g_tile_scheduler->mutex);
+				}
+
+				if (g_tile_scheduler->should_exit)
+				{
+					thread::mutex::unlock(g_tile_scheduler->mutex);
+					return;
+				}
+
+				pass_index = g_tile_scheduler->pass_index;
+				thread::mutex::unlock(g_tile_scheduler->mutex);
+
+				process_tiles(worker_idx);
+
+				thread::mutex::lock(g_tile_scheduler->mutex);
+				if (--g_tile_scheduler->workers_busy == 0)
+				{
+					thread::cond_var::wake_all(g_tile_scheduler->cond_var_pass_end, g_tile_scheduler->mutex);
+				}
+				thread::mutex::unlock(g_tile_scheduler->mutex);
+			}
+		}
+
+		void init(memory_arena_t& arena, uint32_t render_width, uint32_t render_height)
+		{
+			g_tile_scheduler = ARENA_ALLOC_STRUCT_ZERO(arena, tile_scheduler_inst_t);
+			g_tile_scheduler->render_width = render_width;
+			g_tile_scheduler->render_height = render_height;
+			g_tile_scheduler->tiles_x = (render_width + TILE_SIZE - 1) / TILE_SIZE;
+			g_tile_scheduler->tiles_y = (render_height + TILE_SIZE - 1) / TILE_SIZE;
+			g_tile_scheduler->tile_count = g_tile_scheduler->tiles_x * g_tile_scheduler->tiles_y;
+			g_tile_scheduler->morton_tiles = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, g_tile_scheduler->tile_count);
+
+			// Walk the Morton curve over the smallest power of two square that covers all tiles, and skip the codes that fall outside of the render target
+			uint32_t morton_dim = 1;
+			while (morton_dim < MAX(g_tile_scheduler->tiles_x, g_tile_scheduler->tiles_y))
+			{
+				morton_dim <<= 1;
+			}
+
+			uint32_t tile_at = 0;
+			for (uint32_t code = 0; code < morton_dim * morton_dim; ++code)
+			{
+				uint32_t tile_x = morton_compact_bits(code);
+				uint32_t tile_y = morton_compact_bits(code >> 1);
+
+				if (tile_x < g_tile_scheduler->tiles_x && tile_y < g_tile_scheduler->tiles_y)
+				{
+					g_tile_scheduler->morton_tiles[tile_at++] = tile_y * g_tile_scheduler->tiles_x + tile_x;
+				}
+			}
+			ASSERT(tile_at == g_tile_scheduler->tile_count);
+
+			// Leave one hardware thread for the main thread, which keeps recording the frame while the workers path trace
+			g_tile_scheduler->worker_count = MAX(thread::get_hardware_thread_count(), 2) - 1;
+			g_tile_scheduler->worker_threads = ARENA_ALLOC_ARRAY_ZERO(arena, thread_t, g_tile_scheduler->worker_count);
+			g_tile_scheduler->worker_deques = ARENA_ALLOC_ARRAY_ZERO(arena, tile_deque_t, g_tile_scheduler->worker_count);
+
+			for (uint32_t i = 0; i < g_tile_scheduler->worker_count; ++i)
+			{
+				g_tile_scheduler->worker_threads[i] = thread::create(worker_thread_proc, (void*)(uintptr_t)i);
+			}
+
+			LOG_INFO("CPU", "Tile scheduler: %u worker threads, %u tiles", g_tile_scheduler->worker_count, g_tile_scheduler->tile_count);
+		}
+
+		void exit()
+		{
+			cancel_pass();
+			wait_pass();
+
+			thread::mutex::lock(g_tile_scheduler->mutex);
+			g_tile_scheduler->should_exit = true;
+			thread::cond_var::wake_all(g_tile_scheduler->cond_var_pass_begin, g_tile_scheduler->mutex);
+			thread::mutex::unlock(g_tile_scheduler->mutex);
+
+			for (uint32_t i = 0; i < g_tile_scheduler->worker_count; ++i)
+			{
+				thread::join(g_tile_scheduler->worker_threads[i]);
+			}
+		}
+
+		void begin_pass(tile_proc_t tile_proc, void* user_data, uint32_t first_tile, uint32_t tile_count)
+		{
+			ASSERT_MSG(!g_tile_scheduler->pass_in_flight, "Tried to begin a new CPU tile pass while the previous one was still in flight");
+			ASSERT(first_tile < g_tile_scheduler->tile_count);
+
+			tile_count = MIN(tile_count, g_tile_scheduler->tile_count - first_tile);
+
+			// The workers are idle in between passes, so the deques can be refilled without locking them
+			// Every worker starts out with a contiguous range of the Morton curve, which keeps the tiles it traces close together
+			for (uint32_t i = 0; i < g_tile_scheduler->worker_count; ++i)
+			{
+				g_tile_scheduler->worker_deques[i].begin = first_tile + (tile_count * i) / g_tile_scheduler->worker_count;
+				g_tile_scheduler->worker_deques[i].end = first_tile + (tile_count * (i + 1)) / g_tile_scheduler->worker_count;
+			}
+
+			g_tile_scheduler->pass_cancelled.store(false);
+			g_tile_scheduler->tiles_remaining.store(tile_count);
+
+			thread::mutex::lock(g_tile_scheduler->mutex);
+			g_tile_scheduler->tile_proc = tile_proc;
+			g_tile_scheduler->user_data = user_data;
+			g_tile_scheduler->workers_busy = g_tile_scheduler->worker_count;
+			g_tile_scheduler->pass_in_flight = true;
+			g_tile_scheduler->pass_index++;
+			thread::cond_var::wake_all(g_tile_scheduler->cond_var_pass_begin, g_tile_scheduler->mutex);
+			thread::mutex::unlock(g_tile_scheduler->mutex);
+		}
+
+		void cancel_pass()
+		{
+			g_tile_scheduler->pass_cancelled.store(true);
+		}
+
+		bool wait_pass()
+		{
+			thread::mutex::lock(g_tile_scheduler->mutex);
+			if (!g_tile_scheduler->pass_in_flight)
+			{
+				thread::mutex::unlock(g_tile_scheduler->mutex);
+				return false;
+			}
+
+			while (g_tile_scheduler->workers_busy > 0)
+			{
+				thread::cond_var::sleep(g_tile_scheduler->cond_var_pass_end, g_tile_scheduler->mutex);
+			}
+			g_tile_scheduler->pass_in_flight = false;
+			thread::mutex::unlock(g_tile_scheduler->mutex);
+
+			return g_tile_scheduler->tiles_remaining.load() == 0;
+		}
+
+		uint32_t get_tile_count()
+		{
+			return g_tile_scheduler->tile_count;
+		}
+
+	}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "core/common.h"
+
+struct memory_arena_t;
+
+namespace cpu
+{
+
+	// Tiles are small enough to balance the work between threads well, while neighbouring rays still share most of their BVH nodes in cache
+	inline constexpr uint32_t TILE_SIZE = 16;
+
+	// Called once for every tile in a pass, tile_min is inclusive and tile_max is exclusive
+	using tile_proc_t = void(*)(const glm::uvec2& tile_min, const glm::uvec2& tile_max, void* user_data);
+
+	namespace tile_scheduler
+	{
+
+		void init(memory_arena_t& arena, uint32_t render_width, uint32_t render_height);
+		void exit();
+
+		// Hands out the tiles of the render target to the worker threads and returns immediately, the caller needs to keep user_data alive until wait_pass returns
+		// Every worker owns a Morton ordered range of tiles and steals from the other workers once its own range runs out
+		// A pass can be limited to tile_count tiles along the Morton curve starting at first_tile, which keeps the tiles of a partial pass close together
+		void begin_pass(tile_proc_t tile_proc, void* user_data, uint32_t first_tile = 0, uint32_t tile_count = UINT32_MAX);
+		// Stops handing out the remaining tiles of the pass in flight, tiles that are already being processed still finish
+		void cancel_pass();
+		// Blocks until all workers are done with the pass in flight, returns false if there was no pass in flight or if it was cancelled before all tiles were processed
+		bool wait_pass();
+
+		// Number of tiles that cover the render target
+		uint32_t get_tile_count();
+
+	}
+
+}
@@ -43,6 +43,7 @@ namespace d3d12
 		LOG_INFO("D3D12", "Init");
 
 		g_d3d = ARENA_BOOTSTRAP(d3d12_instance_t, 0);
+		g_d3d->arena.name = "D3D12";
 		g_d3d->vsync = init_params.vsync;
 
 		// Enable debug layer
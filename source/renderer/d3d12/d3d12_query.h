@@ -5,7 +5,8 @@
 namespace d3d12
 {
 
-    inline constexpr uint32_t TIMESTAMP_QUERIES_DEFAULT_CAPACITY = 256;
+    // The frame time budget can record the wavefront path tracer scopes for up to 16 samples per frame
+    inline constexpr uint32_t TIMESTAMP_QUERIES_DEFAULT_CAPACITY = 4096;
 
     void init_queries(uint32_t timestamp_query_capacity);
     void exit_queries();
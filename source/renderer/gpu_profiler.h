@@ -20,6 +20,7 @@ enum GPU_PROFILE_SCOPE : uint16_t
 	GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_GENERATE,
 	GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_EXTEND,
 	GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_SHADE,
+	GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CONNECT,
 	GPU_PROFILE_SCOPE_POST_PROCESS,
 	GPU_PROFILE_SCOPE_COPY_BACKBUFFER,
 	GPU_PROFILE_SCOPE_IMGUI,
@@ -61,7 +62,7 @@ static const char* gpu_profile_scope_labels[GPU_PROFILE_SCOPE::GPU_PROFILE_SCOPE
 	"Total GPU Time",
 	"TLAS Build",
 	"Pathtrace Megakernel",
-	"Wavefront Clear", "Wavefront Init Args", "Wavefront Generate", "Wavefront Extend", "Wavefront Shade",
+	"Wavefront Clear", "Wavefront Init Args", "Wavefront Generate", "Wavefront Extend", "Wavefront Shade", "Wavefront Connect",
 	"Post-Process",
 	"Copy Backbuffer", "ImGui"
 };
@@ -0,0 +1,61 @@
+#pragma once
+#include "core/common.h"
+#include "core/memory/memory_arena.h"
+
+namespace alias_table
+{
+
+	// Vose's alias method, see: https://www.keithschwarz.com/darts-dice-coins/
+	// Writes the alias_probability, alias_idx and pdf members of each entry, entry i is picked proportional to weights[i]
+	template<typename T>
+	void build(memory_arena_t& arena, const float* weights, float total_weight, uint32_t count, T* out_entries)
+	{
+		float* scaled_probabilities = ARENA_ALLOC_ARRAY_ZERO(arena, float, count);
+		uint32_t* small = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, count);
+		uint32_t* large = ARENA_ALLOC_ARRAY_ZERO(arena, uint32_t, count);
+		uint32_t small_count = 0;
+		uint32_t large_count = 0;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			out_entries[i].pdf = weights[i] / total_weight;
+			scaled_probabilities[i] = out_entries[i].pdf * count;
+
+			if (scaled_probabilities[i] < 1.0f)
+				small[small_count++] = i;
+			else
+				large[large_count++] = i;
+		}
+
+		while (small_count > 0 && large_count > 0)
+		{
+			uint32_t s = small[--small_count];
+			uint32_t l = large[--large_count];
+
+			out_entries[s].alias_probability = scaled_probabilities[s];
+			out_entries[s].alias_idx = l;
+
+			scaled_probabilities[l] = (scaled_probabilities[l] + scaled_probabilities[s]) - 1.0f;
+			if (scaled_probabilities[l] < 1.0f)
+				small[small_count++] = l;
+			else
+				large[large_count++] = l;
+		}
+
+		// Whatever is left should have a probability of 1, but might not due to floating point inaccuracies
+		while (large_count > 0)
+		{
+			uint32_t l = large[--large_count];
+			out_entries[l].alias_probability = 1.0f;
+			out_entries[l].alias_idx = l;
+		}
+
+		while (small_count > 0)
+		{
+			uint32_t s = small[--small_count];
+			out_entries[s].alias_probability = 1.0f;
+			out_entries[s].alias_idx = s;
+		}
+	}
+
+}
@@ -0,0 +1,54 @@
+#include "env_builder.h"
+#include "alias_table.h"
+#include "core/memory/memory_arena.h"
+
+static float get_luminance(const glm::vec3& color)
+{
+	return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+void env_builder_t::build(memory_arena_t& arena, const build_args_t& build_args)
+{
+	m_width = build_args.width;
+	m_height = build_args.height;
+	m_entries = nullptr;
+
+	uint32_t texel_count = m_width * m_height;
+	float* texel_weights = ARENA_ALLOC_ARRAY_ZERO(arena, float, texel_count);
+	float total_weight = 0.0f;
+
+	for (uint32_t y = 0; y < m_height; ++y)
+	{
+		// Texels near the poles of the equirectangular map cover a smaller solid angle than the ones near the equator
+		float sin_theta = glm::sin(glm::pi<float>() * (y + 0.5f) / m_height);
+
+		for (uint32_t x = 0; x < m_width; ++x)
+		{
+			uint32_t texel_idx = y * m_width + x;
+			texel_weights[texel_idx] = glm::max(get_luminance(build_args.pixels[texel_idx]), 0.0f) * sin_theta;
+			total_weight += texel_weights[texel_idx];
+		}
+	}
+
+	// Black environment, nothing to sample
+	if (total_weight <= 0.0f)
+		return;
+
+	m_entries = ARENA_ALLOC_ARRAY_ZERO(arena, env_alias_entry_t, texel_count);
+	alias_table::build(arena, texel_weights, total_weight, texel_count, m_entries);
+}
+
+void env_builder_t::extract(memory_arena_t& arena, env_distribution_t& out_distribution, uint64_t& out_distribution_byte_size) const
+{
+	out_distribution.width = m_width;
+	out_distribution.height = m_height;
+	out_distribution.entries = nullptr;
+	out_distribution_byte_size = 0;
+
+	if (!m_entries)
+		return;
+
+	out_distribution_byte_size = sizeof(env_alias_entry_t) * m_width * m_height;
+	out_distribution.entries = ARENA_ALLOC_ARRAY(arena, env_alias_entry_t, m_width * m_height);
+	memcpy(out_distribution.entries, m_entries, out_distribution_byte_size);
+}
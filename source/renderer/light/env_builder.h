@@ -0,0 +1,35 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+struct memory_arena_t;
+
+struct env_distribution_t
+{
+	uint32_t width;
+	uint32_t height;
+	// One entry per texel, null if the environment map does not emit any light
+	env_alias_entry_t* entries;
+};
+
+class env_builder_t
+{
+public:
+	struct build_args_t
+	{
+		// RGBA32 float equirectangular environment map
+		const glm::vec4* pixels;
+		uint32_t width;
+		uint32_t height;
+	};
+
+public:
+	void build(memory_arena_t& arena, const build_args_t& build_args);
+	void extract(memory_arena_t& arena, env_distribution_t& out_distribution, uint64_t& out_distribution_byte_size) const;
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	env_alias_entry_t* m_entries;
+
+};
@@ -0,0 +1,84 @@
+#include "light_builder.h"
+#include "alias_table.h"
+#include "core/memory/memory_arena.h"
+
+static float get_luminance(const glm::vec3& color)
+{
+	return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+static glm::vec3 get_material_emission(const material_t& material)
+{
+	return material.emissive_factor * material.emissive_strength;
+}
+
+void light_builder_t::build(memory_arena_t& arena, const build_args_t& build_args)
+{
+	// Every triangle of an instance with an emissive material becomes a light
+	m_light_count = 0;
+	for (uint32_t instance_idx = 0; instance_idx < build_args.instance_count; ++instance_idx)
+	{
+		instance_data_t& instance = build_args.instances[instance_idx];
+		instance.light_offset = LIGHT_IDX_INVALID;
+
+		if (get_luminance(get_material_emission(instance.material)) > 0.0f)
+		{
+			instance.light_offset = m_light_count;
+			m_light_count += build_args.instance_triangle_counts[instance_idx];
+		}
+	}
+
+	m_lights = ARENA_ALLOC_ARRAY_ZERO(arena, emissive_triangle_t, m_light_count);
+	float* light_powers = ARENA_ALLOC_ARRAY_ZERO(arena, float, m_light_count);
+	float total_power = 0.0f;
+
+	for (uint32_t instance_idx = 0; instance_idx < build_args.instance_count; ++instance_idx)
+	{
+		const instance_data_t& instance = build_args.instances[instance_idx];
+		if (instance.light_offset == LIGHT_IDX_INVALID)
+			continue;
+
+		float emission_luminance = get_luminance(get_material_emission(instance.material));
+		const triangle_t* triangles = build_args.instance_triangles[instance_idx];
+
+		for (uint32_t tri_idx = 0; tri_idx < build_args.instance_triangle_counts[instance_idx]; ++tri_idx)
+		{
+			uint32_t light_idx = instance.light_offset + tri_idx;
+			emissive_triangle_t& light = m_lights[light_idx];
+
+			// Lights are stored in world-space, so sampling them does not require the instance transform
+			light.p0 = transform_point(instance.local_to_world, triangles[tri_idx].v0.position);
+			light.p1 = transform_point(instance.local_to_world, triangles[tri_idx].v1.position);
+			light.p2 = transform_point(instance.local_to_world, triangles[tri_idx].v2.position);
+			light.instance_idx = instance_idx;
+			light.primitive_idx = tri_idx;
+			light.area = 0.5f * glm::length(glm::cross(light.p1 - light.p0, light.p2 - light.p0));
+
+			light_powers[light_idx] = light.area * emission_luminance;
+			total_power += light_powers[light_idx];
+		}
+	}
+
+	// Degenerate emissive triangles only, nothing to sample
+	if (total_power <= 0.0f)
+	{
+		for (uint32_t instance_idx = 0; instance_idx < build_args.instance_count; ++instance_idx)
+		{
+			build_args.instances[instance_idx].light_offset = LIGHT_IDX_INVALID;
+		}
+
+		m_light_count = 0;
+		return;
+	}
+
+	alias_table::build(arena, light_powers, total_power, m_light_count, m_lights);
+}
+
+void light_builder_t::extract(memory_arena_t& arena, light_list_t& out_light_list, uint64_t& out_light_list_byte_size) const
+{
+	out_light_list_byte_size = sizeof(emissive_triangle_t) * m_light_count;
+
+	out_light_list.light_count = m_light_count;
+	out_light_list.lights = ARENA_ALLOC_ARRAY(arena, emissive_triangle_t, m_light_count);
+	memcpy(out_light_list.lights, m_lights, out_light_list_byte_size);
+}
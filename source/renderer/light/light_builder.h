@@ -0,0 +1,35 @@
+#pragma once
+#include "core/common.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+struct memory_arena_t;
+
+inline constexpr uint32_t LIGHT_IDX_INVALID = UINT32_MAX;
+
+struct light_list_t
+{
+	uint32_t light_count;
+	emissive_triangle_t* lights;
+};
+
+class light_builder_t
+{
+public:
+	struct build_args_t
+	{
+		// The light offset of every instance gets written by the build
+		instance_data_t* instances;
+		const triangle_t* const* instance_triangles;
+		const uint32_t* instance_triangle_counts;
+		uint32_t instance_count;
+	};
+
+public:
+	void build(memory_arena_t& arena, const build_args_t& build_args);
+	void extract(memory_arena_t& arena, light_list_t& out_light_list, uint64_t& out_light_list_byte_size) const;
+
+private:
+	uint32_t m_light_count;
+	emissive_triangle_t* m_lights;
+
+};
@@ -9,6 +9,14 @@
 
 #include "bvh/bvh_builder.h"
 #include "bvh/as_util.h"
+#include "light/light_builder.h"
+
+#include "cpu/cpu_pathtracer.h"
+#include "cpu/cpu_render_pass.h"
+#include "cpu/cpu_tile_scheduler.h"
+#include "cpu/cpu_texture_cache.h"
+#include "cpu/cpu_scan.h"
+#include "cpu/cpu_path_guiding.h"
 
 #include "core/assertion.h"
 #include "core/memory/memory_arena.h"
@@ -17,6 +25,8 @@
 #include "core/random.h"
 #include "core/assets/asset_types.h"
 
+#include "platform/platform.h"
+
 #include "imgui/imgui.h"
 
 namespace renderer
@@ -34,20 +44,91 @@ namespace renderer
 		render_settings_t defaults = {};
 		defaults.use_wavefront_pathtracing = true;
 		defaults.use_software_rt = false;
+		defaults.use_cpu_pathtracing = false;
+		defaults.bvh_short_stack = false;
+		defaults.texture_lod_ray_cones = true;
+		defaults.path_guiding = false;
+		defaults.wavefront_compact_payloads = true;
+		defaults.wavefront_path_regeneration = false;
 		defaults.render_view_mode = RENDER_VIEW_MODE_NONE;
 		defaults.max_bounces = 3;
 		defaults.accumulate = true;
+		defaults.sample_offset = 0;
+		defaults.frame_time_budget = false;
+		defaults.frame_time_target_ms = 33.3f;
+		defaults.frame_time_budget_max_samples = 16;
+		defaults.sampler_type = SAMPLER_TYPE_SOBOL;
 		defaults.cosine_weighted_diffuse = true;
+		defaults.next_event_estimation = true;
+		defaults.russian_roulette = true;
+		defaults.russian_roulette_min_depth = 2;
+		defaults.adaptive_sampling = false;
+		defaults.adaptive_sampling_min_samples = 16;
+		defaults.adaptive_sampling_threshold = 0.01f;
+		defaults.denoise = false;
+		defaults.denoise_iterations = 5;
+		defaults.denoise_sigma_color = 4.0f;
+		defaults.denoise_sigma_albedo = 0.1f;
+		defaults.denoise_sigma_normal = 0.5f;
+		defaults.denoise_sigma_depth = 0.1f;
 
 		defaults.hdr_env_strength = 1.0f;
+		defaults.traversal_cost_heatmap_max = 256;
 
 		return defaults;
 	}
 
 	static void reset_color_accumulator()
 	{
-		// TODO: Clear accumulator UAV render target
-		g_renderer->accum_count = 1;
+		// The CPU pass in flight was started with the previous camera or settings, so its result is discarded in the next render
+		cpu::render_pass::reset_accumulation();
+
+		// The accumulator count is incremented at the start of the next render, so the first sample after a reset always has a count of one
+		// The accumulator and pixel variance render targets do not need to be cleared, since the first sample overwrites them
+		g_renderer->accum_count = 0;
+	}
+
+	// Feedback controller for the frame time budget, called once at the start of every render
+	// The time between two renders covers everything a frame waited on, including the GPU frames in flight and the CPU pass of the previous frame
+	// The work of a frame scales about linearly with its samples or tiles, so the work gets scaled by the ratio between the target and measured frame time
+	// That ratio is limited and its square root is taken, since the frames in flight make the measured frame time lag a few frames behind the work
+	static void update_frame_budget()
+	{
+		renderer_inst_t::frame_budget_t& budget = g_renderer->frame_budget;
+		const render_settings_t& settings = g_renderer->settings;
+
+		timer_ticks_t render_ticks = platform::get_ticks();
+		budget.frame_time_ms = budget.has_prev_render ? (float)(platform::get_elapsed_seconds(budget.prev_render_ticks, render_ticks) * 1000.0) : 0.0f;
+		budget.prev_render_ticks = render_ticks;
+		budget.has_prev_render = true;
+
+		// Frames that do not accumulate trace every pixel exactly once, since the post-process replaces the color of every pixel with the energy of that frame
+		float cpu_tile_count = (float)cpu::tile_scheduler::get_tile_count();
+		float max_samples = (float)glm::clamp(settings.frame_time_budget_max_samples, 1u, FRAME_BUDGET_MAX_SAMPLES);
+		if (!settings.frame_time_budget || !settings.accumulate || settings.render_view_mode != RENDER_VIEW_MODE_NONE)
+		{
+			budget.gpu_samples_per_frame = 1.0f;
+			budget.cpu_tiles_per_frame = cpu_tile_count;
+			return;
+		}
+
+		float correction = 1.0f;
+		if (budget.frame_time_ms > 0.0f)
+		{
+			correction = glm::sqrt(glm::clamp(settings.frame_time_target_ms / budget.frame_time_ms, FRAME_BUDGET_MIN_CORRECTION, FRAME_BUDGET_MAX_CORRECTION));
+		}
+
+		// Only the work of the active path tracer gets corrected, the other one starts over from a full frame when switching to it
+		if (settings.use_cpu_pathtracing)
+		{
+			budget.gpu_samples_per_frame = 1.0f;
+			budget.cpu_tiles_per_frame = glm::clamp(budget.cpu_tiles_per_frame * correction, 1.0f, cpu_tile_count);
+		}
+		else
+		{
+			budget.gpu_samples_per_frame = glm::clamp(budget.gpu_samples_per_frame * correction, 1.0f, max_samples);
+			budget.cpu_tiles_per_frame = cpu_tile_count;
+		}
 	}
 
 	static void create_mesh_triangle_buffer_internal(render_mesh_t& out_mesh)
@@ -85,7 +166,42 @@ namespace renderer
 		}
 	}
 
-	static void create_mesh_software_blas_buffer_internal(render_mesh_t& out_mesh)
+	static void create_env_alias_buffer_internal(render_texture_t& out_texture)
+	{
+		ARENA_SCRATCH_SCOPE()
+		{
+			// Upload environment alias table buffer
+			uint64_t buffer_byte_size = sizeof(env_alias_entry_t) * out_texture.width * out_texture.height;
+			uint64_t upload_byte_count = buffer_byte_size;
+			uint64_t upload_offset = 0;
+
+			// Create alias table buffer
+			out_texture.env_alias_buffer = d3d12::create_buffer(ARENA_WPRINTF(arena_scratch, L"Env Alias Table Buffer %.*ls", STRING_EXPAND(out_texture.debug_name)).buf, buffer_byte_size);
+
+			// Allocate and initialize alias table buffer descriptor
+			out_texture.env_alias_srv = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			d3d12::create_buffer_srv(out_texture.env_alias_buffer, out_texture.env_alias_srv, 0, buffer_byte_size);
+
+			// Do actual data upload
+			while (upload_byte_count > 0)
+			{
+				// CPU to upload copy
+				d3d12::upload_alloc_t& upload = d3d12::begin_upload(upload_byte_count);
+				memcpy(upload.ptr, PTR_OFFSET(out_texture.env_alias_table, upload_offset), upload.ring_buffer_alloc.byte_size);
+
+				// Copy current chunk from upload to final GPU buffer
+				upload.d3d_command_list->CopyBufferRegion(out_texture.env_alias_buffer, upload_offset, upload.d3d_resource, upload.ring_buffer_alloc.byte_offset, upload.ring_buffer_alloc.byte_size);
+
+				// Submit upload
+				d3d12::end_upload(upload);
+
+				upload_byte_count -= upload.ring_buffer_alloc.byte_size;
+				upload_offset += upload.ring_buffer_alloc.byte_size;
+			}
+		}
+	}
+
+	static void create_mesh_bvh_internal(render_mesh_t& out_mesh)
 	{
 		ARENA_SCRATCH_SCOPE()
 		{
@@ -94,24 +210,31 @@ namespace renderer
 			bvh_build_args.triangle_count = out_mesh.triangle_count;
 			bvh_build_args.options.interval_count = 8;
 			bvh_build_args.options.subdivide_single_prim = false;
+			bvh_build_args.options.emit_triangle_soa = true;
 
 			// Build the BVH with a temporary scratch memory arena, to automatically get rid of temporary allocations for the build process
 			bvh_builder_t bvh_builder = {};
 			bvh_builder.build(arena_scratch, bvh_build_args);
 
-			// Extract the final BVH data using the scratch arena as well since we will upload the data to the GPU inside this arena scratch scope
-			// If we wanted to keep the BVH data around on the CPU (maybe do CPU path tracing) we could do so here by using a different arena
-			bvh_t mesh_bvh;
-			uint64_t mesh_bvh_byte_size;
-			bvh_builder.extract(arena_scratch, mesh_bvh, mesh_bvh_byte_size);
+			// Extract the final BVH data into the mesh arena, since we keep the BVH around on the CPU for the CPU path tracer
+			// and for (re)creating the software BLAS buffers when switching raytracing modes
+			bvh_builder.extract(g_renderer->mesh_arena, out_mesh.bvh, out_mesh.bvh_byte_size);
 
 			// Keep the BVH local bounds around for creating BVH instances later when building the TLAS
-			bvh_node_t* bvh_root_node = (bvh_node_t*)mesh_bvh.data;
+			bvh_node_t* bvh_root_node = (bvh_node_t*)out_mesh.bvh.data;
 			out_mesh.blas_min = bvh_root_node->aabb_min;
 			out_mesh.blas_max = bvh_root_node->aabb_max;
+		}
+	}
+
+	static void create_mesh_software_blas_buffer_internal(render_mesh_t& out_mesh)
+	{
+		ARENA_SCRATCH_SCOPE()
+		{
+			const bvh_t& mesh_bvh = out_mesh.bvh;
 
 			// Upload mesh BVH buffer
-			uint64_t buffer_byte_size = sizeof(bvh_header_t) + mesh_bvh_byte_size;
+			uint64_t buffer_byte_size = sizeof(bvh_header_t) + out_mesh.bvh_byte_size;
 			uint64_t upload_byte_count = buffer_byte_size;
 			uint64_t upload_offset = 0;
 			bool upload_header = true;
@@ -224,6 +347,10 @@ namespace renderer
 		LOG_INFO("Renderer", "Init");
 
 		g_renderer = ARENA_BOOTSTRAP(renderer_inst_t, 0);
+		g_renderer->arena.name = "Renderer";
+		g_renderer->mesh_arena.name = "Mesh";
+		g_renderer->mesh_arena.commit_granularity = MB(2ull);
+		g_renderer->mesh_arena.huge_pages = true;
 
 		g_renderer->render_width = init_params.render_width;
 		g_renderer->render_height = init_params.render_height;
@@ -239,6 +366,9 @@ namespace renderer
 		backend_params.vsync = init_params.vsync;
 		d3d12::init(backend_params);
 
+		// Needs to exist before any render texture is created, since every texture adds its tiles to the texture cache
+		cpu::render_pass::init(g_renderer->arena, g_renderer->render_width, g_renderer->render_height);
+
 		// Create defaults
 		{
 			uint32_t texture_data = (255 << 24) | (255 << 16) | (255 << 8) | (255 << 0);
@@ -290,10 +420,21 @@ namespace renderer
 		}
 
 		g_renderer->frame_ctx = ARENA_ALLOC_ARRAY_ZERO(g_renderer->arena, frame_context_t, backend_params.back_buffer_count);
+		for (uint32_t i = 0; i < backend_params.back_buffer_count; ++i)
+		{
+			g_renderer->frame_ctx[i].arena.name = "Frame";
+			g_renderer->frame_ctx[i].arena.decommit_threshold = UINT64_MAX;
+		}
 		gpu_profiler_init();
 
 		// Default render settings
 		g_renderer->settings = get_default_render_settings();
+		if (init_params.batch)
+		{
+			g_renderer->settings.use_cpu_pathtracing = true;
+			g_renderer->settings.accumulate = true;
+			g_renderer->settings.denoise = init_params.denoise;
+		}
 
 		// Descriptor ranges and root parameters for root signature
 		D3D12_DESCRIPTOR_RANGE1 descriptor_ranges[2] = {};
@@ -413,6 +554,19 @@ namespace renderer
 			IDxcBlob* shader_binary_wavefront_shade = d3d12::compile_shader(L"shaders/wavefront/shade.hlsl",
 				L"main", L"cs_6_7", ARRAY_SIZE(defines), defines);
 			g_renderer->wavefront.pso_shade = d3d12::create_pso_cs(shader_binary_wavefront_shade, g_renderer->root_signature);
+			
+			IDxcBlob* shader_binary_wavefront_connect = d3d12::compile_shader(L"shaders/wavefront/connect.hlsl",
+				L"main", L"cs_6_7", ARRAY_SIZE(defines), defines);
+			g_renderer->wavefront.pso_connect = d3d12::create_pso_cs(shader_binary_wavefront_connect, g_renderer->root_signature);
+
+			DxcDefine defines_software[] = { DxcDefine{ .Name = L"RAYTRACING_MODE_SOFTWARE", .Value = L"1" } };
+			IDxcBlob* shader_binary_wavefront_extend_software = d3d12::compile_shader(L"shaders/wavefront/extend.hlsl",
+				L"main", L"cs_6_7", ARRAY_SIZE(defines_software), defines_software);
+			g_renderer->wavefront.pso_extend_software = d3d12::create_pso_cs(shader_binary_wavefront_extend_software, g_renderer->root_signature);
+
+			IDxcBlob* shader_binary_wavefront_connect_software = d3d12::compile_shader(L"shaders/wavefront/connect.hlsl",
+				L"main", L"cs_6_7", ARRAY_SIZE(defines_software), defines_software);
+			g_renderer->wavefront.pso_connect_software = d3d12::create_pso_cs(shader_binary_wavefront_connect_software, g_renderer->root_signature);
 		}
 
 		// Initialize wavefront pathtracing resources
@@ -430,25 +584,37 @@ namespace renderer
 			d3d12::g_d3d->device->CreateCommandSignature(&command_signature_desc, nullptr, IID_PPV_ARGS(&g_renderer->wavefront.command_signature));
 
 			uint64_t element_count = g_renderer->render_width * g_renderer->render_height;
-			// The maximum recursion count (limited by UI) is currently 8, so we allow 8 bounces for a total of 9 indirect dispatch arg sets 
-			uint64_t buffer_size = 9 * sizeof(D3D12_DISPATCH_ARGUMENTS);
+			// One indirect dispatch arg set per recursion depth for extension rays, followed by one per recursion depth for shadow rays
+			uint64_t buffer_size = WAVEFRONT_RAY_COUNT_TOTAL * sizeof(D3D12_DISPATCH_ARGUMENTS);
 			g_renderer->wavefront.buffer_indirect_args = d3d12::create_buffer(L"Wavefront Indirect Arguments", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 			g_renderer->wavefront.buffer_indirect_args_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
 			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_indirect_args, g_renderer->wavefront.buffer_indirect_args_srv_uav, 0, buffer_size);
 			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_indirect_args, g_renderer->wavefront.buffer_indirect_args_srv_uav, 1, buffer_size);
 
-			buffer_size = 9 * sizeof(uint32_t);
+			buffer_size = WAVEFRONT_RAY_COUNT_TOTAL * sizeof(uint32_t);
 			g_renderer->wavefront.buffer_ray_counts = d3d12::create_buffer(L"Wavefront Ray Counts", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 			g_renderer->wavefront.buffer_ray_counts_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
 			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_ray_counts, g_renderer->wavefront.buffer_ray_counts_srv_uav, 0, buffer_size);
 			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_ray_counts, g_renderer->wavefront.buffer_ray_counts_srv_uav, 1, buffer_size);
 			
+			// The queue buffers are sized for the full precision layouts, so the compact layouts can be toggled at runtime
 			buffer_size = element_count * sizeof(RayDesc2);
 			g_renderer->wavefront.buffer_rays = d3d12::create_buffer(L"Wavefront Ray Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 			g_renderer->wavefront.buffer_rays_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
 			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_rays, g_renderer->wavefront.buffer_rays_srv_uav, 0, buffer_size);
 			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_rays, g_renderer->wavefront.buffer_rays_srv_uav, 1, buffer_size);
 
+			g_renderer->wavefront.buffer_rays_two = d3d12::create_buffer(L"Wavefront Ray Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			g_renderer->wavefront.buffer_rays_two_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_rays_two, g_renderer->wavefront.buffer_rays_two_srv_uav, 0, buffer_size);
+			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_rays_two, g_renderer->wavefront.buffer_rays_two_srv_uav, 1, buffer_size);
+
+			buffer_size = element_count * sizeof(shadow_ray_t);
+			g_renderer->wavefront.buffer_shadow_rays = d3d12::create_buffer(L"Wavefront Shadow Ray Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			g_renderer->wavefront.buffer_shadow_rays_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_shadow_rays, g_renderer->wavefront.buffer_shadow_rays_srv_uav, 0, buffer_size);
+			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_shadow_rays, g_renderer->wavefront.buffer_shadow_rays_srv_uav, 1, buffer_size);
+
 			buffer_size = element_count * 8;
 			g_renderer->wavefront.buffer_pixel_coords = d3d12::create_buffer(L"Wavefront Pixelpos Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 			g_renderer->wavefront.buffer_pixel_coords_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
@@ -467,6 +633,29 @@ namespace renderer
 			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_hit_results, g_renderer->wavefront.buffer_hit_results_srv_uav, 0, buffer_size);
 			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_hit_results, g_renderer->wavefront.buffer_hit_results_srv_uav, 1, buffer_size);
 
+			buffer_size = element_count * sizeof(wavefront_path_state_t);
+			g_renderer->wavefront.buffer_path_states = d3d12::create_buffer(L"Wavefront Path State Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			g_renderer->wavefront.buffer_path_states_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_path_states, g_renderer->wavefront.buffer_path_states_srv_uav, 0, buffer_size);
+			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_path_states, g_renderer->wavefront.buffer_path_states_srv_uav, 1, buffer_size);
+
+			buffer_size = TRAVERSAL_STATS_COUNTER_COUNT * sizeof(uint64_t);
+			g_renderer->wavefront.buffer_traversal_stats = d3d12::create_buffer(L"Traversal Stats Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			g_renderer->wavefront.buffer_traversal_stats_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_traversal_stats, g_renderer->wavefront.buffer_traversal_stats_srv_uav, 0, buffer_size);
+			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_traversal_stats, g_renderer->wavefront.buffer_traversal_stats_srv_uav, 1, buffer_size);
+
+			for (uint32_t i = 0; i < backend_params.back_buffer_count; ++i)
+			{
+				g_renderer->frame_ctx[i].traversal_stats_readback_resource = d3d12::create_buffer_readback(L"Traversal Stats Readback Buffer", buffer_size);
+			}
+
+			buffer_size = element_count * sizeof(uint32_t);
+			g_renderer->wavefront.buffer_traversal_costs = d3d12::create_buffer(L"Wavefront Traversal Cost Buffer", buffer_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			g_renderer->wavefront.buffer_traversal_costs_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_buffer_srv(g_renderer->wavefront.buffer_traversal_costs, g_renderer->wavefront.buffer_traversal_costs_srv_uav, 0, buffer_size);
+			d3d12::create_buffer_uav(g_renderer->wavefront.buffer_traversal_costs, g_renderer->wavefront.buffer_traversal_costs_srv_uav, 1, buffer_size);
+
 			g_renderer->wavefront.texture_energy = d3d12::create_texture_2d(L"Wavefront Energy Texture", DXGI_FORMAT_R16G16B16A16_FLOAT,
 				g_renderer->render_width, g_renderer->render_height, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 			g_renderer->wavefront.texture_energy_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
@@ -489,16 +678,48 @@ namespace renderer
 			d3d12::create_texture_2d_srv(g_renderer->rt_color_accum, g_renderer->rt_color_accum_srv_uav, 0);
 			d3d12::create_texture_2d_uav(g_renderer->rt_color_accum, g_renderer->rt_color_accum_srv_uav, 1);
 
+			g_renderer->rt_pixel_variance = d3d12::create_texture_2d(L"Pixel Variance RT", DXGI_FORMAT_R32G32B32A32_FLOAT,
+				g_renderer->render_width, g_renderer->render_height, 1,
+				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, nullptr);
+			g_renderer->rt_pixel_variance_srv_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+			d3d12::create_texture_2d_srv(g_renderer->rt_pixel_variance, g_renderer->rt_pixel_variance_srv_uav, 0);
+			d3d12::create_texture_2d_uav(g_renderer->rt_pixel_variance, g_renderer->rt_pixel_variance_srv_uav, 1);
+
 			g_renderer->rt_final_color = d3d12::create_texture_2d(L"Final Color RT", DXGI_FORMAT_R8G8B8A8_UNORM,
 				g_renderer->render_width, g_renderer->render_height, 1,
 				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, nullptr);
 			g_renderer->rt_final_color_uav = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 1);
 			d3d12::create_texture_2d_uav(g_renderer->rt_final_color, g_renderer->rt_final_color_uav, 0);
 		}
+
+		// Create CPU path tracer resources
+		{
+			cpu::scan::init(g_renderer->arena);
+			g_renderer->cpu.texture_energy = d3d12::create_texture_2d(L"CPU Energy Texture", DXGI_FORMAT_R32G32B32A32_FLOAT,
+				g_renderer->render_width, g_renderer->render_height, 1);
+			g_renderer->cpu.texture_energy_srv = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 1);
+			d3d12::create_texture_2d_srv(g_renderer->cpu.texture_energy, g_renderer->cpu.texture_energy_srv, 0);
+
+			// The energy texture is too large for the frame resource allocator, so each frame context gets its own upload buffer
+			D3D12_RESOURCE_DESC texture_desc = g_renderer->cpu.texture_energy->GetDesc();
+			uint64_t upload_byte_size = 0;
+			d3d12::g_d3d->device->GetCopyableFootprints(&texture_desc, 0, 1, 0, nullptr, nullptr, nullptr, &upload_byte_size);
+
+			for (uint32_t i = 0; i < backend_params.back_buffer_count; ++i)
+			{
+				frame_context_t& frame_ctx = g_renderer->frame_ctx[i];
+				frame_ctx.cpu_energy_upload_resource = d3d12::create_buffer_upload(L"CPU Energy Upload Buffer", upload_byte_size);
+				frame_ctx.cpu_energy_upload_ptr = d3d12::map_resource(frame_ctx.cpu_energy_upload_resource);
+			}
+		}
 	}
 
 	void exit()
 	{
+		// Stop the CPU path tracer worker threads before anything they read from gets released
+		cpu::render_pass::exit();
+		cpu::scan::exit();
+
 		// Wait for all potential in-flight frames to finish operations on the GPU
 		d3d12::flush();
 
@@ -506,11 +727,16 @@ namespace renderer
 		
 		for (uint32_t i = 0; i < d3d12::g_d3d->swapchain.back_buffer_count; ++i)
 		{
+			d3d12::unmap_resource(g_renderer->frame_ctx[i].cpu_energy_upload_resource);
+			DX_RELEASE_OBJECT(g_renderer->frame_ctx[i].cpu_energy_upload_resource);
+			DX_RELEASE_OBJECT(g_renderer->frame_ctx[i].scene_lights_resource);
+			DX_RELEASE_OBJECT(g_renderer->frame_ctx[i].traversal_stats_readback_resource);
 			ARENA_RELEASE(g_renderer->frame_ctx[i].arena);
 		}
 		
 		slotmap::destroy(g_renderer->texture_slotmap);
 		slotmap::destroy(g_renderer->mesh_slotmap);
+		ARENA_RELEASE(g_renderer->mesh_arena);
 		
 		DX_RELEASE_OBJECT(g_renderer->wavefront.command_signature);
 		
@@ -519,17 +745,27 @@ namespace renderer
 		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_generate);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_extend);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_shade);
-		//DX_RELEASE_OBJECT(g_renderer->wavefront.pso_connect);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_connect);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_extend_software);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.pso_connect_software);
 		
 		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_indirect_args);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_ray_counts);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_rays);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_rays_two);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_shadow_rays);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.texture_energy);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.texture_throughput);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_pixel_coords);
 		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_hit_results);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_path_states);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_traversal_stats);
+		DX_RELEASE_OBJECT(g_renderer->wavefront.buffer_traversal_costs);
+
+		DX_RELEASE_OBJECT(g_renderer->cpu.texture_energy);
 
 		DX_RELEASE_OBJECT(g_renderer->rt_color_accum);
+		DX_RELEASE_OBJECT(g_renderer->rt_pixel_variance);
 		DX_RELEASE_OBJECT(g_renderer->rt_final_color);
 
 		DX_RELEASE_OBJECT(g_renderer->root_signature);
@@ -546,10 +782,20 @@ namespace renderer
 
 		gpu_profiler_begin_frame();
 		
-		// Clear arena for the current frame
+		// Clear arena for the current frame, the memory stays committed and only decays when the frames need less of it
 		frame_context_t& frame_ctx = get_frame_context();
+		memory_arena::decay(frame_ctx.arena, FRAME_ARENA_DECAY_FRACTION);
 		ARENA_CLEAR(frame_ctx.arena);
+		memory_arena::decay(memory_arena::get_scratch(), FRAME_ARENA_DECAY_FRACTION);
 		frame_ctx.gpu_timer_queries_at = 0;
+
+		// The GPU is done with the frame that last used this frame context, so the traversal counters it copied can be read
+		if (frame_ctx.traversal_stats_pending)
+		{
+			memcpy(&g_renderer->gpu_traversal_stats, d3d12::map_resource(frame_ctx.traversal_stats_readback_resource), sizeof(cpu::traversal_totals_t));
+			d3d12::unmap_resource(frame_ctx.traversal_stats_readback_resource);
+			frame_ctx.traversal_stats_pending = false;
+		}
 		frame_ctx.gpu_timer_queries = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, gpu_timer_query_t, d3d12::TIMESTAMP_QUERIES_DEFAULT_CAPACITY);
 
 		d3d12::frame_context_t& d3d_frame_ctx = d3d12::get_frame_context();
@@ -560,11 +806,20 @@ namespace renderer
 			change_raytracing_mode();
 		}
 		
-		if (g_renderer->settings.use_software_rt)
+		if (g_renderer->settings.use_software_rt || g_renderer->settings.use_cpu_pathtracing)
 		{
 			g_renderer->tlas_instance_data_software = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, bvh_instance_t, g_renderer->instance_data_capacity);
 		}
 
+		g_renderer->instance_triangles = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, const triangle_t*, g_renderer->instance_data_capacity);
+		g_renderer->instance_triangle_counts = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, uint32_t, g_renderer->instance_data_capacity);
+
+		if (g_renderer->settings.use_cpu_pathtracing)
+		{
+			g_renderer->cpu.instance_bvhs = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, const bvh_t*, g_renderer->instance_data_capacity);
+			g_renderer->cpu.instance_textures = ARENA_ALLOC_ARRAY_ZERO(frame_ctx.arena, cpu::material_textures_t, g_renderer->instance_data_capacity);
+		}
+
 		g_renderer->cb_render_settings = d3d12::allocate_frame_resource(sizeof(render_settings_t), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 		render_settings_t* ptr_settings = (render_settings_t*)g_renderer->cb_render_settings.ptr;
 		*ptr_settings = g_renderer->settings;
@@ -589,11 +844,6 @@ namespace renderer
 
 		gpu_profiler_end_frame();
 		g_renderer->frame_index++;
-
-		if (g_renderer->settings.accumulate)
-		{
-			g_renderer->accum_count++;
-		}
 	}
 
 	void begin_scene(const camera_t& scene_camera, render_texture_handle_t env_render_texture_handle)
@@ -616,17 +866,20 @@ namespace renderer
 		glm::mat4 proj_mat = glm::perspectiveFovLH_ZO(glm::radians(g_renderer->scene_camera.vfov_deg),
 			(float)g_renderer->render_width, (float)g_renderer->render_height, near_plane, far_plane);
 		
+		// Keep a CPU copy of the view around for the CPU path tracer
+		view_t& view = g_renderer->scene_view;
+		view.world_to_view = g_renderer->scene_camera.view_matrix;
+		view.view_to_world = glm::inverse(g_renderer->scene_camera.view_matrix);
+		view.view_to_clip = proj_mat;
+		view.clip_to_view = glm::inverse(proj_mat);
+		view.render_dim.x = (float)g_renderer->render_width;
+		view.render_dim.y = (float)g_renderer->render_height;
+		view.near_plane = near_plane;
+		view.far_plane = far_plane;
+
 		g_renderer->cb_view = d3d12::allocate_frame_resource(sizeof(view_t), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 		view_t* view_cb = (view_t*)g_renderer->cb_view.ptr;
-
-		view_cb->world_to_view = g_renderer->scene_camera.view_matrix;
-		view_cb->view_to_world = glm::inverse(g_renderer->scene_camera.view_matrix);
-		view_cb->view_to_clip = proj_mat;
-		view_cb->clip_to_view = glm::inverse(proj_mat);
-		view_cb->render_dim.x = (float)g_renderer->render_width;
-		view_cb->render_dim.y = (float)g_renderer->render_height;
-		view_cb->near_plane = near_plane;
-		view_cb->far_plane = far_plane;
+		*view_cb = view;
 	}
 
 	void render()
@@ -634,7 +887,15 @@ namespace renderer
 		d3d12::frame_context_t& d3d_frame_ctx = d3d12::get_frame_context();
 		frame_context_t& frame_ctx = get_frame_context();
 
-		if (g_renderer->settings.use_software_rt)
+		update_frame_budget();
+
+		// Increment before rendering, so that any accumulator reset from the previous frame's UI or from begin_scene is picked up this frame
+		if (g_renderer->settings.accumulate || g_renderer->accum_count == 0)
+		{
+			g_renderer->accum_count++;
+		}
+
+		if (g_renderer->settings.use_software_rt || g_renderer->settings.use_cpu_pathtracing)
 		{
 			ARENA_SCRATCH_SCOPE()
 			{
@@ -642,30 +903,35 @@ namespace renderer
 				tlas_builder_t tlas_builder = {};
 				tlas_builder.build(arena_scratch, g_renderer->tlas_instance_data_software, g_renderer->instance_data_at);
 				uint64_t tlas_byte_size = 0;
-				tlas_builder.extract(arena_scratch, g_renderer->scene_tlas, tlas_byte_size);
+				// Extract into the frame arena, since the CPU path tracer reads from the TLAS later this frame
+				tlas_builder.extract(frame_ctx.arena, g_renderer->scene_tlas, tlas_byte_size);
 
-				// Upload TLAS to the GPU
-				// Copy TLAS data from CPU to upload buffer allocation
-				d3d12::frame_resource_t upload = d3d12::allocate_frame_resource(sizeof(tlas_header_t) + tlas_byte_size);
+				// The CPU path tracer does not need the TLAS on the GPU
+				if (!g_renderer->settings.use_cpu_pathtracing)
+				{
+					// Upload TLAS to the GPU
+					// Copy TLAS data from CPU to upload buffer allocation
+					d3d12::frame_resource_t upload = d3d12::allocate_frame_resource(sizeof(tlas_header_t) + tlas_byte_size);
 
-				memcpy(upload.ptr, &g_renderer->scene_tlas.header, sizeof(tlas_header_t));
-				memcpy(PTR_OFFSET(upload.ptr, sizeof(tlas_header_t)), g_renderer->scene_tlas.data, tlas_byte_size);
+					memcpy(upload.ptr, &g_renderer->scene_tlas.header, sizeof(tlas_header_t));
+					memcpy(PTR_OFFSET(upload.ptr, sizeof(tlas_header_t)), g_renderer->scene_tlas.data, tlas_byte_size);
 
-				// Create TLAS buffer
-				DX_RELEASE_OBJECT(frame_ctx.scene_tlas_resource);
-				frame_ctx.scene_tlas_resource = d3d12::create_buffer(L"Scene TLAS Buffer (SW)", sizeof(bvh_header_t) + tlas_byte_size);
+					// Create TLAS buffer
+					DX_RELEASE_OBJECT(frame_ctx.scene_tlas_resource);
+					frame_ctx.scene_tlas_resource = d3d12::create_buffer(L"Scene TLAS Buffer (SW)", sizeof(bvh_header_t) + tlas_byte_size);
 
-				// Allocate SRV for the scene TLAS, if there is none yet
-				if (!d3d12::is_valid_descriptor(frame_ctx.scene_tlas_srv))
-				{
-					frame_ctx.scene_tlas_srv = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-				}
-				// Update the scene TLAS descriptor
-				d3d12::create_buffer_srv(frame_ctx.scene_tlas_resource, frame_ctx.scene_tlas_srv, 0, sizeof(bvh_header_t) + tlas_byte_size);
+					// Allocate SRV for the scene TLAS, if there is none yet
+					if (!d3d12::is_valid_descriptor(frame_ctx.scene_tlas_srv))
+					{
+						frame_ctx.scene_tlas_srv = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+					}
+					// Update the scene TLAS descriptor
+					d3d12::create_buffer_srv(frame_ctx.scene_tlas_resource, frame_ctx.scene_tlas_srv, 0, sizeof(bvh_header_t) + tlas_byte_size);
 
-				// Copy TLAS data from upload buffer to final buffer
-				d3d_frame_ctx.command_list->CopyBufferRegion(frame_ctx.scene_tlas_resource, 0,
-					upload.resource, upload.byte_offset, sizeof(tlas_header_t) + tlas_byte_size);
+					// Copy TLAS data from upload buffer to final buffer
+					d3d_frame_ctx.command_list->CopyBufferRegion(frame_ctx.scene_tlas_resource, 0,
+						upload.resource, upload.byte_offset, sizeof(tlas_header_t) + tlas_byte_size);
+				}
 			}
 		}
 		else
@@ -689,6 +955,46 @@ namespace renderer
 			gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_TLAS_BUILD);
 		}
 
+		// Build the scene lights, which writes the light offsets to the instance data, so this needs to happen before the instance data upload
+		ARENA_SCRATCH_SCOPE()
+		{
+			light_builder_t::build_args_t light_build_args = {};
+			light_build_args.instances = g_renderer->instance_data;
+			light_build_args.instance_triangles = g_renderer->instance_triangles;
+			light_build_args.instance_triangle_counts = g_renderer->instance_triangle_counts;
+			light_build_args.instance_count = g_renderer->instance_data_at;
+
+			light_builder_t light_builder = {};
+			light_builder.build(arena_scratch, light_build_args);
+			uint64_t lights_byte_size = 0;
+			// Extract into the frame arena, since the CPU path tracer reads from the lights later this frame
+			light_builder.extract(frame_ctx.arena, g_renderer->scene_lights, lights_byte_size);
+
+			// The CPU path tracer does not need the lights on the GPU
+			if (!g_renderer->settings.use_cpu_pathtracing && g_renderer->scene_lights.light_count > 0)
+			{
+				// Copy light data from CPU to upload buffer allocation
+				d3d12::frame_resource_t upload = d3d12::allocate_frame_resource(lights_byte_size);
+				memcpy(upload.ptr, g_renderer->scene_lights.lights, lights_byte_size);
+
+				// Create lights buffer
+				DX_RELEASE_OBJECT(frame_ctx.scene_lights_resource);
+				frame_ctx.scene_lights_resource = d3d12::create_buffer(L"Scene Lights Buffer", lights_byte_size);
+
+				// Allocate SRV for the scene lights, if there is none yet
+				if (!d3d12::is_valid_descriptor(frame_ctx.scene_lights_srv))
+				{
+					frame_ctx.scene_lights_srv = d3d12::allocate_descriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+				}
+				// Update the scene lights descriptor
+				d3d12::create_buffer_srv(frame_ctx.scene_lights_resource, frame_ctx.scene_lights_srv, 0, lights_byte_size);
+
+				// Copy light data from upload buffer to final buffer
+				d3d_frame_ctx.command_list->CopyBufferRegion(frame_ctx.scene_lights_resource, 0,
+					upload.resource, upload.byte_offset, lights_byte_size);
+			}
+		}
+
 		if (g_renderer->instance_data_at > 0)
 		{
 			// Upload instance buffer data
@@ -736,315 +1042,605 @@ namespace renderer
 		uint32_t dispatch_blocks_x = MAX((g_renderer->render_width + dispatch_threads_per_block_x - 1) / dispatch_threads_per_block_x, 1);
 		uint32_t dispatch_blocks_y = MAX((g_renderer->render_height + dispatch_threads_per_block_y - 1) / dispatch_threads_per_block_y, 1);
 
-		uint32_t frame_seed = random::rand_uint32();
+		// The CPU pass started last frame is displayed this frame, it was traced with the same camera and settings unless the accumulator got reset,
+		// in which case it was cancelled and nothing gets accumulated this frame
+		bool cpu_pass_completed = cpu::render_pass::wait();
+
+		// The frame time budget takes more than one sample per frame with the GPU path tracers, every sample gets traced and accumulated separately
+		// The CPU path tracer always runs one pass per frame, the frame time budget limits the tiles of that pass instead
+		uint32_t frame_sample_count = g_renderer->settings.use_cpu_pathtracing ? 1 : (uint32_t)g_renderer->frame_budget.gpu_samples_per_frame;
 
-		// Dispatch wavefront pathtracing compute shaders
-		if (g_renderer->settings.use_wavefront_pathtracing)
+		for (uint32_t frame_sample = 0; frame_sample < frame_sample_count; ++frame_sample)
 		{
+			// The first sample of the frame was already counted at the start of render
+			if (frame_sample > 0)
 			{
-				D3D12_RESOURCE_BARRIER barriers[] =
+				g_renderer->accum_count++;
+			}
+
+			uint32_t frame_seed = rng::rand_uint32();
+
+			// Copy the result of the previous CPU pass to the CPU energy texture, and start the next CPU pass on the worker threads
+			if (g_renderer->settings.use_cpu_pathtracing)
+			{
+				if (!cpu_pass_completed)
 				{
-					d3d12::barrier_transition(g_renderer->wavefront.buffer_indirect_args, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
-				};
-				d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+					cpu::render_pass::clear_energy();
+				}
+
+				// Copy the energy to the upload buffer row by row, since the upload footprint rows are aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+				D3D12_RESOURCE_DESC dst_desc = g_renderer->cpu.texture_energy->GetDesc();
+				const glm::vec4* cpu_energy = cpu::render_pass::get_energy();
+				D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+				uint32_t row_count;
+				uint64_t row_size;
+				d3d12::g_d3d->device->GetCopyableFootprints(&dst_desc, 0, 1, 0, &footprint, &row_count, &row_size, nullptr);
+
+				for (uint32_t y = 0; y < row_count; ++y)
+				{
+					memcpy(PTR_OFFSET(frame_ctx.cpu_energy_upload_ptr, y * footprint.Footprint.RowPitch),
+						&cpu_energy[y * g_renderer->render_width], row_size);
+				}
+
+				D3D12_TEXTURE_COPY_LOCATION dst_loc = {};
+				dst_loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+				dst_loc.pResource = g_renderer->cpu.texture_energy;
+				dst_loc.SubresourceIndex = 0;
+
+				D3D12_TEXTURE_COPY_LOCATION src_loc = {};
+				src_loc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+				src_loc.pResource = frame_ctx.cpu_energy_upload_resource;
+				src_loc.PlacedFootprint = footprint;
+
+				{
+					D3D12_RESOURCE_BARRIER barriers[] =
+					{
+						d3d12::barrier_transition(g_renderer->cpu.texture_energy, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST)
+					};
+					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+				}
+
+				d3d_frame_ctx.command_list->CopyTextureRegion(&dst_loc, 0, 0, 0, &src_loc, nullptr);
+
+				{
+					D3D12_RESOURCE_BARRIER barriers[] =
+					{
+						d3d12::barrier_transition(g_renderer->cpu.texture_energy, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE)
+					};
+					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+				}
+
+				// Snapshot everything the next CPU pass reads, since the instance data and TLAS get rebuilt next frame while the pass is still in flight
+				cpu::render_pass::pass_params_t cpu_pass = {};
+				cpu_pass.tlas = g_renderer->scene_tlas;
+				cpu_pass.settings = g_renderer->settings;
+				cpu_pass.view = g_renderer->scene_view;
+				cpu_pass.frame_seed = frame_seed;
+				cpu_pass.sample_count = g_renderer->accum_count;
+
+				// Partial passes continue along the Morton curve where the previous pass stopped, full passes always start at the first tile
+				uint32_t tile_count = cpu::tile_scheduler::get_tile_count();
+				uint32_t pass_tile_count = (uint32_t)g_renderer->frame_budget.cpu_tiles_per_frame;
+				if (pass_tile_count >= tile_count)
+				{
+					g_renderer->cpu.tile_cursor = 0;
+				}
+
+				cpu_pass.first_tile = g_renderer->cpu.tile_cursor;
+				cpu_pass.tile_count = MIN(pass_tile_count, tile_count - cpu_pass.first_tile);
+				g_renderer->cpu.tile_cursor = (cpu_pass.first_tile + cpu_pass.tile_count) % tile_count;
+
+				// The frame arena outlives the pass, since it is only cleared a swapchain cycle later
+				instance_data_t* cpu_instances = ARENA_ALLOC_ARRAY(frame_ctx.arena, instance_data_t, g_renderer->instance_data_at);
+				memcpy(cpu_instances, g_renderer->instance_data, sizeof(instance_data_t) * g_renderer->instance_data_at);
+
+				cpu_pass.scene.instance_count = g_renderer->instance_data_at;
+				cpu_pass.scene.instances = cpu_instances;
+				cpu_pass.scene.instance_bvhs = g_renderer->cpu.instance_bvhs;
+				cpu_pass.scene.instance_textures = g_renderer->cpu.instance_textures;
+				cpu_pass.scene.instance_triangles = g_renderer->instance_triangles;
+				cpu_pass.scene.light_count = g_renderer->scene_lights.light_count;
+				cpu_pass.scene.lights = g_renderer->scene_lights.lights;
+
+				if (g_renderer->scene_hdr_env_texture->cpu_data)
+				{
+					cpu_pass.scene.hdr_env_pixels = (const glm::vec4*)g_renderer->scene_hdr_env_texture->cpu_data;
+					cpu_pass.scene.hdr_env_width = g_renderer->scene_hdr_env_texture->width;
+					cpu_pass.scene.hdr_env_height = g_renderer->scene_hdr_env_texture->height;
+					cpu_pass.scene.hdr_env_alias_table = g_renderer->scene_hdr_env_texture->env_alias_table;
+				}
+
+				// The energy of the previous pass was already copied, so the pass can clear the energy outside of a partial pass
+				cpu::render_pass::begin(cpu_pass);
 			}
-			
-			for (uint32_t recursion_depth = 0; recursion_depth <= g_renderer->settings.max_bounces; ++recursion_depth)
+			// Dispatch wavefront pathtracing compute shaders
+			else if (g_renderer->settings.use_wavefront_pathtracing)
 			{
-				if (recursion_depth == 0)
+				// The indirect arguments stay in the indirect argument state for the other samples of the frame
+				if (frame_sample == 0)
 				{
-					// Clear wavefront buffers
-					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
-					
-					struct shader_input_t
+					D3D12_RESOURCE_BARRIER barriers[] =
 					{
-						uint32_t buffer_ray_counts_index;
-						uint32_t texture_energy_index;
-						uint32_t texture_throughput_index;
-						uint32_t buffer_pixel_coords_index;
-						uint32_t buffer_pixel_coords_two_index;
+						d3d12::barrier_transition(g_renderer->wavefront.buffer_indirect_args, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
 					};
-					d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-					shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-					shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
-					shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
-					shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
-					shader_input->buffer_pixel_coords_index = g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
-					shader_input->buffer_pixel_coords_two_index = g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1;
+					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+				}
+			
+				// Every iteration traces one bounce of all paths in flight, with path regeneration paths that finish get replaced by new camera samples
+				// Regenerated paths still need max_bounces more iterations after the one that started them, so paths are only regenerated in the first half of the iterations
+				bool path_regeneration = g_renderer->settings.wavefront_path_regeneration && g_renderer->settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+				uint32_t iteration_count = (path_regeneration ? 2 : 1) * (g_renderer->settings.max_bounces + 1);
 
-					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_clear_buffers);
-					d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-					d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
+				for (uint32_t recursion_depth = 0; recursion_depth < iteration_count; ++recursion_depth)
+				{
+					if (recursion_depth == 0)
+					{
+						// Clear wavefront buffers
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
+					
+						struct shader_input_t
+						{
+							uint32_t buffer_ray_counts_index;
+							uint32_t texture_energy_index;
+							uint32_t texture_throughput_index;
+							uint32_t buffer_pixel_coords_index;
+							uint32_t buffer_pixel_coords_two_index;
+							uint32_t buffer_traversal_stats_index;
+							uint32_t clear_traversal_stats;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
+						shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
+						shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
+						shader_input->buffer_pixel_coords_index = g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
+						shader_input->buffer_pixel_coords_two_index = g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1;
+						shader_input->buffer_traversal_stats_index = g_renderer->wavefront.buffer_traversal_stats_srv_uav.offset + 1;
+						shader_input->clear_traversal_stats = frame_sample == 0;
+
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_clear_buffers);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
 
+						{
+							D3D12_RESOURCE_BARRIER barriers[] =
+							{
+								d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
+								d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
+								d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
+								d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords),
+								d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords_two),
+								d3d12::barrier_uav(g_renderer->wavefront.buffer_traversal_stats)
+							};
+							d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+						}
+					
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
+					}
+
+					if (recursion_depth == 0)
 					{
+						// Generate, dispatched for every pixel since the primary ray count is only known after adaptive sampling skipped the converged pixels
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_GENERATE);
+					
+						struct shader_input_t
+						{
+							uint32_t buffer_rays_index;
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_pixel_coords_index;
+							uint32_t texture_energy_index;
+							uint32_t texture_pixel_variance_index;
+							uint32_t sample_count;
+							uint32_t random_seed;
+							uint32_t path_regeneration;
+							uint32_t buffer_path_states_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->buffer_rays_index = g_renderer->wavefront.buffer_rays_srv_uav.offset + 1;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
+						shader_input->buffer_pixel_coords_index = g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
+						shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
+						shader_input->texture_pixel_variance_index = g_renderer->rt_pixel_variance_srv_uav.offset + 1;
+						shader_input->sample_count = g_renderer->accum_count;
+						shader_input->random_seed = frame_seed;
+						shader_input->path_regeneration = path_regeneration;
+						shader_input->buffer_path_states_index = g_renderer->wavefront.buffer_path_states_srv_uav.offset + 1;
+
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_generate);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
+
 						D3D12_RESOURCE_BARRIER barriers[] =
 						{
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_rays),
 							d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
-							d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
-							d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
 							d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords),
-							d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords_two)
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_path_states),
+							d3d12::barrier_uav(g_renderer->wavefront.texture_energy)
 						};
 						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-					}
 					
-					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
-				}
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_GENERATE);
+					}
 
-				{
-					// Init indirect arguments
-					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
-					
-					struct shader_input_t
 					{
-						uint32_t recursion_depth;
-						uint32_t buffer_ray_counts_index;
-						uint32_t buffer_indirect_args_index;
-					};
-					d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-					shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-					shader_input->recursion_depth = recursion_depth;
-					shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
-					shader_input->buffer_indirect_args_index = g_renderer->wavefront.buffer_indirect_args_srv_uav.offset + 1;
+						// Init indirect arguments
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
+					
+						struct shader_input_t
+						{
+							uint32_t recursion_depth;
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_indirect_args_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->recursion_depth = recursion_depth;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
+						shader_input->buffer_indirect_args_index = g_renderer->wavefront.buffer_indirect_args_srv_uav.offset + 1;
 
-					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_init_args);
-					d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-					d3d_frame_ctx.command_list->Dispatch(1, 1, 1);
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_init_args);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->Dispatch(1, 1, 1);
+
+						{
+							D3D12_RESOURCE_BARRIER barriers[] =
+							{
+								d3d12::barrier_uav(g_renderer->wavefront.buffer_indirect_args)
+							};
+							d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+						}
+					
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
+					}
 
 					{
+						// Extend
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_EXTEND);
+					
+						struct shader_input_t
+						{
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_rays_index;
+							uint32_t buffer_hit_results_index;
+							uint32_t buffer_scene_tlas_index;
+							uint32_t recursion_depth;
+							uint32_t buffer_traversal_stats_index;
+							uint32_t buffer_traversal_costs_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
+						shader_input->buffer_rays_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_rays_srv_uav.offset : g_renderer->wavefront.buffer_rays_two_srv_uav.offset;
+						shader_input->buffer_hit_results_index = g_renderer->wavefront.buffer_hit_results_srv_uav.offset + 1;
+						shader_input->buffer_scene_tlas_index = frame_ctx.scene_tlas_srv.offset;
+						shader_input->recursion_depth = recursion_depth;
+						shader_input->buffer_traversal_stats_index = g_renderer->wavefront.buffer_traversal_stats_srv_uav.offset + 1;
+						shader_input->buffer_traversal_costs_index = g_renderer->wavefront.buffer_traversal_costs_srv_uav.offset + 1;
+
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->settings.use_software_rt ?
+							g_renderer->wavefront.pso_extend_software : g_renderer->wavefront.pso_extend);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
+							g_renderer->wavefront.buffer_indirect_args, recursion_depth * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+					
 						D3D12_RESOURCE_BARRIER barriers[] =
 						{
-							d3d12::barrier_uav(g_renderer->wavefront.buffer_indirect_args)
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_hit_results),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_traversal_costs)
 						};
 						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+					
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_EXTEND);
 					}
+					{
+						// Shade
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_SHADE);
 					
-					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
-				}
+						struct shader_input_t
+						{
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_rays_index;
+							uint32_t buffer_rays_two_index;
+							uint32_t buffer_hit_results_index;
+							uint32_t texture_energy_index;
+							uint32_t texture_throughput_index;
+							uint32_t buffer_pixel_coords_index;
+							uint32_t buffer_pixel_coords_two_index;
+							uint32_t buffer_instances_index;
+							uint32_t texture_hdr_env_index;
+							glm::uvec2 texture_hdr_env_dims;
+							uint32_t random_seed;
+							uint32_t recursion_depth;
+							uint32_t buffer_shadow_rays_index;
+							uint32_t buffer_lights_index;
+							uint32_t light_count;
+							uint32_t buffer_hdr_env_alias_index;
+							uint32_t hdr_env_importance_sampling;
+							uint32_t sample_count;
+							uint32_t path_regeneration;
+							uint32_t regenerate_paths;
+							uint32_t buffer_path_states_index;
+							uint32_t buffer_traversal_costs_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
+						shader_input->buffer_rays_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_rays_srv_uav.offset : g_renderer->wavefront.buffer_rays_two_srv_uav.offset;
+						shader_input->buffer_rays_two_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_rays_two_srv_uav.offset + 1 : g_renderer->wavefront.buffer_rays_srv_uav.offset + 1;
+						shader_input->buffer_hit_results_index = g_renderer->wavefront.buffer_hit_results_srv_uav.offset;
+						shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
+						shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
+						shader_input->buffer_pixel_coords_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset : g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset;
+						shader_input->buffer_pixel_coords_two_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1 : g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
+						shader_input->buffer_instances_index = g_renderer->instance_buffer_srv.offset;
+						shader_input->texture_hdr_env_index = g_renderer->scene_hdr_env_texture->texture_srv.offset;
+						shader_input->texture_hdr_env_dims = glm::uvec2(g_renderer->scene_hdr_env_texture->width, g_renderer->scene_hdr_env_texture->height);
+						shader_input->random_seed = frame_seed;
+						shader_input->recursion_depth = recursion_depth;
+						shader_input->buffer_shadow_rays_index = g_renderer->wavefront.buffer_shadow_rays_srv_uav.offset + 1;
+						shader_input->buffer_lights_index = frame_ctx.scene_lights_srv.offset;
+						shader_input->light_count = g_renderer->scene_lights.light_count;
+						shader_input->buffer_hdr_env_alias_index = g_renderer->scene_hdr_env_texture->env_alias_srv.offset;
+						shader_input->hdr_env_importance_sampling = g_renderer->scene_hdr_env_texture->env_alias_table != nullptr;
+						shader_input->sample_count = g_renderer->accum_count;
+						shader_input->path_regeneration = path_regeneration;
+						shader_input->regenerate_paths = path_regeneration && recursion_depth + g_renderer->settings.max_bounces + 2 <= iteration_count;
+						shader_input->buffer_path_states_index = g_renderer->wavefront.buffer_path_states_srv_uav.offset + 1;
+						shader_input->buffer_traversal_costs_index = g_renderer->wavefront.buffer_traversal_costs_srv_uav.offset;
+
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_shade);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
+							g_renderer->wavefront.buffer_indirect_args, recursion_depth * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
 
-				if (recursion_depth == 0)
-				{
-					// Generate
-					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_GENERATE);
+						D3D12_RESOURCE_BARRIER barriers[] =
+						{
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
+							d3d12::barrier_uav(recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_rays_two : g_renderer->wavefront.buffer_rays),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_shadow_rays),
+							d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
+							d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_path_states),
+							d3d12::barrier_uav(recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_two : g_renderer->wavefront.buffer_pixel_coords)
+						};
+						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
 					
-					struct shader_input_t
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_SHADE);
+					}
 					{
-						uint32_t buffer_rays_index;
-					};
-					d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-					shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-					shader_input->buffer_rays_index = g_renderer->wavefront.buffer_rays_srv_uav.offset + 1;
+						// Init indirect arguments for the shadow rays, the shadow ray counts and arguments are stored after the extension ray ones
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
 
-					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_generate);
-					d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-					d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
-						g_renderer->wavefront.buffer_indirect_args, 0, nullptr, 0);
+						struct shader_input_t
+						{
+							uint32_t recursion_depth;
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_indirect_args_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->recursion_depth = WAVEFRONT_SHADOW_RAY_COUNT_OFFSET + recursion_depth;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
+						shader_input->buffer_indirect_args_index = g_renderer->wavefront.buffer_indirect_args_srv_uav.offset + 1;
 
-					D3D12_RESOURCE_BARRIER barriers[] =
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_init_args);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->Dispatch(1, 1, 1);
+
+						D3D12_RESOURCE_BARRIER barriers[] =
+						{
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_indirect_args)
+						};
+						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_INIT_ARGS);
+					}
 					{
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_rays)
-					};
-					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-					
-					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_GENERATE);
+						// Connect, traces the shadow rays queued by the shade stage
+						gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CONNECT);
+
+						struct shader_input_t
+						{
+							uint32_t buffer_ray_counts_index;
+							uint32_t buffer_shadow_rays_index;
+							uint32_t buffer_scene_tlas_index;
+							uint32_t texture_energy_index;
+							uint32_t recursion_depth;
+							uint32_t buffer_traversal_stats_index;
+						};
+						d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+						shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
+						shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
+						shader_input->buffer_shadow_rays_index = g_renderer->wavefront.buffer_shadow_rays_srv_uav.offset;
+						shader_input->buffer_scene_tlas_index = frame_ctx.scene_tlas_srv.offset;
+						shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
+						shader_input->recursion_depth = recursion_depth;
+						shader_input->buffer_traversal_stats_index = g_renderer->wavefront.buffer_traversal_stats_srv_uav.offset + 1;
+
+						d3d_frame_ctx.command_list->SetPipelineState(g_renderer->settings.use_software_rt ?
+							g_renderer->wavefront.pso_connect_software : g_renderer->wavefront.pso_connect);
+						d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
+						d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
+							g_renderer->wavefront.buffer_indirect_args, (WAVEFRONT_SHADOW_RAY_COUNT_OFFSET + recursion_depth) * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+
+						D3D12_RESOURCE_BARRIER barriers[] =
+						{
+							d3d12::barrier_uav(g_renderer->wavefront.texture_energy)
+						};
+						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+
+						gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CONNECT);
+					}
 				}
+			}
+			else
+			{
 				{
-					// Extend
-					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_EXTEND);
-					
+					// Clear buffers (only energy buffer needs to be cleared for megakernel)
+					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
+			
 					struct shader_input_t
 					{
 						uint32_t buffer_ray_counts_index;
-						uint32_t buffer_rays_index;
-						uint32_t buffer_hit_results_index;
-						uint32_t buffer_scene_tlas_index;
-						uint32_t recursion_depth;
+						uint32_t texture_energy_index;
+						uint32_t texture_throughput_index;
+						uint32_t buffer_pixel_coords_index;
+						uint32_t buffer_pixel_coords_two_index;
+						uint32_t buffer_traversal_stats_index;
+						uint32_t clear_traversal_stats;
 					};
 					d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
 					shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-					shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset;
-					shader_input->buffer_rays_index = g_renderer->wavefront.buffer_rays_srv_uav.offset;
-					shader_input->buffer_hit_results_index = g_renderer->wavefront.buffer_hit_results_srv_uav.offset + 1;
-					shader_input->buffer_scene_tlas_index = frame_ctx.scene_tlas_srv.offset;
-					shader_input->recursion_depth = recursion_depth;
+					shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
+					shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
+					shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
+					shader_input->buffer_pixel_coords_index = g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
+					shader_input->buffer_pixel_coords_two_index = g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1;
+					shader_input->buffer_traversal_stats_index = g_renderer->wavefront.buffer_traversal_stats_srv_uav.offset + 1;
+					shader_input->clear_traversal_stats = frame_sample == 0;
 
-					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_extend);
+					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_clear_buffers);
 					d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-					d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
-						g_renderer->wavefront.buffer_indirect_args, recursion_depth * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
-					
-					D3D12_RESOURCE_BARRIER barriers[] =
+					d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
+
 					{
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_hit_results)
-					};
-					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-					
-					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_EXTEND);
+						D3D12_RESOURCE_BARRIER barriers[] =
+						{
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
+							d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
+							d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords_two),
+							d3d12::barrier_uav(g_renderer->wavefront.buffer_traversal_stats)
+						};
+						d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
+					}
+			
+					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
 				}
+
 				{
-					// Shade
-					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_SHADE);
-					
+					// Megakernel path trace
+					gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_MEGAKERNEL);
+			
 					struct shader_input_t
 					{
-						uint32_t buffer_ray_counts_index;
-						uint32_t buffer_rays_index;
-						uint32_t buffer_hit_results_index;
-						uint32_t texture_energy_index;
-						uint32_t texture_throughput_index;
-						uint32_t buffer_pixel_coords_index;
-						uint32_t buffer_pixel_coords_two_index;
-						uint32_t buffer_instances_index;
+						uint32_t buffer_scene_tlas_index;
 						uint32_t texture_hdr_env_index;
 						glm::uvec2 texture_hdr_env_dims;
+						uint32_t buffer_instances_index;
+						uint32_t texture_energy_index;
 						uint32_t random_seed;
-						uint32_t recursion_depth;
+						uint32_t buffer_lights_index;
+						uint32_t light_count;
+						uint32_t buffer_hdr_env_alias_index;
+						uint32_t hdr_env_importance_sampling;
+						uint32_t texture_pixel_variance_index;
+						uint32_t sample_count;
+						uint32_t buffer_traversal_stats_index;
 					};
 					d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
 					shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-					shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
-					shader_input->buffer_rays_index = g_renderer->wavefront.buffer_rays_srv_uav.offset + 1;
-					shader_input->buffer_hit_results_index = g_renderer->wavefront.buffer_hit_results_srv_uav.offset;
-					shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
-					shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
-					shader_input->buffer_pixel_coords_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset : g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset;
-					shader_input->buffer_pixel_coords_two_index = recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1 : g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
-					shader_input->buffer_instances_index = g_renderer->instance_buffer_srv.offset;
+					shader_input->buffer_scene_tlas_index = frame_ctx.scene_tlas_srv.offset;
 					shader_input->texture_hdr_env_index = g_renderer->scene_hdr_env_texture->texture_srv.offset;
 					shader_input->texture_hdr_env_dims = glm::uvec2(g_renderer->scene_hdr_env_texture->width, g_renderer->scene_hdr_env_texture->height);
+					shader_input->buffer_instances_index = g_renderer->instance_buffer_srv.offset;
+					shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
 					shader_input->random_seed = frame_seed;
-					shader_input->recursion_depth = recursion_depth;
-
-					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_shade);
+					shader_input->buffer_lights_index = frame_ctx.scene_lights_srv.offset;
+					shader_input->light_count = g_renderer->scene_lights.light_count;
+					shader_input->buffer_hdr_env_alias_index = g_renderer->scene_hdr_env_texture->env_alias_srv.offset;
+					shader_input->hdr_env_importance_sampling = g_renderer->scene_hdr_env_texture->env_alias_table != nullptr;
+					shader_input->texture_pixel_variance_index = g_renderer->rt_pixel_variance_srv_uav.offset + 1;
+					shader_input->sample_count = g_renderer->accum_count;
+					shader_input->buffer_traversal_stats_index = g_renderer->wavefront.buffer_traversal_stats_srv_uav.offset + 1;
+
+					d3d_frame_ctx.command_list->SetPipelineState(g_renderer->settings.use_software_rt ?
+						g_renderer->pso_cs_pathtracer_software : g_renderer->pso_cs_pathtracer_hardware);
 					d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-					d3d_frame_ctx.command_list->ExecuteIndirect(g_renderer->wavefront.command_signature, 1,
-						g_renderer->wavefront.buffer_indirect_args, recursion_depth * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+					d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
 
 					D3D12_RESOURCE_BARRIER barriers[] =
 					{
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_rays),
-						d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
-						d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
-						d3d12::barrier_uav(recursion_depth % 2 == 0 ? g_renderer->wavefront.buffer_pixel_coords_two : g_renderer->wavefront.buffer_pixel_coords)
+						d3d12::barrier_uav(g_renderer->wavefront.texture_energy)
 					};
 					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-					
-					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_SHADE);
-				}
-				{
-					// TODO: Connect (Next event estimation)
+			
+					gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_MEGAKERNEL);
 				}
 			}
-		}
-		else
-		{
+
+			// Dispatch post-process compute shader
 			{
-				// Clear buffers (only energy buffer needs to be cleared for megakernel)
-				gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
-			
+				gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_POST_PROCESS);
+
+				// Bind shader input constant buffer
 				struct shader_input_t
 				{
-					uint32_t buffer_ray_counts_index;
 					uint32_t texture_energy_index;
-					uint32_t texture_throughput_index;
-					uint32_t buffer_pixel_coords_index;
-					uint32_t buffer_pixel_coords_two_index;
+					uint32_t texture_color_accum_index;
+					uint32_t texture_color_final_index;
+					uint32_t texture_pixel_variance_index;
+					uint32_t sample_count;
+					uint32_t energy_accumulated;
+					uint32_t path_regeneration;
+					uint32_t buffer_path_states_index;
 				};
-				d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-				shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-				shader_input->buffer_ray_counts_index = g_renderer->wavefront.buffer_ray_counts_srv_uav.offset + 1;
-				shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
-				shader_input->texture_throughput_index = g_renderer->wavefront.texture_throughput_srv_uav.offset + 1;
-				shader_input->buffer_pixel_coords_index = g_renderer->wavefront.buffer_pixel_coords_srv_uav.offset + 1;
-				shader_input->buffer_pixel_coords_two_index = g_renderer->wavefront.buffer_pixel_coords_two_srv_uav.offset + 1;
-
-				d3d_frame_ctx.command_list->SetPipelineState(g_renderer->wavefront.pso_clear_buffers);
-				d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-				d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
+				d3d12::frame_resource_t shader_cb = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
+				shader_input_t* shader_input = (shader_input_t*)shader_cb.ptr;
+				shader_input->energy_accumulated = g_renderer->settings.use_cpu_pathtracing && cpu::render_pass::is_energy_denoised();
+				// Same condition as the wavefront dispatch, only the wavefront path tracer regenerates paths
+				shader_input->path_regeneration = !g_renderer->settings.use_cpu_pathtracing && g_renderer->settings.use_wavefront_pathtracing &&
+					g_renderer->settings.wavefront_path_regeneration && g_renderer->settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+				shader_input->buffer_path_states_index = g_renderer->wavefront.buffer_path_states_srv_uav.offset;
+				shader_input->texture_energy_index = g_renderer->settings.use_cpu_pathtracing ?
+					g_renderer->cpu.texture_energy_srv.offset : g_renderer->wavefront.texture_energy_srv_uav.offset;
+				shader_input->texture_color_accum_index = g_renderer->rt_color_accum_srv_uav.offset + 1;
+				shader_input->texture_color_final_index = g_renderer->rt_final_color_uav.offset;
+				shader_input->texture_pixel_variance_index = g_renderer->rt_pixel_variance_srv_uav.offset + 1;
+				shader_input->sample_count = g_renderer->accum_count;
+
+				d3d_frame_ctx.command_list->SetPipelineState(g_renderer->pso_cs_post_process);
+				d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, shader_cb.resource->GetGPUVirtualAddress() + shader_cb.byte_offset);
+				d3d_frame_ctx.command_list->Dispatch(dispatch_blocks_x, dispatch_blocks_y, 1);
 
+				D3D12_RESOURCE_BARRIER barriers[] =
 				{
-					D3D12_RESOURCE_BARRIER barriers[] =
-					{
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_ray_counts),
-						d3d12::barrier_uav(g_renderer->wavefront.texture_energy),
-						d3d12::barrier_uav(g_renderer->wavefront.texture_throughput),
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords),
-						d3d12::barrier_uav(g_renderer->wavefront.buffer_pixel_coords_two)
-					};
-					d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-				}
+					d3d12::barrier_uav(g_renderer->rt_color_accum),
+					d3d12::barrier_uav(g_renderer->rt_pixel_variance),
+					d3d12::barrier_uav(g_renderer->rt_final_color)
+				};
+				d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
 			
-				gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_WAVEFRONT_CLEAR);
+				gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_POST_PROCESS);
 			}
 
+			// The next sample of the frame overwrites the energy that the post-process just read from
+			if (frame_sample + 1 < frame_sample_count)
 			{
-				// Megakernel path trace
-				gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_MEGAKERNEL);
-			
-				struct shader_input_t
-				{
-					uint32_t buffer_scene_tlas_index;
-					uint32_t texture_hdr_env_index;
-					glm::uvec2 texture_hdr_env_dims;
-					uint32_t buffer_instances_index;
-					uint32_t texture_energy_index;
-					uint32_t random_seed;
-				};
-				d3d12::frame_resource_t cb_shader = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-				shader_input_t* shader_input = (shader_input_t*)cb_shader.ptr;
-				shader_input->buffer_scene_tlas_index = frame_ctx.scene_tlas_srv.offset;
-				shader_input->texture_hdr_env_index = g_renderer->scene_hdr_env_texture->texture_srv.offset;
-				shader_input->texture_hdr_env_dims = glm::uvec2(g_renderer->scene_hdr_env_texture->width, g_renderer->scene_hdr_env_texture->height);
-				shader_input->buffer_instances_index = g_renderer->instance_buffer_srv.offset;
-				shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset + 1;
-				shader_input->random_seed = frame_seed;
-
-				d3d_frame_ctx.command_list->SetPipelineState(g_renderer->pso_cs_pathtracer_hardware);
-				d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, cb_shader.resource->GetGPUVirtualAddress() + cb_shader.byte_offset);
-				d3d_frame_ctx.command_list->Dispatch((g_renderer->render_width * g_renderer->render_height + 63) / 64, 1, 1);
-
 				D3D12_RESOURCE_BARRIER barriers[] =
 				{
 					d3d12::barrier_uav(g_renderer->wavefront.texture_energy)
 				};
 				d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-			
-				gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_PATHTRACE_MEGAKERNEL);
 			}
 		}
 
-		// Dispatch post-process compute shader
+		// Copy the traversal counters of all samples of the frame, they are read back once this frame context is used again
+		if (!g_renderer->settings.use_cpu_pathtracing)
 		{
-			gpu_profiler_begin_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_POST_PROCESS);
-
-			// Bind shader input constant buffer
-			struct shader_input_t
-			{
-				uint32_t texture_energy_index;
-				uint32_t texture_color_accum_index;
-				uint32_t texture_color_final_index;
-				uint32_t sample_count;
-			};
-			d3d12::frame_resource_t shader_cb = d3d12::allocate_frame_resource(sizeof(shader_input_t), 256);
-			shader_input_t* shader_input = (shader_input_t*)shader_cb.ptr;
-			shader_input->texture_energy_index = g_renderer->wavefront.texture_energy_srv_uav.offset;
-			shader_input->texture_color_accum_index = g_renderer->rt_color_accum_srv_uav.offset + 1;
-			shader_input->texture_color_final_index = g_renderer->rt_final_color_uav.offset;
-			shader_input->sample_count = g_renderer->accum_count;
-
-			d3d_frame_ctx.command_list->SetPipelineState(g_renderer->pso_cs_post_process);
-			d3d_frame_ctx.command_list->SetComputeRootConstantBufferView(2, shader_cb.resource->GetGPUVirtualAddress() + shader_cb.byte_offset);
-			d3d_frame_ctx.command_list->Dispatch(dispatch_blocks_x, dispatch_blocks_y, 1);
-
 			D3D12_RESOURCE_BARRIER barriers[] =
 			{
-				d3d12::barrier_uav(g_renderer->rt_color_accum),
-				d3d12::barrier_uav(g_renderer->rt_final_color)
+				d3d12::barrier_transition(g_renderer->wavefront.buffer_traversal_stats, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE)
 			};
 			d3d_frame_ctx.command_list->ResourceBarrier(ARRAY_SIZE(barriers), barriers);
-			
-			gpu_profiler_end_scope(frame_ctx, d3d_frame_ctx.command_list, GPU_PROFILE_SCOPE_POST_PROCESS);
+
+			// The buffer decays back to the common state once the command list is done, the clear of the next frame promotes it to unordered access again
+			d3d_frame_ctx.command_list->CopyBufferRegion(frame_ctx.traversal_stats_readback_resource, 0,
+				g_renderer->wavefront.buffer_traversal_stats, 0, TRAVERSAL_STATS_COUNTER_COUNT * sizeof(uint64_t));
+			frame_ctx.traversal_stats_pending = true;
 		}
 	}
 
@@ -1053,6 +1649,19 @@ namespace renderer
 		g_renderer->instance_data_at = 0;
 	}
 
+	static void render_arena_stats_ui(const char* name, memory_arena_t& arena)
+	{
+		memory_arena::stats_t stats = memory_arena::get_stats(arena);
+
+		ImGui::SeparatorText(name);
+		ImGui::Text("Reserved: %llu KB", TO_KB(stats.reserved));
+		ImGui::Text("Committed: %llu KB (peak %llu KB)", TO_KB(stats.committed), TO_KB(stats.peak_committed));
+		ImGui::Text("Allocated: %llu KB (peak %llu KB)", TO_KB(stats.allocated), TO_KB(stats.peak_allocated));
+		ImGui::Text("Allocations: %llu", stats.alloc_count);
+		// Virtual memory calls, for the arenas that are allocated from every frame these should stop going up once the frames are steady
+		ImGui::Text("Commits: %llu, decommits: %llu", stats.commit_count, stats.decommit_count);
+	}
+
 	void render_ui()
 	{
 		gpu_profiler_render_ui();
@@ -1068,6 +1677,14 @@ namespace renderer
 			ImGui::SetItemTooltip("When VSync is enabled, GPU timers cannot be trusted because depending on hardware/drivers, "
 						 "any stalls introduced by VSync might affect them.");
 			ImGui::Text("Accumulator: %u", g_renderer->accum_count);
+			if (g_renderer->settings.frame_time_budget)
+			{
+				const renderer_inst_t::frame_budget_t& budget = g_renderer->frame_budget;
+				if (g_renderer->settings.use_cpu_pathtracing)
+					ImGui::Text("Frame time: %.2f ms, %u/%u tiles per frame", budget.frame_time_ms, (uint32_t)budget.cpu_tiles_per_frame, cpu::tile_scheduler::get_tile_count());
+				else
+					ImGui::Text("Frame time: %.2f ms, %u samples per frame", budget.frame_time_ms, (uint32_t)budget.gpu_samples_per_frame);
+			}
 
 			// GPU memory usage
 			if (ImGui::CollapsingHeader("GPU Memory"))
@@ -1089,6 +1706,73 @@ namespace renderer
 				ImGui::Text("Available reserve: %llu MB", TO_MB(gpu_memory.non_local_mem.AvailableForReservation));
 			}
 
+			// CPU memory usage of the renderer arenas, and of the allocation call sites per arena when tracking is enabled
+			if (ImGui::CollapsingHeader("CPU Memory"))
+			{
+				render_arena_stats_ui("Renderer Arena", g_renderer->arena);
+				render_arena_stats_ui("Mesh Arena", g_renderer->mesh_arena);
+				render_arena_stats_ui("Frame Arena", get_frame_context().arena);
+				render_arena_stats_ui("Main Thread Scratch Arena", memory_arena::get_scratch());
+
+				ImGui::SeparatorText("Allocation Call Sites");
+#if ARENA_ENABLE_TRACKING
+				if (ImGui::Button("Log call sites"))
+				{
+					memory_arena::log_call_site_stats(ARENA_UI_CALL_SITE_COUNT);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Reset call sites"))
+				{
+					memory_arena::reset_call_site_stats();
+				}
+
+				ARENA_SCRATCH_SCOPE()
+				{
+					memory_arena::call_site_stats_t* call_sites = ARENA_ALLOC_ARRAY(arena_scratch, memory_arena::call_site_stats_t, ARENA_UI_CALL_SITE_COUNT);
+					uint32_t call_site_count = memory_arena::get_call_site_stats(call_sites, ARENA_UI_CALL_SITE_COUNT);
+
+					if (ImGui::BeginTable("##Allocation call sites", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+					{
+						ImGui::TableSetupColumn("Arena");
+						ImGui::TableSetupColumn("Call site");
+						ImGui::TableSetupColumn("Total");
+						ImGui::TableSetupColumn("Allocs");
+						ImGui::TableSetupColumn("Largest");
+						ImGui::TableHeadersRow();
+
+						for (uint32_t i = 0; i < call_site_count; ++i)
+						{
+							// Only the file name, the full paths do not fit in the window
+							const char* file_name = MAX(strrchr(call_sites[i].file, '\\'), strrchr(call_sites[i].file, '/'));
+							file_name = file_name ? file_name + 1 : call_sites[i].file;
+
+							ImGui::TableNextRow();
+							ImGui::TableNextColumn();
+							// Every thread has its own scratch arena, so the address tells apart the arenas that share a name
+							if (call_sites[i].arena_name)
+								ImGui::Text("%s", call_sites[i].arena_name);
+							else
+								ImGui::Text("%p", (const void*)call_sites[i].arena);
+							ImGui::SetItemTooltip("%p", (const void*)call_sites[i].arena);
+							ImGui::TableNextColumn();
+							ImGui::Text("%s(%u)", file_name, call_sites[i].line);
+							ImGui::SetItemTooltip("%s", call_sites[i].file);
+							ImGui::TableNextColumn();
+							ImGui::Text("%llu KB", TO_KB(call_sites[i].total_bytes));
+							ImGui::TableNextColumn();
+							ImGui::Text("%llu", call_sites[i].alloc_count);
+							ImGui::TableNextColumn();
+							ImGui::Text("%llu KB", TO_KB(call_sites[i].largest_bytes));
+						}
+
+						ImGui::EndTable();
+					}
+				}
+#else
+				ImGui::TextDisabled("Enable ARENA_ENABLE_TRACKING in memory_arena.h to track call sites");
+#endif
+			}
+
 			// Debug category
 			if (ImGui::CollapsingHeader("Debug"))
 			{
@@ -1114,6 +1798,67 @@ namespace renderer
 					ImGui::EndCombo();
 				}
 
+				ImGui::BeginDisabled(g_renderer->settings.render_view_mode != RENDER_VIEW_MODE_TRAVERSAL_COST);
+				if (ImGui::SliderInt("Traversal cost heatmap max", (int32_t*)&g_renderer->settings.traversal_cost_heatmap_max, 16, 4096)) should_reset_accumulators = true;
+				ImGui::EndDisabled();
+				ImGui::SetItemTooltip("Number of AABB and triangle tests of a camera ray that maps to red. Only the software BVH traversal counts its work.");
+
+				// Traversal counters of the last completed CPU pass, averaged over all rays traced in that pass (camera, bounce and shadow rays)
+				if (g_renderer->settings.use_cpu_pathtracing)
+				{
+					const cpu::traversal_totals_t& stats = cpu::render_pass::get_traversal_stats();
+					double rays = (double)MAX(stats.rays, 1ull);
+
+					ImGui::Text("CPU traversal rays: %llu", stats.rays);
+					ImGui::Text("TLAS leaves per ray: %.2f", stats.tlas_leaves / rays);
+					ImGui::Text("Inner nodes per ray: %.2f", stats.inner_nodes / rays);
+					ImGui::Text("AABB tests per ray: %.2f", stats.aabb_tests / rays);
+					ImGui::Text("Triangle tests per ray: %.2f", stats.triangle_tests / rays);
+
+					cpu::texture_cache::stats_t cache_stats = cpu::texture_cache::get_stats();
+					double cache_lookups = (double)MAX(cache_stats.hits + cache_stats.misses, 1ull);
+
+					ImGui::Text("Texture cache hit rate: %.2f%%", 100.0 * cache_stats.hits / cache_lookups);
+					ImGui::Text("Texture cache tiles: %u/%u resident, %u total", cache_stats.resident_tile_count, cache_stats.slot_count, cache_stats.tile_count);
+					ImGui::Text("Texture cache evictions: %llu", cache_stats.evictions);
+
+					if (g_renderer->settings.path_guiding)
+					{
+						cpu::path_guiding::stats_t guiding_stats = cpu::path_guiding::get_stats();
+						ImGui::Text("Path guiding iteration: %u (%s)", guiding_stats.iteration, guiding_stats.training ? "training" : "done");
+						ImGui::Text("Path guiding nodes: %u spatial leaves, %u directional", guiding_stats.spatial_leaf_count, guiding_stats.directional_node_count);
+					}
+				}
+				// Traversal counters of the last GPU frame that was read back, a few frames behind the one on screen
+				else
+				{
+					const cpu::traversal_totals_t& stats = g_renderer->gpu_traversal_stats;
+					double rays = (double)MAX(stats.rays, 1ull);
+
+					ImGui::Text("GPU traversal rays: %llu", stats.rays);
+					ImGui::SetItemTooltip("Only the software BVH traversal counts its work, hardware raytracing leaves all counters at zero.");
+					ImGui::Text("TLAS leaves per ray: %.2f", stats.tlas_leaves / rays);
+					ImGui::Text("Inner nodes per ray: %.2f", stats.inner_nodes / rays);
+					ImGui::Text("AABB tests per ray: %.2f", stats.aabb_tests / rays);
+					ImGui::Text("Triangle tests per ray: %.2f", stats.triangle_tests / rays);
+				}
+
+				// Parallel prefix sum based compaction against one atomic append per element, the same way the wavefront shaders fill their queues
+				if (ImGui::Button("Run compaction benchmark"))
+				{
+					g_renderer->cpu.scan_benchmark = cpu::scan::run_benchmark(SCAN_BENCHMARK_ELEMENT_COUNT, SCAN_BENCHMARK_ACTIVE_FRACTION, SCAN_BENCHMARK_ITERATION_COUNT);
+				}
+				ImGui::SetItemTooltip("Blocks the main thread until done. The CPU path tracer workers compete for the same cores, so the timings are only meaningful when it is disabled.");
+
+				const cpu::scan::benchmark_result_t& scan_benchmark = g_renderer->cpu.scan_benchmark;
+				if (scan_benchmark.element_count > 0)
+				{
+					ImGui::Text("Compaction: %u of %u elements on %u threads", scan_benchmark.active_count, scan_benchmark.element_count, scan_benchmark.thread_count);
+					ImGui::Text("Exclusive scan: %.3f ms, parallel %.3f ms", scan_benchmark.scan_ms, scan_benchmark.parallel_scan_ms);
+					ImGui::Text("Compact: %.3f ms, parallel %.3f ms", scan_benchmark.compact_ms, scan_benchmark.parallel_compact_ms);
+					ImGui::Text("Atomic append: %.3f ms (%s)", scan_benchmark.atomic_append_ms, scan_benchmark.atomic_append_ordered ? "ordered" : "unordered");
+				}
+
 				ImGui::Unindent(10.0f);
 			}
 
@@ -1126,6 +1871,10 @@ namespace renderer
 				ImGui::Checkbox("Use Wavefront Path-tracing", (bool*)&g_renderer->settings.use_wavefront_pathtracing);
 				ImGui::SetItemTooltip("On: Wavefront path-tracing enabled.\nOff: Megakernel path-tracing enabled");
 
+				// CPU reference path tracer
+				if (ImGui::Checkbox("Use CPU Path-tracing", (bool*)&g_renderer->settings.use_cpu_pathtracing)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Path-traces the scene on the CPU instead, using the software BVHs. This is very slow and meant as a reference for the GPU path tracers.");
+
 				// Software/Hardware raytracing
 				ImGui::BeginDisabled(true);
 				if (ImGui::Checkbox("Use software raytracing", (bool*)&g_renderer->settings.use_software_rt))
@@ -1136,12 +1885,92 @@ namespace renderer
 				ImGui::SetItemTooltip("When this is enabled the raytracing will use software raytracing with custom acceleration structures instead of hardware raytracing."
 					"This might take a while because it will rebuild all bottom level acceleration structures of all meshes.");
 
+				// Short stack BLAS traversal for the software BVHs, produces the same image as the full stack
+				ImGui::Checkbox("BVH short stack traversal", (bool*)&g_renderer->settings.bvh_short_stack);
+				ImGui::SetItemTooltip("Only used by the software BVHs (CPU path-tracing and software raytracing).\n"
+					"Keeps a short ring buffer of node indices during BLAS traversal and walks up the parent links when entries were dropped, instead of a full stack.");
+
+				// Packed ray, hit result, and shadow ray layouts for the wavefront queues
+				ImGui::Checkbox("Wavefront compact payloads", (bool*)&g_renderer->settings.wavefront_compact_payloads);
+				ImGui::SetItemTooltip("Only used by wavefront path-tracing, compare the wavefront stage timings in the GPU profiler with this on and off.\n"
+					"Stores ray directions octahedral encoded, pixel positions inside the ray, barycentrics as 16-bit unorm, and shadow ray contributions as half floats.");
+
+				// Path regeneration for the wavefront queues
+				if (ImGui::Checkbox("Wavefront path regeneration", (bool*)&g_renderer->settings.wavefront_path_regeneration)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Only used by wavefront path-tracing.\n"
+					"Paths that terminate are replaced by new camera samples of the same pixel within the same frame, so later bounces do not run on mostly empty queues.\n"
+					"Runs twice as many iterations per frame, and pixels take a varying number of samples per frame.");
+
+				// Texture mip selection with ray cones for the CPU path tracer
+				if (ImGui::Checkbox("Texture LOD ray cones", (bool*)&g_renderer->settings.texture_lod_ray_cones)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Only used by CPU path-tracing.\n"
+					"Selects the texture mip from the footprint of a ray cone that widens with every bounce, instead of always sampling mip 0.");
+
+				// Path guiding for the CPU path tracer
+				if (ImGui::Checkbox("Path guiding", (bool*)&g_renderer->settings.path_guiding)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Only used by CPU path-tracing.\n"
+					"Learns the incident radiance over the scene while accumulating, and samples half of the diffuse bounces from it once the first training iteration is done.");
+
 				// Slider for maximum amount of recursion for each ray
 				if (ImGui::SliderInt("Max bounces",(int32_t*)&g_renderer->settings.max_bounces, 0, 8)) should_reset_accumulators = true;
 				// Toggle accumulation
 				if (ImGui::Checkbox("Accumulate", (bool*)&g_renderer->settings.accumulate)) should_reset_accumulators = true;
+				// Frame time budget, does not change the accumulated result so the accumulator keeps going
+				ImGui::Checkbox("Frame time budget", (bool*)&g_renderer->settings.frame_time_budget);
+				ImGui::SetItemTooltip("Only used when accumulating.\n"
+					"Takes as many samples per frame as fit in the target frame time with the GPU path tracers, "
+					"and limits the tiles per frame of the CPU path tracer so that it stays responsive.");
+				ImGui::BeginDisabled(!g_renderer->settings.frame_time_budget);
+				ImGui::DragFloat("Frame time target (ms)", &g_renderer->settings.frame_time_target_ms, 0.1f, 1.0f, 1000.0f, "%.1f");
+				ImGui::SliderInt("Frame time budget max samples", (int32_t*)&g_renderer->settings.frame_time_budget_max_samples, 1, FRAME_BUDGET_MAX_SAMPLES);
+				ImGui::EndDisabled();
+				// Sample sequence used for all random decisions along a path
+				if (ImGui::BeginCombo("Sampler", sampler_type_labels[g_renderer->settings.sampler_type], ImGuiComboFlags_None))
+				{
+					for (uint32_t i = 0; i < SAMPLER_TYPE_COUNT; ++i)
+					{
+						bool selected = i == g_renderer->settings.sampler_type;
+						if (ImGui::Selectable(sampler_type_labels[i], selected))
+						{
+							g_renderer->settings.sampler_type = i;
+							should_reset_accumulators = true;
+						}
+						if (selected)
+						{
+							ImGui::SetItemDefaultFocus();
+						}
+					}
+					ImGui::EndCombo();
+				}
+				ImGui::SetItemTooltip("Sobol: Every pixel walks its own Owen scrambled Sobol sequence, converges faster than random sampling.\n"
+					"Blue noise: All pixels share one Sobol sequence and are offset by a low-discrepancy pattern in screen space, "
+					"which spreads the remaining error as high frequency noise at the cost of slightly slower convergence per pixel.");
 				// Enable/disable cosine weighted diffuse reflections, uses uniform hemisphere sample if disabled
 				if (ImGui::Checkbox("Cosine weighted diffuse", (bool*)&g_renderer->settings.cosine_weighted_diffuse)) should_reset_accumulators = true;
+				// Enable/disable sampling the emissive triangles directly at every bounce, combined with the BSDF samples through MIS
+				if (ImGui::Checkbox("Next event estimation", (bool*)&g_renderer->settings.next_event_estimation)) should_reset_accumulators = true;
+				// Enable/disable russian roulette, which terminates paths with a low throughput after the minimum depth
+				if (ImGui::Checkbox("Russian roulette", (bool*)&g_renderer->settings.russian_roulette)) should_reset_accumulators = true;
+				ImGui::BeginDisabled(!g_renderer->settings.russian_roulette);
+				if (ImGui::SliderInt("Russian roulette min depth", (int32_t*)&g_renderer->settings.russian_roulette_min_depth, 0, 8)) should_reset_accumulators = true;
+				ImGui::EndDisabled();
+				// Adaptive sampling, stops tracing pixels whose relative error dropped below the threshold after the minimum amount of samples
+				if (ImGui::Checkbox("Adaptive sampling", (bool*)&g_renderer->settings.adaptive_sampling)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Only works when accumulating, pixels that have converged are skipped until the accumulator is reset.");
+				ImGui::BeginDisabled(!g_renderer->settings.adaptive_sampling);
+				if (ImGui::SliderInt("Adaptive sampling min samples", (int32_t*)&g_renderer->settings.adaptive_sampling_min_samples, 2, 256)) should_reset_accumulators = true;
+				if (ImGui::DragFloat("Adaptive sampling threshold", &g_renderer->settings.adaptive_sampling_threshold, 0.001f, 0.001f, 1.0f, "%.3f")) should_reset_accumulators = true;
+				ImGui::EndDisabled();
+				// Edge-avoiding a-trous denoiser, filters the accumulated color before tone mapping
+				if (ImGui::Checkbox("Denoise", (bool*)&g_renderer->settings.denoise)) should_reset_accumulators = true;
+				ImGui::SetItemTooltip("Only implemented for the CPU path tracer, and only used when no view mode is selected.");
+				ImGui::BeginDisabled(!g_renderer->settings.denoise);
+				if (ImGui::SliderInt("Denoise iterations", (int32_t*)&g_renderer->settings.denoise_iterations, 1, 8)) should_reset_accumulators = true;
+				if (ImGui::DragFloat("Denoise sigma color", &g_renderer->settings.denoise_sigma_color, 0.05f, 0.01f, 100.0f)) should_reset_accumulators = true;
+				if (ImGui::DragFloat("Denoise sigma albedo", &g_renderer->settings.denoise_sigma_albedo, 0.005f, 0.001f, 10.0f, "%.3f")) should_reset_accumulators = true;
+				if (ImGui::DragFloat("Denoise sigma normal", &g_renderer->settings.denoise_sigma_normal, 0.005f, 0.001f, 10.0f, "%.3f")) should_reset_accumulators = true;
+				if (ImGui::DragFloat("Denoise sigma depth", &g_renderer->settings.denoise_sigma_depth, 0.005f, 0.001f, 10.0f, "%.3f")) should_reset_accumulators = true;
+				ImGui::EndDisabled();
 				if (ImGui::DragFloat("HDR env strength", &g_renderer->settings.hdr_env_strength, 0.05f, 0.0f, 100.0f)) should_reset_accumulators = true;
 
 				ImGui::Unindent(10.0f);
@@ -1154,6 +1983,17 @@ namespace renderer
 		ImGui::End();
 	}
 
+	cpu_accumulation_t get_cpu_accumulation()
+	{
+		return cpu::render_pass::get_accumulation();
+	}
+
+	void reset_cpu_accumulation(uint32_t sample_offset)
+	{
+		g_renderer->settings.sample_offset = sample_offset;
+		reset_color_accumulator();
+	}
+
 	render_texture_handle_t create_render_texture(const render_texture_params_t& texture_params)
 	{
 		// TODO: Support different DXGI formats, figure out format based on texture_params
@@ -1236,9 +2076,29 @@ namespace renderer
 		render_texture.width = (uint32_t)dst_desc.Width;
 		render_texture.height = dst_desc.Height;
 		render_texture.depth = dst_desc.DepthOrArraySize;
+		if (texture_params.format == TEXTURE_FORMAT_RGBA32_FLOAT)
+		{
+			render_texture.cpu_data = ARENA_ALLOC_ARRAY(g_renderer->arena, uint8_t, src_total_bytes);
+			memcpy(render_texture.cpu_data, texture_params.ptr_data, src_total_bytes);
+		}
+		else
+		{
+			cpu::create_texture(render_texture.cpu_texture, texture_params.format,
+				texture_params.width, texture_params.height, texture_params.ptr_data);
+		}
 		ARENA_COPY_WSTR(g_renderer->arena, texture_params.debug_name, render_texture.debug_name);
 		d3d12::create_texture_2d_srv(render_texture.texture_buffer, render_texture.texture_srv, 0);
 
+		if (texture_params.env_alias_table)
+		{
+			// Kept around on the CPU as well for the CPU path tracer
+			uint32_t texel_count = render_texture.width * render_texture.height;
+			render_texture.env_alias_table = ARENA_ALLOC_ARRAY(g_renderer->arena, env_alias_entry_t, texel_count);
+			memcpy(render_texture.env_alias_table, texture_params.env_alias_table, sizeof(env_alias_entry_t) * texel_count);
+
+			create_env_alias_buffer_internal(render_texture);
+		}
+
 		render_texture_handle_t handle = slotmap::add(g_renderer->texture_slotmap, render_texture);
 		return handle;
 	}
@@ -1249,7 +2109,7 @@ namespace renderer
 		// Need to copy the string buffer since mesh_params.debug_name is temporary
 		ARENA_COPY_WSTR(g_renderer->arena, mesh_params.debug_name, mesh.debug_name);
 		mesh.triangle_count = mesh_params.index_count / 3;
-		mesh.triangles = ARENA_ALLOC_ARRAY(g_renderer->arena, triangle_t, mesh.triangle_count);
+		mesh.triangles = ARENA_ALLOC_ARRAY(g_renderer->mesh_arena, triangle_t, mesh.triangle_count);
 		for (uint32_t tri_idx = 0, i = 0; tri_idx < mesh.triangle_count; ++tri_idx, i += 3)
 		{
 			mesh.triangles[tri_idx].v0 = mesh_params.vertices[mesh_params.indices[i]];
@@ -1263,6 +2123,9 @@ namespace renderer
 			ASSERT_MSG(mesh.triangle_buffer, "Tried creating a render mesh but triangle buffer is null");
 			ASSERT_MSG(d3d12::is_valid_descriptor(mesh.triangle_srv), "Tried creating a render mesh but triangle buffer SRV is invalid");
 
+			create_mesh_bvh_internal(mesh);
+			ASSERT_MSG(mesh.bvh.data, "Tried creating a render mesh but bvh data is null");
+
 			if (g_renderer->settings.use_software_rt)
 			{
 				create_mesh_software_blas_buffer_internal(mesh);
@@ -1280,6 +2143,15 @@ namespace renderer
 		return handle;
 	}
 
+	static const cpu::texture_t* get_cpu_material_texture(render_texture_handle_t handle, const render_texture_t* default_texture)
+	{
+		const render_texture_t* render_texture = slotmap::find(g_renderer->texture_slotmap, handle);
+		if (!render_texture)
+			render_texture = default_texture;
+
+		return render_texture->cpu_texture.mip_count > 0 ? &render_texture->cpu_texture : nullptr;
+	}
+
 	void submit_render_mesh(render_mesh_handle_t render_mesh_handle, const glm::mat4& transform, const material_asset_t& material)
 	{
 		const render_mesh_t* mesh = slotmap::find(g_renderer->mesh_slotmap, render_mesh_handle);
@@ -1316,16 +2188,24 @@ namespace renderer
 
 		// Write instance to instance buffer
 		instance_data_t& instance_data = g_renderer->instance_data[g_renderer->instance_data_at];
-		instance_data.local_to_world = transform;
-		instance_data.world_to_local = glm::inverse(transform);
+		instance_data.local_to_world = make_affine_transform(transform);
 		instance_data.material = render_material;
 		instance_data.triangle_buffer_idx = mesh->triangle_srv.offset;
+		instance_data.light_offset = LIGHT_IDX_INVALID;
 
-		if (g_renderer->settings.use_software_rt)
+		g_renderer->instance_triangles[g_renderer->instance_data_at] = mesh->triangles;
+		g_renderer->instance_triangle_counts[g_renderer->instance_data_at] = mesh->triangle_count;
+
+		if (g_renderer->settings.use_software_rt || g_renderer->settings.use_cpu_pathtracing)
 		{
 			bvh_instance_t* tlas_instance_software = &g_renderer->tlas_instance_data_software[g_renderer->instance_data_at];
-			tlas_instance_software->world_to_local = instance_data.world_to_local;
+			// Instances that are not moved, rotated or scaled are common for static geometry, those skip both the inverse and the ray transform
+			tlas_instance_software->identity_transform = is_identity_transform(instance_data.local_to_world);
+			tlas_instance_software->world_to_local = tlas_instance_software->identity_transform ?
+				instance_data.local_to_world : affine_inverse(instance_data.local_to_world);
 			tlas_instance_software->bvh_index = mesh->blas_srv.offset;
+			tlas_instance_software->aabb_min = glm::vec3(FLT_MAX);
+			tlas_instance_software->aabb_max = glm::vec3(-FLT_MAX);
 
 			for (uint32_t i = 0; i < 8; ++i)
 			{
@@ -1334,11 +2214,22 @@ namespace renderer
 				as_util::grow_aabb(tlas_instance_software->aabb_min, tlas_instance_software->aabb_max, pos_world);
 			}
 		}
-		else
+
+		if (g_renderer->settings.use_cpu_pathtracing)
+		{
+			g_renderer->cpu.instance_bvhs[g_renderer->instance_data_at] = &mesh->bvh;
+
+			// Textures that cannot be sampled on the CPU are left null, which only leaves the material factors
+			cpu::material_textures_t& cpu_textures = g_renderer->cpu.instance_textures[g_renderer->instance_data_at];
+			cpu_textures.base_color = get_cpu_material_texture(material.base_color_texture.render_texture_handle, g_renderer->defaults.texture_base_color);
+			cpu_textures.metallic_roughness = get_cpu_material_texture(material.metallic_roughness_texture.render_texture_handle, g_renderer->defaults.texture_metallic_roughness);
+			cpu_textures.emissive = get_cpu_material_texture(material.emissive_texture.render_texture_handle, g_renderer->defaults.texture_emissive);
+		}
+
+		if (!g_renderer->settings.use_software_rt)
 		{
 			D3D12_RAYTRACING_INSTANCE_DESC& tlas_instance_hardware = g_renderer->tlas_instance_data_hardware[g_renderer->instance_data_at];
-			glm::mat4 temp = glm::transpose(transform);
-			memcpy(tlas_instance_hardware.Transform, &temp, sizeof(float) * 12);
+			memcpy(tlas_instance_hardware.Transform, &instance_data.local_to_world, sizeof(tlas_instance_hardware.Transform));
 			tlas_instance_hardware.InstanceID = g_renderer->instance_data_at;
 			tlas_instance_hardware.InstanceMask = 1;
 			tlas_instance_hardware.InstanceContributionToHitGroupIndex = 0;
@@ -6,6 +6,7 @@
 struct camera_t;
 struct vertex_t;
 struct material_asset_t;
+struct env_alias_entry_t;
 
 namespace renderer
 {
@@ -16,6 +17,9 @@ namespace renderer
 		uint32_t render_height;
 		uint32_t backbuffer_count;
 		bool vsync;
+		// Batch mode renders with the CPU path tracer and accumulates, so that the result can be read back with get_cpu_accumulation
+		bool batch;
+		bool denoise;
 	};
 	
 	void init(const init_params_t& init_params);
@@ -30,6 +34,23 @@ namespace renderer
 
 	void render_ui();
 
+	struct cpu_accumulation_t
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t sample_count;
+		uint64_t ray_count;
+		// Linear HDR color of every pixel, row by row starting at the top row, only valid until the next call to render
+		const glm::vec4* pixels;
+		// Same layout as the pixels, the x component is the number of samples the pixel has accumulated, which differs between pixels with adaptive sampling
+		const glm::vec4* pixel_variance;
+	};
+	// Waits for the CPU pass in flight and returns everything the CPU path tracer has accumulated since the last accumulator reset,
+	// the denoised color is returned if the denoiser is enabled
+	cpu_accumulation_t get_cpu_accumulation();
+	// Restarts the CPU accumulation with the sample index of every pixel starting at the sample offset instead of zero
+	void reset_cpu_accumulation(uint32_t sample_offset);
+
 	struct render_texture_params_t
 	{
 		uint32_t width;
@@ -37,6 +58,8 @@ namespace renderer
 		uint32_t bits_per_pixel;
 		TEXTURE_FORMAT format;
 		uint8_t* ptr_data;
+		// Optional, one entry per texel for importance sampling equirectangular environment maps, see env_builder_t
+		const env_alias_entry_t* env_alias_table;
 
 		wstring_t debug_name;
 	};
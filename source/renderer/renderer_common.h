@@ -8,7 +8,14 @@
 #include "shaders/shared.hlsl.h"
 
 #include "renderer/renderer_fwd.h"
+#include "renderer/bvh/bvh_builder.h"
 #include "renderer/bvh/tlas_builder.h"
+#include "renderer/light/light_builder.h"
+#include "renderer/cpu/cpu_pathtracer.h"
+#include "renderer/cpu/cpu_accelstruct.h"
+#include "renderer/cpu/cpu_render_pass.h"
+#include "renderer/cpu/cpu_texture.h"
+#include "renderer/cpu/cpu_scan.h"
 
 #include "renderer/d3d12/d3d12_descriptor.h"
 #include "renderer/d3d12/d3d12_frame.h"
@@ -20,8 +27,18 @@ struct bvh_instance_t;
 namespace renderer
 {
 
-	inline constexpr uint32_t MAX_INSTANCES = 65536;
 	inline constexpr uint32_t GPU_PROFILER_MAX_HISTORY = 512;
+	// One flag per pixel of a 2048x2048 render target, half of them active, roughly what a bounce queue of the wavefront path tracer gets compacted from
+	inline constexpr uint32_t SCAN_BENCHMARK_ELEMENT_COUNT = 2048 * 2048;
+	inline constexpr float SCAN_BENCHMARK_ACTIVE_FRACTION = 0.5f;
+	inline constexpr uint32_t SCAN_BENCHMARK_ITERATION_COUNT = 16;
+	// Limits how much the frame time budget can change the work of a frame from one frame to the next
+	inline constexpr float FRAME_BUDGET_MIN_CORRECTION = 0.5f;
+	inline constexpr float FRAME_BUDGET_MAX_CORRECTION = 2.0f;
+	// The frame time budget never takes more samples per frame than this, the UI slider is limited to it as well
+	inline constexpr uint32_t FRAME_BUDGET_MAX_SAMPLES = 16;
+	// Number of allocation call sites listed in the CPU memory UI and the log dump
+	inline constexpr uint32_t ARENA_UI_CALL_SITE_COUNT = 32;
 
 	static const char* render_view_mode_labels[RENDER_VIEW_MODE_COUNT] =
 	{
@@ -29,10 +46,17 @@ namespace renderer
 		"Geometry Instance", "Geometry Primitive", "Geometry Barycentrics", "Geometry Normal", "Geometry TexCoord",
 		"Material Base Color", "Material Normal", "Material Metallic Roughness", "Material Emissive",
 		"World Normal",
-		"RenderTarget Depth"
+		"RenderTarget Depth",
+		"Traversal Cost"
 	};
 	static_assert(RENDER_VIEW_MODE_COUNT == ARRAY_SIZE(render_view_mode_labels));
 
+	static const char* sampler_type_labels[SAMPLER_TYPE_COUNT] =
+	{
+		"Random", "Sobol (Owen scrambled)", "Sobol (Blue noise)"
+	};
+	static_assert(SAMPLER_TYPE_COUNT == ARRAY_SIZE(sampler_type_labels));
+
 	struct render_texture_t
 	{
 		ID3D12Resource* texture_buffer;
@@ -42,6 +66,16 @@ namespace renderer
 		uint32_t height;
 		uint32_t depth;
 
+		// Only kept around for RGBA32 float textures, used by the CPU path tracer to sample the HDR environment
+		uint8_t* cpu_data;
+		// Mipmapped copy for the CPU path tracer to sample material textures from, the texels are paged in by the texture cache, empty for RGBA32 float textures
+		cpu::texture_t cpu_texture;
+
+		// Only for HDR environment maps, alias table used to importance sample the environment
+		env_alias_entry_t* env_alias_table;
+		ID3D12Resource* env_alias_buffer;
+		d3d12::descriptor_allocation_t env_alias_srv;
+
 		wstring_t debug_name;
 	};
 
@@ -52,6 +86,10 @@ namespace renderer
 		ID3D12Resource* blas_buffer;
 		d3d12::descriptor_allocation_t blas_srv;
 
+		// The BVH is always kept around on the CPU, used for software raytracing uploads and the CPU path tracer
+		bvh_t bvh;
+		uint64_t bvh_byte_size;
+
 		triangle_t* triangles;
 		uint32_t triangle_count;
 		ID3D12Resource* triangle_buffer;
@@ -68,8 +106,19 @@ namespace renderer
 		ID3D12Resource* scene_tlas_resource;
 		d3d12::descriptor_allocation_t scene_tlas_srv;
 
+		ID3D12Resource* scene_lights_resource;
+		d3d12::descriptor_allocation_t scene_lights_srv;
+
+		// Persistently mapped upload buffer for the CPU path tracer energy output
+		ID3D12Resource* cpu_energy_upload_resource;
+		void* cpu_energy_upload_ptr;
+
 		gpu_timer_query_t* gpu_timer_queries;
 		uint32_t gpu_timer_queries_at;
+
+		// Traversal counters of the GPU path tracers, copied at the end of the frame and read once the frame context comes around again
+		ID3D12Resource* traversal_stats_readback_resource;
+		bool traversal_stats_pending;
 	};
 	
 	struct gpu_profiler_t
@@ -89,6 +138,8 @@ namespace renderer
 	struct renderer_inst_t
 	{
 		memory_arena_t arena;
+		// Triangles and BVHs of the render meshes, backed by huge pages since the CPU path tracer reads from them all over during traversal
+		memory_arena_t mesh_arena;
 
 		uint32_t render_width;
 		uint32_t render_height;
@@ -100,7 +151,7 @@ namespace renderer
 
 		bool change_raytracing_mode;
 
-		// Only used for software raytracing
+		// Only used for software raytracing and CPU path tracing
 		bvh_instance_t* tlas_instance_data_software;
 		tlas_t scene_tlas;
 
@@ -115,10 +166,18 @@ namespace renderer
 		ID3D12Resource* instance_buffer;
 		d3d12::descriptor_allocation_t instance_buffer_srv;
 
+		// Per-instance triangles, used to build the scene lights and by the CPU path tracer
+		const triangle_t** instance_triangles;
+		uint32_t* instance_triangle_counts;
+
+		// Emissive triangles of all submitted instances, rebuilt every frame
+		light_list_t scene_lights;
+
 		// Scene TLAS resource
 		frame_context_t* frame_ctx;
 
 		camera_t scene_camera;
+		view_t scene_view;
 		render_texture_t* scene_hdr_env_texture;
 
 		render_settings_t settings;
@@ -145,37 +204,77 @@ namespace renderer
 			ID3D12PipelineState* pso_generate;
 			ID3D12PipelineState* pso_extend;
 			ID3D12PipelineState* pso_shade;
-			//ID3D12PipelineState* pso_connect;
+			ID3D12PipelineState* pso_connect;
+			// Only the stages that trace rays need a software raytracing variant
+			ID3D12PipelineState* pso_extend_software;
+			ID3D12PipelineState* pso_connect_software;
 			
 			ID3D12Resource* buffer_indirect_args;
 			ID3D12Resource* buffer_ray_counts;
+			// Extension rays ping-pong between the two ray buffers, the shade stage reads the rays of one recursion depth and writes the next ones to the other buffer
 			ID3D12Resource* buffer_rays;
-			// RGBA16 float, Alpha channel is unused
+			ID3D12Resource* buffer_rays_two;
+			ID3D12Resource* buffer_shadow_rays;
+			// RGBA16 float, Alpha channel is the number of paths traced for the pixel this frame, zero for pixels skipped by adaptive sampling
 			ID3D12Resource* texture_energy;
-			// RGBA16 float, Alpha channel is unused
+			// RGBA16 float, Alpha channel stores the pdf of the last BSDF sample for MIS
 			ID3D12Resource* texture_throughput;
 			ID3D12Resource* buffer_pixel_coords;
 			ID3D12Resource* buffer_pixel_coords_two;
 			ID3D12Resource* buffer_hit_results;
+			// One wavefront_path_state_t per pixel, only used with path regeneration
+			ID3D12Resource* buffer_path_states;
+			// 64-bit traversal counters summed over all samples of the frame, shared with the megakernel
+			ID3D12Resource* buffer_traversal_stats;
+			// Traversal cost of every ray traced by the extend stage, only written for the traversal cost view mode
+			ID3D12Resource* buffer_traversal_costs;
 
 			d3d12::descriptor_allocation_t buffer_indirect_args_srv_uav;
 			d3d12::descriptor_allocation_t buffer_ray_counts_srv_uav;
 			d3d12::descriptor_allocation_t buffer_rays_srv_uav;
+			d3d12::descriptor_allocation_t buffer_rays_two_srv_uav;
+			d3d12::descriptor_allocation_t buffer_shadow_rays_srv_uav;
 			d3d12::descriptor_allocation_t texture_energy_srv_uav;
 			d3d12::descriptor_allocation_t texture_throughput_srv_uav;
 			d3d12::descriptor_allocation_t buffer_pixel_coords_srv_uav;
 			d3d12::descriptor_allocation_t buffer_pixel_coords_two_srv_uav;
 			d3d12::descriptor_allocation_t buffer_hit_results_srv_uav;
+			d3d12::descriptor_allocation_t buffer_path_states_srv_uav;
+			d3d12::descriptor_allocation_t buffer_traversal_stats_srv_uav;
+			d3d12::descriptor_allocation_t buffer_traversal_costs_srv_uav;
 		} wavefront;
 
+		struct cpu_t
+		{
+			// Per-instance data for the CPU path tracer, indexed the same way as the instance data
+			const bvh_t** instance_bvhs;
+			cpu::material_textures_t* instance_textures;
+
+			// First tile of the next partial pass, so that partial passes keep sweeping over the render target
+			uint32_t tile_cursor;
+
+			// RGBA32 float, the CPU path tracer energy gets copied to this texture every frame
+			ID3D12Resource* texture_energy;
+			d3d12::descriptor_allocation_t texture_energy_srv;
+
+			// Result of the last compaction benchmark run from the UI, the element count is zero if it never ran
+			cpu::scan::benchmark_result_t scan_benchmark;
+		} cpu;
+
 		ID3D12RootSignature* root_signature;
 		ID3D12PipelineState* pso_cs_pathtracer_software;
 		ID3D12PipelineState* pso_cs_pathtracer_hardware;
 		ID3D12PipelineState* pso_cs_post_process;
 
+		// Traversal counters of the last GPU frame that was read back, the counters stay zero for hardware raytracing
+		cpu::traversal_totals_t gpu_traversal_stats;
+
 		ID3D12Resource* rt_color_accum;
 		d3d12::descriptor_allocation_t rt_color_accum_srv_uav;
 		uint32_t accum_count;
+		// RGBA32 float, x: per-pixel sample count, y: luminance mean, z: luminance M2 (Welford), used by adaptive sampling
+		ID3D12Resource* rt_pixel_variance;
+		d3d12::descriptor_allocation_t rt_pixel_variance_srv_uav;
 		ID3D12Resource* rt_final_color;
 		d3d12::descriptor_allocation_t rt_final_color_uav;
 
@@ -183,6 +282,17 @@ namespace renderer
 		d3d12::frame_resource_t cb_view;
 
 		gpu_profiler_t gpu_profiler;
+
+		// Feedback controller state of the frame time budget, the work of a frame is the samples per frame for the GPU path tracers and the tiles per pass for the CPU path tracer
+		struct frame_budget_t
+		{
+			timer_ticks_t prev_render_ticks;
+			bool has_prev_render;
+			// Time between the last two renders, zero before the second render
+			float frame_time_ms;
+			float gpu_samples_per_frame;
+			float cpu_tiles_per_frame;
+		} frame_budget;
 	};
 	extern renderer_inst_t* g_renderer;
 	
@@ -9,6 +9,19 @@
 DECLARE_HANDLE_TYPE(render_texture_handle_t);
 DECLARE_HANDLE_TYPE(render_mesh_handle_t);
 
+/*
+	Renderer constants, shared by the D3D12 and the headless renderer
+*/
+
+namespace renderer
+{
+
+	inline constexpr uint32_t MAX_INSTANCES = 65536;
+	// Frame arenas keep their memory committed between frames, and give back this fraction of what they did not need every frame
+	inline constexpr float FRAME_ARENA_DECAY_FRACTION = 0.05f;
+
+}
+
 /*
 	Texture format
 */
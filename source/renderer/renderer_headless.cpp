@@ -0,0 +1,481 @@
+#include "renderer.h"
+#include "renderer/shaders/shared.hlsl.h"
+
+#include "bvh/bvh_builder.h"
+#include "bvh/tlas_builder.h"
+#include "bvh/as_util.h"
+#include "light/light_builder.h"
+
+#include "cpu/cpu_pathtracer.h"
+#include "cpu/cpu_render_pass.h"
+#include "cpu/cpu_tile_scheduler.h"
+#include "cpu/cpu_texture.h"
+
+#include "core/assertion.h"
+#include "core/memory/memory_arena.h"
+#include "core/containers/slotmap.h"
+#include "core/camera/camera.h"
+#include "core/logger.h"
+#include "core/random.h"
+#include "core/assets/asset_types.h"
+
+// Renderer without a GPU, for platforms without D3D12 where only batch rendering and distributed workers are supported
+// Implements the same interface as renderer.cpp with only the CPU path tracer, the passes run through cpu::render_pass the same way they do there
+namespace renderer
+{
+
+	struct headless_texture_t
+	{
+		uint32_t width;
+		uint32_t height;
+
+		// Only kept around for RGBA32 float textures, used to sample the HDR environment
+		uint8_t* cpu_data;
+		// Mipmapped copy to sample material textures from, the texels are paged in by the texture cache, empty for RGBA32 float textures
+		cpu::texture_t cpu_texture;
+		// Only for HDR environment maps, alias table used to importance sample the environment
+		env_alias_entry_t* env_alias_table;
+
+		wstring_t debug_name;
+	};
+
+	struct headless_mesh_t
+	{
+		glm::vec3 blas_min;
+		glm::vec3 blas_max;
+
+		bvh_t bvh;
+		uint64_t bvh_byte_size;
+
+		triangle_t* triangles;
+		uint32_t triangle_count;
+
+		wstring_t debug_name;
+	};
+
+	struct headless_inst_t
+	{
+		memory_arena_t arena;
+		// Triangles and BVHs of the render meshes, backed by huge pages since the CPU path tracer reads from them all over during traversal
+		memory_arena_t mesh_arena;
+		// The CPU pass started in a frame reads from the frame arena until it is waited on in the next frame, so the frames alternate between arenas
+		memory_arena_t* frame_arenas;
+		uint32_t frame_arena_count;
+
+		uint32_t render_width;
+		uint32_t render_height;
+
+		slotmap_t<render_texture_handle_t, headless_texture_t> texture_slotmap;
+		slotmap_t<render_mesh_handle_t, headless_mesh_t> mesh_slotmap;
+
+		uint32_t instance_data_capacity;
+		uint32_t instance_data_at;
+		instance_data_t* instance_data;
+		bvh_instance_t* tlas_instance_data;
+		const triangle_t** instance_triangles;
+		uint32_t* instance_triangle_counts;
+		const bvh_t** instance_bvhs;
+		cpu::material_textures_t* instance_textures;
+
+		tlas_t scene_tlas;
+		light_list_t scene_lights;
+
+		camera_t scene_camera;
+		view_t scene_view;
+		headless_texture_t* scene_hdr_env_texture;
+
+		render_settings_t settings;
+		uint64_t frame_index;
+		uint32_t accum_count;
+
+		struct defaults_t
+		{
+			headless_texture_t* texture_base_color;
+			headless_texture_t* texture_metallic_roughness;
+			headless_texture_t* texture_emissive;
+		} defaults;
+	} static *g_headless = nullptr;
+
+	static memory_arena_t& get_frame_arena()
+	{
+		return g_headless->frame_arenas[g_headless->frame_index % g_headless->frame_arena_count];
+	}
+
+	static render_settings_t get_default_render_settings()
+	{
+		render_settings_t defaults = {};
+		defaults.use_cpu_pathtracing = true;
+		defaults.texture_lod_ray_cones = true;
+		defaults.render_view_mode = RENDER_VIEW_MODE_NONE;
+		defaults.max_bounces = 3;
+		defaults.accumulate = true;
+		defaults.sampler_type = SAMPLER_TYPE_SOBOL;
+		defaults.cosine_weighted_diffuse = true;
+		defaults.next_event_estimation = true;
+		defaults.russian_roulette = true;
+		defaults.russian_roulette_min_depth = 2;
+		defaults.adaptive_sampling_min_samples = 16;
+		defaults.adaptive_sampling_threshold = 0.01f;
+		defaults.denoise_iterations = 5;
+		defaults.denoise_sigma_color = 4.0f;
+		defaults.denoise_sigma_albedo = 0.1f;
+		defaults.denoise_sigma_normal = 0.5f;
+		defaults.denoise_sigma_depth = 0.1f;
+
+		defaults.hdr_env_strength = 1.0f;
+		defaults.traversal_cost_heatmap_max = 256;
+
+		return defaults;
+	}
+
+	static void reset_color_accumulator()
+	{
+		cpu::render_pass::reset_accumulation();
+		g_headless->accum_count = 0;
+	}
+
+	static void create_mesh_bvh_internal(headless_mesh_t& out_mesh)
+	{
+		ARENA_SCRATCH_SCOPE()
+		{
+			bvh_builder_t::build_args_t bvh_build_args = {};
+			bvh_build_args.triangles = out_mesh.triangles;
+			bvh_build_args.triangle_count = out_mesh.triangle_count;
+			bvh_build_args.options.interval_count = 8;
+			bvh_build_args.options.subdivide_single_prim = false;
+			bvh_build_args.options.emit_triangle_soa = true;
+
+			bvh_builder_t bvh_builder = {};
+			bvh_builder.build(arena_scratch, bvh_build_args);
+			bvh_builder.extract(g_headless->mesh_arena, out_mesh.bvh, out_mesh.bvh_byte_size);
+
+			// Keep the BVH local bounds around for creating BVH instances later when building the TLAS
+			bvh_node_t* bvh_root_node = (bvh_node_t*)out_mesh.bvh.data;
+			out_mesh.blas_min = bvh_root_node->aabb_min;
+			out_mesh.blas_max = bvh_root_node->aabb_max;
+		}
+	}
+
+	void init(const init_params_t& init_params)
+	{
+		LOG_INFO("Renderer", "Init (headless, CPU path tracer only)");
+
+		g_headless = ARENA_BOOTSTRAP(headless_inst_t, 0);
+		g_headless->arena.name = "Renderer";
+		g_headless->mesh_arena.name = "Mesh";
+		g_headless->mesh_arena.commit_granularity = MB(2ull);
+		g_headless->mesh_arena.huge_pages = true;
+
+		g_headless->render_width = init_params.render_width;
+		g_headless->render_height = init_params.render_height;
+
+		slotmap::init(g_headless->texture_slotmap, g_headless->arena, 65536);
+		slotmap::init(g_headless->mesh_slotmap, g_headless->arena, 16384);
+
+		g_headless->frame_arena_count = MAX(init_params.backbuffer_count, 2u);
+		g_headless->frame_arenas = ARENA_ALLOC_ARRAY_ZERO(g_headless->arena, memory_arena_t, g_headless->frame_arena_count);
+		for (uint32_t i = 0; i < g_headless->frame_arena_count; ++i)
+		{
+			g_headless->frame_arenas[i].name = "Frame";
+			g_headless->frame_arenas[i].decommit_threshold = UINT64_MAX;
+		}
+
+		// Needs to exist before any render texture is created, since every texture adds its tiles to it
+		cpu::render_pass::init(g_headless->arena, g_headless->render_width, g_headless->render_height);
+
+		// Create defaults, the normal texture is left out since the CPU path tracer does not sample normal maps
+		{
+			uint32_t texture_data = (255 << 24) | (255 << 16) | (255 << 8) | (255 << 0);
+			render_texture_params_t params = {};
+			params.width = 1;
+			params.height = 1;
+			params.bits_per_pixel = 32;
+			params.format = TEXTURE_FORMAT_RGBA8_SRGB;
+			params.ptr_data = (uint8_t*)(&texture_data);
+			params.debug_name = WSTRING_LITERAL(L"Default Texture Base Color/Emissive");
+			g_headless->defaults.texture_base_color = slotmap::find(g_headless->texture_slotmap, create_render_texture(params));
+
+			uint16_t texture_data_16 = (255 << 8) | (255 << 0);
+			params.bits_per_pixel = 16;
+			params.format = TEXTURE_FORMAT_RG8;
+			params.ptr_data = (uint8_t*)(&texture_data_16);
+			params.debug_name = WSTRING_LITERAL(L"Default Texture Metallic Roughness");
+			g_headless->defaults.texture_metallic_roughness = slotmap::find(g_headless->texture_slotmap, create_render_texture(params));
+
+			g_headless->defaults.texture_emissive = g_headless->defaults.texture_base_color;
+		}
+
+		g_headless->instance_data_capacity = MAX_INSTANCES;
+		g_headless->instance_data = ARENA_ALLOC_ARRAY_ZERO(g_headless->arena, instance_data_t, g_headless->instance_data_capacity);
+
+		// There is nothing to display the result on, so the headless renderer always accumulates like batch mode does
+		g_headless->settings = get_default_render_settings();
+		g_headless->settings.denoise = init_params.denoise;
+	}
+
+	void exit()
+	{
+		// Stop the CPU path tracer worker threads before anything they read from gets released
+		cpu::render_pass::exit();
+
+		for (uint32_t i = 0; i < g_headless->frame_arena_count; ++i)
+		{
+			ARENA_RELEASE(g_headless->frame_arenas[i]);
+		}
+
+		slotmap::destroy(g_headless->texture_slotmap);
+		slotmap::destroy(g_headless->mesh_slotmap);
+		ARENA_RELEASE(g_headless->mesh_arena);
+		ARENA_RELEASE(g_headless->arena);
+		g_headless = nullptr;
+	}
+
+	void begin_frame()
+	{
+		// Clear arena for the current frame, the memory stays committed and only decays when the frames need less of it
+		memory_arena_t& frame_arena = get_frame_arena();
+		memory_arena::decay(frame_arena, FRAME_ARENA_DECAY_FRACTION);
+		ARENA_CLEAR(frame_arena);
+		memory_arena::decay(memory_arena::get_scratch(), FRAME_ARENA_DECAY_FRACTION);
+
+		g_headless->tlas_instance_data = ARENA_ALLOC_ARRAY_ZERO(frame_arena, bvh_instance_t, g_headless->instance_data_capacity);
+		g_headless->instance_triangles = ARENA_ALLOC_ARRAY_ZERO(frame_arena, const triangle_t*, g_headless->instance_data_capacity);
+		g_headless->instance_triangle_counts = ARENA_ALLOC_ARRAY_ZERO(frame_arena, uint32_t, g_headless->instance_data_capacity);
+		g_headless->instance_bvhs = ARENA_ALLOC_ARRAY_ZERO(frame_arena, const bvh_t*, g_headless->instance_data_capacity);
+		g_headless->instance_textures = ARENA_ALLOC_ARRAY_ZERO(frame_arena, cpu::material_textures_t, g_headless->instance_data_capacity);
+	}
+
+	void end_frame()
+	{
+		g_headless->frame_index++;
+	}
+
+	void begin_scene(const camera_t& scene_camera, render_texture_handle_t env_render_texture_handle)
+	{
+		if (g_headless->scene_camera.view_matrix != scene_camera.view_matrix)
+		{
+			reset_color_accumulator();
+		}
+
+		g_headless->scene_camera = scene_camera;
+		g_headless->scene_hdr_env_texture = slotmap::find(g_headless->texture_slotmap, env_render_texture_handle);
+		if (!g_headless->scene_hdr_env_texture)
+		{
+			g_headless->scene_hdr_env_texture = g_headless->defaults.texture_base_color;
+		}
+
+		float near_plane = 0.01f;
+		float far_plane = 1000.0f;
+		glm::mat4 proj_mat = glm::perspectiveFovLH_ZO(glm::radians(g_headless->scene_camera.vfov_deg),
+			(float)g_headless->render_width, (float)g_headless->render_height, near_plane, far_plane);
+
+		view_t& view = g_headless->scene_view;
+		view.world_to_view = g_headless->scene_camera.view_matrix;
+		view.view_to_world = glm::inverse(g_headless->scene_camera.view_matrix);
+		view.view_to_clip = proj_mat;
+		view.clip_to_view = glm::inverse(proj_mat);
+		view.render_dim.x = (float)g_headless->render_width;
+		view.render_dim.y = (float)g_headless->render_height;
+		view.near_plane = near_plane;
+		view.far_plane = far_plane;
+	}
+
+	void render()
+	{
+		memory_arena_t& frame_arena = get_frame_arena();
+
+		if (g_headless->settings.accumulate || g_headless->accum_count == 0)
+		{
+			g_headless->accum_count++;
+		}
+
+		// Both are extracted into the frame arena, since the CPU pass reads from them until it is waited on next frame
+		{
+			ARENA_SCRATCH_SCOPE()
+			{
+				tlas_builder_t tlas_builder = {};
+				tlas_builder.build(arena_scratch, g_headless->tlas_instance_data, g_headless->instance_data_at);
+				uint64_t tlas_byte_size = 0;
+				tlas_builder.extract(frame_arena, g_headless->scene_tlas, tlas_byte_size);
+			}
+		}
+
+		{
+			ARENA_SCRATCH_SCOPE()
+			{
+				light_builder_t::build_args_t light_build_args = {};
+				light_build_args.instances = g_headless->instance_data;
+				light_build_args.instance_triangles = g_headless->instance_triangles;
+				light_build_args.instance_triangle_counts = g_headless->instance_triangle_counts;
+				light_build_args.instance_count = g_headless->instance_data_at;
+
+				light_builder_t light_builder = {};
+				light_builder.build(arena_scratch, light_build_args);
+				uint64_t lights_byte_size = 0;
+				light_builder.extract(frame_arena, g_headless->scene_lights, lights_byte_size);
+			}
+		}
+
+		// There is nothing to display the energy of the previous pass on, it only gets accumulated
+		// There is no frame time budget without a window to present to either, so every pass covers the entire render target
+		cpu::render_pass::wait();
+
+		// Snapshot everything the next CPU pass reads, since the instance data gets rewritten next frame while the pass is still in flight
+		cpu::render_pass::pass_params_t cpu_pass = {};
+		cpu_pass.tlas = g_headless->scene_tlas;
+		cpu_pass.settings = g_headless->settings;
+		cpu_pass.view = g_headless->scene_view;
+		cpu_pass.frame_seed = rng::rand_uint32();
+		cpu_pass.sample_count = g_headless->accum_count;
+		cpu_pass.first_tile = 0;
+		cpu_pass.tile_count = cpu::tile_scheduler::get_tile_count();
+
+		instance_data_t* cpu_instances = ARENA_ALLOC_ARRAY(frame_arena, instance_data_t, g_headless->instance_data_at);
+		memcpy(cpu_instances, g_headless->instance_data, sizeof(instance_data_t) * g_headless->instance_data_at);
+
+		cpu_pass.scene.instance_count = g_headless->instance_data_at;
+		cpu_pass.scene.instances = cpu_instances;
+		cpu_pass.scene.instance_bvhs = g_headless->instance_bvhs;
+		cpu_pass.scene.instance_textures = g_headless->instance_textures;
+		cpu_pass.scene.instance_triangles = g_headless->instance_triangles;
+		cpu_pass.scene.light_count = g_headless->scene_lights.light_count;
+		cpu_pass.scene.lights = g_headless->scene_lights.lights;
+
+		if (g_headless->scene_hdr_env_texture->cpu_data)
+		{
+			cpu_pass.scene.hdr_env_pixels = (const glm::vec4*)g_headless->scene_hdr_env_texture->cpu_data;
+			cpu_pass.scene.hdr_env_width = g_headless->scene_hdr_env_texture->width;
+			cpu_pass.scene.hdr_env_height = g_headless->scene_hdr_env_texture->height;
+			cpu_pass.scene.hdr_env_alias_table = g_headless->scene_hdr_env_texture->env_alias_table;
+		}
+
+		cpu::render_pass::begin(cpu_pass);
+	}
+
+	void end_scene()
+	{
+		g_headless->instance_data_at = 0;
+	}
+
+	void render_ui()
+	{
+	}
+
+	cpu_accumulation_t get_cpu_accumulation()
+	{
+		return cpu::render_pass::get_accumulation();
+	}
+
+	void reset_cpu_accumulation(uint32_t sample_offset)
+	{
+		g_headless->settings.sample_offset = sample_offset;
+		reset_color_accumulator();
+	}
+
+	render_texture_handle_t create_render_texture(const render_texture_params_t& texture_params)
+	{
+		headless_texture_t texture = {};
+		texture.width = texture_params.width;
+		texture.height = texture_params.height;
+
+		uint64_t src_total_bytes = ((uint64_t)texture_params.width * texture_params.height * texture_params.bits_per_pixel) / 8;
+		if (texture_params.format == TEXTURE_FORMAT_RGBA32_FLOAT)
+		{
+			texture.cpu_data = ARENA_ALLOC_ARRAY(g_headless->arena, uint8_t, src_total_bytes);
+			memcpy(texture.cpu_data, texture_params.ptr_data, src_total_bytes);
+		}
+		else
+		{
+			cpu::create_texture(texture.cpu_texture, texture_params.format,
+				texture_params.width, texture_params.height, texture_params.ptr_data);
+		}
+		ARENA_COPY_WSTR(g_headless->arena, texture_params.debug_name, texture.debug_name);
+
+		if (texture_params.env_alias_table)
+		{
+			uint32_t texel_count = texture.width * texture.height;
+			texture.env_alias_table = ARENA_ALLOC_ARRAY(g_headless->arena, env_alias_entry_t, texel_count);
+			memcpy(texture.env_alias_table, texture_params.env_alias_table, sizeof(env_alias_entry_t) * texel_count);
+		}
+
+		return slotmap::add(g_headless->texture_slotmap, texture);
+	}
+
+	render_mesh_handle_t create_render_mesh(const render_mesh_params_t& mesh_params)
+	{
+		headless_mesh_t mesh = {};
+		// Need to copy the string buffer since mesh_params.debug_name is temporary
+		ARENA_COPY_WSTR(g_headless->arena, mesh_params.debug_name, mesh.debug_name);
+		mesh.triangle_count = mesh_params.index_count / 3;
+		mesh.triangles = ARENA_ALLOC_ARRAY(g_headless->mesh_arena, triangle_t, mesh.triangle_count);
+		for (uint32_t tri_idx = 0, i = 0; tri_idx < mesh.triangle_count; ++tri_idx, i += 3)
+		{
+			mesh.triangles[tri_idx].v0 = mesh_params.vertices[mesh_params.indices[i]];
+			mesh.triangles[tri_idx].v1 = mesh_params.vertices[mesh_params.indices[i + 1]];
+			mesh.triangles[tri_idx].v2 = mesh_params.vertices[mesh_params.indices[i + 2]];
+		}
+
+		create_mesh_bvh_internal(mesh);
+		ASSERT_MSG(mesh.bvh.data, "Tried creating a render mesh but bvh data is null");
+
+		return slotmap::add(g_headless->mesh_slotmap, mesh);
+	}
+
+	static const cpu::texture_t* get_cpu_material_texture(render_texture_handle_t handle, const headless_texture_t* default_texture)
+	{
+		const headless_texture_t* texture = slotmap::find(g_headless->texture_slotmap, handle);
+		if (!texture)
+			texture = default_texture;
+
+		return texture->cpu_texture.mip_count > 0 ? &texture->cpu_texture : nullptr;
+	}
+
+	void submit_render_mesh(render_mesh_handle_t render_mesh_handle, const glm::mat4& transform, const material_asset_t& material)
+	{
+		const headless_mesh_t* mesh = slotmap::find(g_headless->mesh_slotmap, render_mesh_handle);
+
+		ASSERT_MSG(mesh, "Mesh with render mesh handle { index: %u, version: %u } was not valid", render_mesh_handle.index, render_mesh_handle.version);
+		ASSERT_MSG(g_headless->instance_data_at < g_headless->instance_data_capacity, "Exceeded capacity of instances");
+
+		// The texture indices are bindless descriptor indices that only the GPU path tracers use
+		material_t render_material = {};
+		render_material.base_color_factor = glm::vec3(material.base_color_factor);
+		render_material.metallic_factor = material.metallic_factor;
+		render_material.roughness_factor = material.roughness_factor;
+		render_material.emissive_factor = material.emissive_factor;
+		render_material.emissive_strength = material.emissive_strength;
+
+		instance_data_t& instance_data = g_headless->instance_data[g_headless->instance_data_at];
+		instance_data.local_to_world = make_affine_transform(transform);
+		instance_data.material = render_material;
+		instance_data.light_offset = LIGHT_IDX_INVALID;
+
+		g_headless->instance_triangles[g_headless->instance_data_at] = mesh->triangles;
+		g_headless->instance_triangle_counts[g_headless->instance_data_at] = mesh->triangle_count;
+
+		bvh_instance_t* tlas_instance = &g_headless->tlas_instance_data[g_headless->instance_data_at];
+		tlas_instance->identity_transform = is_identity_transform(instance_data.local_to_world);
+		tlas_instance->world_to_local = tlas_instance->identity_transform ?
+			instance_data.local_to_world : affine_inverse(instance_data.local_to_world);
+		tlas_instance->aabb_min = glm::vec3(FLT_MAX);
+		tlas_instance->aabb_max = glm::vec3(-FLT_MAX);
+
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			glm::vec3 pos_world = transform *
+				glm::vec4(i & 1 ? mesh->blas_max.x : mesh->blas_min.x, i & 2 ? mesh->blas_max.y : mesh->blas_min.y, i & 4 ? mesh->blas_max.z : mesh->blas_min.z, 1.0f);
+			as_util::grow_aabb(tlas_instance->aabb_min, tlas_instance->aabb_max, pos_world);
+		}
+
+		g_headless->instance_bvhs[g_headless->instance_data_at] = &mesh->bvh;
+
+		// Textures that cannot be sampled on the CPU are left null, which only leaves the material factors
+		cpu::material_textures_t& cpu_textures = g_headless->instance_textures[g_headless->instance_data_at];
+		cpu_textures.base_color = get_cpu_material_texture(material.base_color_texture.render_texture_handle, g_headless->defaults.texture_base_color);
+		cpu_textures.metallic_roughness = get_cpu_material_texture(material.metallic_roughness_texture.render_texture_handle, g_headless->defaults.texture_metallic_roughness);
+		cpu_textures.emissive = get_cpu_material_texture(material.emissive_texture.render_texture_handle, g_headless->defaults.texture_emissive);
+
+		++g_headless->instance_data_at;
+	}
+
+}
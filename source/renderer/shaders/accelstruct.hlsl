@@ -2,7 +2,44 @@
 #include "common.hlsl"
 #include "intersect.hlsl"
 
+// Work done by the software traversal of the current thread, static globals are private to each thread
+// Hardware raytracing does not expose its traversal, so the counters stay zero in that case
+static traversal_stats_t g_traversal_stats = (traversal_stats_t)0;
+
+// Number of AABB and triangle tests, which is what the traversal cost view mode visualizes
+uint get_traversal_cost(traversal_stats_t stats)
+{
+    return stats.aabb_tests + stats.triangle_tests;
+}
+
+// Adds the counters of the active threads to the frame counters, the wave sums its counters first so that there is only one atomic per counter per wave
+// The sum of a single wave fits in 32 bits, the frame counters are 64-bit since a frame traces far more rays than that
+void add_traversal_stats(RWByteAddressBuffer buffer_traversal_stats)
+{
 #if RAYTRACING_MODE_SOFTWARE
+    uint rays = WaveActiveSum(g_traversal_stats.rays);
+    uint tlas_leaves = WaveActiveSum(g_traversal_stats.tlas_leaves);
+    uint inner_nodes = WaveActiveSum(g_traversal_stats.inner_nodes);
+    uint aabb_tests = WaveActiveSum(g_traversal_stats.aabb_tests);
+    uint triangle_tests = WaveActiveSum(g_traversal_stats.triangle_tests);
+
+    [branch]
+    if (WaveIsFirstLane())
+    {
+        buffer_traversal_stats.InterlockedAdd64(0 * sizeof(uint64_t), (uint64_t)rays);
+        buffer_traversal_stats.InterlockedAdd64(1 * sizeof(uint64_t), (uint64_t)tlas_leaves);
+        buffer_traversal_stats.InterlockedAdd64(2 * sizeof(uint64_t), (uint64_t)inner_nodes);
+        buffer_traversal_stats.InterlockedAdd64(3 * sizeof(uint64_t), (uint64_t)aabb_tests);
+        buffer_traversal_stats.InterlockedAdd64(4 * sizeof(uint64_t), (uint64_t)triangle_tests);
+    }
+#endif
+}
+
+#if RAYTRACING_MODE_SOFTWARE
+// Full traversal stack of node indices, and the short stack that falls back to the parent links once it overflows
+#define BVH_STACK_SIZE          64
+#define BVH_SHORT_STACK_SIZE    8
+
 bvh_header_t bvh_get_header(ByteAddressBuffer buffer)
 {
     bvh_header_t header = buffer.Load<bvh_header_t>(0);
@@ -30,6 +67,13 @@ uint bvh_get_triangle_index(ByteAddressBuffer buffer, bvh_header_t header, uint
     return triangle_index;
 }
 
+uint bvh_get_parent(ByteAddressBuffer buffer, bvh_header_t header, uint node_idx)
+{
+    uint byte_offset = header.parents_offset + 4 * node_idx;
+    uint parent_idx = buffer.Load<uint>(byte_offset);
+    return parent_idx;
+}
+
 tlas_header_t tlas_get_header(ByteAddressBuffer buffer)
 {
     tlas_header_t header = buffer.Load<tlas_header_t>(0);
@@ -55,76 +99,187 @@ bool tlas_node_is_leaf(tlas_node_t node)
     return node.left_right == 0;
 }
 
+// Closest-hit intersection of all triangles in a leaf node, shortens the ray extent for every hit
+bool intersect_bvh_leaf(ByteAddressBuffer buffer, bvh_header_t header, bvh_node_t node, watertight_ray_t ray_wt, inout ray_t ray, inout hit_result_t hit)
+{
+    bool has_hit = false;
+    g_traversal_stats.triangle_tests += node.prim_count;
+    
+    for (uint i = node.left_first; i < node.left_first + node.prim_count; ++i)
+    {
+        uint tri_idx = bvh_get_triangle_index(buffer, header, i);
+        bvh_triangle_t tri = bvh_get_triangle(buffer, header, tri_idx);
+        bool intersected = intersect_ray_triangle_watertight(tri.p0, tri.p1, tri.p2, ray_wt, ray, hit.bary);
+        
+        if (intersected)
+        {
+            hit.primitive_idx = tri_idx;
+            has_hit = intersected;
+        }
+    }
+    
+    return has_hit;
+}
+
+// Orders the children of an interior node by their entry distance, left first on a tie
+// The ray extent only ever gets shorter during a traversal, so a child that is visited first stays first whenever the order is computed again
+void bvh_get_ordered_children(ByteAddressBuffer buffer, bvh_header_t header, bvh_node_t node, ray_t ray,
+    out uint near_idx, out uint far_idx, out float dist_near, out float dist_far)
+{
+    g_traversal_stats.inner_nodes++;
+    g_traversal_stats.aabb_tests += 2;
+    
+    bvh_node_t node_left = bvh_get_node(buffer, header, node.left_first);
+    bvh_node_t node_right = bvh_get_node(buffer, header, node.left_first + 1);
+    
+    near_idx = node.left_first;
+    far_idx = node.left_first + 1;
+    dist_near = intersect_ray_aabb(node_left.aabb_min, node_left.aabb_max, ray);
+    dist_far = intersect_ray_aabb(node_right.aabb_min, node_right.aabb_max, ray);
+    
+    if (dist_near > dist_far)
+    {
+        uint temp_idx = near_idx;
+        near_idx = far_idx;
+        far_idx = temp_idx;
+        
+        float temp_dist = dist_near;
+        dist_near = dist_far;
+        dist_far = temp_dist;
+    }
+}
+
 bool trace_ray_bvh_local(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_t hit)
 {
     bool has_hit = false;
+    watertight_ray_t ray_wt = make_watertight_ray(ray);
     
+    // The stack only holds node indices, the nodes themselves are loaded again once they are popped
     bvh_header_t header = bvh_get_header(buffer);
-    bvh_node_t node = bvh_get_node(buffer, header, 0);
-    bvh_node_t stack[64];
+    uint node_idx = 0;
+    uint stack[BVH_STACK_SIZE];
     uint stack_at = 0;
  
     while (true)
     {
+        bvh_node_t node = bvh_get_node(buffer, header, node_idx);
+        
         // Node is a leaf node, check for triangle intersections
         if (node.prim_count > 0)
         {
-            for (uint i = node.left_first; i < node.left_first + node.prim_count; ++i)
+            if (intersect_bvh_leaf(buffer, header, node, ray_wt, ray, hit))
+                has_hit = true;
+        }
+        // Current node is not a leaf node, keep traversing the BVH
+        else
+        {
+            uint near_idx, far_idx;
+            float dist_near, dist_far;
+            bvh_get_ordered_children(buffer, header, node, ray, near_idx, far_idx, dist_near, dist_far);
+            
+            // We have intersected with at least one of the child nodes, check the closest one first
+            // and push the other one onto the stack
+            if (dist_near != RAY_MAX_T)
             {
-                uint tri_idx = bvh_get_triangle_index(buffer, header, i);
-                bvh_triangle_t tri = bvh_get_triangle(buffer, header, tri_idx);
-                bool intersected = intersect_ray_triangle(tri.p0, tri.p1, tri.p2, ray, hit.bary);
+                if (dist_far != RAY_MAX_T)
+                    stack[stack_at++] = far_idx;
                 
-                if (intersected)
-                {
-                    hit.primitive_idx = tri_idx;
-                    has_hit = intersected;
-                }
+                node_idx = near_idx;
+                continue;
             }
-            
-            if (stack_at == 0)
-                break;
-            else
-                node = stack[--stack_at];
-            continue;
         }
         
-		// Current node is not a leaf node, keep traversing the BVH
-        bvh_node_t node_left = bvh_get_node(buffer, header, node.left_first);
-        bvh_node_t node_right = bvh_get_node(buffer, header, node.left_first + 1);
+        // If we have not intersected with the child nodes, we keep traversing the node stack
+        if (stack_at == 0)
+            break;
         
-        // Determine the distance to the left and right child nodes
-        float dist_left = intersect_ray_aabb(node_left.aabb_min, node_left.aabb_max, ray);
-        float dist_right = intersect_ray_aabb(node_right.aabb_min, node_right.aabb_max, ray);
+        node_idx = stack[--stack_at];
+    }
+    
+    return has_hit;
+}
+
+// Walks up from the last visited node until it finds a parent whose far child was not visited yet and is still within the ray extent
+// The far child of a parent is pending exactly when we are coming up from its near child, since the far child is visited after the near child
+bool bvh_find_next_far_child(ByteAddressBuffer buffer, bvh_header_t header, ray_t ray, inout uint node_idx)
+{
+    while (node_idx != 0)
+    {
+        uint parent_idx = bvh_get_parent(buffer, header, node_idx);
         
-        // Swap the left and right child nodes to have the closest one first
-        if (dist_left > dist_right)
+        uint near_idx, far_idx;
+        float dist_near, dist_far;
+        bvh_get_ordered_children(buffer, header, bvh_get_node(buffer, header, parent_idx), ray, near_idx, far_idx, dist_near, dist_far);
+        
+        if (node_idx == near_idx && dist_far != RAY_MAX_T)
         {
-            float temp_dist = dist_left;
-            dist_left = dist_right;
-            dist_right = temp_dist;
-            
-            bvh_node_t temp_node = node_left;
-            node_left = node_right;
-            node_right = temp_node;
+            node_idx = far_idx;
+            return true;
         }
         
-        // If we have no intersected with the child nodes, we keep traversing the node stack
-        if (dist_left == RAY_MAX_T)
+        node_idx = parent_idx;
+    }
+    
+    return false;
+}
+
+// Same result as trace_ray_bvh_local, but only keeps the last BVH_SHORT_STACK_SIZE node indices in a ring buffer to lower the register pressure
+// Entries that fall off the bottom of the stack are found again by walking up the parent links once the stack runs empty
+bool trace_ray_bvh_local_short_stack(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_t hit)
+{
+    bool has_hit = false;
+    watertight_ray_t ray_wt = make_watertight_ray(ray);
+    
+    bvh_header_t header = bvh_get_header(buffer);
+    uint node_idx = 0;
+    uint stack[BVH_SHORT_STACK_SIZE];
+    uint stack_top = 0;
+    uint stack_count = 0;
+    bool stack_overflowed = false;
+    
+    while (true)
+    {
+        bvh_node_t node = bvh_get_node(buffer, header, node_idx);
+        
+        if (node.prim_count > 0)
         {
-            if (stack_at == 0)
-                break;
-            else
-                node = stack[--stack_at];
+            if (intersect_bvh_leaf(buffer, header, node, ray_wt, ray, hit))
+                has_hit = true;
         }
-        // We have intersected with at least one of the child nodes, check the closest one first
-        // and push the other one onto the stack
         else
         {
-            node = node_left;
-            if (dist_right != RAY_MAX_T)
-                stack[stack_at++] = node_right;
+            uint near_idx, far_idx;
+            float dist_near, dist_far;
+            bvh_get_ordered_children(buffer, header, node, ray, near_idx, far_idx, dist_near, dist_far);
+            
+            if (dist_near != RAY_MAX_T)
+            {
+                // A push onto a full stack overwrites the oldest entry
+                if (dist_far != RAY_MAX_T)
+                {
+                    stack_overflowed = stack_overflowed || stack_count == BVH_SHORT_STACK_SIZE;
+                    stack[stack_top] = far_idx;
+                    stack_top = (stack_top + 1) % BVH_SHORT_STACK_SIZE;
+                    stack_count = min(stack_count + 1, BVH_SHORT_STACK_SIZE);
+                }
+                
+                node_idx = near_idx;
+                continue;
+            }
         }
+        
+        if (stack_count > 0)
+        {
+            stack_top = (stack_top + BVH_SHORT_STACK_SIZE - 1) % BVH_SHORT_STACK_SIZE;
+            stack_count--;
+            node_idx = stack[stack_top];
+            continue;
+        }
+        
+        // The stack is empty, if it never overflowed there is nothing left to visit
+        // Otherwise the dropped entries are all far children of ancestors of the current node, so the parent links lead us back to them
+        if (!stack_overflowed || !bvh_find_next_far_child(buffer, header, ray, node_idx))
+            break;
     }
     
     return has_hit;
@@ -137,12 +292,20 @@ bool trace_ray_bvh_instance(bvh_instance_t instance, inout ray_t ray, inout hit_
     // Create a new ray that will be in local/object space of the bvh we want to intersect here
     // Same thing as if we transformed the BVH triangles to world space, but much more convenient
     ray_t ray_local = ray;
-    ray_local.Origin = mul(float4(ray.Origin, 1.0f), instance.world_to_local).xyz;
-    ray_local.Direction = mul(float4(ray.Direction, 0.0f), instance.world_to_local).xyz;
-    ray_local.inv_dir = 1.0f / ray_local.Direction;
+    [branch]
+    if (!instance.identity_transform)
+    {
+        ray_local.Origin = transform_point(instance.world_to_local, ray.Origin);
+        ray_local.Direction = transform_vector(instance.world_to_local, ray.Direction);
+        ray_local.inv_dir = 1.0f / ray_local.Direction;
+    }
     
     ByteAddressBuffer bvh_buffer = get_resource<ByteAddressBuffer>(instance.bvh_index);
-    has_hit = trace_ray_bvh_local(bvh_buffer, ray_local, hit);
+    [branch]
+    if (cb_settings.bvh_short_stack)
+        has_hit = trace_ray_bvh_local_short_stack(bvh_buffer, ray_local, hit);
+    else
+        has_hit = trace_ray_bvh_local(bvh_buffer, ray_local, hit);
     ray.t = ray_local.t;
     
     return has_hit;
@@ -150,6 +313,9 @@ bool trace_ray_bvh_instance(bvh_instance_t instance, inout ray_t ray, inout hit_
 
 void trace_ray_tlas(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_t hit)
 {
+    g_traversal_stats.rays++;
+    g_traversal_stats.aabb_tests++;
+    
     tlas_header_t header = tlas_get_header(buffer);
     tlas_node_t node = tlas_get_node(buffer, header, 0);
     
@@ -165,6 +331,7 @@ void trace_ray_tlas(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_
         if (tlas_node_is_leaf(node))
         {
             bvh_instance_t instance = tlas_get_instance(buffer, header, node.instance_idx);
+            g_traversal_stats.tlas_leaves++;
             bool intersected = trace_ray_bvh_instance(instance, ray, hit);
             
             if (intersected)
@@ -181,6 +348,9 @@ void trace_ray_tlas(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_
         }
         
         // Node is not a leaf node, keep traversing
+        g_traversal_stats.inner_nodes++;
+        g_traversal_stats.aabb_tests += 2;
+        
         tlas_node_t node_left = tlas_get_node(buffer, header, node.left_right >> 16);
         tlas_node_t node_right = tlas_get_node(buffer, header, node.left_right & 0x0000FFFF);
         
@@ -216,6 +386,132 @@ void trace_ray_tlas(ByteAddressBuffer buffer, inout ray_t ray, inout hit_result_
         }
     }
 }
+
+// Occlusion-only traversal for shadow rays, the search ends at the first intersection found within the ray extent
+// Child nodes are not sorted by distance and only node indices are pushed onto the stack since the traversal order does not matter
+bool trace_ray_bvh_local_occluded(ByteAddressBuffer buffer, ray_t ray)
+{
+    watertight_ray_t ray_wt = make_watertight_ray(ray);
+    bvh_header_t header = bvh_get_header(buffer);
+    uint node_idx = 0;
+    uint stack[64];
+    uint stack_at = 0;
+    
+    while (true)
+    {
+        bvh_node_t node = bvh_get_node(buffer, header, node_idx);
+        
+        if (node.prim_count > 0)
+        {
+            g_traversal_stats.triangle_tests += node.prim_count;
+            
+            for (uint i = node.left_first; i < node.left_first + node.prim_count; ++i)
+            {
+                uint tri_idx = bvh_get_triangle_index(buffer, header, i);
+                bvh_triangle_t tri = bvh_get_triangle(buffer, header, tri_idx);
+                
+                if (intersect_ray_triangle_watertight_any(tri.p0, tri.p1, tri.p2, ray_wt, ray))
+                    return true;
+            }
+        }
+        else
+        {
+            g_traversal_stats.inner_nodes++;
+            g_traversal_stats.aabb_tests += 2;
+            
+            bvh_node_t node_left = bvh_get_node(buffer, header, node.left_first);
+            bvh_node_t node_right = bvh_get_node(buffer, header, node.left_first + 1);
+            
+            bool hit_left = intersect_ray_aabb(node_left.aabb_min, node_left.aabb_max, ray) != RAY_MAX_T;
+            bool hit_right = intersect_ray_aabb(node_right.aabb_min, node_right.aabb_max, ray) != RAY_MAX_T;
+            
+            if (hit_left || hit_right)
+            {
+                node_idx = hit_left ? node.left_first : node.left_first + 1;
+                if (hit_left && hit_right)
+                    stack[stack_at++] = node.left_first + 1;
+                continue;
+            }
+        }
+        
+        if (stack_at == 0)
+            break;
+        
+        node_idx = stack[--stack_at];
+    }
+    
+    return false;
+}
+
+bool trace_ray_bvh_instance_occluded(bvh_instance_t instance, ray_t ray)
+{
+    // The ray direction is not normalized after the transform, so ray.t stays valid in local space
+    ray_t ray_local = ray;
+    [branch]
+    if (!instance.identity_transform)
+    {
+        ray_local.Origin = transform_point(instance.world_to_local, ray.Origin);
+        ray_local.Direction = transform_vector(instance.world_to_local, ray.Direction);
+        ray_local.inv_dir = 1.0f / ray_local.Direction;
+    }
+    
+    ByteAddressBuffer bvh_buffer = get_resource<ByteAddressBuffer>(instance.bvh_index);
+    return trace_ray_bvh_local_occluded(bvh_buffer, ray_local);
+}
+
+bool trace_ray_tlas_occluded(ByteAddressBuffer buffer, ray_t ray)
+{
+    g_traversal_stats.rays++;
+    g_traversal_stats.aabb_tests++;
+    
+    tlas_header_t header = tlas_get_header(buffer);
+    tlas_node_t node = tlas_get_node(buffer, header, 0);
+    
+    if (intersect_ray_aabb(node.aabb_min, node.aabb_max, ray) == RAY_MAX_T)
+        return false;
+    
+    uint stack[64];
+    uint stack_at = 0;
+    
+    while (true)
+    {
+        if (tlas_node_is_leaf(node))
+        {
+            bvh_instance_t instance = tlas_get_instance(buffer, header, node.instance_idx);
+            g_traversal_stats.tlas_leaves++;
+            if (trace_ray_bvh_instance_occluded(instance, ray))
+                return true;
+        }
+        else
+        {
+            g_traversal_stats.inner_nodes++;
+            g_traversal_stats.aabb_tests += 2;
+            
+            uint node_idx_left = node.left_right >> 16;
+            uint node_idx_right = node.left_right & 0x0000FFFF;
+            tlas_node_t node_left = tlas_get_node(buffer, header, node_idx_left);
+            tlas_node_t node_right = tlas_get_node(buffer, header, node_idx_right);
+            
+            bool hit_left = intersect_ray_aabb(node_left.aabb_min, node_left.aabb_max, ray) != RAY_MAX_T;
+            bool hit_right = intersect_ray_aabb(node_right.aabb_min, node_right.aabb_max, ray) != RAY_MAX_T;
+            
+            if (hit_left || hit_right)
+            {
+                node = hit_left ? node_left : node_right;
+                if (hit_left && hit_right)
+                    stack[stack_at++] = node_idx_right;
+                continue;
+            }
+        }
+        
+        if (stack_at == 0)
+            break;
+        
+        node = tlas_get_node(buffer, header, stack[--stack_at]);
+    }
+    
+    return false;
+}
 #else
 void trace_ray_tlas(RaytracingAccelerationStructure scene_tlas, RayDesc2 ray, inout hit_result_t hit)
 {
@@ -224,7 +520,7 @@ void trace_ray_tlas(RaytracingAccelerationStructure scene_tlas, RayDesc2 ray, in
     RayQuery<RAY_FLAG_CULL_BACK_FACING_TRIANGLES> ray_query;
     ray_query.TraceRayInline(scene_tlas, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0u, ray_desc);
 #else
-    RayQuery<RAY_FLAG_NONE> ray_query; // For shadow rays, use RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH (https://learn.microsoft.com/en-us/windows/win32/direct3d12/ray_flag)
+    RayQuery<RAY_FLAG_NONE> ray_query; // For shadow rays, see trace_ray_tlas_occluded (https://learn.microsoft.com/en-us/windows/win32/direct3d12/ray_flag)
     ray_query.TraceRayInline(scene_tlas, RAY_FLAG_NONE, ~0u, ray_desc);
 #endif
     
@@ -250,4 +546,30 @@ void trace_ray_tlas(RaytracingAccelerationStructure scene_tlas, RayDesc2 ray, in
         } break;
     }
 }
+
+// Occlusion-only traversal for shadow rays, the search ends at the first intersection found within the ray extent
+bool trace_ray_tlas_occluded(RaytracingAccelerationStructure scene_tlas, RayDesc2 ray)
+{
+    RayDesc ray_desc = raydesc2_to_raydesc(ray);
+#if TRIANGLE_BACKFACE_CULLING
+    RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_CULL_BACK_FACING_TRIANGLES> ray_query;
+    ray_query.TraceRayInline(scene_tlas, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0u, ray_desc);
+#else
+    RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH> ray_query;
+    ray_query.TraceRayInline(scene_tlas, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, ~0u, ray_desc);
+#endif
+    
+    while (ray_query.Proceed())
+    {
+        switch (ray_query.CandidateType())
+        {
+        case CANDIDATE_NON_OPAQUE_TRIANGLE:
+            {
+                ray_query.CommitNonOpaqueTriangleHit();
+            } break;
+        }
+    }
+    
+    return ray_query.CommittedStatus() == COMMITTED_TRIANGLE_HIT;
+}
 #endif
@@ -17,6 +17,14 @@
 
 #define INSTANCE_IDX_INVALID        UINT_MAX
 #define PRIMITIVE_IDX_INVALID       UINT_MAX
+#define LIGHT_IDX_INVALID           UINT_MAX
+
+// Shadow rays towards a light are shortened slightly so that they do not hit the light itself
+#define SHADOW_RAY_T_MAX_MULTIPLIER (1.0 - 1e-4)
+// Lower bound for the russian roulette survival probability, so that surviving paths do not get boosted by too much
+#define RUSSIAN_ROULETTE_MIN_SURVIVAL_PROBABILITY 0.05
+// Lower bound for the mean pixel luminance in the adaptive sampling error estimate, so that dark pixels do not need an infinite amount of samples
+#define ADAPTIVE_SAMPLING_MIN_LUMINANCE 1e-3
 
 #define PI                          3.14159265
 #define TWO_PI                      6.28318530
@@ -96,6 +104,226 @@ float rand_float(inout uint seed)
 #endif
 }
 
+// Stateless counter-based generator, pcg4d from "Hash Functions for GPU Rendering" (Jarzynski and Olano 2020)
+// The output only depends on the input counter, so any thread can draw any number without shared state, matches rng::pcg4d
+uint4 pcg4d(uint4 v)
+{
+    v = v * 1664525u + 1013904223u;
+    
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    
+    v ^= v >> 16u;
+    
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    
+    return v;
+}
+
+// Four random numbers for one dimension of one sample of a pixel, every combination of pixel, sample and dimension gets its own uncorrelated stream
+uint4 rand_counter_uint4(uint2 pixel_pos, uint sample_idx, uint dimension)
+{
+    return pcg4d(uint4(pixel_pos, sample_idx, dimension));
+}
+
+// Range 0..1, only the upper 24 bits are used so that the result can never round up to one
+float2 rand_counter_float2(uint2 pixel_pos, uint sample_idx, uint dimension)
+{
+    uint4 r = rand_counter_uint4(pixel_pos, sample_idx, dimension);
+    return float2(r.xy >> 8) * 5.96046448e-8;
+}
+
+uint murmur_mix(uint hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+uint hash_combine(uint seed, uint value)
+{
+    return seed ^ (murmur_mix(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+/*
+    Sampler
+*/
+
+// Owen scrambling from "Practical Hash-based Owen Scrambling" (Burley 2020), the bits are reversed so that the
+// permutation of a higher bit only depends on the bits above it
+uint laine_karras_permutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47c;
+    x ^= x * 0xb82f1e52;
+    x ^= x * 0xc7afe638;
+    x ^= x * 0x8d22f6e6;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed)
+{
+    x = reversebits(x);
+    x = laine_karras_permutation(x, seed);
+    x = reversebits(x);
+    return x;
+}
+
+// First two dimensions of the Sobol sequence, the first one is the van der Corput sequence
+uint2 sobol_2d(uint index)
+{
+    uint2 p = uint2(reversebits(index), 0);
+    
+    uint direction = 1u << 31;
+    for (; index != 0; index >>= 1, direction ^= direction >> 1)
+    {
+        if (index & 1)
+            p.y ^= direction;
+    }
+    
+    return p;
+}
+
+// Shuffles the sample index and scrambles both dimensions, so that every seed produces an independent Owen scrambled sequence
+float2 shuffled_scrambled_sobol_2d(uint index, uint seed)
+{
+    index = nested_uniform_scramble(index, seed);
+    uint2 p = sobol_2d(index);
+    p.x = nested_uniform_scramble(p.x, hash_combine(seed, 0));
+    p.y = nested_uniform_scramble(p.y, hash_combine(seed, 1));
+    
+    // Only keep 24 bits so that the result can never round up to one
+    return float2(p >> 8) * 5.96046448e-8;
+}
+
+struct path_sampler_t
+{
+    uint type;
+    // Key of the counter-based generator for random sampling
+    uint2 pixel_pos;
+    // Per-pixel seed for the Sobol sampler
+    uint seed;
+    uint sample_idx;
+    // First dimension of the bounce, every sample of the bounce uses its own dimension from SAMPLER_DIMENSION on top of it
+    uint bounce_dimension;
+    // Screen space offset of the blue noise sampler, all pixels share the same Sobol sequence and are offset by a low-discrepancy pattern in screen space
+    float2 pixel_offset;
+};
+
+// Sample index of the current frame, the Sobol sequence is walked in order while accumulating, and randomized otherwise
+uint get_sample_index(uint sample_count, uint random_seed)
+{
+    return cb_settings.accumulate ? sample_count - 1 : random_seed;
+}
+
+// Every bounce starts at its own fixed dimension, so that the wavefront kernels draw the same samples as the megakernel without passing sampler state around
+path_sampler_t make_path_sampler(uint type, uint2 pixel_pos, uint sample_idx, uint bounce)
+{
+    path_sampler_t path_sampler = (path_sampler_t)0;
+    path_sampler.type = type;
+    path_sampler.pixel_pos = pixel_pos;
+    path_sampler.sample_idx = sample_idx;
+    path_sampler.bounce_dimension = bounce * SAMPLER_DIMENSIONS_PER_BOUNCE;
+    
+    switch (type)
+    {
+    case SAMPLER_TYPE_SOBOL:
+    {
+        path_sampler.seed = hash_combine(hash_combine(0, pixel_pos.x), pixel_pos.y);
+    } break;
+    case SAMPLER_TYPE_SOBOL_BLUE_NOISE:
+    {
+        // R2 sequence over the pixel coordinates, neighbouring pixels get offsets that are far apart
+        path_sampler.seed = 0;
+        path_sampler.pixel_offset = frac(float2(
+            dot(float2(pixel_pos), float2(0.7548776662, 0.5698402910)),
+            dot(float2(pixel_pos), float2(0.5698402910, 0.7548776662))
+        ));
+    } break;
+    }
+    
+    return path_sampler;
+}
+
+float2 path_sampler_get_2d(path_sampler_t path_sampler, uint sampler_dimension)
+{
+    float2 r = 0.0;
+    uint dimension = path_sampler.bounce_dimension + sampler_dimension;
+    uint dimension_seed = hash_combine(path_sampler.seed, dimension);
+    
+    switch (path_sampler.type)
+    {
+    case SAMPLER_TYPE_RANDOM:
+    {
+        r = rand_counter_float2(path_sampler.pixel_pos, path_sampler.sample_idx, dimension);
+    } break;
+    case SAMPLER_TYPE_SOBOL:
+    {
+        r = shuffled_scrambled_sobol_2d(path_sampler.sample_idx, dimension_seed);
+    } break;
+    case SAMPLER_TYPE_SOBOL_BLUE_NOISE:
+    {
+        // Every dimension also gets its own random rotation, otherwise all dimensions would see the same screen space offsets
+        float2 dimension_offset = float2(murmur_mix(dimension_seed) >> 8, murmur_mix(dimension_seed + 1) >> 8) * 5.96046448e-8;
+        r = frac(shuffled_scrambled_sobol_2d(path_sampler.sample_idx, dimension_seed) + path_sampler.pixel_offset + dimension_offset);
+    } break;
+    }
+    
+    return r;
+}
+
+float path_sampler_get_1d(path_sampler_t path_sampler, uint sampler_dimension)
+{
+    return path_sampler_get_2d(path_sampler, sampler_dimension).x;
+}
+
+/*
+    Color
+*/
+
+float get_luminance(float3 color)
+{
+    return dot(color, float3(0.2126, 0.7152, 0.0722));
+}
+
+/*
+    Path termination
+*/
+
+// Paths that carry little energy are more likely to get terminated, the caller divides the throughput by this probability if the path survives
+float get_russian_roulette_survival_probability(float3 throughput)
+{
+    return clamp(get_luminance(throughput), RUSSIAN_ROULETTE_MIN_SURVIVAL_PROBABILITY, 1.0);
+}
+
+/*
+    Adaptive sampling
+*/
+
+// Pixel variance stores the sample count in x, the mean luminance in y, and the sum of squared differences from the mean in z (Welford's algorithm)
+bool is_pixel_converged(float4 pixel_variance)
+{
+    if (!cb_settings.adaptive_sampling || !cb_settings.accumulate || cb_settings.render_view_mode != RENDER_VIEW_MODE_NONE)
+        return false;
+
+    float sample_count = pixel_variance.x;
+    if (sample_count < max(cb_settings.adaptive_sampling_min_samples, 2))
+        return false;
+
+    float variance_of_mean = pixel_variance.z / ((sample_count - 1.0) * sample_count);
+    float relative_error = sqrt(variance_of_mean) / max(pixel_variance.y, ADAPTIVE_SAMPLING_MIN_LUMINANCE);
+
+    return relative_error < cb_settings.adaptive_sampling_threshold;
+}
+
 /*
     Common data structures
 */
@@ -153,6 +381,15 @@ ray_t make_ray(float3 origin, float3 dir)
     return ray;
 }
 
+// Makes a ray with a limited extent, used for shadow rays towards a point on a light source
+ray_t make_ray(float3 origin, float3 dir, float t_max)
+{
+    ray_t ray = make_ray(origin, dir);
+    ray.t = t_max;
+    
+    return ray;
+}
+
 ray_t make_primary_ray(uint2 pixel_pos, float2 render_dim)
 {
     float2 uv = (pixel_pos + 0.5f) / render_dim;
@@ -179,6 +416,15 @@ RayDesc2 make_ray(float3 origin, float3 dir)
     return ray;
 }
 
+// Makes a ray with a limited extent, used for shadow rays towards a point on a light source
+RayDesc2 make_ray(float3 origin, float3 dir, float t_max)
+{
+    RayDesc2 ray = make_ray(origin, dir);
+    ray.TMax = t_max;
+
+    return ray;
+}
+
 RayDesc2 make_primary_ray(uint2 pixel_pos, float2 render_dim)
 {
     float2 uv = (pixel_pos + 0.5f) / render_dim;
@@ -234,10 +480,10 @@ hit_surface_t get_hit_surface(ByteAddressBuffer buffer_instances, hit_result_t h
     hit_surface.tri = load_triangle(triangle_buffer, hit.primitive_idx);
     
     hit_surface.position = interpolate(hit_surface.tri.v0.position, hit_surface.tri.v1.position, hit_surface.tri.v2.position, hit.bary);
-    hit_surface.position = mul(float4(hit_surface.position, 1.0), hit_surface.instance.local_to_world).xyz;
+    hit_surface.position = transform_point(hit_surface.instance.local_to_world, hit_surface.position);
     // TODO: Calculate bitangent, do normal mapping
     hit_surface.normal = interpolate(hit_surface.tri.v0.normal, hit_surface.tri.v1.normal, hit_surface.tri.v2.normal, hit.bary);
-    hit_surface.normal = normalize(mul(float4(hit_surface.normal, 0.0), hit_surface.instance.local_to_world).xyz);
+    hit_surface.normal = normalize(transform_vector(hit_surface.instance.local_to_world, hit_surface.normal));
     //hit_surface.tangent = interpolate(hit_tri.v0.tangent, hit_tri.v1.tangent, hit_tri.v2.tangent, hit.bary);
     hit_surface.tex_coord = interpolate(hit_surface.tri.v0.uv, hit_surface.tri.v1.uv, hit_surface.tri.v2.uv, hit.bary);
     
@@ -273,14 +519,15 @@ bool is_nan(float x)
     return (asuint(x) & 0x7fffffff) > 0x7f800000;
 }
 
-uint murmur_mix(uint hash)
+// Maps the traversal cost to a blue-green-red color ramp
+float3 cost_to_heatmap(float cost, float max_cost)
 {
-    hash ^= hash >> 16;
-    hash *= 0x85ebca6b;
-    hash ^= hash >> 13;
-    hash *= 0xc2b2ae35;
-    hash ^= hash >> 16;
-    return hash;
+    float x = saturate(cost / max(max_cost, 1.0));
+    return saturate(float3(
+        1.5 - abs(4.0 * x - 3.0),
+        1.5 - abs(4.0 * x - 2.0),
+        1.5 - abs(4.0 * x - 1.0)
+    ));
 }
 
 float3 int_to_color(uint value)
@@ -50,6 +50,152 @@ bool intersect_ray_triangle(float3 v0, float3 v1, float3 v2, inout ray_t ray, in
     return true;
 }
 
+// Occlusion-only variant of the Moeller-Trumbore intersection, used for shadow rays
+// Does not write back the hit distance or barycentrics, we only care whether something is hit within the ray extent
+bool intersect_ray_triangle_any(float3 v0, float3 v1, float3 v2, ray_t ray)
+{
+    float3 v0v1 = v1 - v0;
+    float3 v0v2 = v2 - v0;
+    
+    float3 pvec = cross(ray.Direction, v0v2);
+    float det = dot(v0v1, pvec);
+    
+#if TRIANGLE_BACKFACE_CULLING
+    if (det < INTERSECT_EPSILON)
+#else
+    if (abs(det) < INTERSECT_EPSILON)
+#endif
+    {
+        return false;
+    }
+    
+    float inv_det = 1.0f / det;
+    float3 tvec = ray.Origin - v0;
+    float v = dot(tvec, pvec) * inv_det;
+    
+    if (v < 0.0f || v > 1.0f)
+    {
+        return false;
+    }
+    
+    float3 qvec = cross(tvec, v0v1);
+    float w = dot(ray.Direction, qvec) * inv_det;
+    
+    if (w < 0.0f || v + w > 1.0f)
+    {
+        return false;
+    }
+    
+    float t = dot(v0v2, qvec) * inv_det;
+    return t >= 0.0f && t < ray.t;
+}
+
+// Per-ray constants for the watertight ray-triangle intersection, the ray is sheared so that it points along +z from the origin
+struct watertight_ray_t
+{
+    uint3 k;
+    float3 s;
+};
+
+// Watertight ray-triangle intersection, see: https://jcgt.org/published/0002/01/05/
+// The dominant axis of the ray direction becomes the z axis, and the other two axes are sheared so that the ray points along +z
+watertight_ray_t make_watertight_ray(ray_t ray)
+{
+    watertight_ray_t ray_wt;
+    
+    float3 abs_dir = abs(ray.Direction);
+    ray_wt.k.z = abs_dir.x > abs_dir.y ? (abs_dir.x > abs_dir.z ? 0 : 2) : (abs_dir.y > abs_dir.z ? 1 : 2);
+    ray_wt.k.x = (ray_wt.k.z + 1) % 3;
+    ray_wt.k.y = (ray_wt.k.x + 1) % 3;
+    
+    // Swap the x and y axes to preserve the winding of the triangles when the ray points along the negative dominant axis
+    if (ray.Direction[ray_wt.k.z] < 0.0)
+    {
+        ray_wt.k.xy = ray_wt.k.yx;
+    }
+    
+    ray_wt.s.x = ray.Direction[ray_wt.k.x] / ray.Direction[ray_wt.k.z];
+    ray_wt.s.y = ray.Direction[ray_wt.k.y] / ray.Direction[ray_wt.k.z];
+    ray_wt.s.z = 1.0 / ray.Direction[ray_wt.k.z];
+    
+    return ray_wt;
+}
+
+bool intersect_ray_triangle_watertight_internal(float3 v0, float3 v1, float3 v2, watertight_ray_t ray_wt, ray_t ray, out float t, out float2 barycentrics)
+{
+    t = 0.0;
+    barycentrics = (float2)0;
+    
+    float3 a = v0 - ray.Origin;
+    float3 b = v1 - ray.Origin;
+    float3 c = v2 - ray.Origin;
+    
+    float ax = a[ray_wt.k.x] - ray_wt.s.x * a[ray_wt.k.z];
+    float ay = a[ray_wt.k.y] - ray_wt.s.y * a[ray_wt.k.z];
+    float bx = b[ray_wt.k.x] - ray_wt.s.x * b[ray_wt.k.z];
+    float by = b[ray_wt.k.y] - ray_wt.s.y * b[ray_wt.k.z];
+    float cx = c[ray_wt.k.x] - ray_wt.s.x * c[ray_wt.k.z];
+    float cy = c[ray_wt.k.y] - ray_wt.s.y * c[ray_wt.k.z];
+    
+    // Scaled barycentrics, an edge shared by two triangles gives the exact same result for both, so rays can not slip through in between them
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    
+    bool any_negative = u < 0.0 || v < 0.0 || w < 0.0;
+    bool any_positive = u > 0.0 || v > 0.0 || w > 0.0;
+    
+#if TRIANGLE_BACKFACE_CULLING
+    if (any_negative)
+#else
+    if (any_negative && any_positive)
+#endif
+    {
+        return false;
+    }
+    
+    float det = u + v + w;
+    if (det == 0.0)
+    {
+        return false;
+    }
+    
+    // Compare the scaled hit distance against the ray extent before dividing, with the sign of the determinant folded into both sides
+    float t_scaled = u * (ray_wt.s.z * a[ray_wt.k.z]) + v * (ray_wt.s.z * b[ray_wt.k.z]) + w * (ray_wt.s.z * c[ray_wt.k.z]);
+    float det_sign = det < 0.0 ? -1.0 : 1.0;
+    
+    if (t_scaled * det_sign < 0.0 || t_scaled * det_sign >= ray.t * det * det_sign)
+    {
+        return false;
+    }
+    
+    float inv_det = 1.0 / det;
+    t = t_scaled * inv_det;
+    barycentrics = float2(v, w) * inv_det;
+    return true;
+}
+
+bool intersect_ray_triangle_watertight(float3 v0, float3 v1, float3 v2, watertight_ray_t ray_wt, inout ray_t ray, inout float2 barycentrics)
+{
+    float t;
+    float2 bary;
+    if (!intersect_ray_triangle_watertight_internal(v0, v1, v2, ray_wt, ray, t, bary))
+    {
+        return false;
+    }
+    
+    ray.t = t;
+    barycentrics = bary;
+    return true;
+}
+
+bool intersect_ray_triangle_watertight_any(float3 v0, float3 v1, float3 v2, watertight_ray_t ray_wt, ray_t ray)
+{
+    float t;
+    float2 bary;
+    return intersect_ray_triangle_watertight_internal(v0, v1, v2, ray_wt, ray, t, bary);
+}
+
 float intersect_ray_aabb(float3 aabb_min, float3 aabb_max, ray_t ray)
 {
     float tx1 = (aabb_min.x - ray.Origin.x) * ray.inv_dir.x;
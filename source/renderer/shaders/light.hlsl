@@ -0,0 +1,173 @@
+#pragma once
+#include "common.hlsl"
+#include "sample.hlsl"
+#include "material.hlsl"
+
+struct light_sample_t
+{
+    float3 direction;
+    float distance;
+    float3 emission;
+    // Solid angle pdf of the sample, including the probability of picking the light
+    float pdf;
+};
+
+emissive_triangle_t load_emissive_triangle(ByteAddressBuffer buffer_lights, uint light_idx)
+{
+    return buffer_lights.Load<emissive_triangle_t>(light_idx * sizeof(emissive_triangle_t));
+}
+
+float3 get_emissive_triangle_normal(emissive_triangle_t light)
+{
+    return normalize(cross(light.p1 - light.p0, light.p2 - light.p0));
+}
+
+// Converts the area pdf of a point on a light to a solid angle pdf, as seen from the shading point
+float light_pdf_to_solid_angle(float pdf_area, float distance, float cos_light)
+{
+    return cos_light > 0.0 ? pdf_area * (distance * distance) / cos_light : 0.0;
+}
+
+float mis_power_heuristic(float pdf_a, float pdf_b)
+{
+    float pdf_a_sq = pdf_a * pdf_a;
+    return pdf_a_sq / (pdf_a_sq + pdf_b * pdf_b);
+}
+
+// Probability of sampling the HDR environment instead of the emissive triangles, both are picked equally often if both are present
+float get_env_selection_probability(uint light_count, bool env_importance_sampling)
+{
+    if (!env_importance_sampling)
+        return 0.0;
+
+    return light_count > 0 ? 0.5 : 1.0;
+}
+
+// Converts the probability of picking an environment texel to a solid angle pdf, texels near the poles cover a smaller solid angle
+float env_pdf_to_solid_angle(float pdf_texel, uint2 env_dims, float3 direction)
+{
+    float sin_theta = sqrt(max(0.0, 1.0 - direction.y * direction.y));
+    return sin_theta > 0.0 ? pdf_texel * (env_dims.x * env_dims.y) / (2.0 * PI * PI * sin_theta) : 0.0;
+}
+
+env_alias_entry_t load_env_alias_entry(ByteAddressBuffer buffer_env_alias, uint texel_idx)
+{
+    return buffer_env_alias.Load<env_alias_entry_t>(texel_idx * sizeof(env_alias_entry_t));
+}
+
+// Picks a light proportional to its power with the alias table
+uint sample_light_index(ByteAddressBuffer buffer_lights, uint light_count, float r0, float r1)
+{
+    uint light_idx = min(uint(r0 * light_count), light_count - 1);
+    emissive_triangle_t light = load_emissive_triangle(buffer_lights, light_idx);
+
+    return r1 < light.alias_probability ? light_idx : light.alias_idx;
+}
+
+// Samples a uniformly distributed point on an emissive triangle picked by the alias table
+light_sample_t sample_light(ByteAddressBuffer buffer_lights, ByteAddressBuffer buffer_instances, uint light_count, float3 position, float4 r)
+{
+    light_sample_t light_sample = (light_sample_t)0;
+
+    uint light_idx = sample_light_index(buffer_lights, light_count, r.x, r.y);
+    emissive_triangle_t light = load_emissive_triangle(buffer_lights, light_idx);
+
+    float r_sqrt = sqrt(r.z);
+    float2 bary = float2(r_sqrt * (1.0 - r.w), r_sqrt * r.w);
+    float3 light_position = interpolate(light.p0, light.p1, light.p2, bary);
+
+    float3 to_light = light_position - position;
+    light_sample.distance = length(to_light);
+    light_sample.direction = to_light / light_sample.distance;
+
+    float cos_light = dot(get_emissive_triangle_normal(light), -light_sample.direction);
+    light_sample.pdf = light.area > 0.0 ? light_pdf_to_solid_angle(light.pdf / light.area, light_sample.distance, cos_light) : 0.0;
+
+    // Evaluate the emissive material at the sampled point, since the emissive color might come from a texture
+    instance_data_t instance = load_instance(buffer_instances, light.instance_idx);
+    ByteAddressBuffer triangle_buffer = get_resource<ByteAddressBuffer>(instance.triangle_buffer_idx);
+    triangle_t tri = load_triangle(triangle_buffer, light.primitive_idx);
+    float2 tex_coord = interpolate(tri.v0.uv, tri.v1.uv, tri.v2.uv, bary);
+    light_sample.emission = sample_material_emissive(instance.material, tex_coord);
+
+    return light_sample;
+}
+
+// Picks a texel proportional to its luminance with the alias table, and samples a uniformly distributed direction within that texel
+light_sample_t sample_env(ByteAddressBuffer buffer_env_alias, Texture2D texture_env, uint2 env_dims, float4 r)
+{
+    light_sample_t light_sample = (light_sample_t)0;
+
+    uint texel_count = env_dims.x * env_dims.y;
+    uint texel_idx = min(uint(r.x * texel_count), texel_count - 1);
+    env_alias_entry_t entry = load_env_alias_entry(buffer_env_alias, texel_idx);
+
+    if (r.y >= entry.alias_probability)
+    {
+        texel_idx = entry.alias_idx;
+        entry = load_env_alias_entry(buffer_env_alias, texel_idx);
+    }
+
+    uint2 texel_pos = uint2(texel_idx % env_dims.x, texel_idx / env_dims.x);
+    float2 uv = (float2(texel_pos) + r.zw) / float2(env_dims);
+
+    light_sample.direction = equirect_uv_to_direction(uv);
+    light_sample.distance = RAY_MAX_T;
+    light_sample.emission = texture_env[texel_pos].xyz * cb_settings.hdr_env_strength;
+    light_sample.pdf = env_pdf_to_solid_angle(entry.pdf, env_dims, light_sample.direction);
+
+    return light_sample;
+}
+
+// Picks either the HDR environment or one of the emissive triangles, the returned pdf includes the probability of picking either one
+light_sample_t sample_direct_light(ByteAddressBuffer buffer_lights, ByteAddressBuffer buffer_instances, uint light_count,
+    ByteAddressBuffer buffer_env_alias, Texture2D texture_env, uint2 env_dims, float env_selection_probability,
+    float3 position, float r_select, float4 r)
+{
+    light_sample_t light_sample = (light_sample_t)0;
+
+    [branch]
+    if (r_select < env_selection_probability)
+    {
+        light_sample = sample_env(buffer_env_alias, texture_env, env_dims, r);
+        light_sample.pdf *= env_selection_probability;
+    }
+    else
+    {
+        light_sample = sample_light(buffer_lights, buffer_instances, light_count, position, r);
+        light_sample.pdf *= 1.0 - env_selection_probability;
+    }
+
+    return light_sample;
+}
+
+// Returns the MIS weight for the environment that was found by a BSDF sampled ray, since the same direction could have been found with next event estimation
+float get_env_hit_mis_weight(ByteAddressBuffer buffer_env_alias, uint2 env_dims, float3 ray_direction, float bsdf_pdf, float env_selection_probability)
+{
+    // A BSDF pdf of zero means that the previous vertex did not do next event estimation (e.g. camera rays)
+    if (bsdf_pdf <= 0.0 || env_selection_probability <= 0.0)
+        return 1.0;
+
+    uint2 texel_pos = min(uint2(direction_to_equirect_uv(ray_direction) * env_dims), env_dims - 1);
+    env_alias_entry_t entry = load_env_alias_entry(buffer_env_alias, texel_pos.y * env_dims.x + texel_pos.x);
+    float env_pdf = env_selection_probability * env_pdf_to_solid_angle(entry.pdf, env_dims, ray_direction);
+
+    return mis_power_heuristic(bsdf_pdf, env_pdf);
+}
+
+// Returns the MIS weight for emission that was found by a BSDF sampled ray, since the same light could have been found with next event estimation
+float get_emissive_hit_mis_weight(ByteAddressBuffer buffer_lights, instance_data_t instance, hit_result_t hit, float3 ray_direction, float bsdf_pdf, float light_selection_probability)
+{
+    // A BSDF pdf of zero means that the previous vertex did not do next event estimation (e.g. camera rays)
+    if (bsdf_pdf <= 0.0 || instance.light_offset == LIGHT_IDX_INVALID)
+        return 1.0;
+
+    emissive_triangle_t light = load_emissive_triangle(buffer_lights, instance.light_offset + hit.primitive_idx);
+    if (light.area <= 0.0)
+        return 1.0;
+
+    float cos_light = dot(get_emissive_triangle_normal(light), -ray_direction);
+    float light_pdf = light_selection_probability * light_pdf_to_solid_angle(light.pdf / light.area, hit.t, cos_light);
+
+    return mis_power_heuristic(bsdf_pdf, light_pdf);
+}
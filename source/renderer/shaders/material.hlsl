@@ -37,3 +37,11 @@ sampled_material_t sample_material(material_t material, float2 tex_coord)
     
     return sampled_material;
 }
+
+// Only samples the emissive color, used when evaluating lights for next event estimation
+float3 sample_material_emissive(material_t material, float2 tex_coord)
+{
+    Texture2D texture_emissive = get_resource<Texture2D>(material.emissive_index);
+    float4 emissive = texture_emissive.SampleLevel(sampler_linear_wrap, tex_coord, 0);
+    return material.emissive_strength * material.emissive_factor * emissive.xyz;
+}
@@ -3,6 +3,7 @@
 #include "accelstruct.hlsl"
 #include "sample.hlsl"
 #include "material.hlsl"
+#include "light.hlsl"
 
 struct shader_input_t
 {
@@ -12,6 +13,13 @@ struct shader_input_t
     uint buffer_instances_index;
     uint texture_energy_index;
     uint random_seed;
+    uint buffer_lights_index;
+    uint light_count;
+    uint buffer_hdr_env_alias_index;
+    uint hdr_env_importance_sampling;
+    uint texture_pixel_variance_index;
+    uint sample_count;
+    uint buffer_traversal_stats_index;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
@@ -23,9 +31,13 @@ static const RaytracingAccelerationStructure buffer_scene_tlas = get_resource_un
 #endif
     
 static const ByteAddressBuffer buffer_instances = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_instances_index);
+static const ByteAddressBuffer buffer_lights = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_lights_index);
+static const ByteAddressBuffer buffer_hdr_env_alias = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_hdr_env_alias_index);
 
 static const Texture2D texture_hdr_env = get_resource_uniform<Texture2D>(cb_in.texture_hdr_env_index);
 static const RWTexture2D<float4> texture_energy = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_energy_index);
+static const RWTexture2D<float4> texture_pixel_variance = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_pixel_variance_index);
+static const RWByteAddressBuffer buffer_traversal_stats = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_traversal_stats_index);
 
 float4 sample_hdr_env(float3 dir, float2 tex_dim)
 {
@@ -48,6 +60,9 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
     float3 throughput = (float3) 1;
     float3 energy = (float3) 0;
     uint ray_depth = 0;
+    // Pdf of the BSDF sample that generated the current ray, zero for camera rays
+    float bsdf_pdf = 0.0;
+    float env_selection_probability = get_env_selection_probability(cb_in.light_count, cb_in.hdr_env_importance_sampling);
     
     while (ray_depth <= cb_settings.max_bounces)
     {
@@ -55,11 +70,21 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
         hit_result_t hit = make_hit_result();
         trace_ray_tlas(scene_tlas, ray, hit);
         
+        // The traversal cost view mode only looks at the camera rays, and also needs to show the ones that miss the scene
+        [branch]
+        if (cb_settings.render_view_mode == RENDER_VIEW_MODE_TRAVERSAL_COST)
+        {
+            energy = cost_to_heatmap(get_traversal_cost(g_traversal_stats), cb_settings.traversal_cost_heatmap_max);
+            break;
+        }
+        
         // We have missed the scene entirely, so we treat the HDR environment texture as a light source and stop tracing
         if (!has_hit_geometry(hit))
         {
             float3 hdr_env_color = sample_hdr_env(ray.Direction, float2(cb_in.texture_hdr_env_dims)).xyz;
-            energy += throughput * cb_settings.hdr_env_strength * hdr_env_color;
+            float mis_weight = cb_settings.next_event_estimation ?
+                get_env_hit_mis_weight(buffer_hdr_env_alias, cb_in.texture_hdr_env_dims, ray.Direction, bsdf_pdf, env_selection_probability) : 1.0;
+            energy += throughput * cb_settings.hdr_env_strength * hdr_env_color * mis_weight;
             break;
         }
         
@@ -69,12 +94,14 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
         [branch]
         if (any(sampled_material.emissive_color) > 0.0)
         {
-            energy += throughput * sampled_material.emissive_color;
+            float mis_weight = cb_settings.next_event_estimation ?
+                get_emissive_hit_mis_weight(buffer_lights, hit_surface.instance, hit, ray.Direction, bsdf_pdf, 1.0 - env_selection_probability) : 1.0;
+            energy += throughput * sampled_material.emissive_color * mis_weight;
             break;
         }
 
-        uint seed = cb_in.random_seed + dispatch_id.x;
-        float r_path = rand_float(seed);
+        path_sampler_t path_sampler = make_path_sampler(cb_settings.sampler_type, pixel_pos, get_sample_index(cb_in.sample_count, cb_in.random_seed), ray_depth);
+        float r_path = path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_LOBE_SELECT);
 
         float3 V = -ray.Direction;
         float3 F0 = float3(0.04, 0.04, 0.04);
@@ -85,7 +112,7 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
         /*[branch]
         if (specular_bounce)
         {
-            float2 r_spec = float2(rand_float(seed), rand_float(seed));
+            float2 r_spec = path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_BSDF);
             
             float3 N = hit_surface.normal;
             float3 L = sample_ggxv_ndf(V, sampled_material.roughness, r_spec.x, r_spec.y);
@@ -101,7 +128,7 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
         }
         else*/
         {
-            float2 r_diffuse = float2(rand_float(seed), rand_float(seed));
+            float2 r_diffuse = path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_BSDF);
             
             float3 N = hit_surface.normal;
             float3 L = 0;
@@ -128,7 +155,38 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
             }
 
             float3 diffuse_brdf = sampled_material.base_color * INV_PI;
+
+            // Next event estimation, only done when the BSDF sampled ray will be traced as well, otherwise the MIS weights do not add up to one
+            [branch]
+            if (cb_settings.next_event_estimation && (cb_in.light_count > 0 || cb_in.hdr_env_importance_sampling) &&
+                ray_depth < cb_settings.max_bounces && cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+            {
+                float r_light_select = path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_LIGHT_SELECT);
+                float4 r_light = float4(path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_XY), path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_ZW));
+                light_sample_t light_sample = sample_direct_light(buffer_lights, buffer_instances, cb_in.light_count,
+                    buffer_hdr_env_alias, texture_hdr_env, cb_in.texture_hdr_env_dims, env_selection_probability, hit_surface.position, r_light_select, r_light);
+                float NoL_light = dot(N, light_sample.direction);
+
+                if (NoL_light > 0.0 && light_sample.pdf > 0.0)
+                {
+                    float light_bsdf_pdf = cb_settings.cosine_weighted_diffuse ? cosine_weighted_hemisphere_pdf(NoL_light) : uniform_hemisphere_pdf();
+                    float mis_weight = mis_power_heuristic(light_sample.pdf, light_bsdf_pdf);
+                    float3 contribution = throughput * diffuse_brdf * NoL_light * light_sample.emission * (mis_weight / light_sample.pdf);
+
+#if RAYTRACING_MODE_SOFTWARE
+                    ray_t shadow_ray = make_ray(hit_surface.position, light_sample.direction, light_sample.distance * SHADOW_RAY_T_MAX_MULTIPLIER);
+#else
+                    RayDesc2 shadow_ray = make_ray(hit_surface.position, light_sample.direction, light_sample.distance * SHADOW_RAY_T_MAX_MULTIPLIER);
+#endif
+                    if (!trace_ray_tlas_occluded(scene_tlas, shadow_ray))
+                    {
+                        energy += contribution;
+                    }
+                }
+            }
+
             throughput *= (NoL * diffuse_brdf) * (1.0 / pdf);// * (1.0 - specular_probability);
+            bsdf_pdf = pdf;
             ray = make_ray(hit_surface.position, L);
         }
 
@@ -152,6 +210,19 @@ float3 trace_path(RaytracingAccelerationStructure scene_tlas, uint2 dispatch_id,
         {
             break;
         }
+
+        // Russian roulette, stochastically terminate paths with a low throughput and compensate the ones that survive
+        [branch]
+        if (cb_settings.russian_roulette && ray_depth >= cb_settings.russian_roulette_min_depth)
+        {
+            float survival_probability = get_russian_roulette_survival_probability(throughput);
+            if (path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_RUSSIAN_ROULETTE) >= survival_probability)
+            {
+                break;
+            }
+
+            throughput /= survival_probability;
+        }
         
         ray_depth++;
     }
@@ -164,6 +235,14 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
 {
     // Make the primary ray and start tracing
     uint2 pixel_pos = uint2(dispatch_id.x % cb_view.render_dim.x, dispatch_id.x / cb_view.render_dim.x);
+
+    // Pixels that have converged are skipped, the energy alpha channel stays zero so the post-process does not accumulate them
+    float4 pixel_variance = cb_in.sample_count > 1 ? texture_pixel_variance[pixel_pos] : (float4)0;
+    if (is_pixel_converged(pixel_variance))
+        return;
+
     float3 energy = trace_path(buffer_scene_tlas, dispatch_id.xy, pixel_pos, cb_view.render_dim);
-    texture_energy[pixel_pos].xyz = energy;
+    texture_energy[pixel_pos] = float4(energy, 1.0);
+
+    add_traversal_stats(buffer_traversal_stats);
 }
@@ -13,7 +13,13 @@ struct shader_input_t
     uint texture_energy_index;
     uint texture_color_accum_index;
     uint texture_color_final_index;
+    uint texture_pixel_variance_index;
     uint sample_count;
+    // The CPU denoiser accumulates the energy itself, so it replaces the accumulated color as is
+    uint energy_accumulated;
+    // Set when the wavefront path tracer regenerated paths this frame, the path states hold the luminance of the paths of every pixel
+    uint path_regeneration;
+    uint buffer_path_states_index;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
@@ -21,6 +27,8 @@ ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
 static const Texture2D<float4> texture_energy = get_resource_uniform<Texture2D<float4> >(cb_in.texture_energy_index);
 static const RWTexture2D<float4> texture_color_accum = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_color_accum_index);
 static const RWTexture2D<float4> texture_color_final = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_color_final_index);
+static const RWTexture2D<float4> texture_pixel_variance = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_pixel_variance_index);
+static const ByteAddressBuffer buffer_path_states = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_path_states_index);
 
 [numthreads(GROUP_THREADS_X, GROUP_THREADS_Y, 1)]
 void main(uint3 dispatch_id : SV_DispatchThreadID)
@@ -28,8 +36,11 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
     uint data_offset = dispatch_id.y * cb_view.render_dim.x + dispatch_id.x;
     uint2 pixel_pos = uint2(dispatch_id.xy);
     
-    // Get the final energy buffer from path trace
-    float3 energy = texture_energy[pixel_pos].xyz;
+    // Get the final energy buffer from path trace, the alpha channel is only set for pixels that were traced this frame
+    // The alpha channel is the number of paths that were traced for the pixel, which is more than one with wavefront path regeneration
+    float path_count = texture_energy[pixel_pos].w;
+    bool traced = path_count > 0.0;
+    float3 energy = traced ? texture_energy[pixel_pos].xyz / path_count : texture_energy[pixel_pos].xyz;
 
     // Badness detector for NaN/INF in energy buffer
     if (is_nan(energy.x) || is_nan(energy.y) || is_nan(energy.z) || any(isinf(energy)))
@@ -37,19 +48,45 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
         energy = float3(1.0, 0.0, 1.0);
     }
     
-    // Update HDR color accumulator
+    // Update HDR color accumulator, every pixel keeps track of its own sample count since adaptive sampling skips converged pixels
+    // The first sample after the accumulator was reset discards the per-pixel statistics of the previous accumulation
     float4 color_accum = texture_color_accum[pixel_pos];
-    float sample_weight = 1.0f / cb_in.sample_count;
+    float4 pixel_variance = cb_in.sample_count > 1 ? texture_pixel_variance[pixel_pos] : (float4)0;
 
-    if (cb_settings.accumulate && cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+    if (cb_settings.accumulate && cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE && !cb_in.energy_accumulated)
     {
-        texture_color_accum[pixel_pos] = color_accum * (1.0f - sample_weight) + float4(energy, 1.0) * sample_weight;
+        if (traced)
+        {
+            pixel_variance.x += path_count;
+            float sample_weight = path_count / pixel_variance.x;
+            texture_color_accum[pixel_pos] = color_accum * (1.0f - sample_weight) + float4(energy, 1.0) * sample_weight;
+
+            // Welford's online variance of the pixel luminance, merged per frame with Chan's formula when a pixel traced more than one path
+            float luminance = get_luminance(energy);
+            float delta = luminance - pixel_variance.y;
+            pixel_variance.y += delta * sample_weight;
+            pixel_variance.z += delta * (luminance - pixel_variance.y) * path_count;
+
+            // Chan's formula also adds the M2 of the paths within this frame, which is their sum of squares minus the path count times their squared mean
+            // The last path of the frame is not followed by a regenerated path, so the shade stage never completed it and it is added here
+            [branch]
+            if (cb_in.path_regeneration)
+            {
+                wavefront_path_state_t path_state = buffer_path_states.Load<wavefront_path_state_t>(data_offset * sizeof(wavefront_path_state_t));
+                float last_path_luminance = luminance * path_count - path_state.path_luminance_begin;
+                float luminance_sq_sum = path_state.path_luminance_sq_sum + last_path_luminance * last_path_luminance;
+                pixel_variance.z += max(luminance_sq_sum - luminance * luminance * path_count, 0.0);
+            }
+        }
     }
     else
     {
         texture_color_accum[pixel_pos] = float4(energy, 1.0);
+        pixel_variance = (float4)0;
     }
 
+    texture_pixel_variance[pixel_pos] = pixel_variance;
+
     // Write final LDR color
     float4 final_color = texture_color_accum[pixel_pos];
 
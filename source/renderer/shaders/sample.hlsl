@@ -10,6 +10,16 @@ float2 direction_to_equirect_uv(float3 dir)
     return uv;
 }
 
+// Inverse of direction_to_equirect_uv
+float3 equirect_uv_to_direction(float2 uv)
+{
+    float phi = (uv.x - 0.5) * TWO_PI;
+    float latitude = (uv.y - 0.5) * PI;
+    float cos_latitude = cos(latitude);
+
+    return float3(cos_latitude * cos(phi), -sin(latitude), cos_latitude * sin(phi));
+}
+
 float3x3 create_orthonormal_basis(float3 normal)
 {
     float3 tangent = (float3) 0;
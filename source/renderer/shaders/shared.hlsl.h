@@ -14,6 +14,14 @@
 #define float4x4 glm::mat4
 #endif
 
+// The maximum bounce count (limited by UI) is 8, so there are at most 9 recursion depths in the wavefront path tracer
+// With path regeneration the wavefront path tracer runs twice as many iterations, so that paths regenerated in the first half still get all of their bounces
+// Ray counts and indirect arguments store one entry per iteration for extension rays, followed by one entry per iteration for shadow rays
+#define WAVEFRONT_RECURSION_DEPTH_COUNT 9
+#define WAVEFRONT_ITERATION_COUNT_MAX (2 * WAVEFRONT_RECURSION_DEPTH_COUNT)
+#define WAVEFRONT_SHADOW_RAY_COUNT_OFFSET WAVEFRONT_ITERATION_COUNT_MAX
+#define WAVEFRONT_RAY_COUNT_TOTAL (2 * WAVEFRONT_ITERATION_COUNT_MAX)
+
 enum RENDER_VIEW_MODE
 {
 	RENDER_VIEW_MODE_NONE,
@@ -28,19 +36,89 @@ enum RENDER_VIEW_MODE
 	RENDER_VIEW_MODE_MATERIAL_EMISSIVE,
 	RENDER_VIEW_MODE_WORLD_NORMAL,
 	RENDER_VIEW_MODE_RENDER_TARGET_DEPTH,
+	RENDER_VIEW_MODE_TRAVERSAL_COST,
 	RENDER_VIEW_MODE_COUNT
 };
 
+enum SAMPLER_TYPE
+{
+	SAMPLER_TYPE_RANDOM,
+	SAMPLER_TYPE_SOBOL,
+	SAMPLER_TYPE_SOBOL_BLUE_NOISE,
+	SAMPLER_TYPE_COUNT
+};
+
+// Dimension of every sample a bounce draws, relative to the first dimension of the bounce
+// All path tracers draw each sample from the same dimension, whether or not they draw the samples before it, so that they produce the same samples
+enum SAMPLER_DIMENSION
+{
+	// 1D, picks the specular or the diffuse lobe
+	SAMPLER_DIMENSION_LOBE_SELECT,
+	// 2D, direction of the BSDF sample, only one of the lobes is sampled so they share the dimension
+	SAMPLER_DIMENSION_BSDF,
+	// 1D, picks the light or the environment for next event estimation
+	SAMPLER_DIMENSION_LIGHT_SELECT,
+	// 2D each, the four random numbers of the light sample
+	SAMPLER_DIMENSION_LIGHT_XY,
+	SAMPLER_DIMENSION_LIGHT_ZW,
+	// 1D, survival of the path for russian roulette
+	SAMPLER_DIMENSION_RUSSIAN_ROULETTE,
+	SAMPLER_DIMENSION_COUNT
+};
+
+// Number of sampler dimensions reserved for every bounce, needs to be at least SAMPLER_DIMENSION_COUNT
+#define SAMPLER_DIMENSIONS_PER_BOUNCE 8
+
 struct render_settings_t
 {
 	uint use_wavefront_pathtracing;
 	uint use_software_rt;
+	uint use_cpu_pathtracing;
+	// Traverses the BLASes with a short stack of node indices and falls back to the parent links when it overflows
+	uint bvh_short_stack;
+	// Selects the texture mip from the ray cone footprint instead of always sampling mip 0, only implemented for the CPU path tracer
+	uint texture_lod_ray_cones;
+	// Mixes the diffuse bounce with directions sampled from the radiance learned by earlier passes, only implemented for the CPU path tracer
+	uint path_guiding;
+	// Stores the rays, hit results, and shadow rays of the wavefront queues in their packed layouts instead of the full precision ones
+	uint wavefront_compact_payloads;
+	// Replaces paths that terminated by new camera samples of the same pixel, so the wavefront queues stay full instead of shrinking with every bounce
+	uint wavefront_path_regeneration;
 	uint render_view_mode;
 	uint max_bounces;
 	uint cosine_weighted_diffuse;
+	uint next_event_estimation;
+	uint russian_roulette;
+	// Paths are only terminated by russian roulette from this bounce onwards
+	uint russian_roulette_min_depth;
 	uint accumulate;
+	// Added to the sample index of every accumulated CPU path, distributed workers use it to render disjoint sample ranges of the same image
+	uint sample_offset;
+	// Scales the samples per frame of the GPU path tracers, or the tiles per frame of the CPU path tracer, so that accumulating frames take about the target frame time
+	uint frame_time_budget;
+	float frame_time_target_ms;
+	// Upper bound for the samples per frame of the GPU path tracers with the frame time budget
+	uint frame_time_budget_max_samples;
+	uint sampler_type;
+	uint adaptive_sampling;
+	// Pixels are only considered converged after they have accumulated at least this many samples
+	uint adaptive_sampling_min_samples;
+	// Relative standard error of the pixel luminance below which a pixel stops receiving new samples
+	float adaptive_sampling_threshold;
+	// Edge-avoiding a-trous filter between accumulation and tone mapping, only implemented for the CPU path tracer
+	uint denoise;
+	// Every iteration doubles the distance between the filter taps, so the filter radius grows exponentially with the iteration count
+	uint denoise_iterations;
+	// Standard deviations of the edge-stopping functions, a smaller value preserves more edges of that feature
+	float denoise_sigma_color;
+	float denoise_sigma_albedo;
+	float denoise_sigma_normal;
+	// Relative to the depth of the filtered pixel
+	float denoise_sigma_depth;
 
 	float hdr_env_strength;
+	// Traversal cost (AABB tests plus triangle tests) of a camera ray that maps to the hottest color in the traversal cost view mode
+	uint traversal_cost_heatmap_max;
 };
 
 struct view_t
@@ -84,23 +162,47 @@ struct material_t
 	uint emissive_index;
 };
 
+// Row-major 3x4 affine transform, the last column is the translation, same layout as the transform of D3D12_RAYTRACING_INSTANCE_DESC
+struct affine_transform_t
+{
+	float4 row0;
+	float4 row1;
+	float4 row2;
+};
+
 struct instance_data_t
 {
-	float4x4 local_to_world;
-	float4x4 world_to_local;
+	affine_transform_t local_to_world;
 	
 	material_t material;
 	uint triangle_buffer_idx;
+	// Index of the emissive triangle for primitive 0 in the scene light list, or LIGHT_IDX_INVALID if the instance is not emissive
+	uint light_offset;
 };
 
 // ---------------------------------------------------------------------------------------
 // Acceleration structure
 
+// Work done by the software BVH traversal, for a single ray or summed over many rays
+struct traversal_stats_t
+{
+	uint rays;
+	uint tlas_leaves;
+	uint inner_nodes;
+	uint aabb_tests;
+	uint triangle_tests;
+};
+
+// The GPU path tracers sum the counters of a frame into one 64-bit counter per member of traversal_stats_t, in the same order
+#define TRAVERSAL_STATS_COUNTER_COUNT 5
+
 struct bvh_header_t
 {
 	uint nodes_offset;
 	uint triangles_offset;
 	uint indices_offset;
+	// Parent node index for every node, used to find the remaining nodes again once the short traversal stack has overflowed
+	uint parents_offset;
 };
 
 struct bvh_node_t
@@ -120,8 +222,10 @@ struct bvh_triangle_t
 
 struct bvh_instance_t
 {
-	float4x4 world_to_local;
+	affine_transform_t world_to_local;
 	float3 aabb_min;
+	// Non-zero if world_to_local is the identity, rays then enter the BLAS without being transformed
+	uint identity_transform;
 	float3 aabb_max;
 	uint bvh_index;
 };
@@ -141,6 +245,35 @@ struct tlas_node_t
 	uint instance_idx;
 };
 
+// ---------------------------------------------------------------------------------------
+// Lights
+
+struct emissive_triangle_t
+{
+	// World-space triangle positions
+	float3 p0;
+	uint instance_idx;
+	float3 p1;
+	uint primitive_idx;
+	float3 p2;
+	float area;
+
+	// Alias table entry, used to pick lights proportional to their emitted power in constant time
+	float alias_probability;
+	uint alias_idx;
+	// Probability of picking this light
+	float pdf;
+};
+
+// One entry per texel of an equirectangular HDR environment map, texels are picked proportional to their luminance and solid angle
+struct env_alias_entry_t
+{
+	float alias_probability;
+	uint alias_idx;
+	// Probability of picking this texel
+	float pdf;
+};
+
 struct hit_result_t
 {
 	uint instance_idx;
@@ -160,6 +293,265 @@ struct RayDesc2
 	float TMax;
 };
 
+// Shadow rays are generated by the shade stage and traced in a separate batch by the connect stage
+struct shadow_ray_t
+{
+	RayDesc2 ray;
+	// Radiance that is added to the pixel energy when the shadow ray is not occluded, already weighted by the path throughput
+	float3 contribution;
+	uint2 pixel_pos;
+};
+
+// Path of a pixel that is in flight in the wavefront path tracer with path regeneration, every pixel has at most one path in flight at a time
+struct wavefront_path_state_t
+{
+	uint bounce;
+	uint sample_idx;
+	// Luminance of the pixel energy when the current path started, the energy of a path is the pixel energy minus this once the path is complete
+	float path_luminance_begin;
+	// Sum of the squared luminance of every complete path of the pixel this frame, for the variance between the paths of a pixel within a frame
+	float path_luminance_sq_sum;
+	// Set when the path got regenerated, the previous path is only complete after the shadow ray of its last bounce was connected
+	uint previous_path_pending;
+};
+
+// Compact layouts for the wavefront queues, which are bandwidth bound since every stage reads and writes each ray in memory
+// The ray carries its own pixel position, so there is no separate pixel position buffer, and the minimum distance is always RAY_MIN_T
+struct packed_ray_t
+{
+	float3 origin;
+	// Octahedral encoded, 16 bits per component
+	uint direction;
+	float t_max;
+	// 16 bits per component, x in the low bits
+	uint pixel_pos;
+};
+
+struct packed_hit_result_t
+{
+	uint instance_idx;
+	uint primitive_idx;
+	float t;
+	// 16 bits unorm per component
+	uint bary;
+};
+
+struct packed_shadow_ray_t
+{
+	packed_ray_t ray;
+	// Half precision, the upper 16 bits of the second component are unused
+	uint2 contribution;
+};
+
+// Largest finite half precision value, larger contributions would turn into infinity when packed
+#define PACKED_HALF_MAX 65504.0
+
+#ifdef __cplusplus
+inline uint pack_unorm2x16(float2 v)
+{
+	return glm::packUnorm2x16(v);
+}
+
+inline float2 unpack_unorm2x16(uint packed)
+{
+	return glm::unpackUnorm2x16(packed);
+}
+
+inline uint pack_snorm2x16(float2 v)
+{
+	return glm::packSnorm2x16(v);
+}
+
+inline float2 unpack_snorm2x16(uint packed)
+{
+	return glm::unpackSnorm2x16(packed);
+}
+
+inline uint2 pack_half3(float3 v)
+{
+	v = glm::min(v, float3(PACKED_HALF_MAX));
+	return uint2(glm::packHalf2x16(float2(v.x, v.y)), glm::packHalf2x16(float2(v.z, 0.0f)));
+}
+
+inline float3 unpack_half3(uint2 packed)
+{
+	return float3(glm::unpackHalf2x16(packed.x), glm::unpackHalf2x16(packed.y).x);
+}
+
+// "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al. 2014)
+// Projects the direction onto an octahedron, and unfolds the lower half of the octahedron onto the corners of the square
+inline uint encode_octahedral(float3 dir)
+{
+	float2 p = float2(dir.x, dir.y) * (1.0f / (glm::abs(dir.x) + glm::abs(dir.y) + glm::abs(dir.z)));
+	if (dir.z < 0.0f)
+	{
+		float2 sign_not_zero = float2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		p = (1.0f - glm::abs(float2(p.y, p.x))) * sign_not_zero;
+	}
+
+	return pack_snorm2x16(p);
+}
+
+inline float3 decode_octahedral(uint packed)
+{
+	float2 p = unpack_snorm2x16(packed);
+	float3 dir = float3(p.x, p.y, 1.0f - glm::abs(p.x) - glm::abs(p.y));
+	if (dir.z < 0.0f)
+	{
+		float2 sign_not_zero = float2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		float2 unfolded = (1.0f - glm::abs(float2(p.y, p.x))) * sign_not_zero;
+		dir.x = unfolded.x;
+		dir.y = unfolded.y;
+	}
+
+	return glm::normalize(dir);
+}
+
+inline uint pack_pixel_pos(uint2 pixel_pos)
+{
+	return pixel_pos.x | (pixel_pos.y << 16);
+}
+
+inline uint2 unpack_pixel_pos(uint packed)
+{
+	return uint2(packed & 0xFFFF, packed >> 16);
+}
+
+// glm matrices are column-major, the bottom row of the matrix is dropped so it needs to be affine
+inline affine_transform_t make_affine_transform(const float4x4& m)
+{
+	affine_transform_t t = {};
+	t.row0 = float4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	t.row1 = float4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	t.row2 = float4(m[0][2], m[1][2], m[2][2], m[3][2]);
+
+	return t;
+}
+
+inline bool is_identity_transform(const affine_transform_t& t)
+{
+	return t.row0 == float4(1.0f, 0.0f, 0.0f, 0.0f) && t.row1 == float4(0.0f, 1.0f, 0.0f, 0.0f) && t.row2 == float4(0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+// The rows of the inverse of the 3x3 part are the cross products of its columns divided by the determinant, the translation is then moved back through those rows
+inline affine_transform_t affine_inverse(const affine_transform_t& t)
+{
+	float3 c0 = float3(t.row0.x, t.row1.x, t.row2.x);
+	float3 c1 = float3(t.row0.y, t.row1.y, t.row2.y);
+	float3 c2 = float3(t.row0.z, t.row1.z, t.row2.z);
+	float3 translation = float3(t.row0.w, t.row1.w, t.row2.w);
+
+	float3 r0 = glm::cross(c1, c2);
+	float3 r1 = glm::cross(c2, c0);
+	float3 r2 = glm::cross(c0, c1);
+	float inv_det = 1.0f / glm::dot(c0, r0);
+	r0 *= inv_det;
+	r1 *= inv_det;
+	r2 *= inv_det;
+
+	affine_transform_t inv = {};
+	inv.row0 = float4(r0, -glm::dot(r0, translation));
+	inv.row1 = float4(r1, -glm::dot(r1, translation));
+	inv.row2 = float4(r2, -glm::dot(r2, translation));
+
+	return inv;
+}
+
+inline float3 transform_point(const affine_transform_t& t, float3 p)
+{
+	float4 p4 = float4(p, 1.0f);
+	return float3(glm::dot(t.row0, p4), glm::dot(t.row1, p4), glm::dot(t.row2, p4));
+}
+
+inline float3 transform_vector(const affine_transform_t& t, float3 v)
+{
+	return float3(glm::dot(float3(t.row0), v), glm::dot(float3(t.row1), v), glm::dot(float3(t.row2), v));
+}
+#else
+uint pack_unorm2x16(float2 v)
+{
+	uint2 u = uint2(round(saturate(v) * 65535.0));
+	return u.x | (u.y << 16);
+}
+
+float2 unpack_unorm2x16(uint packed)
+{
+	return float2(packed & 0xFFFF, packed >> 16) * (1.0 / 65535.0);
+}
+
+uint pack_snorm2x16(float2 v)
+{
+	int2 i = int2(round(clamp(v, -1.0, 1.0) * 32767.0));
+	return (uint(i.x) & 0xFFFF) | (uint(i.y) << 16);
+}
+
+float2 unpack_snorm2x16(uint packed)
+{
+	// Sign extend both components by shifting them into the upper bits first
+	int2 i = int2(int(packed << 16) >> 16, int(packed) >> 16);
+	return max(float2(i) * (1.0 / 32767.0), -1.0);
+}
+
+uint2 pack_half3(float3 v)
+{
+	v = min(v, PACKED_HALF_MAX);
+	return uint2(f32tof16(v.x) | (f32tof16(v.y) << 16), f32tof16(v.z));
+}
+
+float3 unpack_half3(uint2 packed)
+{
+	return float3(f16tof32(packed.x), f16tof32(packed.x >> 16), f16tof32(packed.y));
+}
+
+// "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al. 2014)
+// Projects the direction onto an octahedron, and unfolds the lower half of the octahedron onto the corners of the square
+uint encode_octahedral(float3 dir)
+{
+	float2 p = dir.xy * (1.0 / (abs(dir.x) + abs(dir.y) + abs(dir.z)));
+	if (dir.z < 0.0)
+	{
+		float2 sign_not_zero = select(p >= 0.0, 1.0, -1.0);
+		p = (1.0 - abs(p.yx)) * sign_not_zero;
+	}
+
+	return pack_snorm2x16(p);
+}
+
+float3 decode_octahedral(uint packed)
+{
+	float2 p = unpack_snorm2x16(packed);
+	float3 dir = float3(p, 1.0 - abs(p.x) - abs(p.y));
+	if (dir.z < 0.0)
+	{
+		float2 sign_not_zero = select(p >= 0.0, 1.0, -1.0);
+		dir.xy = (1.0 - abs(p.yx)) * sign_not_zero;
+	}
+
+	return normalize(dir);
+}
+
+uint pack_pixel_pos(uint2 pixel_pos)
+{
+	return pixel_pos.x | (pixel_pos.y << 16);
+}
+
+uint2 unpack_pixel_pos(uint packed)
+{
+	return uint2(packed & 0xFFFF, packed >> 16);
+}
+
+float3 transform_point(affine_transform_t t, float3 p)
+{
+	float4 p4 = float4(p, 1.0);
+	return float3(dot(t.row0, p4), dot(t.row1, p4), dot(t.row2, p4));
+}
+
+float3 transform_vector(affine_transform_t t, float3 v)
+{
+	return float3(dot(t.row0.xyz, v), dot(t.row1.xyz, v), dot(t.row2.xyz, v));
+}
+#endif
+
 #ifdef __cplusplus
 #undef int
 #undef uint
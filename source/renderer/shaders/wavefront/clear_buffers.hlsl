@@ -7,6 +7,9 @@ struct shader_input_t
     uint texture_throughput_index;
     uint buffer_pixel_coords_index;
     uint buffer_pixel_coords_two_index;
+    uint buffer_traversal_stats_index;
+    // The traversal counters add up all samples of a frame, so they are only cleared before the first one
+    uint clear_traversal_stats;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
@@ -14,6 +17,7 @@ ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
 static const RWByteAddressBuffer buffer_ray_counts = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_ray_counts_index);
 static const RWByteAddressBuffer buffer_pixel_coords = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_pixel_coords_index);
 static const RWByteAddressBuffer buffer_pixel_coords_two = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_pixel_coords_two_index);
+static const RWByteAddressBuffer buffer_traversal_stats = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_traversal_stats_index);
 
 static const RWTexture2D<float4> texture_energy = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_energy_index);
 static const RWTexture2D<float4> texture_throughput = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_throughput_index);
@@ -21,13 +25,16 @@ static const RWTexture2D<float4> texture_throughput = get_resource_uniform<RWTex
 [numthreads(64, 1, 1)]
 void main(uint3 dispatch_id : SV_DispatchThreadID)
 {
-    // Ray counts buffer stores up to 8 bounces, so we only need to clear it up to index 8
+    // Ray counts buffer stores the extension ray counts for every iteration, followed by the shadow ray counts for every iteration
+    // The primary ray count is zero as well, since the generate stage appends a primary ray only for pixels that have not converged yet
     [branch]
-    if (dispatch_id.x == 0)
-        buffer_ray_counts.Store<uint>(dispatch_id.x * sizeof(uint), cb_view.render_dim.x * cb_view.render_dim.y);
-    else if (dispatch_id.x <= 8)
+    if (dispatch_id.x < WAVEFRONT_RAY_COUNT_TOTAL)
         buffer_ray_counts.Store<uint>(dispatch_id.x * sizeof(uint), 0);
 
+    [branch]
+    if (cb_in.clear_traversal_stats && dispatch_id.x < TRAVERSAL_STATS_COUNTER_COUNT)
+        buffer_traversal_stats.Store<uint64_t>(dispatch_id.x * sizeof(uint64_t), 0);
+
     // Initialize energy, throughput, and pixel coord buffers
     uint2 pixel_pos = uint2(dispatch_id.x % cb_view.render_dim.x, dispatch_id.x / cb_view.render_dim.x);
 
@@ -1 +1,53 @@
-// THIS IS EMPTY FOR NOW, SINCE WE DO NOT GENERATE EXPLICIT SHADOW RAYS
+#include "../common.hlsl"
+#include "../accelstruct.hlsl"
+#include "payload.hlsl"
+
+struct shader_input_t
+{
+    uint buffer_ray_counts_index;
+    uint buffer_shadow_rays_index;
+    uint buffer_scene_tlas_index;
+    uint texture_energy_index;
+    uint recursion_depth;
+    uint buffer_traversal_stats_index;
+};
+
+ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
+
+#if RAYTRACING_MODE_SOFTWARE
+static const ByteAddressBuffer buffer_scene_tlas = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_scene_tlas_index);
+#else
+static const RaytracingAccelerationStructure buffer_scene_tlas = get_resource_uniform<RaytracingAccelerationStructure>(cb_in.buffer_scene_tlas_index);
+#endif
+
+static const ByteAddressBuffer buffer_ray_counts = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_ray_counts_index);
+static const ByteAddressBuffer buffer_shadow_rays = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_shadow_rays_index);
+static const RWByteAddressBuffer buffer_traversal_stats = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_traversal_stats_index);
+
+static const RWTexture2D<float4> texture_energy = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_energy_index);
+
+[numthreads(64, 1, 1)]
+void main(uint3 dispatch_id : SV_DispatchThreadID)
+{
+    uint shadow_ray_count = buffer_ray_counts.Load<uint>((WAVEFRONT_SHADOW_RAY_COUNT_OFFSET + cb_in.recursion_depth) * sizeof(uint));
+
+    // Dispatches might have work that is not divisible by the dispatch thread dimensions, so we skip those
+    if (dispatch_id.x >= shadow_ray_count)
+        return;
+
+    shadow_ray_t shadow_ray = load_shadow_ray(buffer_shadow_rays, dispatch_id.x);
+
+#if RAYTRACING_MODE_SOFTWARE
+    ray_t ray = make_ray(shadow_ray.ray.Origin, shadow_ray.ray.Direction, shadow_ray.ray.TMax);
+    bool occluded = trace_ray_tlas_occluded(buffer_scene_tlas, ray);
+#else
+    bool occluded = trace_ray_tlas_occluded(buffer_scene_tlas, shadow_ray.ray);
+#endif
+    add_traversal_stats(buffer_traversal_stats);
+
+    // Each path generates at most one shadow ray per recursion depth, so no other thread writes to this pixel
+    if (!occluded)
+    {
+        texture_energy[shadow_ray.pixel_pos].xyz += shadow_ray.contribution;
+    }
+}
@@ -1,5 +1,6 @@
 #include "../common.hlsl"
 #include "../accelstruct.hlsl"
+#include "payload.hlsl"
 
 struct shader_input_t
 {
@@ -8,6 +9,8 @@ struct shader_input_t
     uint buffer_hit_results_index;
     uint buffer_scene_tlas_index;
     uint recursion_depth;
+    uint buffer_traversal_stats_index;
+    uint buffer_traversal_costs_index;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
@@ -21,6 +24,9 @@ static const RaytracingAccelerationStructure buffer_scene_tlas = get_resource_un
 static const ByteAddressBuffer buffer_ray_counts = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_ray_counts_index);
 static const ByteAddressBuffer buffer_rays = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_rays_index);
 static const RWByteAddressBuffer buffer_hit_results = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_hit_results_index);
+static const RWByteAddressBuffer buffer_traversal_stats = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_traversal_stats_index);
+// Traversal cost of every ray, only written for the traversal cost view mode, which the shade stage turns into the heatmap
+static const RWByteAddressBuffer buffer_traversal_costs = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_traversal_costs_index);
 
 [numthreads(64, 1, 1)]
 void main(uint3 dispatch_id : SV_DispatchThreadID)
@@ -31,10 +37,23 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
     if (dispatch_id.x >= ray_count)
         return;
     
-    RayDesc2 ray = buffer_rays.Load<RayDesc2>(dispatch_id.x * sizeof(RayDesc2));
+    RayDesc2 ray_desc = load_ray(buffer_rays, dispatch_id.x);
+#if RAYTRACING_MODE_SOFTWARE
+    ray_t ray = make_ray(ray_desc.Origin, ray_desc.Direction, ray_desc.TMax);
+#else
+    RayDesc2 ray = ray_desc;
+#endif
     
     hit_result_t hit = make_hit_result();
     trace_ray_tlas(buffer_scene_tlas, ray, hit);
 
-    buffer_hit_results.Store<hit_result_t>(dispatch_id.x * sizeof(hit_result_t), hit);
+    store_hit_result(buffer_hit_results, dispatch_id.x, hit);
+
+    [branch]
+    if (cb_settings.render_view_mode == RENDER_VIEW_MODE_TRAVERSAL_COST)
+    {
+        buffer_traversal_costs.Store<uint>(dispatch_id.x * sizeof(uint), get_traversal_cost(g_traversal_stats));
+    }
+
+    add_traversal_stats(buffer_traversal_stats);
 }
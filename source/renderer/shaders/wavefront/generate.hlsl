@@ -1,20 +1,73 @@
 #include "../common.hlsl"
+#include "payload.hlsl"
 
 struct shader_input_t
 {
     uint buffer_rays_index;
+    uint buffer_ray_counts_index;
+    uint buffer_pixel_coords_index;
+    uint texture_energy_index;
+    uint texture_pixel_variance_index;
+    uint sample_count;
+    uint random_seed;
+    uint path_regeneration;
+    uint buffer_path_states_index;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
 
 static const RWByteAddressBuffer buffer_rays = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_rays_index);
+static const RWByteAddressBuffer buffer_ray_counts = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_ray_counts_index);
+static const RWByteAddressBuffer buffer_pixel_coords = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_pixel_coords_index);
+static const RWByteAddressBuffer buffer_path_states = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_path_states_index);
+
+static const RWTexture2D<float4> texture_energy = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_energy_index);
+static const RWTexture2D<float4> texture_pixel_variance = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_pixel_variance_index);
 
 [numthreads(64, 1, 1)]
 void main(uint3 dispatch_id : SV_DispatchThreadID)
 {
+    // Dispatches might have work that is not divisible by the dispatch thread dimensions, so we skip those
+    if (dispatch_id.x >= cb_view.render_dim.x * cb_view.render_dim.y)
+        return;
+
     uint2 pixel_pos = uint2(dispatch_id.x % cb_view.render_dim.x, dispatch_id.x / cb_view.render_dim.x);
 
-    // Make primary ray and write to buffer
-    RayDesc2 ray = make_primary_ray(pixel_pos, cb_view.render_dim);
-    buffer_rays.Store<RayDesc2>(dispatch_id.x * sizeof(RayDesc2), ray);
+    // Pixels that have converged do not get a new primary ray, the statistics are discarded on the first sample after an accumulator reset
+    float4 pixel_variance = cb_in.sample_count > 1 ? texture_pixel_variance[pixel_pos] : (float4)0;
+    bool generate_ray = !is_pixel_converged(pixel_variance);
+
+    // Compact the primary rays so that the following stages only dispatch threads for pixels that still need samples
+    // Only one atomic per wave to reserve space for all of the rays within that wave
+    uint wave_ray_count = WaveActiveCountBits(generate_ray);
+    uint wave_write_offset = 0;
+    if (WaveIsFirstLane())
+    {
+        buffer_ray_counts.InterlockedAdd(0, wave_ray_count, wave_write_offset);
+    }
+    wave_write_offset = WaveReadLaneFirst(wave_write_offset);
+
+    if (generate_ray)
+    {
+        uint write_offset = wave_write_offset + WavePrefixCountBits(generate_ray);
+
+        // Make primary ray and write to buffer
+        RayDesc2 ray = make_primary_ray(pixel_pos, cb_view.render_dim);
+        store_ray(buffer_rays, buffer_pixel_coords, write_offset, ray, pixel_pos);
+
+        // With path regeneration a pixel takes more than one sample per frame, so every pixel counts its own samples
+        // The first sample continues from the samples the pixel has accumulated so far, regenerated paths take the sample indices after it
+        [branch]
+        if (cb_in.path_regeneration)
+        {
+            wavefront_path_state_t path_state = (wavefront_path_state_t)0;
+            path_state.bounce = 0;
+            path_state.sample_idx = cb_settings.accumulate ? (uint)pixel_variance.x : cb_in.random_seed;
+            buffer_path_states.Store<wavefront_path_state_t>(dispatch_id.x * sizeof(wavefront_path_state_t), path_state);
+        }
+
+        // Mark the pixel as traced, so that the post-process accumulates the energy of this pixel
+        // The alpha channel counts the paths of this pixel, which is always one without path regeneration
+        texture_energy[pixel_pos] = float4(0.0, 0.0, 0.0, 1.0);
+    }
 }
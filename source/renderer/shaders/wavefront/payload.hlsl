@@ -0,0 +1,131 @@
+#pragma once
+#include "../common.hlsl"
+
+/*
+    Loads and stores for the wavefront queues, the layout is picked by the wavefront_compact_payloads setting
+    Full precision: RayDesc2 + separate uint2 pixel position (40 bytes), hit_result_t (20 bytes), shadow_ray_t (52 bytes)
+    Compact: packed_ray_t with the pixel position inside (24 bytes), packed_hit_result_t (16 bytes), packed_shadow_ray_t (32 bytes)
+*/
+
+packed_ray_t pack_ray(RayDesc2 ray, uint2 pixel_pos)
+{
+    packed_ray_t packed = (packed_ray_t)0;
+    packed.origin = ray.Origin;
+    packed.direction = encode_octahedral(ray.Direction);
+    packed.t_max = ray.TMax;
+    packed.pixel_pos = pack_pixel_pos(pixel_pos);
+
+    return packed;
+}
+
+RayDesc2 unpack_ray(packed_ray_t packed)
+{
+    return make_ray(packed.origin, decode_octahedral(packed.direction), packed.t_max);
+}
+
+// The pixel positions are only read from and written to buffer_pixel_coords for the full precision layout
+void store_ray(RWByteAddressBuffer buffer_rays, RWByteAddressBuffer buffer_pixel_coords, uint ray_idx, RayDesc2 ray, uint2 pixel_pos)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        buffer_rays.Store<packed_ray_t>(ray_idx * sizeof(packed_ray_t), pack_ray(ray, pixel_pos));
+    }
+    else
+    {
+        buffer_rays.Store<RayDesc2>(ray_idx * sizeof(RayDesc2), ray);
+        buffer_pixel_coords.Store<uint2>(ray_idx * sizeof(uint2), pixel_pos);
+    }
+}
+
+RayDesc2 load_ray(ByteAddressBuffer buffer_rays, uint ray_idx)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        return unpack_ray(buffer_rays.Load<packed_ray_t>(ray_idx * sizeof(packed_ray_t)));
+    }
+
+    return buffer_rays.Load<RayDesc2>(ray_idx * sizeof(RayDesc2));
+}
+
+uint2 load_ray_pixel_pos(ByteAddressBuffer buffer_rays, ByteAddressBuffer buffer_pixel_coords, uint ray_idx)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        // The packed pixel position is the last member of packed_ray_t, so the rest of the ray does not need to be loaded
+        return unpack_pixel_pos(buffer_rays.Load<uint>(ray_idx * sizeof(packed_ray_t) + sizeof(packed_ray_t) - sizeof(uint)));
+    }
+
+    return buffer_pixel_coords.Load<uint2>(ray_idx * sizeof(uint2));
+}
+
+void store_hit_result(RWByteAddressBuffer buffer_hit_results, uint ray_idx, hit_result_t hit)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        packed_hit_result_t packed = (packed_hit_result_t)0;
+        packed.instance_idx = hit.instance_idx;
+        packed.primitive_idx = hit.primitive_idx;
+        packed.t = hit.t;
+        packed.bary = pack_unorm2x16(hit.bary);
+        buffer_hit_results.Store<packed_hit_result_t>(ray_idx * sizeof(packed_hit_result_t), packed);
+    }
+    else
+    {
+        buffer_hit_results.Store<hit_result_t>(ray_idx * sizeof(hit_result_t), hit);
+    }
+}
+
+hit_result_t load_hit_result(ByteAddressBuffer buffer_hit_results, uint ray_idx)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        packed_hit_result_t packed = buffer_hit_results.Load<packed_hit_result_t>(ray_idx * sizeof(packed_hit_result_t));
+
+        hit_result_t hit = (hit_result_t)0;
+        hit.instance_idx = packed.instance_idx;
+        hit.primitive_idx = packed.primitive_idx;
+        hit.t = packed.t;
+        hit.bary = unpack_unorm2x16(packed.bary);
+        return hit;
+    }
+
+    return buffer_hit_results.Load<hit_result_t>(ray_idx * sizeof(hit_result_t));
+}
+
+void store_shadow_ray(RWByteAddressBuffer buffer_shadow_rays, uint ray_idx, shadow_ray_t shadow_ray)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        packed_shadow_ray_t packed = (packed_shadow_ray_t)0;
+        packed.ray = pack_ray(shadow_ray.ray, shadow_ray.pixel_pos);
+        packed.contribution = pack_half3(shadow_ray.contribution);
+        buffer_shadow_rays.Store<packed_shadow_ray_t>(ray_idx * sizeof(packed_shadow_ray_t), packed);
+    }
+    else
+    {
+        buffer_shadow_rays.Store<shadow_ray_t>(ray_idx * sizeof(shadow_ray_t), shadow_ray);
+    }
+}
+
+shadow_ray_t load_shadow_ray(ByteAddressBuffer buffer_shadow_rays, uint ray_idx)
+{
+    [branch]
+    if (cb_settings.wavefront_compact_payloads)
+    {
+        packed_shadow_ray_t packed = buffer_shadow_rays.Load<packed_shadow_ray_t>(ray_idx * sizeof(packed_shadow_ray_t));
+
+        shadow_ray_t shadow_ray = (shadow_ray_t)0;
+        shadow_ray.ray = unpack_ray(packed.ray);
+        shadow_ray.contribution = unpack_half3(packed.contribution);
+        shadow_ray.pixel_pos = unpack_pixel_pos(packed.ray.pixel_pos);
+        return shadow_ray;
+    }
+
+    return buffer_shadow_rays.Load<shadow_ray_t>(ray_idx * sizeof(shadow_ray_t));
+}
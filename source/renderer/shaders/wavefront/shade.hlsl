@@ -2,11 +2,14 @@
 #include "../sample.hlsl"
 #include "../material.hlsl"
 #include "../brdf.hlsl"
+#include "../light.hlsl"
+#include "payload.hlsl"
 
 struct shader_input_t
 {
     uint buffer_ray_counts_index;
     uint buffer_rays_index;
+    uint buffer_rays_two_index;
     uint buffer_hit_results_index;
     uint texture_energy_index;
     uint texture_throughput_index;
@@ -18,16 +21,33 @@ struct shader_input_t
     uint texture_hdr_env_height;
     uint random_seed;
     uint recursion_depth;
+    uint buffer_shadow_rays_index;
+    uint buffer_lights_index;
+    uint light_count;
+    uint buffer_hdr_env_alias_index;
+    uint hdr_env_importance_sampling;
+    uint sample_count;
+    uint path_regeneration;
+    // Only set for the iterations that leave enough iterations after them for a regenerated path to reach the maximum bounce count
+    uint regenerate_paths;
+    uint buffer_path_states_index;
+    uint buffer_traversal_costs_index;
 };
 
 ConstantBuffer<shader_input_t> cb_in : register(b2, space0);
 
 static const ByteAddressBuffer buffer_instances = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_instances_index);
+static const ByteAddressBuffer buffer_lights = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_lights_index);
+static const ByteAddressBuffer buffer_hdr_env_alias = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_hdr_env_alias_index);
 static const ByteAddressBuffer buffer_hit_results = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_hit_results_index);
 static const ByteAddressBuffer buffer_pixel_coords = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_pixel_coords_index);
 static const RWByteAddressBuffer buffer_pixel_coords_two = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_pixel_coords_two_index);
 static const RWByteAddressBuffer buffer_ray_counts = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_ray_counts_index);
-static const RWByteAddressBuffer buffer_rays = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_rays_index);
+static const ByteAddressBuffer buffer_rays = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_rays_index);
+static const RWByteAddressBuffer buffer_rays_two = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_rays_two_index);
+static const RWByteAddressBuffer buffer_shadow_rays = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_shadow_rays_index);
+static const RWByteAddressBuffer buffer_path_states = get_resource_uniform<RWByteAddressBuffer>(cb_in.buffer_path_states_index);
+static const ByteAddressBuffer buffer_traversal_costs = get_resource_uniform<ByteAddressBuffer>(cb_in.buffer_traversal_costs_index);
 
 static const Texture2D texture_hdr_env = get_resource_uniform<Texture2D>(cb_in.texture_hdr_env_index);
 static const RWTexture2D<float4> texture_energy = get_resource_uniform<RWTexture2D<float4> >(cb_in.texture_energy_index);
@@ -39,6 +59,21 @@ float4 sample_hdr_env(float3 dir, float2 tex_dim)
     return texture_hdr_env[sample_pos];
 }
 
+// Appends a shadow ray to the batch that is traced by the connect stage for the current recursion depth
+// The contribution is only added to the pixel energy if the shadow ray turns out to be unoccluded
+void queue_shadow_ray(RayDesc2 ray, float3 contribution, uint2 pixel_pos)
+{
+    uint write_offset;
+    uint shadow_ray_count_offset = WAVEFRONT_SHADOW_RAY_COUNT_OFFSET + cb_in.recursion_depth;
+    buffer_ray_counts.InterlockedAdd(shadow_ray_count_offset * sizeof(uint), 1u, write_offset);
+
+    shadow_ray_t shadow_ray = (shadow_ray_t)0;
+    shadow_ray.ray = ray;
+    shadow_ray.contribution = contribution;
+    shadow_ray.pixel_pos = pixel_pos;
+    store_shadow_ray(buffer_shadow_rays, write_offset, shadow_ray);
+}
+
 [numthreads(64, 1, 1)]
 void main(uint3 dispatch_id : SV_DispatchThreadID)
 {
@@ -48,19 +83,50 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
     if (dispatch_id.x >= ray_count)
         return;
     
-    uint2 pixel_pos = buffer_pixel_coords.Load<uint2>(dispatch_id.x * sizeof(uint2));
-    RayDesc2 ray = buffer_rays.Load<RayDesc2>(dispatch_id.x * sizeof(RayDesc2));
-    hit_result_t hit = buffer_hit_results.Load<hit_result_t>(dispatch_id.x * sizeof(hit_result_t));
+    uint2 pixel_pos = load_ray_pixel_pos(buffer_rays, buffer_pixel_coords, dispatch_id.x);
+    RayDesc2 ray = load_ray(buffer_rays, dispatch_id.x);
+    hit_result_t hit = load_hit_result(buffer_hit_results, dispatch_id.x);
+
+    uint pixel_idx = pixel_pos.y * cb_view.render_dim.x + pixel_pos.x;
+
+    // Without path regeneration every path is at the bounce of the current iteration, and every pixel takes one sample per frame
+    wavefront_path_state_t path_state = (wavefront_path_state_t)0;
+    path_state.bounce = cb_in.recursion_depth;
+    path_state.sample_idx = get_sample_index(cb_in.sample_count, cb_in.random_seed);
+
+    [branch]
+    if (cb_in.path_regeneration)
+    {
+        path_state = buffer_path_states.Load<wavefront_path_state_t>(pixel_idx * sizeof(wavefront_path_state_t));
+    }
 
+    // The energy of all paths of a pixel is summed, the alpha channel holds the path count that the post-process divides by
     float3 energy = texture_energy[pixel_pos].xyz;
+    float path_count = texture_energy[pixel_pos].w;
     float3 throughput = texture_throughput[pixel_pos].xyz;
+    // The pdf of the BSDF sample that generated this ray is stored in the alpha channel, zero for camera rays
+    float bsdf_pdf = texture_throughput[pixel_pos].w;
+    float env_selection_probability = get_env_selection_probability(cb_in.light_count, cb_in.hdr_env_importance_sampling);
+
+    // The first shade of a regenerated path comes after the connect stage of the iteration that regenerated it, so the previous path is complete now
+    [branch]
+    if (cb_in.path_regeneration && path_state.previous_path_pending)
+    {
+        float energy_luminance = get_luminance(energy);
+        float path_luminance = energy_luminance - path_state.path_luminance_begin;
+        path_state.path_luminance_sq_sum += path_luminance * path_luminance;
+        path_state.path_luminance_begin = energy_luminance;
+        path_state.previous_path_pending = 0;
+    }
 
     bool terminate_path = false;
     [branch]
     if (!has_hit_geometry(hit))
     {
         float3 hdr_env_color = sample_hdr_env(ray.Direction, float2(cb_in.texture_hdr_env_width, cb_in.texture_hdr_env_height)).xyz;
-        energy += throughput * cb_settings.hdr_env_strength * hdr_env_color;
+        float mis_weight = cb_settings.next_event_estimation ?
+            get_env_hit_mis_weight(buffer_hdr_env_alias, uint2(cb_in.texture_hdr_env_width, cb_in.texture_hdr_env_height), ray.Direction, bsdf_pdf, env_selection_probability) : 1.0;
+        energy += throughput * cb_settings.hdr_env_strength * hdr_env_color * mis_weight;
         terminate_path = true;
     }
 
@@ -70,15 +136,17 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
     [branch]
     if (!terminate_path && any(sampled_material.emissive_color) > 0.0)
     {
-        energy += throughput * sampled_material.emissive_color;
+        float mis_weight = cb_settings.next_event_estimation ?
+            get_emissive_hit_mis_weight(buffer_lights, hit_surface.instance, hit, ray.Direction, bsdf_pdf, 1.0 - env_selection_probability) : 1.0;
+        energy += throughput * sampled_material.emissive_color * mis_weight;
         terminate_path = true;
     }
 
     [branch]
     if (!terminate_path)
     {
-        uint seed = cb_in.random_seed + dispatch_id.x;
-        float r_path = rand_float(seed);
+        path_sampler_t path_sampler = make_path_sampler(cb_settings.sampler_type, pixel_pos, path_state.sample_idx, path_state.bounce);
+        float r_path = path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_LOBE_SELECT);
 
         float3 V = -ray.Direction;
         float3 F0 = float3(0.04, 0.04, 0.04);
@@ -89,7 +157,7 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
         /*[branch]
         if (specular_bounce)
         {
-            float2 r_spec = float2(rand_float(seed), rand_float(seed));
+            float2 r_spec = path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_BSDF);
             
             float3 N = hit_surface.normal;
             float3 L = sample_ggxv_ndf(V, sampled_material.roughness, r_spec.x, r_spec.y);
@@ -105,7 +173,7 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
         }
         else*/
         {
-            float2 r_diffuse = float2(rand_float(seed), rand_float(seed));
+            float2 r_diffuse = path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_BSDF);
             
             float3 N = hit_surface.normal;
             float3 L = 0;
@@ -132,9 +200,49 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
             }
 
             float3 diffuse_brdf = sampled_material.base_color * INV_PI;
+
+            // Next event estimation, only done when the BSDF sampled ray will be traced as well, otherwise the MIS weights do not add up to one
+            [branch]
+            if (cb_settings.next_event_estimation && (cb_in.light_count > 0 || cb_in.hdr_env_importance_sampling) &&
+                path_state.bounce < cb_settings.max_bounces && cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+            {
+                float r_light_select = path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_LIGHT_SELECT);
+                float4 r_light = float4(path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_XY), path_sampler_get_2d(path_sampler, SAMPLER_DIMENSION_LIGHT_ZW));
+                light_sample_t light_sample = sample_direct_light(buffer_lights, buffer_instances, cb_in.light_count,
+                    buffer_hdr_env_alias, texture_hdr_env, uint2(cb_in.texture_hdr_env_width, cb_in.texture_hdr_env_height), env_selection_probability, hit_surface.position, r_light_select, r_light);
+                float NoL_light = dot(N, light_sample.direction);
+
+                if (NoL_light > 0.0 && light_sample.pdf > 0.0)
+                {
+                    float light_bsdf_pdf = cb_settings.cosine_weighted_diffuse ? cosine_weighted_hemisphere_pdf(NoL_light) : uniform_hemisphere_pdf();
+                    float mis_weight = mis_power_heuristic(light_sample.pdf, light_bsdf_pdf);
+                    float3 contribution = throughput * diffuse_brdf * NoL_light * light_sample.emission * (mis_weight / light_sample.pdf);
+
+                    RayDesc2 shadow_ray = make_ray(hit_surface.position, light_sample.direction, light_sample.distance * SHADOW_RAY_T_MAX_MULTIPLIER);
+                    queue_shadow_ray(shadow_ray, contribution, pixel_pos);
+                }
+            }
+
             throughput *= (NoL * diffuse_brdf) * (1.0 / pdf);// * (1.0 - specular_probability);
+            bsdf_pdf = pdf;
             ray = make_ray(hit_surface.position, L);
         }
+
+        // Russian roulette, stochastically terminate paths with a low throughput and compensate the ones that survive
+        [branch]
+        if (cb_settings.russian_roulette && path_state.bounce >= cb_settings.russian_roulette_min_depth &&
+            cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+        {
+            float survival_probability = get_russian_roulette_survival_probability(throughput);
+            if (path_sampler_get_1d(path_sampler, SAMPLER_DIMENSION_RUSSIAN_ROULETTE) >= survival_probability)
+            {
+                terminate_path = true;
+            }
+            else
+            {
+                throughput /= survival_probability;
+            }
+        }
     }
 
     switch (cb_settings.render_view_mode)
@@ -150,25 +258,54 @@ void main(uint3 dispatch_id : SV_DispatchThreadID)
     case RENDER_VIEW_MODE_MATERIAL_EMISSIVE:            energy = sampled_material.emissive_color; break;
     case RENDER_VIEW_MODE_WORLD_NORMAL:                 energy = abs(hit_surface.normal); break;
     case RENDER_VIEW_MODE_RENDER_TARGET_DEPTH:          energy = float3(hit.t, hit.t, hit.t) / cb_view.far_plane; break;
+    // Written by the extend stage for the camera ray, which includes the rays that missed the scene
+    case RENDER_VIEW_MODE_TRAVERSAL_COST:               energy = cost_to_heatmap(buffer_traversal_costs.Load<uint>(dispatch_id.x * sizeof(uint)), cb_settings.traversal_cost_heatmap_max); break;
     }
     
+    bool continue_path = !terminate_path &&
+        path_state.bounce < cb_settings.max_bounces &&
+        cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE;
+    // Path regeneration replaces a finished path by a new camera sample of the same pixel, so the next iteration has as many rays as this one
+    bool regenerate_path = !continue_path && cb_in.regenerate_paths;
+
+    [branch]
+    if (regenerate_path)
+    {
+        ray = make_primary_ray(pixel_pos, cb_view.render_dim);
+        throughput = float3(1.0, 1.0, 1.0);
+        bsdf_pdf = 0.0;
+        path_count += 1.0;
+
+        path_state.bounce = 0;
+        path_state.sample_idx++;
+        path_state.previous_path_pending = 1;
+    }
+    else
+    {
+        path_state.bounce++;
+    }
+
     // Write new ray to output buffer if we need to do another recursion
     [branch]
-    if (!terminate_path &&
-        cb_in.recursion_depth < cb_settings.max_bounces &&
-        cb_settings.render_view_mode == RENDER_VIEW_MODE_NONE)
+    if (continue_path || regenerate_path)
     {
         // Update indirect args for next recursion
         uint write_offset;
         uint ray_count_offset = cb_in.recursion_depth + 1;
         buffer_ray_counts.InterlockedAdd(ray_count_offset * sizeof(uint), 1u, write_offset);
 
-        // Get next ray offset and write new ray
-        buffer_rays.Store<RayDesc2>(write_offset * sizeof(RayDesc2), ray);
-        buffer_pixel_coords_two.Store<uint2>(write_offset * sizeof(uint2), pixel_pos);
+        // Get next ray offset and write new ray, to the other ray buffer since rays of this recursion depth might not have been read yet
+        store_ray(buffer_rays_two, buffer_pixel_coords_two, write_offset, ray, pixel_pos);
+    }
+
+    // Also stored for paths that end here, since the post-process reads the luminance of the paths of the pixel
+    [branch]
+    if (cb_in.path_regeneration)
+    {
+        buffer_path_states.Store<wavefront_path_state_t>(pixel_idx * sizeof(wavefront_path_state_t), path_state);
     }
 
     // Write new energy and throughput to output buffers at correct pixel position
-    texture_energy[pixel_pos].xyz = energy;
-    texture_throughput[pixel_pos].xyz = throughput;
+    texture_energy[pixel_pos] = float4(energy, path_count);
+    texture_throughput[pixel_pos] = float4(throughput, bsdf_pdf);
 }